@@ -17,31 +17,32 @@
  *  - Program individual NVPARAM entry
  *  - Program a full NVPARAM based on the output of nvgen command
  *  - Clear NVPARAM area
+ *  - Apply a manifest of NVPARAM entries in one flash cycle
  */
 
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
-#include <mtd/mtd-user.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <limits.h>
 #include <dirent.h>
+#include <stddef.h>
+#include "flash-io.h"
 
-typedef unsigned char uint8_t;
-typedef unsigned int uint32_t;
 #define PERCENTAGE(x, total) (((x) * 100) / (total))
 #define KB(x)		     ((x) / 1024)
 
 /* size of read/write buffer */
 #define BUFSIZE (10 * 1024)
+/* value of an erased NOR byte */
+#define FLASH_ERASED 0xFF
 
 /* error levels */
 #define LOG_NORMAL 1
@@ -50,9 +51,18 @@ typedef unsigned int uint32_t;
 #define PROC_MTD_INFO		"/proc/mtd"
 #define HOST_SPI_FLASH_MTD_NAME "\"pnor\""
 #define MTD_DEV_SIZE		20
+/*
+ * The MTD number found in /proc/mtd is kept in /run for the next call. It
+ * is only trusted after checking the name of that MTD device in sysfs.
+ */
+#define MTD_CACHE_FILE	      "/run/nvparm-mtd"
+#define SYS_MTD_NAME	      "/sys/class/mtd/mtd%d/name"
+#define HOST_SPI_FLASH_SYS_NAME "pnor\n"
 
 /* Option string of this application */
-#define OPTION_STRING "cd:ef:hlo:rs:"
+#define OPTION_STRING "b:cd:ef:hlo:rs:V:"
+/* value returned by getopt_long() for --verify-all */
+#define OPTION_VERIFY_ALL_VAL 0x100
 enum {
 	OPTION_C = 0,
 	OPTION_D,
@@ -63,6 +73,8 @@ enum {
 	OPTION_S,
 	OPTION_E,
 	OPTION_L,
+	OPTION_B,
+	OPTION_VERIFY_ALL,
 	MAX_OPTIONS,
 };
 
@@ -79,9 +91,55 @@ struct nvparam_entry {
 	uint32_t crc16 : 16;
 } __attribute__((__packed__));
 
-struct mtd_info_user mtd;
+/*
+ * NVPARAM format understood by the host firmware, selected with -V.
+ *
+ * Format 1 is a table of fixed slots filling the erase block, the SPI
+ * offset of a slot identifies the parameter.
+ *
+ * Format 2 keeps the slots in the first half of the erase block and uses
+ * the second half as an append-only log of nvparam_log_entry records. The
+ * last record written for a slot overrides the slot, free records read as
+ * erased flash. A record replaces the previous one by being appended, the
+ * previous one is then invalidated by clearing its valid bit, so a change
+ * needs no erase until the log is full. The log is then folded back into
+ * the slots with a single erase of the block. The first record of the log
+ * is a header marking the block as format 2, -c -V 2 writes it.
+ *
+ * In both formats an entry that can be reached by clearing bits only is
+ * reprogrammed in place.
+ */
+#define NVPARAM_FORMAT_FIXED 1
+#define NVPARAM_FORMAT_LOG   2
+#define NVPARAM_LOG_FREE     0xFFFFFFFF
+#define NVPARAM_LOG_MAGIC    0x324C564E /* "NVL2", slot of the header */
+struct nvparam_log_entry {
+	uint32_t slot; /* byte offset of the slot in the erase block */
+	struct nvparam_entry entry;
+} __attribute__((__packed__));
+
+/*
+ * One line of a -b manifest, in hex:
+ *	<SPI offset>,<value>[,<acl_rd>[,<acl_wr>[,<valid>]]]
+ * acl_rd, acl_wr and valid default to all 1s as for -s. Blank lines and
+ * text after '#' are ignored.
+ */
+#define MANIFEST_LINE_SIZE 128
+struct nvparam_op {
+	ulong offset;
+	struct nvparam_entry entry;
+};
+
+struct flash_dev mtd;
 struct stat filestat;
-struct erase_info_user erase;
+int nvparam_format = NVPARAM_FORMAT_FIXED;
+
+/* what the write engine did with the erase blocks it was given */
+struct flash_stats {
+	int erased;
+	int programmed;
+	int unchanged;
+};
 
 /*----------------------------------------------------------------------------
  * @fn log_printf
@@ -156,59 +214,182 @@ static int validate_input_offset(ulong offset)
 		ret = -1;
 	}
 
-	if ((offset % mtd.erasesize) != 0) {
+	if ((offset % mtd.erase_size) != 0) {
 		log_printf(LOG_ERROR,
 			   "offset:0x%x is not a sector boundary\n"
 			   "It needs to be multiples of erasesize:0x%x\n",
-			   offset, mtd.erasesize);
+			   offset, mtd.erase_size);
 		ret = -1;
 	}
 
 	return ret;
 }
 
+/*----------------------------------------------------------------------------
+ * @fn flash_is_erased
+ *
+ * @brief Check if a buffer holds erased flash only
+ * @params  buf [IN] - Data to check
+ * 			len [IN] - Size of data in bytes
+ * @return  1 - All bytes are erased
+ * 			0 - Otherwise
+ *--------------------------------------------------------------------------*/
+static int flash_is_erased(const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != FLASH_ERASED)
+			return 0;
+	}
+
+	return 1;
+}
+
 /*----------------------------------------------------------------------------
  * @fn flash_erase
  *
  * @brief Erase the content of given SPI NOR device, at given offset and length.
- * @params  dev_fd [IN] - The file descriptor of SPI NOR device to be erased
+ * Blocks that already read back as erased are skipped, each run of blocks
+ * that are not is erased with a single ioctl.
+ * @params  dev [IN] - The SPI NOR device to be erased
  * 			offset [IN] - The offset in SPI NOR device to begin erasing
  * 			length [IN] - Number of bytes will be erased
  * @return  0 - Success
  * 			-1 - Failure
  *--------------------------------------------------------------------------*/
-static int flash_erase(int dev_fd, ulong offset, ulong length)
+static int flash_erase(struct flash_dev *dev, ulong offset, ulong length)
 {
-	int i, blocks;
+	uint8_t *cur;
+	ulong run = 0;
+	int i, blocks, skipped = 0;
+	int ret = 0;
 
-	erase.start = offset;
-	erase.length = (length + mtd.erasesize - 1) / mtd.erasesize;
-	erase.length *= mtd.erasesize;
+	blocks = (length + mtd.erase_size - 1) / mtd.erase_size;
 
-	blocks = erase.length / mtd.erasesize;
-	erase.length = mtd.erasesize;
+	cur = malloc(mtd.erase_size);
+	if (!cur) {
+		log_printf(LOG_ERROR, "Erase: malloc failure\n");
+		return -1;
+	}
 
 	/* Erasing required flash sector based on input file size */
-	for (i = 1; i <= blocks; i++) {
-		log_printf(LOG_NORMAL, "\rErasing blocks: %d/%d (%d%%)", i,
-			   blocks, PERCENTAGE(i, blocks));
-		if (ioctl(dev_fd, MEMERASE, &erase) < 0) {
-			log_printf(
-				LOG_ERROR,
-				"Error While erasing blocks 0x%.8x-0x%.8x: %m\n",
-				(unsigned int)erase.start,
-				(unsigned int)(erase.start + erase.length));
-			return -1;
+	for (i = 0; i < blocks; i++) {
+		ulong block = offset + (ulong)i * mtd.erase_size;
+
+		log_printf(LOG_NORMAL, "\rErasing blocks: %d/%d (%d%%)", i + 1,
+			   blocks, PERCENTAGE(i + 1, blocks));
+		if (flash_dev_read(dev, block, cur, mtd.erase_size) == 0 &&
+		    flash_is_erased(cur, mtd.erase_size)) {
+			/* close the pending run, if any */
+			if (run && flash_dev_erase(dev, block - run, run)) {
+				ret = -1;
+				goto out;
+			}
+			run = 0;
+			skipped++;
+			continue;
 		}
-		erase.start += mtd.erasesize;
+		run += mtd.erase_size;
+	}
+	if (run && flash_dev_erase(dev,
+				   offset + (ulong)blocks * mtd.erase_size - run,
+				   run)) {
+		ret = -1;
+		goto out;
 	}
 
-	log_printf(LOG_NORMAL, "\rErasing blocks: %d/%d (100%%)\n", blocks,
-		   blocks);
+	log_printf(LOG_NORMAL,
+		   "\rErasing blocks: %d/%d (100%%), %d already blank\n",
+		   blocks, blocks, skipped);
+out:
+	free(cur);
+	return ret;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn flash_update_block
+ *
+ * @brief Bring one erase block to the given content. The block is read
+ * first: an identical block is left alone, a blank one is only programmed,
+ * anything else is erased and programmed. Data is written with one write
+ * of whole write pages, the erased tail of the block is not written.
+ * @params  dev [IN] - Flash device
+ * 			block [IN] - Erase block aligned offset in flash
+ * 			data [IN] - New content, mtd.erase_size bytes
+ * 			cur [IN] - Scratch buffer of mtd.erase_size bytes
+ * 			stats [OUT] - Counters of the action taken
+ * @return  0 - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int flash_update_block(struct flash_dev *dev, ulong block,
+			      const uint8_t *data, uint8_t *cur,
+			      struct flash_stats *stats)
+{
+	size_t len = mtd.erase_size;
+
+	if (flash_dev_read(dev, block, cur, mtd.erase_size) < 0) {
+		log_printf(LOG_ERROR, "\nWhile reading block 0x%.8x\n",
+			   (unsigned int)block);
+		return -1;
+	}
+
+	if (!memcmp(cur, data, mtd.erase_size)) {
+		stats->unchanged++;
+		return 0;
+	}
+
+	if (!flash_is_erased(cur, mtd.erase_size)) {
+		if (flash_dev_erase(dev, block, mtd.erase_size) < 0)
+			return -1;
+		stats->erased++;
+	}
+
+	/* nothing to program past the last written page */
+	while (len && data[len - 1] == FLASH_ERASED)
+		len--;
+	len = (len + mtd.write_size - 1) / mtd.write_size * mtd.write_size;
+	if (!len)
+		return 0;
+
+	if (flash_dev_write(dev, block, data, len) < 0) {
+		log_printf(LOG_ERROR, "\nWhile writing block 0x%.8x\n",
+			   (unsigned int)block);
+		return -1;
+	}
+	stats->programmed++;
 
 	return 0;
 }
 
+/*----------------------------------------------------------------------------
+ * @fn flash_can_program
+ *
+ * @brief Check if flash holding cur can be changed to data without an erase,
+ * that is by clearing bits only. Only NOR flash with single byte writes
+ * allows that (FLASH_DEV_BIT_PROGRAM).
+ * @params  cur [IN] - Current flash content
+ * 			data [IN] - New content
+ * 			len [IN] - Size of content in bytes
+ * @return  1 - Can be programmed in place
+ * 			0 - Needs an erase
+ *--------------------------------------------------------------------------*/
+static int flash_can_program(const void *cur, const void *data, size_t len)
+{
+	const uint8_t *c = cur, *d = data;
+	size_t i;
+
+	if (!(mtd.flags & FLASH_DEV_BIT_PROGRAM))
+		return 0;
+
+	for (i = 0; i < len; i++) {
+		if ((c[i] & d[i]) != d[i])
+			return 0;
+	}
+
+	return 1;
+}
+
 /*----------------------------------------------------------------------------
  * @fn flash_open
  *
@@ -290,42 +471,43 @@ static int flash_rewind(int fd, unsigned long offset, const char *filename)
 /*----------------------------------------------------------------------------
  * @fn flash_write
  *
- * @brief Write content of input file to flash at desired offset
- * @params  dev_fd [IN] - File descriptor of flash
+ * @brief Write content of input file to flash at desired offset, one erase
+ * block at a time. The part of the last block past the end of the file ends
+ * up erased.
+ * @params  dev [IN] - Flash device
  * 			fil_fd [IN] - File descriptor of input file
- * 			offset [IN] - Location in flash to write
+ * 			offset [IN] - Location in flash to write, erase block aligned
  * 			argv1_ptr [IN] - String of input file name
  * 			argv2_ptr [IN] - String of input flash offset
  * @return  0 - Success
  * 			-1 - Failure
  *--------------------------------------------------------------------------*/
-static int flash_write(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
-		       char *argv2_ptr)
+static int flash_write(struct flash_dev *dev, int fil_fd, ulong offset,
+		       char *argv1_ptr, char *argv2_ptr)
 {
-	ssize_t result, size, written;
-	unsigned char src[BUFSIZE];
-	int i, tmp = 0;
+	struct flash_stats stats = { 0, 0, 0 };
+	uint8_t *src = NULL, *cur = NULL;
+	ssize_t size, written, i;
+	int tmp = 0;
 	int ret = 0;
 
 	log_printf(LOG_NORMAL, "Writing data: 0k/%luk (0%%)",
 		   KB(filestat.st_size));
 
+	src = malloc(mtd.erase_size);
+	cur = malloc(mtd.erase_size);
+	if (!src || !cur) {
+		log_printf(LOG_ERROR, "\nWrite: malloc failure\n");
+		ret = -1;
+		goto out;
+	}
+
 	size = filestat.st_size;
-	i = BUFSIZE;
 	written = 0;
 
-	if (offset) {
-		tmp = flash_rewind(dev_fd, offset, argv2_ptr);
-		if (tmp < 0) {
-			ret = -1;
-			goto out;
-		}
-	}
-
 	/* Writing file content into flash partition */
 	while (size) {
-		if (size < BUFSIZE)
-			i = size;
+		i = size < (ssize_t)mtd.erase_size ? size : mtd.erase_size;
 
 		log_printf(LOG_NORMAL, "\rWriting data: %dk/%luk (%lu%%)",
 			   KB(written + i), KB(filestat.st_size),
@@ -337,26 +519,16 @@ static int flash_write(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
 			ret = -1;
 			goto out;
 		}
+		memset(src + i, FLASH_ERASED, mtd.erase_size - i);
 
 		/* write to device */
-		result = write(dev_fd, src, i);
-		if (i != result) {
-			printf("\n");
-			if (result < 0) {
-				log_printf(LOG_ERROR,
-					   "While writing data to"
-					   "0x%.8x-0x%.8x on %s: %m\n",
-					   written, written + i, argv2_ptr);
-				ret = -1;
-				goto out;
-			}
-
+		tmp = flash_update_block(dev, offset + written, src, cur,
+					 &stats);
+		if (tmp < 0) {
 			log_printf(LOG_ERROR,
-				   "Short write count returned while"
-				   "writing to x%.8x-0x%.8x on %s: %d/%lu bytes"
-				   " written to flash\n",
-				   written, written + i, argv2_ptr,
-				   written + result, filestat.st_size);
+				   "While writing data to"
+				   "0x%.8x-0x%.8x on %s\n",
+				   written, written + i, argv2_ptr);
 			ret = -1;
 			goto out;
 		}
@@ -366,7 +538,12 @@ static int flash_write(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
 
 	log_printf(LOG_NORMAL, "\rWriting data: %luk/%luk (100%%)\n",
 		   KB(filestat.st_size), KB(filestat.st_size));
+	log_printf(LOG_NORMAL,
+		   "Erased %d, programmed %d, unchanged %d block(s)\n",
+		   stats.erased, stats.programmed, stats.unchanged);
 out:
+	free(src);
+	free(cur);
 	return ret;
 }
 
@@ -374,7 +551,7 @@ out:
  * @fn flash_verify
  *
  * @brief Compare input file with flashed content
- * @params  dev_fd [IN] - File descriptor of flash
+ * @params  dev [IN] - Flash device
  * 			fil_fd [IN] - File descriptor of input file
  * 			offset [IN] - Location in flash to start comparing
  * 			argv1_ptr [IN] - String of input file name
@@ -382,8 +559,8 @@ out:
  * @return  0 - Match
  * 			-1 - Failure
  *--------------------------------------------------------------------------*/
-static int flash_verify(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
-			char *argv2_ptr)
+static int flash_verify(struct flash_dev *dev, int fil_fd, ulong offset,
+			char *argv1_ptr, char *argv2_ptr)
 {
 	unsigned char src[BUFSIZE], dest[BUFSIZE];
 	ssize_t size, written;
@@ -391,10 +568,9 @@ static int flash_verify(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
 	int ret = 0;
 
 	/*
-	 * After flash write operation file pointer and device pointer
-	 * are moved to other location based upon the size. For verify
-	 * operation we need to move back the file poitner and device
-	 * pointer to original location
+	 * After flash write operation file pointer is moved to other
+	 * location based upon the size. For verify operation we need to
+	 * move back the file poitner to original location
 	 */
 	tmp = flash_rewind(fil_fd, 0x0, argv1_ptr);
 	if (tmp < 0) {
@@ -402,12 +578,6 @@ static int flash_verify(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
 		goto out;
 	}
 
-	tmp = flash_rewind(dev_fd, offset, argv2_ptr);
-	if (tmp < 0) {
-		ret = -1;
-		goto out;
-	}
-
 	size = filestat.st_size;
 	i = BUFSIZE;
 	written = 0;
@@ -432,8 +602,10 @@ static int flash_verify(int dev_fd, int fil_fd, ulong offset, char *argv1_ptr,
 		}
 
 		/* read from device */
-		tmp = flash_read(dev_fd, argv2_ptr, dest, i);
+		tmp = flash_dev_read(dev, offset + written, dest, i);
 		if (tmp < 0) {
+			log_printf(LOG_ERROR, "\nWhile reading from %s\n",
+				   argv2_ptr);
 			ret = -1;
 			goto out;
 		}
@@ -463,54 +635,588 @@ out:
 }
 
 /*----------------------------------------------------------------------------
- * @fn crc16
+ * @fn nvparam_entry_crc
  *
- * @brief Calculate CRC16
- * @params  ptr [IN] - Input buffer to calculate CRC16 on
- * 			count [IN] - Number of bytes to calculate CRC16
+ * @brief Calculate the CRC16 of a NVPARAM entry. CRC16 is calculated on
+ * whole NVPARAM entry with crc16 = 0
+ * @params  entry [IN] - The NVPARAM entry
  * @return  CRC16 value
  *--------------------------------------------------------------------------*/
-static int crc16(uint8_t *ptr, int count)
+static int nvparam_entry_crc(const struct nvparam_entry *entry)
 {
-	int crc = 0;
-	int i;
-
-	while (--count >= 0) {
-		crc = crc ^ (int)*ptr++ << 8;
-		for (i = 0; i < 8; ++i) {
-			if (crc & 0x8000)
-				crc = crc << 1 ^ 0x1021;
-			else
-				crc = crc << 1;
-		}
-	}
+	struct nvparam_entry tmp = *entry;
+
+	tmp.crc16 = 0;
 
-	return crc & 0xffff;
+	return flash_crc16(0, &tmp, sizeof(tmp));
 }
 
 /*----------------------------------------------------------------------------
  * @fn nvparam_get
  *
  * @brief Read one erase block of NVPARAM
- * @params  mtd_fd [IN] - File descriptor of SPI NOR device contains NVPARAM partition
+ * @params  dev [IN] - SPI NOR device contains NVPARAM partition
  * 			nvparam_base [IN] - Base offset of NVPARAM partition
  * 			nvparam_blob [OUT] - Buffer of read NVPARAM
  * @return  0 - Success
  * 			-1 - Failure
  *--------------------------------------------------------------------------*/
-static int nvparam_get(int mtd_fd, ulong nvparam_base, void *nvparam_blob)
+static int nvparam_get(struct flash_dev *dev, ulong nvparam_base,
+		       void *nvparam_blob)
+{
+	if (flash_dev_read(dev, nvparam_base, nvparam_blob, mtd.erase_size) <
+	    0)
+		return -1;
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_put
+ *
+ * @brief Write back one erase block of NVPARAM
+ * @params  dev [IN] - SPI NOR device contains NVPARAM partition
+ * 			nvparam_base [IN] - Base offset of NVPARAM partition
+ * 			nvparam_blob [IN] - NVPARAM to write
+ * @return  0 - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int nvparam_put(struct flash_dev *dev, ulong nvparam_base,
+		       void *nvparam_blob)
+{
+	struct flash_stats stats = { 0, 0, 0 };
+	uint8_t *cur;
+	int ret;
+
+	cur = malloc(mtd.erase_size);
+	if (!cur)
+		return -1;
+
+	ret = flash_update_block(dev, nvparam_base, nvparam_blob, cur, &stats);
+	free(cur);
+
+	return ret;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_slots
+ *
+ * @brief Get the number of fixed slots in one erase block of NVPARAM
+ * @return  Number of slots
+ *--------------------------------------------------------------------------*/
+static uint nvparam_slots(void)
+{
+	if (nvparam_format >= NVPARAM_FORMAT_LOG)
+		return mtd.erase_size / 2 / sizeof(struct nvparam_entry);
+
+	return mtd.erase_size / sizeof(struct nvparam_entry);
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_log_header
+ *
+ * @brief Build the header record which starts the log of a format 2 block
+ * @params  hdr [OUT] - The header record
+ *--------------------------------------------------------------------------*/
+static void nvparam_log_header(struct nvparam_log_entry *hdr)
+{
+	hdr->slot = NVPARAM_LOG_MAGIC;
+	hdr->entry.param1 = NVPARAM_FORMAT_LOG;
+	hdr->entry.acl_rd = 0xFF;
+	hdr->entry.acl_wr = 0x7F;
+	hdr->entry.valid = 1;
+	hdr->entry.crc16 = nvparam_entry_crc(&hdr->entry);
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_check_format
+ *
+ * @brief Check that an erase block of NVPARAM is in the format selected
+ * with -V. A format 2 block carries the log header, a format 1 block must
+ * not, so neither format is misread as the other.
+ * @params  blob [IN] - One erase block of NVPARAM, as read from flash
+ * 			nvparam_base [IN] - Base offset of the erase block
+ * @return  0 - Formats match
+ * 			-1 - Mismatch
+ *--------------------------------------------------------------------------*/
+static int nvparam_check_format(const struct nvparam_entry *blob,
+				ulong nvparam_base)
+{
+	struct nvparam_log_entry hdr;
+	int has_log;
+
+	nvparam_log_header(&hdr);
+	has_log = !memcmp((const uint8_t *)blob + mtd.erase_size / 2, &hdr,
+			  sizeof(hdr));
+
+	if (nvparam_format >= NVPARAM_FORMAT_LOG && !has_log) {
+		log_printf(LOG_ERROR,
+			   "NVPARAM at 0x%x is not format 2, "
+			   "format it with -c -V 2\n",
+			   (unsigned int)nvparam_base);
+		return -1;
+	}
+
+	if (nvparam_format < NVPARAM_FORMAT_LOG && has_log) {
+		log_printf(LOG_ERROR, "NVPARAM at 0x%x is format 2, add -V 2\n",
+			   (unsigned int)nvparam_base);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_format_log
+ *
+ * @brief Write the format 2 log header to every erase block of an erased
+ * NVPARAM partition
+ * @params  dev [IN] - SPI NOR device contains NVPARAM partition
+ * 			nvparam_base [IN] - Base offset of NVPARAM partition
+ * @return  0 - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int nvparam_format_log(struct flash_dev *dev, ulong nvparam_base)
+{
+	struct nvparam_log_entry hdr;
+	ulong block, size = NVPARAM_PARTITION_SIZE;
+
+	if (size < mtd.erase_size)
+		size = mtd.erase_size;
+
+	nvparam_log_header(&hdr);
+	for (block = nvparam_base; block < nvparam_base + size;
+	     block += mtd.erase_size) {
+		if (flash_dev_write(dev, block + mtd.erase_size / 2, &hdr,
+				    sizeof(hdr)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_apply_log
+ *
+ * @brief Fold the log of a format 2 NVPARAM blob into its slots and leave
+ * the log empty but for its header. Format 1 blobs are left alone.
+ * @params  blob [IN/OUT] - One erase block of NVPARAM
+ *--------------------------------------------------------------------------*/
+static void nvparam_apply_log(struct nvparam_entry *blob)
+{
+	struct nvparam_log_entry *log;
+	uint i, slots, records;
+
+	if (nvparam_format < NVPARAM_FORMAT_LOG)
+		return;
+
+	slots = nvparam_slots();
+	log = (struct nvparam_log_entry *)&blob[slots];
+	records = mtd.erase_size / 2 / sizeof(struct nvparam_log_entry);
+
+	/* Record 0 is the header */
+	for (i = 1; i < records && log[i].slot != NVPARAM_LOG_FREE; i++) {
+		uint entry_no = log[i].slot / sizeof(struct nvparam_entry);
+
+		if (entry_no < slots)
+			blob[entry_no] = log[i].entry;
+	}
+
+	memset((void *)log, 0xFF, mtd.erase_size / 2);
+	nvparam_log_header(&log[0]);
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_set_entry
+ *
+ * @brief Change one NVPARAM entry, with as little flash work as the format
+ * allows: nothing if it is unchanged, in place if only bits are cleared,
+ * a log record in format 2, else an erase and rewrite of the block.
+ * @params  dev [IN] - SPI NOR device contains NVPARAM partition
+ * 			nvparam_base [IN] - Base offset of NVPARAM partition
+ * 			blob [IN] - The erase block of NVPARAM, as read from flash
+ * 			entry_no [IN] - Slot of the entry
+ * 			entry [IN] - New content of the entry
+ * @return  0 - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int nvparam_set_entry(struct flash_dev *dev, ulong nvparam_base,
+			     struct nvparam_entry *blob, uint entry_no,
+			     const struct nvparam_entry *entry)
+{
+	struct nvparam_entry *cur = &blob[entry_no], old;
+	ulong cur_off = nvparam_base + entry_no * sizeof(struct nvparam_entry);
+	ulong log_base = nvparam_base + mtd.erase_size / 2;
+	struct nvparam_log_entry *log = NULL, rec;
+	uint i = 0, records = 0;
+
+	if (entry_no >= nvparam_slots()) {
+		log_printf(LOG_ERROR, "Offset is not a NVPARAM slot\n");
+		return -1;
+	}
+
+	/* In format 2, the entry in effect is the last record of the slot */
+	if (nvparam_format >= NVPARAM_FORMAT_LOG) {
+		log = (struct nvparam_log_entry *)&blob[nvparam_slots()];
+		records = mtd.erase_size / 2 / sizeof(struct nvparam_log_entry);
+		for (i = 1; i < records && log[i].slot != NVPARAM_LOG_FREE;
+		     i++) {
+			if (log[i].slot !=
+			    entry_no * sizeof(struct nvparam_entry))
+				continue;
+			cur = &log[i].entry;
+			cur_off = log_base + i * sizeof(rec) +
+				  offsetof(struct nvparam_log_entry, entry);
+		}
+	}
+
+	if (!memcmp(cur, entry, sizeof(*entry)))
+		return 0;
+
+	if (flash_can_program(cur, entry, sizeof(*entry)))
+		return flash_dev_write(dev, cur_off, entry, sizeof(*entry));
+
+	/* i is the first free record of the log */
+	if (log && i < records) {
+		rec.slot = entry_no * sizeof(struct nvparam_entry);
+		rec.entry = *entry;
+		if (flash_dev_write(dev, log_base + i * sizeof(rec), &rec,
+				    sizeof(rec)) < 0)
+			return -1;
+
+		/* Invalidate the entry it replaces, this only clears a bit */
+		if (cur->valid) {
+			old = *cur;
+			old.valid = 0;
+			if (flash_dev_write(dev, cur_off, &old, sizeof(old)) <
+			    0) {
+				log_printf(LOG_ERROR,
+					   "Failed to invalidate NVPARAM at 0x%x\n",
+					   (unsigned int)cur_off);
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	/* Log full or format 1: rewrite the whole block */
+	nvparam_apply_log(blob);
+	blob[entry_no] = *entry;
+
+	return nvparam_put(dev, nvparam_base, (void *)blob);
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_read_manifest
+ *
+ * @brief Parse a -b manifest into a list of NVPARAM entries with their CRC16
+ * @params  filename [IN] - Manifest file name
+ * 			ops [OUT] - Allocated list of operations, to be freed
+ * @return  Number of operations - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int nvparam_read_manifest(const char *filename, struct nvparam_op **ops)
+{
+	char line[MANIFEST_LINE_SIZE], *p;
+	struct nvparam_op *list = NULL, *tmp;
+	unsigned long offset;
+	unsigned long long value;
+	uint acl_rd, acl_wr, valid;
+	int count = 0, lineno = 0, n;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		log_printf(LOG_ERROR, "Failed to open the file: %s\n",
+			   filename);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		p = strchr(line, '#');
+		if (p)
+			*p = '\0';
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if (*p == '\0' || *p == '\n' || *p == '\r')
+			continue;
+
+		acl_rd = 0xFF;
+		acl_wr = 0x7F;
+		valid = 1;
+		n = sscanf(p, "%lx ,%llx ,%x ,%x ,%x", &offset, &value, &acl_rd,
+			   &acl_wr, &valid);
+		if (n < 2 || offset % sizeof(struct nvparam_entry) ||
+		    offset >= mtd.size || value > 0xFFFFFFFF || acl_rd > 0xFF ||
+		    acl_wr > 0x7F || valid > 1) {
+			log_printf(LOG_ERROR, "%s:%d: invalid entry\n",
+				   filename, lineno);
+			goto error;
+		}
+
+		tmp = realloc(list, (count + 1) * sizeof(*list));
+		if (!tmp) {
+			log_printf(LOG_ERROR, "Manifest: malloc failure\n");
+			goto error;
+		}
+		list = tmp;
+		list[count].offset = offset;
+		list[count].entry.param1 = value;
+		list[count].entry.acl_rd = acl_rd;
+		list[count].entry.acl_wr = acl_wr;
+		list[count].entry.valid = valid;
+		list[count].entry.crc16 = nvparam_entry_crc(&list[count].entry);
+		count++;
+	}
+	fclose(fp);
+
+	*ops = list;
+	return count;
+
+error:
+	fclose(fp);
+	free(list);
+	return -1;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn nvparam_batch
+ *
+ * @brief Apply all entries of a manifest. Each NVPARAM erase block they fall
+ * in is read once, updated in memory and written back once.
+ * @params  dev [IN] - SPI NOR device contains NVPARAM partition
+ * 			filename [IN] - Manifest file name
+ * @return  0 - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int nvparam_batch(struct flash_dev *dev, const char *filename)
 {
+	struct nvparam_op *ops = NULL;
+	struct nvparam_entry *blob;
+	ulong nvparam_base;
+	int count, i, j, blocks = 0;
 	int ret = -1;
 
-	ret = flash_rewind(mtd_fd, nvparam_base, NULL);
-	if (ret < 0)
-		return ret;
+	count = nvparam_read_manifest(filename, &ops);
+	if (count < 0)
+		return -1;
 
-	ret = flash_read(mtd_fd, NULL, nvparam_blob, mtd.erasesize);
+	blob = malloc(mtd.erase_size);
+	if (!blob) {
+		log_printf(LOG_ERROR, "Batch: malloc failure\n");
+		goto out;
+	}
 
+	for (i = 0; i < count; i++) {
+		/* offset is cleared once the block of the entry is done */
+		if (ops[i].offset == ULONG_MAX)
+			continue;
+		nvparam_base = (ops[i].offset / mtd.erase_size) * mtd.erase_size;
+
+		if (nvparam_get(dev, nvparam_base, (void *)blob) < 0) {
+			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
+			goto out;
+		}
+		if (nvparam_check_format(blob, nvparam_base) < 0)
+			goto out;
+		nvparam_apply_log(blob);
+
+		for (j = i; j < count; j++) {
+			uint entry_no;
+
+			if (ops[j].offset == ULONG_MAX ||
+			    ops[j].offset / mtd.erase_size * mtd.erase_size !=
+				    nvparam_base)
+				continue;
+			entry_no = (ops[j].offset - nvparam_base) /
+				   sizeof(struct nvparam_entry);
+			if (entry_no >= nvparam_slots()) {
+				log_printf(LOG_ERROR,
+					   "0x%x is not a NVPARAM slot\n",
+					   (unsigned int)ops[j].offset);
+				goto out;
+			}
+			blob[entry_no] = ops[j].entry;
+			ops[j].offset = ULONG_MAX;
+		}
+
+		if (nvparam_put(dev, nvparam_base, (void *)blob) < 0) {
+			log_printf(LOG_ERROR, "Failed to write NVPARAM\n");
+			goto out;
+		}
+		blocks++;
+	}
+
+	log_printf(LOG_NORMAL, "Applied %d NVPARAM(s) in %d block(s)\n", count,
+		   blocks);
+	ret = 0;
+out:
+	free(blob);
+	free(ops);
 	return ret;
 }
 
+/*----------------------------------------------------------------------------
+ * @fn nvparam_verify_all
+ *
+ * @brief Check every entry of a NVPARAM partition in one pass. Erased
+ * entries are empty, the others must carry a matching CRC16.
+ * @params  dev [IN] - SPI NOR device contains NVPARAM partition
+ * 			nvparam_base [IN] - Base offset of NVPARAM partition
+ * @return  0 - No corrupt entry
+ * 			1 - Corrupt entries found
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int nvparam_verify_all(struct flash_dev *dev, ulong nvparam_base)
+{
+	struct nvparam_entry *blob;
+	ulong block, size = NVPARAM_PARTITION_SIZE;
+	int valid = 0, empty = 0, corrupt = 0, cal_crc16;
+	uint index;
+
+	if (size < mtd.erase_size)
+		size = mtd.erase_size;
+
+	blob = malloc(mtd.erase_size);
+	if (!blob) {
+		log_printf(LOG_ERROR, "Verify: malloc failure\n");
+		return -1;
+	}
+
+	for (block = nvparam_base; block < nvparam_base + size;
+	     block += mtd.erase_size) {
+		if (nvparam_get(dev, block, (void *)blob) < 0) {
+			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
+			free(blob);
+			return -1;
+		}
+		if (nvparam_check_format(blob, block) < 0) {
+			free(blob);
+			return -1;
+		}
+		nvparam_apply_log(blob);
+
+		for (index = 0; index < nvparam_slots(); index++) {
+			cal_crc16 = nvparam_entry_crc(&blob[index]);
+			if (blob[index].crc16 == cal_crc16) {
+				valid++;
+			} else if (flash_is_erased((uint8_t *)&blob[index],
+						   sizeof(*blob))) {
+				empty++;
+			} else {
+				log_printf(
+					LOG_NORMAL,
+					"Corrupt NVPARAM at 0x%x: 0x%08x CRC16: %x (Calculated CRC16: %x)\n",
+					(unsigned int)(block +
+						       index * sizeof(*blob)),
+					blob[index].param1, blob[index].crc16,
+					cal_crc16);
+				corrupt++;
+			}
+		}
+	}
+	free(blob);
+
+	log_printf(LOG_NORMAL,
+		   "Verified NVPARAM at 0x%x: %d valid, %d empty, %d corrupt\n",
+		   (unsigned int)nvparam_base, valid, empty, corrupt);
+
+	return corrupt ? 1 : 0;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn mtd_cached_device
+ *
+ * @brief Get the host SPI NOR MTD number saved by an earlier call
+ * @return  MTD number - The cached number still names the host SPI NOR
+ * 			-1 - No usable cache
+ *--------------------------------------------------------------------------*/
+static int mtd_cached_device(void)
+{
+	char path[64], name[32];
+	FILE *fp;
+	int num = -1;
+
+	fp = fopen(MTD_CACHE_FILE, "r");
+	if (!fp)
+		return -1;
+	if (fscanf(fp, "%d", &num) != 1)
+		num = -1;
+	fclose(fp);
+	if (num < 0)
+		return -1;
+
+	/* The MTD numbering can change, check it is still the host SPI NOR */
+	snprintf(path, sizeof(path), SYS_MTD_NAME, num);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	if (!fgets(name, sizeof(name), fp) ||
+	    strcmp(name, HOST_SPI_FLASH_SYS_NAME))
+		num = -1;
+	fclose(fp);
+
+	return num;
+}
+
+/*----------------------------------------------------------------------------
+ * @fn mtd_find_host_device
+ *
+ * @brief Find the MTD number of the host SPI NOR, from the cache or else
+ * from /proc/mtd. A number found in /proc/mtd is cached for the next call.
+ * @return  MTD number - Success
+ * 			-1 - Failure
+ *--------------------------------------------------------------------------*/
+static int mtd_find_host_device(void)
+{
+	int nMTDDeviceNumber;
+	char temp_mtd[4] = { 0 }, *temp;
+	FILE *proc_fp;
+	char proc_buf[80];
+
+	nMTDDeviceNumber = mtd_cached_device();
+	if (nMTDDeviceNumber >= 0)
+		return nMTDDeviceNumber;
+
+	if ((proc_fp = fopen(PROC_MTD_INFO, "r")) == NULL) {
+		log_printf(LOG_ERROR, "Unable to open %s to get MTD info...\n",
+			   PROC_MTD_INFO);
+		return -1;
+	}
+
+	while (fgets(proc_buf, sizeof(proc_buf), proc_fp) != NULL) {
+		/* Try to find "HOST SPI" for BIOS flash */
+		if (strstr(proc_buf, HOST_SPI_FLASH_MTD_NAME)) {
+			temp = strtok(proc_buf, ":");
+			if (temp == NULL) {
+				log_printf(
+					LOG_ERROR,
+					"Error in finding the BIOS Partition \n");
+				fclose(proc_fp);
+				return -1;
+			}
+
+			memcpy((char *)&temp_mtd, (char *)&temp[3],
+			       (strlen(temp) - 3));
+			nMTDDeviceNumber = atoi(temp_mtd);
+			break;
+		}
+	}
+	fclose(proc_fp);
+
+	if (nMTDDeviceNumber >= 0) {
+		/* Best effort, the next call rescans without it */
+		proc_fp = fopen(MTD_CACHE_FILE, "w");
+		if (proc_fp) {
+			fprintf(proc_fp, "%d\n", nMTDDeviceNumber);
+			fclose(proc_fp);
+		}
+	}
+
+	return nMTDDeviceNumber;
+}
+
 /*----------------------------------------------------------------------------
  * @fn help
  *
@@ -536,26 +1242,38 @@ static void help(char *name)
 		"\n\tList out all the valid nvparam settings on a NVPARAM partition at <NVPARAM base SPI offset>\n"
 		"%s -e -o <SPI offset>: "
 		"Erase a particular NVPARAM at host SPI NOR offset <SPI offset>\n"
+		"%s -b <manifest>: "
+		"Apply all NVPARAM entries listed in <manifest>, one line each:"
+		"\n\t<SPI offset>,<value>[,<ACL_RD>[,<ACL_WR>[,<valid>]]] in hex\n"
+		"%s --verify-all -o <NVPARAM base SPI offset>: "
+		"\n\tCheck the CRC16 of every entry of a NVPARAM partition at <NVPARAM base SPI offset>"
+		" and list the corrupt ones\n"
 		"%s -h: "
-		"Print this help\n",
-		name, name, name, name, name, name, name, name);
+		"Print this help\n"
+		"Add -V <format> to -c, -s, -e, -b, -r, -l and --verify-all for a "
+		"host firmware with NVPARAM format <format>"
+		"\n\t1: fixed slots (default), 2: slots with an append-only log"
+		"\n\t-c -V 2 formats the partition for format 2, the other "
+		"commands\n\trefuse a partition in the other format\n",
+		name, name, name, name, name, name, name, name, name, name);
 }
 
 int main(int argc, char *argv[])
 {
-	static int dev_fd = -1, fil_fd = -1;
+	static int fil_fd = -1;
 	int ret = 0;
 	int nMTDDeviceNumber = -1;
 	unsigned long offset = ULONG_MAX, value = ULONG_MAX;
 	char *argv_dev_ptr;
 	char mtd_dev[MTD_DEV_SIZE];
-	char temp_mtd[4] = { 0 }, *temp;
-	FILE *proc_fp;
-	char proc_buf[80];
 	int argflag;
 	int options_used[MAX_OPTIONS] = {
-		0, 0, 0, 0, 0, 0, 0, 0, 0
-	}; /* c, d, f, h, o, r, s, l, e */
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+	}; /* c, d, f, h, o, r, s, l, e, b, verify-all */
+	static const struct option long_options[] = {
+		{ "verify-all", no_argument, NULL, OPTION_VERIFY_ALL_VAL },
+		{ NULL, 0, NULL, 0 },
+	};
 	char *filepath = NULL;
 	char *input_offset = NULL;
 	char *input_value = NULL;
@@ -564,14 +1282,21 @@ int main(int argc, char *argv[])
 		help(argv[0]);
 		goto exit_free;
 	}
-	while ((argflag = getopt(argc, (char **)argv, OPTION_STRING)) != -1) {
+	while ((argflag = getopt_long(argc, (char **)argv, OPTION_STRING,
+				      long_options, NULL)) != -1) {
 		switch (argflag) {
+		case OPTION_VERIFY_ALL_VAL:
+			options_used[OPTION_VERIFY_ALL] = 1;
+			break;
 		case 'c':
 			options_used[OPTION_C] = 1;
 			break;
+		case 'b':
 		case 'd':
 		case 'f':
-			if (argflag == 'd')
+			if (argflag == 'b')
+				options_used[OPTION_B] = 1;
+			else if (argflag == 'd')
 				options_used[OPTION_D] = 1;
 			else
 				options_used[OPTION_F] = 1;
@@ -625,6 +1350,17 @@ int main(int argc, char *argv[])
 		case 'e':
 			options_used[OPTION_E] = 1;
 			break;
+		case 'V':
+			nvparam_format = atoi(optarg);
+			if (nvparam_format < NVPARAM_FORMAT_FIXED ||
+			    nvparam_format > NVPARAM_FORMAT_LOG) {
+				log_printf(LOG_ERROR,
+					   "Unsupported NVPARAM format %s\n",
+					   optarg);
+				ret = 1;
+				goto exit_free;
+			}
+			break;
 		case 'h':
 			options_used[OPTION_H] = 1;
 		default:
@@ -635,7 +1371,33 @@ int main(int argc, char *argv[])
 	}
 
 	/* Sanitize user inputs */
-	if (!options_used[OPTION_O]) {
+	if (options_used[OPTION_B] &&
+	    (options_used[OPTION_C] || options_used[OPTION_D] ||
+	     options_used[OPTION_F] || options_used[OPTION_R] ||
+	     options_used[OPTION_S] || options_used[OPTION_L] ||
+	     options_used[OPTION_E] || options_used[OPTION_O])) {
+		log_printf(LOG_ERROR,
+			   "Option -b can't be mixed with other commands "
+			   "or -o.\n");
+		help(argv[0]);
+		ret = 1;
+		goto exit_free;
+	}
+
+	if (options_used[OPTION_VERIFY_ALL] &&
+	    (options_used[OPTION_C] || options_used[OPTION_D] ||
+	     options_used[OPTION_F] || options_used[OPTION_R] ||
+	     options_used[OPTION_S] || options_used[OPTION_L] ||
+	     options_used[OPTION_E] || options_used[OPTION_B])) {
+		log_printf(LOG_ERROR,
+			   "Option --verify-all can't be mixed with other "
+			   "commands.\n");
+		help(argv[0]);
+		ret = 1;
+		goto exit_free;
+	}
+
+	if (!options_used[OPTION_O] && !options_used[OPTION_B]) {
 		log_printf(LOG_ERROR, "SPI offset must be specified\n");
 		help(argv[0]);
 		ret = 1;
@@ -697,31 +1459,7 @@ int main(int argc, char *argv[])
 	 */
 
 	/* Finding the MTD partition for host boot SPI chip */
-	if ((proc_fp = fopen(PROC_MTD_INFO, "r")) == NULL) {
-		log_printf(LOG_ERROR, "Unable to open %s to get MTD info...\n",
-			   PROC_MTD_INFO);
-		goto out;
-	}
-
-	while (fgets(proc_buf, sizeof(proc_buf), proc_fp) != NULL) {
-		/* Try to find "HOST SPI" for BIOS flash */
-		if (strstr(proc_buf, HOST_SPI_FLASH_MTD_NAME)) {
-			temp = strtok(proc_buf, ":");
-			if (temp == NULL) {
-				log_printf(
-					LOG_ERROR,
-					"Error in finding the BIOS Partition \n");
-				fclose(proc_fp);
-				goto out;
-			}
-
-			memcpy((char *)&temp_mtd, (char *)&temp[3],
-			       (strlen(temp) - 3));
-			nMTDDeviceNumber = atoi(temp_mtd);
-			break;
-		}
-	}
-	fclose(proc_fp);
+	nMTDDeviceNumber = mtd_find_host_device();
 
 	if (nMTDDeviceNumber == -1) {
 		log_printf(
@@ -738,42 +1476,64 @@ int main(int argc, char *argv[])
 
 	argv_dev_ptr = &mtd_dev[0];
 
-	dev_fd = flash_open(argv_dev_ptr, O_SYNC | O_RDWR);
-	if (dev_fd < 0) {
+	/* Open the MTD device, with its geometry */
+	if (flash_dev_open_mtd(&mtd, argv_dev_ptr) < 0) {
 		ret = 1;
 		goto out;
 	}
 
-	/* Get the MTD device info */
-	ret = ioctl(dev_fd, MEMGETINFO, &mtd);
-	if (ret < 0)
-		goto out;
-
 	/* Process user inputs */
+	if (options_used[OPTION_B]) {
+		if (nvparam_batch(&mtd, filepath) < 0) {
+			ret = 1;
+			goto out;
+		}
+		flash_dev_print_stats(&mtd);
+	}
+
+	if (options_used[OPTION_VERIFY_ALL]) {
+		if (validate_input_offset(offset) < 0) {
+			ret = 1;
+			goto out;
+		}
+
+		if (nvparam_verify_all(&mtd, offset) != 0) {
+			ret = 1;
+			goto out;
+		}
+	}
+
 	if (options_used[OPTION_C]) {
 		if (validate_input_offset(offset) < 0) {
 			ret = 1;
 			goto out;
 		}
 
-		if (flash_erase(dev_fd, offset, NVPARAM_PARTITION_SIZE) < 0) {
+		if (flash_erase(&mtd, offset, NVPARAM_PARTITION_SIZE) < 0) {
 			log_printf(LOG_ERROR, "Failed to erase\n");
 			ret = 1;
 			goto out;
 		}
+
+		if (nvparam_format >= NVPARAM_FORMAT_LOG &&
+		    nvparam_format_log(&mtd, offset) < 0) {
+			log_printf(LOG_ERROR, "Failed to format NVPARAM\n");
+			ret = 1;
+			goto out;
+		}
 	}
 
 	if (options_used[OPTION_D]) {
 		struct nvparam_entry
-			blob[mtd.erasesize / sizeof(struct nvparam_entry)];
-		ulong nvparam_base = (offset / mtd.erasesize) * mtd.erasesize;
+			blob[mtd.erase_size / sizeof(struct nvparam_entry)];
+		ulong nvparam_base = (offset / mtd.erase_size) * mtd.erase_size;
 
 		if (validate_input_offset(offset) < 0) {
 			ret = 1;
 			goto out;
 		}
 
-		if (nvparam_get(dev_fd, nvparam_base, (void *)&blob) < 0) {
+		if (nvparam_get(&mtd, nvparam_base, (void *)&blob) < 0) {
 			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
 			ret = 1;
 			goto out;
@@ -808,127 +1568,107 @@ int main(int argc, char *argv[])
 			goto out;
 		}
 
-		if (flash_erase(dev_fd, offset, filestat.st_size) < 0) {
-			log_printf(LOG_ERROR, "Failed to erase\n");
-			ret = 1;
-			goto out;
-		}
-		if (flash_write(dev_fd, fil_fd, offset, filepath,
+		if (flash_write(&mtd, fil_fd, offset, filepath,
 				input_offset) < 0) {
 			ret = 1;
 			goto out;
 		}
-		if (flash_verify(dev_fd, fil_fd, offset, filepath,
+		if (flash_verify(&mtd, fil_fd, offset, filepath,
 				 input_offset) < 0) {
 			ret = 1;
 			goto out;
 		}
+		flash_dev_print_stats(&mtd);
 	}
 
 	if (options_used[OPTION_S]) {
 		struct nvparam_entry
-			blob[mtd.erasesize / sizeof(struct nvparam_entry)];
-		ulong nvparam_base = (offset / mtd.erasesize) * mtd.erasesize;
+			blob[mtd.erase_size / sizeof(struct nvparam_entry)];
+		ulong nvparam_base = (offset / mtd.erase_size) * mtd.erase_size;
 		uint entry_no =
 			(offset - nvparam_base) / sizeof(struct nvparam_entry);
+		struct nvparam_entry entry;
 
-		if (nvparam_get(dev_fd, nvparam_base, (void *)&blob) < 0) {
+		if (nvparam_get(&mtd, nvparam_base, (void *)&blob) < 0) {
 			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
 			ret = 1;
 			goto out;
 		}
+		if (nvparam_check_format(blob, nvparam_base) < 0) {
+			ret = 1;
+			goto out;
+		}
 
-		blob[entry_no].param1 = value;
+		entry.param1 = value;
 		/*
 		 * Set acl_rd, acl_wr and valid to all 1s as requirement of
 		 * host firmware team.
 		 */
-		blob[entry_no].acl_rd = 0xFF;
-		blob[entry_no].acl_wr = 0x7F;
-		blob[entry_no].valid = 1;
-		/*
-		 * Calculate NVPRAM entry CRC16. CRC16 is calculated on whole NVPARAM
-		 * entry with crc16 = 0
-		 */
-		blob[entry_no].crc16 = 0;
-		blob[entry_no].crc16 = crc16((uint8_t *)&blob[entry_no],
-					     sizeof(struct nvparam_entry));
-
-		if (flash_erase(dev_fd, nvparam_base, sizeof(blob)) < 0) {
-			log_printf(LOG_ERROR, "Failed to erase\n");
-			ret = 1;
-			goto out;
-		}
-
-		ret = flash_rewind(dev_fd, nvparam_base, NULL);
-		if (ret < 0) {
-			ret = 1;
-			goto out;
-		}
-
-		ret = write(dev_fd, (void *)blob, sizeof(blob));
-		if (ret < 0) {
+		entry.acl_rd = 0xFF;
+		entry.acl_wr = 0x7F;
+		entry.valid = 1;
+		entry.crc16 = nvparam_entry_crc(&entry);
+
+		if (nvparam_set_entry(&mtd, nvparam_base, blob, entry_no,
+				      &entry) < 0) {
+			log_printf(LOG_ERROR, "Failed to write NVPARAM\n");
 			ret = 1;
 			goto out;
 		}
+		ret = 0;
 	}
 
 	if (options_used[OPTION_E]) {
 		struct nvparam_entry
-			blob[mtd.erasesize / sizeof(struct nvparam_entry)];
-		ulong nvparam_base = (offset / mtd.erasesize) * mtd.erasesize;
+			blob[mtd.erase_size / sizeof(struct nvparam_entry)];
+		ulong nvparam_base = (offset / mtd.erase_size) * mtd.erase_size;
 		uint entry_no =
 			(offset - nvparam_base) / sizeof(struct nvparam_entry);
+		struct nvparam_entry entry;
 
-		if (nvparam_get(dev_fd, nvparam_base, (void *)&blob) < 0) {
+		if (nvparam_get(&mtd, nvparam_base, (void *)&blob) < 0) {
 			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
 			ret = 1;
 			goto out;
 		}
-
-		memset((void *)&blob[entry_no], 0xFF,
-		       sizeof(struct nvparam_entry));
-
-		if (flash_erase(dev_fd, nvparam_base, sizeof(blob)) < 0) {
-			log_printf(LOG_ERROR, "Failed to erase\n");
+		if (nvparam_check_format(blob, nvparam_base) < 0) {
 			ret = 1;
 			goto out;
 		}
 
-		ret = flash_rewind(dev_fd, nvparam_base, NULL);
-		if (ret < 0) {
-			ret = 1;
-			goto out;
-		}
+		memset((void *)&entry, 0xFF, sizeof(struct nvparam_entry));
 
-		ret = write(dev_fd, (void *)blob, sizeof(blob));
-		if (ret < 0) {
+		if (nvparam_set_entry(&mtd, nvparam_base, blob, entry_no,
+				      &entry) < 0) {
+			log_printf(LOG_ERROR, "Failed to write NVPARAM\n");
 			ret = 1;
 			goto out;
 		}
+		ret = 0;
 	}
 
 	if (options_used[OPTION_L]) {
 		struct nvparam_entry
-			blob[mtd.erasesize / sizeof(struct nvparam_entry)];
-		ulong nvparam_base = (offset / mtd.erasesize) * mtd.erasesize;
-		int tmp_crc16, cal_crc16 = 0, found_records = 0;
-		uint index, max_items = mtd.erasesize /
-					sizeof(struct nvparam_entry);
+			blob[mtd.erase_size / sizeof(struct nvparam_entry)];
+		ulong nvparam_base = (offset / mtd.erase_size) * mtd.erase_size;
+		int found_records = 0;
+		uint index, max_items = nvparam_slots();
 
-		if (nvparam_get(dev_fd, nvparam_base, (void *)&blob) < 0) {
+		if (nvparam_get(&mtd, nvparam_base, (void *)&blob) < 0) {
 			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
 			ret = 1;
 			goto out;
 		}
+		if (nvparam_check_format(blob, nvparam_base) < 0) {
+			ret = 1;
+			goto out;
+		}
+		nvparam_apply_log(blob);
 
 		/* List out all valid NVPARAM (CRC field is identical with calculated CRC) */
 		for (index = 0; index < max_items; index++) {
-			tmp_crc16 = blob[index].crc16;
-			blob[index].crc16 = 0;
-			cal_crc16 = crc16((uint8_t *)&blob[index],
-					  sizeof(struct nvparam_entry));
-			if (tmp_crc16 == cal_crc16) {
+			if (blob[index].crc16 ==
+			    nvparam_entry_crc(&blob[index])) {
 				log_printf(
 					LOG_NORMAL,
 					"NVPARAM at 0x%x: 0x%08x (ACL_RD:0x%x - ACL_WR:0x%x)\n",
@@ -947,17 +1687,22 @@ int main(int argc, char *argv[])
 
 	if (options_used[OPTION_R]) {
 		struct nvparam_entry
-			blob[mtd.erasesize / sizeof(struct nvparam_entry)];
-		ulong nvparam_base = (offset / mtd.erasesize) * mtd.erasesize;
+			blob[mtd.erase_size / sizeof(struct nvparam_entry)];
+		ulong nvparam_base = (offset / mtd.erase_size) * mtd.erase_size;
 		uint entry_no =
 			(offset - nvparam_base) / sizeof(struct nvparam_entry);
-		int tmp_crc16, cal_crc16 = 0;
+		int cal_crc16 = 0;
 
-		if (nvparam_get(dev_fd, nvparam_base, (void *)&blob) < 0) {
+		if (nvparam_get(&mtd, nvparam_base, (void *)&blob) < 0) {
 			log_printf(LOG_ERROR, "Failed to read NVPARAM\n");
 			ret = 1;
 			goto out;
 		}
+		if (nvparam_check_format(blob, nvparam_base) < 0) {
+			ret = 1;
+			goto out;
+		}
+		nvparam_apply_log(blob);
 
 		log_printf(LOG_NORMAL,
 			   "NVPARAM at 0x%x:\n"
@@ -969,15 +1714,8 @@ int main(int argc, char *argv[])
 			   offset, blob[entry_no].param1, blob[entry_no].acl_rd,
 			   blob[entry_no].acl_wr, blob[entry_no].valid,
 			   blob[entry_no].crc16);
-		tmp_crc16 = blob[entry_no].crc16;
-		/*
-		 * Calculate NVPRAM entry CRC16. CRC16 is calculated on whole NVPARAM
-		 * entry with crc16 = 0
-		 */
-		blob[entry_no].crc16 = 0;
-		cal_crc16 = crc16((uint8_t *)&blob[entry_no],
-				  sizeof(struct nvparam_entry));
-		if (tmp_crc16 != cal_crc16)
+		cal_crc16 = nvparam_entry_crc(&blob[entry_no]);
+		if (blob[entry_no].crc16 != cal_crc16)
 			log_printf(LOG_NORMAL,
 				   " (Mismatch! Calculated CRC16: %x)\n",
 				   cal_crc16);
@@ -986,7 +1724,7 @@ int main(int argc, char *argv[])
 	}
 
 out:
-	close(dev_fd);
+	flash_dev_close(&mtd);
 	close(fil_fd);
 exit_free:
 	if (filepath) {
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2023 Ampere Computing LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CRC16_REF_H_
+#define _CRC16_REF_H_
+
+#include <stdint.h>
+
+/*
+ * Bitwise CRC16 nvparm used before flash_crc16, kept as the reference.
+ * Only the start value was added, the old loop always started from 0.
+ */
+static inline int crc16_ref(int crc, const uint8_t *ptr, int count)
+{
+	int i;
+
+	while (--count >= 0) {
+		crc = crc ^ (int)*ptr++ << 8;
+		for (i = 0; i < 8; ++i) {
+			if (crc & 0x8000)
+				crc = crc << 1 ^ 0x1021;
+			else
+				crc = crc << 1;
+		}
+	}
+	return crc & 0xffff;
+}
+
+/* xorshift32, the tests want the same buffers on every run */
+static inline uint32_t crc16_ref_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+#endif /* _CRC16_REF_H_ */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 Ampere Computing LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Cross-check of the table-driven flash_crc16 against the bitwise loop
+ * nvparm used before, so entries written by either keep verifying.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash-io.h"
+#include "crc16_ref.h"
+
+#define MAX_LEN	    1024
+#define RANDOM_RUNS 20000
+
+static int failures;
+
+static void check(const char *what, uint16_t start, const uint8_t *buf,
+		  size_t len)
+{
+	uint16_t got = flash_crc16(start, buf, len);
+	int want = crc16_ref(start, buf, (int)len);
+
+	if (got != want && failures++ < 10)
+		printf("%s: len %zu start 0x%04x: flash_crc16 0x%04x, bitwise 0x%04x\n",
+		       what, len, start, got, want);
+}
+
+int main(void)
+{
+	static uint8_t buf[MAX_LEN];
+	uint32_t seed = 0x4e564c32;
+	size_t len, split, i;
+	uint16_t start;
+	int run;
+
+	/* known answer, CRC-16/XMODEM of "123456789" */
+	if (flash_crc16(0, "123456789", 9) != 0x31c3) {
+		printf("check value: 0x%04x, expected 0x31c3\n",
+		       flash_crc16(0, "123456789", 9));
+		failures++;
+	}
+
+	/* every single byte, from 0 and from a non zero start */
+	for (i = 0; i < 256; i++) {
+		buf[0] = (uint8_t)i;
+		check("byte", 0, buf, 1);
+		check("byte", 0xffff, buf, 1);
+	}
+
+	/* erased and zeroed entries, as met by --verify-all */
+	memset(buf, 0xff, sizeof(buf));
+	for (len = 0; len <= 64; len++)
+		check("erased", 0, buf, len);
+	memset(buf, 0, sizeof(buf));
+	for (len = 0; len <= 64; len++)
+		check("zero", 0, buf, len);
+
+	for (run = 0; run < RANDOM_RUNS; run++) {
+		len = crc16_ref_rand(&seed) % (MAX_LEN + 1);
+		start = run & 1 ? (uint16_t)crc16_ref_rand(&seed) : 0;
+		for (i = 0; i < len; i++)
+			buf[i] = (uint8_t)crc16_ref_rand(&seed);
+		check("random", start, buf, len);
+
+		/* a CRC carried over two calls matches one call */
+		split = len ? crc16_ref_rand(&seed) % len : 0;
+		if (flash_crc16(flash_crc16(start, buf, split), buf + split,
+				len - split) != flash_crc16(start, buf, len) &&
+		    failures++ < 10)
+			printf("split: len %zu at %zu differs\n", len, split);
+	}
+
+	if (failures) {
+		printf("flash_crc16: %d mismatches\n", failures);
+		return 1;
+	}
+	printf("flash_crc16: matches the bitwise CRC16\n");
+	return 0;
+}
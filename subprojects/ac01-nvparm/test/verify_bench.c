@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2023 Ampere Computing LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * CRC side of the nvparm dump and --verify-all paths: every 8 byte entry
+ * of a 64KB partition is checked against its CRC16, once with flash_crc16
+ * and once with the bitwise loop it replaced. Fails when the two disagree
+ * on an entry or when the table is not MIN_SPEEDUP times faster.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash-io.h"
+#include "crc16_ref.h"
+
+#define NVPARAM_PARTITION_SIZE (64 * 1024)
+#define ENTRY_SIZE	       8
+#define ENTRIES		       (NVPARAM_PARTITION_SIZE / ENTRY_SIZE)
+#define PASSES		       200
+#define MIN_SPEEDUP	       2
+
+struct verify_count {
+	int valid;
+	int empty;
+	int corrupt;
+};
+
+/* CRC16 of an entry with its crc16 field, the last two bytes, cleared */
+static int entry_crc(const uint8_t *entry, int table)
+{
+	uint8_t tmp[ENTRY_SIZE];
+
+	memcpy(tmp, entry, ENTRY_SIZE);
+	tmp[6] = 0;
+	tmp[7] = 0;
+	if (table)
+		return flash_crc16(0, tmp, ENTRY_SIZE);
+	return crc16_ref(0, tmp, ENTRY_SIZE);
+}
+
+static int entry_stored_crc(const uint8_t *entry)
+{
+	return entry[6] | entry[7] << 8;
+}
+
+static int entry_erased(const uint8_t *entry)
+{
+	int i;
+
+	for (i = 0; i < ENTRY_SIZE; i++)
+		if (entry[i] != 0xff)
+			return 0;
+	return 1;
+}
+
+static uint64_t verify_pass(const uint8_t *part, int table,
+			    struct verify_count *count)
+{
+	uint64_t start = flash_now_us();
+	const uint8_t *entry;
+	int i;
+
+	memset(count, 0, sizeof(*count));
+	for (i = 0; i < ENTRIES; i++) {
+		entry = part + i * ENTRY_SIZE;
+		if (entry_stored_crc(entry) == entry_crc(entry, table))
+			count->valid++;
+		else if (entry_erased(entry))
+			count->empty++;
+		else
+			count->corrupt++;
+	}
+	return flash_now_us() - start;
+}
+
+int main(void)
+{
+	struct verify_count table, bitwise, count;
+	uint64_t table_us = 0, bitwise_us = 0;
+	uint32_t seed = 0x4e564c32;
+	uint8_t *part, *entry;
+	int i, crc;
+
+	part = malloc(NVPARAM_PARTITION_SIZE);
+	if (!part) {
+		printf("malloc failure\n");
+		return 1;
+	}
+
+	/* half programmed, a few corrupt, the rest erased */
+	memset(part, 0xff, NVPARAM_PARTITION_SIZE);
+	for (i = 0; i < ENTRIES / 2; i++) {
+		entry = part + i * ENTRY_SIZE;
+		memset(entry, 0, ENTRY_SIZE);
+		entry[0] = (uint8_t)crc16_ref_rand(&seed);
+		entry[1] = (uint8_t)crc16_ref_rand(&seed);
+		entry[5] = 0x80; /* valid */
+		crc = crc16_ref(0, entry, ENTRY_SIZE);
+		entry[6] = crc & 0xff;
+		entry[7] = crc >> 8;
+		if (i % 97 == 0)
+			entry[0] ^= 0x01;
+	}
+
+	verify_pass(part, 1, &table);
+	verify_pass(part, 0, &bitwise);
+	if (memcmp(&table, &bitwise, sizeof(table))) {
+		printf("table %d/%d/%d, bitwise %d/%d/%d valid/empty/corrupt\n",
+		       table.valid, table.empty, table.corrupt, bitwise.valid,
+		       bitwise.empty, bitwise.corrupt);
+		free(part);
+		return 1;
+	}
+
+	for (i = 0; i < PASSES; i++) {
+		table_us += verify_pass(part, 1, &count);
+		bitwise_us += verify_pass(part, 0, &count);
+	}
+	free(part);
+
+	printf("%d entries, %d valid, %d empty, %d corrupt\n", ENTRIES,
+	       table.valid, table.empty, table.corrupt);
+	printf("flash_crc16: %llu us per pass\n",
+	       (unsigned long long)(table_us / PASSES));
+	printf("bitwise:     %llu us per pass\n",
+	       (unsigned long long)(bitwise_us / PASSES));
+
+	if (table_us * MIN_SPEEDUP > bitwise_us) {
+		printf("flash_crc16 is less than %dx faster than the bitwise loop\n",
+		       MIN_SPEEDUP);
+		return 1;
+	}
+	return 0;
+}
@@ -16,6 +16,8 @@
 #define WRITE_DISABLE_INS_LENGTH 3
 #define PROGRAM_INS_LENGTH	 22
 #define READ_DATA_INS_LENGTH	 20
+#define READ_STATUS_INS_LENGTH	 4
+#define READ_STATUS_DATA_LENGTH	 2
 
 #define VERSION_DATA_LENGTH 2
 
@@ -30,6 +32,14 @@
 #define PAGE_PROGRAM  0x02
 #define READ_DATA     0x03
 #define WRITE_DISABLE 0x04
+#define READ_STATUS_REG 0x05
+
+// SPI flash status register
+#define SPI_STATUS_WIP 0x01
+
+// Fixed waits of the original flow, used unless built with ANLOGIC_WIP_POLL
+#define SECTOR_ERASE_DELAY_US 300000
+#define PAGE_PROGRAM_DELAY_US 1000
 
 // Anlogic Device Info
 #define PAGE_SIZE   16
@@ -4,15 +4,19 @@
 #include "ast-jtag.h"
 
 struct jtag_ops {
-	int (*open)();
-	void (*close)();
-	void (*set_mode)(unsigned int);
-	unsigned int (*get_freq)();
-	int (*set_freq)(unsigned int);
-	int (*run_test_idle)(unsigned char, unsigned char, unsigned char);
-	int (*sir_xfer)(unsigned char, unsigned int, unsigned int);
-	int (*tdo_xfer)(unsigned char, unsigned int, unsigned int *);
-	int (*tdi_xfer)(unsigned char, unsigned int, unsigned int *);
+	int (*open)(struct ast_jtag *, int);
+	void (*close)(struct ast_jtag *);
+	void (*set_mode)(struct ast_jtag *, unsigned int);
+	unsigned int (*get_freq)(struct ast_jtag *);
+	int (*set_freq)(struct ast_jtag *, unsigned int);
+	int (*run_test_idle)(struct ast_jtag *, unsigned char, unsigned char,
+			     unsigned char);
+	int (*sir_xfer)(struct ast_jtag *, unsigned char, unsigned int,
+			unsigned int);
+	int (*tdo_xfer)(struct ast_jtag *, unsigned char, unsigned int,
+			unsigned int *);
+	int (*tdi_xfer)(struct ast_jtag *, unsigned char, unsigned int,
+			unsigned int *);
 };
 
 #endif
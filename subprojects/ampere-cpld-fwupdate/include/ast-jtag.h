@@ -10,18 +10,30 @@ typedef uint64_t __u64;
 #define JTAG_DEVICE0 "/dev/jtag0"
 #define JTAG_DEVICE1 "/dev/jtag1"
 
+struct jtag_ops;
+
+/* One JTAG master, the backend is picked on the first use */
+struct ast_jtag {
+	int fd;
+	unsigned int mode;
+	const struct jtag_ops *ops;
+};
+
+#define AST_JTAG_INIT { .fd = -1, .mode = 0, .ops = NULL }
+
 /******************************************************************************************************************/
-void ast_jtag_set_mode(unsigned int mode);
-int ast_jtag_open(int jtag);
-void ast_jtag_close(void);
-unsigned int ast_get_jtag_freq(void);
-int ast_set_jtag_freq(unsigned int freq);
-int ast_jtag_run_test_idle(unsigned char reset, unsigned char end,
-			   unsigned char tck);
-int ast_jtag_sir_xfer(unsigned char endir, unsigned int len, unsigned int tdi);
-int ast_jtag_tdo_xfer(unsigned char enddr, unsigned int len,
-		      unsigned int *tdio);
-int ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len,
-		      unsigned int *tdio);
+void ast_jtag_set_mode(struct ast_jtag *jtag, unsigned int mode);
+int ast_jtag_open(struct ast_jtag *jtag, int jtag_device);
+void ast_jtag_close(struct ast_jtag *jtag);
+unsigned int ast_get_jtag_freq(struct ast_jtag *jtag);
+int ast_set_jtag_freq(struct ast_jtag *jtag, unsigned int freq);
+int ast_jtag_run_test_idle(struct ast_jtag *jtag, unsigned char reset,
+			   unsigned char end, unsigned char tck);
+int ast_jtag_sir_xfer(struct ast_jtag *jtag, unsigned char endir,
+		      unsigned int len, unsigned int tdi);
+int ast_jtag_tdo_xfer(struct ast_jtag *jtag, unsigned char enddr,
+		      unsigned int len, unsigned int *tdio);
+int ast_jtag_tdi_xfer(struct ast_jtag *jtag, unsigned char enddr,
+		      unsigned int len, unsigned int *tdio);
 
 #endif /* __AST_JTAG_H__ */
@@ -0,0 +1,58 @@
+#ifndef _CPLD_JOURNAL_H_
+#define _CPLD_JOURNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Update journal
+ *
+ * One small record per target, rewritten in place and synced at each
+ * step of an update: the image it belongs to (size and CRC32), whether the
+ * flash has been erased and how many CF rows are known to be programmed.
+ * A run that finds a record for the same image can skip the erase and
+ * continue after the last recorded row. The record is removed once the
+ * update has been verified, and also when programming or verify fails:
+ * the flash content is then unknown and the next run erases it again.
+ */
+#define CPLD_JOURNAL_DIR      "/var/lib/ampere-cpld-fwupdate"
+#define CPLD_JOURNAL_MAGIC    0x4A444C43 /* "CLDJ" */
+#define CPLD_JOURNAL_VERSION  1
+#define CPLD_JOURNAL_INTERVAL 64 /* CF rows between two records */
+
+enum cpld_journal_state {
+	CPLD_JOURNAL_NONE = 0, /* no update in progress */
+	CPLD_JOURNAL_ERASED = 1, /* flash erased, programming CF */
+	CPLD_JOURNAL_UFM = 2, /* CF done, programming UFM */
+};
+
+struct cpld_journal_rec {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t image_size;
+	uint32_t image_crc;
+	uint32_t state;
+	uint32_t rows; /* CF rows programmed */
+	uint32_t crc; /* CRC32 of the fields above */
+};
+
+struct cpld_journal {
+	int fd;
+	char path[128];
+	struct cpld_journal_rec rec;
+};
+
+int cpld_journal_open(struct cpld_journal *j, const char *name,
+		      const void *image, size_t size);
+/* CF row to resume from, -1 when the update has to start over */
+int cpld_journal_resume(const struct cpld_journal *j);
+int cpld_journal_set(struct cpld_journal *j, enum cpld_journal_state state,
+		     unsigned int rows);
+/* record progress every CPLD_JOURNAL_INTERVAL rows */
+void cpld_journal_row(struct cpld_journal *j, unsigned int rows);
+void cpld_journal_done(struct cpld_journal *j);
+/* the update failed, the next run starts over with an erase */
+void cpld_journal_discard(struct cpld_journal *j);
+void cpld_journal_close(struct cpld_journal *j);
+
+#endif /* _CPLD_JOURNAL_H_ */
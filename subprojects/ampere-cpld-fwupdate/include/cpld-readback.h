@@ -0,0 +1,34 @@
+#ifndef _CPLD_READBACK_H_
+#define _CPLD_READBACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Readback stream
+ *
+ * Rows and pages read back from the flash are folded in as they arrive.
+ * The JED style 16-bit byte sum and a CRC32 of the data are kept up to
+ * date, and when the image data is given each row is compared with a
+ * single memcmp, so verify can stop at the first bad row without holding
+ * a second copy of the image.
+ */
+struct cpld_readback {
+	unsigned int sum;
+	uint32_t crc;
+	unsigned int rows;
+};
+
+void cpld_readback_init(struct cpld_readback *rb);
+/* 0 when data matches expect (or expect is NULL), -1 on mismatch */
+int cpld_readback_row(struct cpld_readback *rb, const void *data,
+		      const void *expect, size_t len);
+unsigned int cpld_readback_sum(const struct cpld_readback *rb);
+uint32_t cpld_readback_crc32(const struct cpld_readback *rb);
+
+/* sum of all bytes, as used by the JED C field */
+unsigned int cpld_byte_sum(const void *data, size_t len);
+/* CRC32 (IEEE 802.3), pass 0 as crc for the first block */
+uint32_t cpld_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif /* _CPLD_READBACK_H_ */
@@ -0,0 +1,76 @@
+#ifndef _CPLD_SIM_H_
+#define _CPLD_SIM_H_
+
+#include <stdint.h>
+#include "ast-jtag-intf.h"
+
+/*
+ * Simulated CPLDs
+ *
+ * Software models of the devices handled by lattice.c and anlogic.c, for
+ * running the update paths without hardware. The JTAG side is a jtag_ops
+ * backend installed in ctx->jtag.ops before the probe, the I2C side
+ * replaces i2c-lib.c at link time. Each model answers its IDCODE/ID reads,
+ * reports busy for the configured program and erase times and keeps the
+ * flash contents, so an update can be checked against the image
+ * afterwards. Every call that is an ioctl on the real driver is counted.
+ */
+enum cpld_sim_family {
+	CPLD_SIM_XO3LF_9400 = 0,
+	CPLD_SIM_XO3LF_4300 = 1,
+	CPLD_SIM_XO3D_9400 = 2,
+	CPLD_SIM_YZBB = 3,
+	CPLD_SIM_ANLOGIC = 4,
+	CPLD_SIM_FAMILY_MAX
+};
+
+struct cpld_sim_stats {
+	unsigned long ioctls; /* driver calls, one per JTAG scan or I2C xfer */
+	unsigned long bytes; /* payload moved in both directions */
+	unsigned long busy_polls; /* status reads answered with busy */
+	unsigned long erases;
+	unsigned long programs; /* rows or pages programmed */
+	unsigned long reads; /* rows or pages read */
+	unsigned long errors; /* commands the device would reject */
+};
+
+struct cpld_sim_model {
+	const char *name;
+	uint32_t idcode;
+	int jtag; /* reachable over JTAG as well as I2C */
+	int spi; /* SPI NOR behind the bridge instead of CF/UFM rows */
+	unsigned int cf_rows; /* or SPI size in bytes */
+	unsigned int ufm_rows;
+	/* busy time of each operation (us) */
+	uint32_t erase_us;
+	uint32_t program_us;
+	uint32_t done_us;
+};
+
+struct cpld_sim;
+
+extern const struct jtag_ops cpld_sim_jtag_ops;
+extern const struct cpld_sim_model cpld_sim_models[CPLD_SIM_FAMILY_MAX];
+
+/* scale every busy time, in percent (0 is never busy) */
+void cpld_sim_set_busy_scale(unsigned int percent);
+/*
+ * fastest TCK the simulated board carries cleanly (Hz, 0 is no limit), above
+ * it every third JTAG read returns a flipped bit
+ */
+void cpld_sim_set_tck_limit(unsigned int hz);
+
+/*
+ * Attach a model to a JTAG master (bus is the jtag device) or an I2C
+ * address. The flash starts out holding seed derived contents.
+ */
+struct cpld_sim *cpld_sim_add(enum cpld_sim_family family, int jtag, int bus,
+			      int slave, unsigned int seed);
+void cpld_sim_remove(struct cpld_sim *sim);
+
+const struct cpld_sim_stats *cpld_sim_stats(const struct cpld_sim *sim);
+/* rows of a sector (0 CF, 1 UFM) or the SPI flash bytes, NULL if none */
+const void *cpld_sim_flash(const struct cpld_sim *sim, int sector);
+uint32_t cpld_sim_usercode(const struct cpld_sim *sim);
+
+#endif /* _CPLD_SIM_H_ */
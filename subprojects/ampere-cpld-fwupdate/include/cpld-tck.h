@@ -0,0 +1,46 @@
+#ifndef _CPLD_TCK_H_
+#define _CPLD_TCK_H_
+
+#include <stdint.h>
+
+/*
+ * JTAG TCK tuning
+ *
+ * cpld_program() takes a reference sample of the detected device with its
+ * cpld_sample op (IDCODE, USERCODE and the first CF row) at the slowest
+ * step of CPLD_TCK_STEPS, then raises TCK one step at a time. Devices
+ * without the op keep the driver TCK. A step is good when CPLD_TCK_SAMPLES
+ * samples all match the reference. The first bad step ends the search, the
+ * last good one has to pass CPLD_TCK_CONFIRM more samples or TCK backs off
+ * further. The result is cached per JTAG master and IDCODE, a later run
+ * only checks the cached frequency once before using it.
+ */
+#define CPLD_TCK_STEPS                                                         \
+	{ 1000000, 2000000, 4000000, 6000000, 8000000, 12000000, 16000000,     \
+	  25000000 }
+#define CPLD_TCK_SAMPLES 8
+#define CPLD_TCK_CONFIRM 32
+#define CPLD_TCK_CACHE	 "/var/lib/ampere-cpld-fwupdate/tck-jtag%d"
+#define CPLD_TCK_MAGIC	 0x4B434354 /* "TCCK" */
+
+struct cpld_tck_sample {
+	uint32_t idcode;
+	uint32_t usercode;
+	uint32_t row[4];
+};
+
+struct cpld_tck_rec {
+	uint32_t magic;
+	uint32_t idcode;
+	uint32_t freq;
+	uint32_t crc; /* CRC32 of the fields above */
+};
+
+struct cpld_ctx;
+
+/* pick TCK for a detected JTAG device, keeps the driver setting on failure */
+int cpld_tck_tune(struct cpld_ctx *ctx);
+/* drop the cached frequency of a JTAG master */
+void cpld_tck_forget(int jtag_device);
+
+#endif /* _CPLD_TCK_H_ */
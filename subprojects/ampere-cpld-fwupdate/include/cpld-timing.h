@@ -0,0 +1,53 @@
+#ifndef _CPLD_TIMING_H_
+#define _CPLD_TIMING_H_
+
+#include <stdint.h>
+
+/*
+ * Device timing profile
+ *
+ * Each cpld_dev_info entry carries the datasheet typical and maximum time
+ * of its slow operations. Completion is polled with an exponential back-off
+ * starting well below the typical time, and given up after the maximum time
+ * times CPLD_POLL_MARGIN.
+ */
+#define CPLD_POLL_MARGIN 2
+#define CPLD_POLL_MIN_US 10
+
+enum cpld_op {
+	CPLD_OP_CMD = 0, /* enable/disable and other short commands */
+	CPLD_OP_ERASE = 1, /* flash (sector) erase */
+	CPLD_OP_PROGRAM = 2, /* one row/page program */
+	CPLD_OP_USERCODE = 3, /* USERCODE program */
+	CPLD_OP_DONE = 4, /* DONE bit program */
+	CPLD_OP_READ = 5, /* page read turnaround */
+	CPLD_OP_MAX
+};
+
+struct cpld_op_timing {
+	uint32_t typ_us;
+	uint32_t max_us;
+};
+
+struct cpld_timing {
+	struct cpld_op_timing op[CPLD_OP_MAX];
+};
+
+/* measured latency of one operation type, kept per device context */
+struct cpld_op_stats {
+	unsigned long count;
+	uint64_t total_us;
+	uint64_t max_us;
+};
+
+struct cpld_ctx;
+
+/* return 0 when the operation is done, > 0 while busy, < 0 on error */
+typedef int (*cpld_poll_fn)(struct cpld_ctx *ctx, void *arg);
+
+int cpld_poll(struct cpld_ctx *ctx, enum cpld_op op, cpld_poll_fn poll,
+	      void *arg);
+void cpld_wait(struct cpld_ctx *ctx, enum cpld_op op);
+void cpld_timing_report(struct cpld_ctx *ctx);
+
+#endif /* _CPLD_TIMING_H_ */
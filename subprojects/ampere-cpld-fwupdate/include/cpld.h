@@ -5,7 +5,12 @@
 extern "C" {
 #endif
 
+#include <stdio.h>
 #include <stdint.h>
+#include "ast-jtag.h"
+#include "cpld-timing.h"
+#include "cpld-journal.h"
+#include "cpld-tck.h"
 
 typedef enum { INTF_I2C, INTF_JTAG } cpld_intf_t;
 
@@ -27,17 +32,48 @@ typedef struct {
 	int bus;
 	int slave;
 	int jtag_device;
+	int fast_update; /* skip up to date devices and blank rows */
+	unsigned int tck; /* JTAG TCK (Hz), 0 tunes it in cpld_program() */
 } cpld_intf_info_t;
 
-int cpld_probe(cpld_intf_t intf, cpld_intf_info_t *attr);
-int cpld_scan(cpld_intf_t intf);
-int cpld_intf_close(cpld_intf_t intf);
-int cpld_get_ver(uint32_t *ver);
-int cpld_get_checksum(char *file, uint32_t *crc);
-int cpld_get_device_id(uint32_t *dev_id);
-int cpld_erase(void);
-int cpld_program(char *file, char *key, char is_signed);
-int cpld_verify(char *file);
+typedef void (*cpld_progress_fn)(struct cpld_ctx *ctx, const char *stage,
+				 unsigned int done, unsigned int total);
+
+/*
+ * Per-device context
+ *
+ * Everything the library knows about one CPLD: the interface it sits on,
+ * the detected device, the open JTAG master and the measured operation
+ * latencies. Contexts are independent, devices on different buses can be
+ * updated from different threads.
+ */
+struct cpld_ctx {
+	cpld_intf_info_t info;
+	struct cpld_dev_info *dev;
+	struct ast_jtag jtag;
+	struct cpld_op_stats stats[CPLD_OP_MAX];
+	struct cpld_journal journal;
+	/* row progress, printed on stdout when not set */
+	cpld_progress_fn progress;
+	void *priv;
+};
+
+void cpld_ctx_init(struct cpld_ctx *ctx);
+void cpld_progress(struct cpld_ctx *ctx, const char *stage, unsigned int done,
+		   unsigned int total);
+
+int cpld_probe(struct cpld_ctx *ctx, cpld_intf_t intf,
+	       cpld_intf_info_t *attr);
+int cpld_scan(struct cpld_ctx *ctx, cpld_intf_t intf);
+int cpld_intf_close(struct cpld_ctx *ctx, cpld_intf_t intf);
+int cpld_get_ver(struct cpld_ctx *ctx, uint32_t *ver);
+int cpld_get_checksum(struct cpld_ctx *ctx, char *file, uint32_t *crc);
+int cpld_get_device_id(struct cpld_ctx *ctx, uint32_t *dev_id);
+int cpld_erase(struct cpld_ctx *ctx);
+int cpld_program(struct cpld_ctx *ctx, char *file, char *key, char is_signed);
+int cpld_verify(struct cpld_ctx *ctx, char *file);
+
+const struct cpld_timing *cpld_get_timing(struct cpld_ctx *ctx);
 
 struct cpld_dev_info {
 	const char *name;
@@ -45,14 +81,21 @@ struct cpld_dev_info {
 	uint32_t dev_id2;
 	uint32_t dev_id3;
 	uint32_t dev_id4;
-	int (*cpld_open)(cpld_intf_t intf, cpld_intf_info_t *attr);
-	int (*cpld_close)(cpld_intf_t intf);
-	int (*cpld_ver)(uint32_t *ver);
-	int (*cpld_checksum)(FILE *fd, uint32_t *crc);
-	int (*cpld_erase)(void);
-	int (*cpld_program)(FILE *fd, char *key, char is_signed);
-	int (*cpld_verify)(FILE *fd);
-	int (*cpld_dev_id)(uint32_t *dev_id);
+	int (*cpld_open)(struct cpld_ctx *ctx, cpld_intf_t intf,
+			 cpld_intf_info_t *attr);
+	int (*cpld_close)(struct cpld_ctx *ctx, cpld_intf_t intf);
+	int (*cpld_ver)(struct cpld_ctx *ctx, uint32_t *ver);
+	int (*cpld_checksum)(struct cpld_ctx *ctx, FILE *fd, uint32_t *crc);
+	int (*cpld_erase)(struct cpld_ctx *ctx);
+	int (*cpld_program)(struct cpld_ctx *ctx, FILE *fd, char *key,
+			    char is_signed);
+	int (*cpld_verify)(struct cpld_ctx *ctx, FILE *fd);
+	int (*cpld_dev_id)(struct cpld_ctx *ctx, uint32_t *dev_id);
+	/* read-only JTAG sample for the TCK tuning, NULL if not supported */
+	int (*cpld_sample)(struct cpld_ctx *ctx, struct cpld_tck_sample *s);
+	const struct cpld_timing *timing;
+	/* an interrupted update can continue at any CF row */
+	int resumable;
 };
 
 enum {
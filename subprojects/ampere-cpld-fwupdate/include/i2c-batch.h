@@ -0,0 +1,30 @@
+#ifndef _I2C_BATCH_H_
+#define _I2C_BATCH_H_
+
+#include <stdint.h>
+#include "i2c-lib.h"
+
+/*
+ * I2C transfer batch
+ *
+ * Writes and reads are queued and sent as the messages of a single
+ * I2C_RDWR ioctl, the adapter puts a repeated START between two messages
+ * and a STOP after the last one. The buffers given to i2c_batch_add() have
+ * to stay valid until the batch is flushed. Unlike the JTAG queue there is
+ * no replay on failure, a program command must not be sent twice.
+ */
+struct i2c_batch {
+	int file;
+	struct i2c_xfer_msg msgs[I2C_XFER_MAX_MSGS];
+	unsigned int count;
+	unsigned long flushes; /* number of ioctls sent */
+	unsigned long sent; /* number of messages sent */
+};
+
+void i2c_batch_init(struct i2c_batch *b, int file);
+/* a write of tbuf followed by a read into rbuf, either may be empty */
+int i2c_batch_add(struct i2c_batch *b, uint8_t addr, uint8_t *tbuf,
+		  uint16_t tcount, uint8_t *rbuf, uint16_t rcount);
+int i2c_batch_flush(struct i2c_batch *b);
+
+#endif /* _I2C_BATCH_H_ */
@@ -10,4 +10,21 @@ int i2c_open(uint8_t bus_num, uint8_t addr);
 int i2c_rdwr_msg_transfer(int file, uint8_t addr, uint8_t *tbuf,
 			  uint16_t tcount, uint8_t *rbuf, uint16_t rcount);
 
+/*
+ * One message of a combined I2C_RDWR transfer. Kept apart from struct
+ * i2c_msg so that callers need no kernel headers, addr is the 8-bit
+ * address like for i2c_rdwr_msg_transfer().
+ */
+#define I2C_XFER_MAX_MSGS 42 /* I2C_RDWR_IOCTL_MAX_MSGS */
+
+struct i2c_xfer_msg {
+	uint8_t addr;
+	uint8_t read;
+	uint16_t len;
+	uint8_t *buf;
+};
+
+int i2c_rdwr_msgs(int file, const struct i2c_xfer_msg *msgs,
+		  unsigned int count);
+
 #endif /* CPLDUPDATE_I2C_LIB_H_ */
@@ -0,0 +1,51 @@
+#ifndef _JED_IMAGE_H_
+#define _JED_IMAGE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * JED image
+ *
+ * The image file is mapped once and tokenised in a single pass. Fuse rows
+ * of the CF, UFM and EndCF sections are packed into contiguous arrays of
+ * JED_ROW_WORDS words per row, fuse 0 of each word in bit 0, which is the
+ * layout the JTAG and I2C programming paths shift out. The C field of the
+ * file is checked against the sum of the packed bytes while parsing.
+ *
+ * Images that are not JED files (e.g. ANLOGIC binaries) only use the raw
+ * mapping in data/size.
+ */
+#define JED_ROW_BITS  128
+#define JED_ROW_WORDS (JED_ROW_BITS / 32)
+
+struct jed_image {
+	/* raw file mapping */
+	const unsigned char *data;
+	size_t size;
+
+	/* parsed JED content */
+	unsigned long int QF;
+	unsigned int *CF;
+	unsigned int CF_Line;
+	unsigned int *UFM;
+	unsigned int UFM_Line;
+	unsigned int *EndCF;
+	unsigned int EndCF_Line;
+	unsigned int Version;
+	unsigned int CheckSum;
+	unsigned int FEARBits;
+	unsigned int FeatureRow;
+
+	/* allocated rows of CF/UFM/EndCF */
+	unsigned int CF_Cap;
+	unsigned int UFM_Cap;
+	unsigned int EndCF_Cap;
+};
+
+int jed_image_map(struct jed_image *img, FILE *fp);
+int jed_image_parse(struct jed_image *img);
+int jed_image_load(struct jed_image *img, FILE *fp);
+void jed_image_free(struct jed_image *img);
+
+#endif /* _JED_IMAGE_H_ */
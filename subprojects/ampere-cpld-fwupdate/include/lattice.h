@@ -42,8 +42,16 @@
 #define LCMXO2_LSC_READ_INCR_NV	   0x73
 #define LCMXO2_ISC_PROGRAM_DONE	   0x5E
 #define LCMXO2_ISC_DISABLE	   0x26
+#define LCMXO2_LSC_WRITE_ADDRESS   0xB4
 #define BYPASS			   0xFF
 
+/* LSC_WRITE_ADDRESS operand: sector select + page number */
+#define LCMXO2_ADDR_CF	0x00000000
+#define LCMXO2_ADDR_UFM 0x40000000
+
+/* pages returned by one LSC_READ_INCR_NV over I2C */
+#define LCMXO2_I2C_READ_PAGES 16
+
 /*************************************************************************************/
 #if 0
 /* LC LCMXO2-2000HC */
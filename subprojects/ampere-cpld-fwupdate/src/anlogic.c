@@ -4,11 +4,12 @@
 #include <string.h>
 #include "ast-jtag.h"
 #include "cpld.h"
+#include "cpld-timing.h"
 #include "anlogic.h"
+#include "jed-image.h"
+#include "cpld-readback.h"
 #include "i2c-lib.h"
 
-static cpld_intf_info_t cpld;
-
 //#define DEBUG
 //#define VERBOSE_DEBUG
 #ifdef DEBUG
@@ -27,27 +28,33 @@ static cpld_intf_info_t cpld;
 /******************************************************************************/
 /***************************     JTAG       ***********************************/
 /******************************************************************************/
-static int jtag_cpld_get_ver(unsigned int *ver)
+static int jtag_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
+	UNUSED(ctx);
 	UNUSED(ver);
 	return 0;
 }
 
-static int jtag_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int jtag_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd, char *key,
+			    char is_signed)
 {
+	UNUSED(ctx);
 	UNUSED(jed_fd);
 	UNUSED(key);
 	UNUSED(is_signed);
 	return 0;
 }
 
-static int jtag_cpld_get_id(unsigned int *dev_id)
+static int jtag_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
+	UNUSED(ctx);
 	UNUSED(dev_id);
 	return 0;
 }
-static int jtag_cpld_checksum(FILE *jed_fd, unsigned int *crc)
+static int jtag_cpld_checksum(struct cpld_ctx *ctx, FILE *jed_fd,
+			      unsigned int *crc)
 {
+	UNUSED(ctx);
 	UNUSED(jed_fd);
 	UNUSED(crc);
 	return 0;
@@ -57,24 +64,97 @@ static int jtag_cpld_checksum(FILE *jed_fd, unsigned int *crc)
 /***************************      I2C       ***********************************/
 /******************************************************************************/
 
-static int i2c_read_fw_data(unsigned char *data_buffer, unsigned long data_size)
+#ifdef ANLOGIC_WIP_POLL
+/*
+ * Read the SPI flash status register through the bridge, framed like a
+ * data read: the opcode and one clock byte, then the 00 terminator
+ * I2C 02 05 00 00 STOP
+ * and after the read turnaround
+ * I2C dummy0 status STOP
+ */
+static int i2c_poll_wip(struct cpld_ctx *ctx, void *arg)
+{
+	uint8_t cmd[READ_STATUS_INS_LENGTH] = { WRITE_DATA_TO_SPI,
+						READ_STATUS_REG, 0x00, 0x00 };
+	uint8_t status[READ_STATUS_DATA_LENGTH] = { 0 };
+
+	UNUSED(arg);
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, cmd,
+				  sizeof(cmd), NULL, 0) < 0) {
+		return -1;
+	}
+	cpld_wait(ctx, CPLD_OP_READ);
+
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, NULL, 0,
+				  status, sizeof(status)) < 0) {
+		return -1;
+	}
+
+	return status[1] & SPI_STATUS_WIP;
+}
+#endif
+
+/*
+ * Wait for a sector erase or page program. Until the WIP polling has been
+ * validated on hardware it is only built with ANLOGIC_WIP_POLL, otherwise
+ * the fixed delay of the original flow is kept.
+ */
+static int i2c_wait_wip(struct cpld_ctx *ctx, enum cpld_op op,
+			useconds_t delay_us)
+{
+#ifdef ANLOGIC_WIP_POLL
+	UNUSED(delay_us);
+	return cpld_poll(ctx, op, i2c_poll_wip, NULL);
+#else
+	UNUSED(ctx);
+	UNUSED(op);
+	usleep(delay_us);
+	return 0;
+#endif
+}
+
+/*
+ * Write enable, then a program or erase command, as two STOP-terminated
+ * transfers:
+ * I2C 02 06 00 STOP
+ * I2C 02 cmd addr2 addr1 addr0 .. 00 STOP
+ * Completion is polled separately with i2c_wait_wip().
+ */
+static int i2c_write_cmd(struct cpld_ctx *ctx, uint8_t *cmd, uint16_t len)
+{
+	uint8_t write_en[WRITE_ENABLE_INS_LENGTH] = { WRITE_DATA_TO_SPI,
+						      WRITE_ENABLE, 0x00 };
+	uint8_t addr = ctx->info.slave << 1;
+	int ret;
+
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, addr, write_en,
+				    sizeof(write_en), NULL, 0);
+	if (ret != 0)
+		return ret;
+	cpld_wait(ctx, CPLD_OP_CMD);
+
+	return i2c_rdwr_msg_transfer(ctx->info.fd, addr, cmd, len, NULL, 0);
+}
+
+/*
+ * Read the flash back page by page and fold each page into rb as it
+ * arrives. When expect is given the page is compared with the image and
+ * the read stops at the first page that differs.
+ */
+static int i2c_readback(struct cpld_ctx *ctx, const unsigned char *expect,
+			unsigned long data_size, struct cpld_readback *rb)
 {
 	int ret = 0;
 	unsigned char prog_buf[PROGRAM_INS_LENGTH];
 	unsigned char read_buf[READ_DATA_INS_LENGTH];
-	unsigned int index = 0;
-	unsigned int row_count, col_count;
-
-	row_count =
-		data_size / PAGE_SIZE + ((data_size % PAGE_SIZE != 0) ? 1 : 0);
-	col_count = PAGE_SIZE;
+	unsigned long index = 0;
+	unsigned int len, i;
 
-	memset(data_buffer, 0, data_size);
 	memset(prog_buf, 0, PROGRAM_INS_LENGTH);
 	memset(read_buf, 0, READ_DATA_INS_LENGTH);
 
 	//!!Read the Flash
-	while (row_count > 0) {
+	while (index < data_size) {
 		// Read 16 data from address
 		// I2C 02 03 addr2 addr1 addr0 00 00 .. 00 (16 bytes) 00 STOP
 		prog_buf[0] = WRITE_DATA_TO_SPI;
@@ -82,65 +162,54 @@ static int i2c_read_fw_data(unsigned char *data_buffer, unsigned long data_size)
 		prog_buf[2] = (index >> 16) & 0x0000FF;
 		prog_buf[3] = (index >> 8) & 0x0000FF;
 		prog_buf[4] = index & 0x0000FF;
-		if (i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, prog_buf,
-					  PROGRAM_INS_LENGTH, NULL, 0) < 0) {
+		if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+					  prog_buf, PROGRAM_INS_LENGTH, NULL,
+					  0) < 0) {
 			ret = -1;
 			printf("Can not send read cmd row fw data\n");
 			return ret;
 		}
-		usleep(1000);
+		cpld_wait(ctx, CPLD_OP_READ);
 
 		// Read data from ram buff to i2c interface
 		// I2C dummy0 dummy1 dummy2 dummy3 data0 data1 .. data15 STOP
-		if (i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, NULL, 0,
-					  (uint8_t *)read_buf,
+		if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+					  NULL, 0, (uint8_t *)read_buf,
 					  READ_DATA_INS_LENGTH) < 0) {
 			ret = -1;
 			printf("Can not read cmd row fw data\n");
 			return ret;
 		}
-		memcpy(&data_buffer[index], &read_buf[4], PAGE_SIZE);
-
-		index += col_count;
-		row_count--;
-	}
-
-	return ret;
-}
-
-static int i2c_compare_data(unsigned char *read_buffer,
-			    unsigned char *compare_data,
-			    unsigned long data_size)
-{
-	unsigned int i;
-	int ret = 0;
 
-	if (compare_data != 0) {
-		printf("Starting read back value, and compare with file\n");
-		for (i = 0; i < data_size; i++) {
-			if (read_buffer[i] != compare_data[i]) {
-				printf("VERIFY ERROR!! ERROR at Index %08x\n",
-				       i);
-				printf("ERROR at row %d\n",
-				       (unsigned int)(i / PAGE_SIZE));
-				printf("The file Value is 0x%x, Read Back Value is 0x%x\n",
-				       compare_data[i], read_buffer[i]);
-				ret = -1;
-				break;
-			} else {
-				if (compare_data[i] != 0 &&
-				    read_buffer[i] != 0) {
-					//                    CPLD_DEBUG("At Row[%d]: The file Value is %08x,"
-					//                                "Read Back Value is %08x",(unsigned int)(i/PAGE_SIZE), compare_data[i], read_buffer[i]);
-				}
+		// the last page of the image may be partial
+		len = (data_size - index < PAGE_SIZE) ? data_size - index :
+							PAGE_SIZE;
+		if (cpld_readback_row(rb, &read_buf[4],
+				      expect ? &expect[index] : NULL,
+				      len) < 0) {
+			for (i = 0; i < len; i++) {
+				if (read_buf[4 + i] != expect[index + i])
+					break;
 			}
+			printf("VERIFY ERROR!! ERROR at Index %08lx\n",
+			       index + i);
+			printf("ERROR at row %d\n",
+			       (unsigned int)(index / PAGE_SIZE));
+			printf("The file Value is 0x%x, Read Back Value is 0x%x\n",
+			       expect[index + i], read_buf[4 + i]);
+			return -1;
 		}
+
+		index += len;
+		if (expect)
+			cpld_progress(ctx, "Verify Data", index / PAGE_SIZE,
+				      (data_size + PAGE_SIZE - 1) / PAGE_SIZE);
 	}
 
 	return ret;
 }
 
-static int i2c_cpld_start()
+static int i2c_cpld_start(struct cpld_ctx *ctx)
 {
 	uint8_t cmd[CFG_SPI_INS_LENGTH] = { CFG_SPI_INTERFACE, 0xF0 };
 	int ret = -1;
@@ -149,18 +218,18 @@ static int i2c_cpld_start()
 	//!!Config SPI Interface by I2C Master
 	// SS4  SS3  SS2  SS1  SS0  DIR  CPHA  CPOL
 	// 1    1    1    1    0    0    0     0
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, cmd, sizeof(cmd),
-				    NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, cmd,
+				    sizeof(cmd), NULL, 0);
 	if (ret != 0) {
 		printf("i2c_cpld_start() program done failed\n");
 		return ret;
 	}
-	usleep(100);
+	cpld_wait(ctx, CPLD_OP_CMD);
 
 	return 0;
 }
 
-static int i2c_cpld_end()
+static int i2c_cpld_end(struct cpld_ctx *ctx)
 {
 	uint8_t cmd[WRITE_DISABLE_INS_LENGTH] = { WRITE_DATA_TO_SPI,
 						  WRITE_DISABLE, 0x00 };
@@ -170,23 +239,22 @@ static int i2c_cpld_end()
 	//!!Write disable
 	// I2C 02 04 00 STOP
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, cmd, sizeof(cmd),
-				    NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, cmd,
+				    sizeof(cmd), NULL, 0);
 	if (ret != 0) {
 		printf("i2c_cpld_end() program done failed\n");
 		return ret;
 	}
-	usleep(100);
+	cpld_wait(ctx, CPLD_OP_CMD);
 
 	return 0;
 }
 
-static int i2c_cpld_erase(unsigned long data_size)
+static int i2c_cpld_erase(struct cpld_ctx *ctx, unsigned long data_size)
 {
 	int ret = 0;
 	unsigned int i;
 	unsigned char cmd[SECTOR_ERASE_INS_LENGTH];
-	unsigned int write_en = 0;
 	unsigned int using_sectors = 0;
 	unsigned int addr = 0;
 
@@ -195,53 +263,43 @@ static int i2c_cpld_erase(unsigned long data_size)
 
 	printf("Starting to erase device... (this will take a few seconds)\n");
 	//-----------------------------------------------
-	//!!Write enable
-	// I2C 02 06 00 STOP
-	write_en = (WRITE_ENABLE << 8) | WRITE_DATA_TO_SPI;
-
-	//!!Erase the Flash
+	//!!Erase the Flash, each sector after its own write enable
 	// I2C 02 20 addr2 addr1 addr0 00 STOP
 	cmd[0] = WRITE_DATA_TO_SPI;
 	cmd[1] = SECTOR_ERASE;
 	cmd[5] = 0x00;
 
 	for (i = 0; i < using_sectors; i++) {
-		// Write Enable
-		if (i2c_rdwr_msg_transfer(
-			    cpld.fd, cpld.slave << 1, (uint8_t *)&write_en,
-			    WRITE_ENABLE_INS_LENGTH, NULL, 0) < 0) {
-			ret = -1;
-			return ret;
-		}
-		usleep(100);
-
 		addr = i * SECTOR_SIZE;
 		cmd[2] = (addr >> 16) & 0x0000FF;
 		cmd[3] = (addr >> 8) & 0x0000FF;
 		cmd[4] = addr & 0x0000FF;
 
-		// Sector Erase
-		if (i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, cmd,
-					  SECTOR_ERASE_INS_LENGTH, NULL,
-					  0) < 0) {
+		// Write Enable + Sector Erase
+		ret = i2c_write_cmd(ctx, cmd, SECTOR_ERASE_INS_LENGTH);
+		if (ret < 0) {
+			return ret;
+		}
+		// Wait for the sector erase
+		ret = i2c_wait_wip(ctx, CPLD_OP_ERASE, SECTOR_ERASE_DELAY_US);
+		if (ret != 0) {
+			printf("Erase sector %d failed\n", i);
 			ret = -1;
 			return ret;
 		}
-		// Delay 300ms
-		usleep(300000);
 	}
 	//-----------------------------------------------
 
 	return ret;
 }
 
-static int i2c_cpld_program(unsigned char *buf, unsigned long data_size)
+static int i2c_cpld_program(struct cpld_ctx *ctx, const unsigned char *buf,
+			    unsigned long data_size)
 {
 	int ret = 0;
 	unsigned char prog_buf[PROGRAM_INS_LENGTH];
 	unsigned int index = 0;
 	unsigned int row_count, col_count;
-	unsigned int write_en = 0;
 	int flag = 0;
 
 	if (data_size % PAGE_SIZE)
@@ -251,39 +309,30 @@ static int i2c_cpld_program(unsigned char *buf, unsigned long data_size)
 
 	printf("Starting to program device... (this will take a few seconds)\n");
 	//-----------------------------------------------
-	//!!Write enable
-	// I2C 02 06 00 STOP
-	write_en = (WRITE_ENABLE << 8) | WRITE_DATA_TO_SPI;
-
-	//!!Program the Flash
+	//!!Program the Flash, each page after its own write enable
 	// I2C 02 02 addr2 addr1 addr0 data0 data1 .. data15 00 STOP
 	prog_buf[0] = WRITE_DATA_TO_SPI;
 	prog_buf[1] = PAGE_PROGRAM;
 	prog_buf[21] = 0x00;
 
 	while (row_count > 0) {
-		// Write Enable
-		if (i2c_rdwr_msg_transfer(
-			    cpld.fd, cpld.slave << 1, (uint8_t *)&write_en,
-			    WRITE_ENABLE_INS_LENGTH, NULL, 0) < 0) {
-			ret = -1;
-			return ret;
-		}
-		usleep(100);
-
 		prog_buf[2] = (index >> 16) & 0x0000FF;
 		prog_buf[3] = (index >> 8) & 0x0000FF;
 		prog_buf[4] = index & 0x0000FF;
 		memcpy(&prog_buf[5], &buf[index], PAGE_SIZE);
 
-		// Page Program
-		if (i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, prog_buf,
-					  PROGRAM_INS_LENGTH, NULL, 0) < 0) {
+		// Write Enable + Page Program
+		ret = i2c_write_cmd(ctx, prog_buf, PROGRAM_INS_LENGTH);
+		if (ret < 0) {
+			return ret;
+		}
+		// Wait for the page program
+		ret = i2c_wait_wip(ctx, CPLD_OP_PROGRAM, PAGE_PROGRAM_DELAY_US);
+		if (ret != 0) {
+			printf("Program page at %06x failed\n", index);
 			ret = -1;
 			return ret;
 		}
-		// Delay 1ms
-		usleep(1000);
 
 		index += col_count;
 		row_count--;
@@ -292,69 +341,56 @@ static int i2c_cpld_program(unsigned char *buf, unsigned long data_size)
 	if (flag) {
 		unsigned int last_bytes = data_size % PAGE_SIZE;
 
-		// Write Enable
-		if (i2c_rdwr_msg_transfer(
-			    cpld.fd, cpld.slave << 1, (uint8_t *)&write_en,
-			    WRITE_ENABLE_INS_LENGTH, NULL, 0) < 0) {
-			ret = -1;
-			return ret;
-		}
-		usleep(100);
-
 		prog_buf[2] = (index >> 16) & 0x0000FF;
 		prog_buf[3] = (index >> 8) & 0x0000FF;
 		prog_buf[4] = index & 0x0000FF;
 		memset(&prog_buf[5], 0, PAGE_SIZE);
 		memcpy(&prog_buf[5], &buf[index], last_bytes);
 
-		// Page Program
-		if (i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, prog_buf,
-					  PROGRAM_INS_LENGTH, NULL, 0) < 0) {
+		// Write Enable + Page Program
+		ret = i2c_write_cmd(ctx, prog_buf, PROGRAM_INS_LENGTH);
+		if (ret < 0) {
+			return ret;
+		}
+		// Wait for the page program
+		ret = i2c_wait_wip(ctx, CPLD_OP_PROGRAM, PAGE_PROGRAM_DELAY_US);
+		if (ret != 0) {
+			printf("Program page at %06x failed\n", index);
 			ret = -1;
 			return ret;
 		}
-		// Delay 1ms
-		usleep(1000);
 	}
 	//-----------------------------------------------
 
 	return ret;
 }
 
-static int i2c_cpld_verify(unsigned char *buf, unsigned long data_size)
+static int i2c_cpld_verify(struct cpld_ctx *ctx, const unsigned char *buf,
+			   unsigned long data_size)
 {
+	struct cpld_readback rb;
 	int ret = 0;
-	unsigned char *pCompare;
-
-	pCompare = (unsigned char *)malloc(data_size);
-	if (pCompare == NULL) {
-		printf("Unable to allocate memory\n");
-		return -1;
-	}
-	memset(pCompare, 0xff, data_size);
 
 	printf("Starting to verify device... (this will take a few seconds)\n");
 	//-----------------------------------------------
-	i2c_read_fw_data(pCompare, data_size);
-
-	//!!Compare
-	ret = i2c_compare_data(pCompare, buf, data_size);
+	//!!Read back and compare with the file
+	cpld_readback_init(&rb);
+	ret = i2c_readback(ctx, buf, data_size, &rb);
+	printf("\n");
 	if (ret == 0)
-		printf("Verify Done\n");
+		printf("Verify Done, CRC32 %08X\n", cpld_readback_crc32(&rb));
 	//-----------------------------------------------
 
-	free(pCompare);
-
 	return ret;
 }
 
-static int i2c_cpld_get_ver(unsigned int *ver)
+static int i2c_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
 	uint8_t cmd[READ_VER_INS_LENGTH] = { READ_VERSION };
 	uint8_t dr_data[VERSION_DATA_LENGTH];
 	int ret = -1;
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, ANLOGIC_CPLD_SLAVE << 1,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ANLOGIC_CPLD_SLAVE << 1,
 				    (uint8_t *)&cmd, READ_VER_INS_LENGTH,
 				    (uint8_t *)&dr_data, VERSION_DATA_LENGTH);
 	if (ret != 0) {
@@ -375,64 +411,56 @@ static int i2c_cpld_get_ver(unsigned int *ver)
 	return 0;
 }
 
-static int i2c_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int i2c_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd, char *key,
+			   char is_signed)
 {
+	struct jed_image image;
 	int ret;
-	int totalSize = 0;
-	int transCount = 0;
-	unsigned char *pMemBuffer = NULL;
 
 	UNUSED(key);
 	UNUSED(is_signed);
-	fseek(jed_fd, 0, SEEK_END);
-	totalSize = ftell(jed_fd);
-	printf("Total file size (%d)\n", totalSize);
-	fseek(jed_fd, 0, SEEK_SET);
-	// Read the image
-	pMemBuffer = (unsigned char *)malloc(totalSize);
-	if (pMemBuffer == NULL) {
-		printf("Unable to allocate memory\n");
-		return -1;
+	// Map the image
+	ret = jed_image_map(&image, jed_fd);
+	if (ret < 0) {
+		return ret;
 	}
-	memset(pMemBuffer, 0xff, totalSize);
-	transCount = fread(pMemBuffer, 1, totalSize, jed_fd);
-	printf("Total read size (%d)\n", transCount);
+	printf("Total file size (%zu)\n", image.size);
 
-	ret = i2c_cpld_start();
+	ret = i2c_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Program mode Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_erase(transCount);
+	ret = i2c_cpld_erase(ctx, image.size);
 	if (ret < 0) {
 		printf("[%s] Erase failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_program(pMemBuffer, transCount);
+	ret = i2c_cpld_program(ctx, image.data, image.size);
 	if (ret < 0) {
 		printf("[%s] Program failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_verify(pMemBuffer, transCount);
+	ret = i2c_cpld_verify(ctx, image.data, image.size);
 	if (ret < 0) {
 		printf("[%s] Verify Failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_end();
+	ret = i2c_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Program Mode Failed!\n", __func__);
 	}
 error_exit:
-	free(pMemBuffer);
+	jed_image_free(&image);
 
 	return ret;
 }
 
-static int i2c_cpld_get_id(unsigned int *dev_id)
+static int i2c_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
 	/* Get the ID in the UFM sector (address 0xCA).
      * All Anlogic CPLDs need to support this field. */
@@ -440,8 +468,8 @@ static int i2c_cpld_get_id(unsigned int *dev_id)
 	uint8_t dr_data[UFM_DATA_LENGTH];
 	int ret = -1;
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, cmd, sizeof(cmd),
-				    dr_data, sizeof(dr_data));
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, cmd,
+				    sizeof(cmd), dr_data, sizeof(dr_data));
 	if (ret != 0) {
 		printf("read_device_id() failed\n");
 		return ret;
@@ -464,50 +492,32 @@ static int i2c_cpld_get_id(unsigned int *dev_id)
 
 	return 0;
 }
-static int i2c_cpld_checksum(FILE *jed_fd, unsigned int *crc)
+static int i2c_cpld_checksum(struct cpld_ctx *ctx, FILE *jed_fd,
+			     unsigned int *crc)
 {
+	struct jed_image image;
+	struct cpld_readback rb;
 	int ret = 0;
-	int i;
-	int totalSize = 0;
-	int transCount = 0;
-	unsigned char *pMemBuffer = NULL;
-	unsigned char *pCompare = NULL;
-	unsigned int tmpCrc = 0;
-
-	fseek(jed_fd, 0, SEEK_END);
-	totalSize = ftell(jed_fd);
-	printf("Total file size (%d)\n", totalSize);
-	fseek(jed_fd, 0, SEEK_SET);
-	// Read the image
-	pMemBuffer = (unsigned char *)malloc(totalSize);
-	if (pMemBuffer == NULL) {
-		printf("Unable to allocate memory\n");
-		return -1;
-	}
-	memset(pMemBuffer, 0xff, totalSize);
-	transCount = fread(pMemBuffer, 1, totalSize, jed_fd);
-	printf("Total read size (%d)\n", transCount);
-	for (i = 0; i < transCount; i++) {
-		tmpCrc += pMemBuffer[i] & 0xFF;
-	}
-	tmpCrc &= 0xFFFF;
-	printf("File Checksum is %X\n", tmpCrc);
 
-	pCompare = (unsigned char *)malloc(transCount);
-	if (pCompare == NULL) {
-		printf("Unable to allocate memory\n");
-		return -1;
+	// Map the image
+	ret = jed_image_map(&image, jed_fd);
+	if (ret < 0) {
+		return ret;
 	}
-	memset(pCompare, 0xff, transCount);
-	i2c_read_fw_data(pCompare, transCount);
-	for (i = 0; i < transCount; i++) {
-		*crc += pMemBuffer[i] & 0xFF;
+	printf("Total file size (%zu)\n", image.size);
+	printf("File Checksum is %X\n",
+	       cpld_byte_sum(image.data, image.size) & 0xFFFF);
+
+	// Sum what is in the flash, not the file
+	cpld_readback_init(&rb);
+	ret = i2c_readback(ctx, NULL, image.size, &rb);
+	if (ret == 0) {
+		*crc = cpld_readback_sum(&rb);
+		printf("Fw Checksum is %X\n", *crc);
+		printf("Fw CRC32 is %08X\n", cpld_readback_crc32(&rb));
 	}
-	*crc &= 0xFFFF;
-	printf("Fw Checksum is %X\n", *crc);
 
-	free(pCompare);
-	free(pMemBuffer);
+	jed_image_free(&image);
 
 	return ret;
 }
@@ -516,48 +526,52 @@ static int i2c_cpld_checksum(FILE *jed_fd, unsigned int *crc)
 /***************************      Common       ********************************/
 /******************************************************************************/
 
-static int ANLOGICFamily_cpld_get_ver(unsigned int *ver)
+static int ANLOGICFamily_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
-	return (cpld.intf == INTF_JTAG) ? jtag_cpld_get_ver(ver) :
-					  i2c_cpld_get_ver(ver);
+	return (ctx->info.intf == INTF_JTAG) ? jtag_cpld_get_ver(ctx, ver) :
+					  i2c_cpld_get_ver(ctx, ver);
 }
 
-static int ANLOGICFamily_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int ANLOGICFamily_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd,
+				     char *key, char is_signed)
 {
-	return (cpld.intf == INTF_JTAG) ?
-		       jtag_cpld_update(jed_fd, key, is_signed) :
-		       i2c_cpld_update(jed_fd, key, is_signed);
+	return (ctx->info.intf == INTF_JTAG) ?
+		       jtag_cpld_update(ctx, jed_fd, key, is_signed) :
+		       i2c_cpld_update(ctx, jed_fd, key, is_signed);
 }
 
-static int ANLOGICFamily_cpld_get_id(unsigned int *dev_id)
+static int ANLOGICFamily_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
-	return (cpld.intf == INTF_JTAG) ? jtag_cpld_get_id(dev_id) :
-					  i2c_cpld_get_id(dev_id);
+	return (ctx->info.intf == INTF_JTAG) ? jtag_cpld_get_id(ctx, dev_id) :
+					  i2c_cpld_get_id(ctx, dev_id);
 }
 
-static int ANLOGICFamily_cpld_checksum(FILE *jed_fd, uint32_t *crc)
+static int ANLOGICFamily_cpld_checksum(struct cpld_ctx *ctx, FILE *jed_fd,
+				       uint32_t *crc)
 {
-	return (cpld.intf == INTF_JTAG) ? jtag_cpld_checksum(jed_fd, crc) :
-					  i2c_cpld_checksum(jed_fd, crc);
+	return (ctx->info.intf == INTF_JTAG) ? jtag_cpld_checksum(ctx, jed_fd,
+								  crc) :
+					  i2c_cpld_checksum(ctx, jed_fd, crc);
 }
 
-static int ANLOGICFamily_cpld_dev_open(cpld_intf_t intf, cpld_intf_info_t *attr)
+static int ANLOGICFamily_cpld_dev_open(struct cpld_ctx *ctx, cpld_intf_t intf,
+				       cpld_intf_info_t *attr)
 {
 	int rc = 0;
 
-	cpld.intf = intf;
+	ctx->info.intf = intf;
 	if (attr != NULL) {
-		cpld.bus = attr->bus;
-		cpld.slave = attr->slave;
-		cpld.mode = attr->mode;
+		ctx->info.bus = attr->bus;
+		ctx->info.slave = attr->slave;
+		ctx->info.mode = attr->mode;
 	}
 
 	if (intf == INTF_JTAG) {
-		ast_jtag_set_mode(JTAG_XFER_HW_MODE);
-		rc = ast_jtag_open(cpld.jtag_device);
+		ast_jtag_set_mode(&ctx->jtag, JTAG_XFER_HW_MODE);
+		rc = ast_jtag_open(&ctx->jtag, ctx->info.jtag_device);
 	} else if (intf == INTF_I2C) {
-		cpld.fd = i2c_open(cpld.bus, cpld.slave);
-		if (cpld.fd < 0)
+		ctx->info.fd = i2c_open(ctx->info.bus, ctx->info.slave);
+		if (ctx->info.fd < 0)
 			rc = -1;
 	} else {
 		printf("[%s] Interface type %d is not supported\n", __func__,
@@ -568,12 +582,12 @@ static int ANLOGICFamily_cpld_dev_open(cpld_intf_t intf, cpld_intf_info_t *attr)
 	return rc;
 }
 
-static int ANLOGICFamily_cpld_dev_close(cpld_intf_t intf)
+static int ANLOGICFamily_cpld_dev_close(struct cpld_ctx *ctx, cpld_intf_t intf)
 {
 	if (intf == INTF_JTAG) {
-		ast_jtag_close();
+		ast_jtag_close(&ctx->jtag);
 	} else if (intf == INTF_I2C) {
-		close(cpld.fd);
+		close(ctx->info.fd);
 	} else {
 		printf("[%s] Interface type %d is not supported\n", __func__,
 		       intf);
@@ -583,6 +597,22 @@ static int ANLOGICFamily_cpld_dev_close(cpld_intf_t intf)
 }
 
 /******************************************************************************/
+/*
+ * SPI NOR flash behind the ANLOGIC I2C bridge (us). Erase is per 4KB sector,
+ * program per 16 bytes page. Command and read turnaround of the bridge have
+ * no completion flag and always wait their maximum.
+ */
+static const struct cpld_timing anlogic_timing = {
+	.op = {
+		[CPLD_OP_CMD] = { 100, 100 },
+		[CPLD_OP_ERASE] = { 45000, 400000 },
+		[CPLD_OP_PROGRAM] = { 400, 3000 },
+		[CPLD_OP_USERCODE] = { 0, 0 },
+		[CPLD_OP_DONE] = { 0, 0 },
+		[CPLD_OP_READ] = { 1000, 1000 },
+	},
+};
+
 struct cpld_dev_info
 	anlogic_dev_list[] = { [0] = {
 				       .name = "ANLOGIC-Family",
@@ -597,4 +627,5 @@ struct cpld_dev_info
 				       .cpld_dev_id = ANLOGICFamily_cpld_get_id,
 				       .cpld_checksum =
 					       ANLOGICFamily_cpld_checksum,
+				       .timing = &anlogic_timing,
 			       } };
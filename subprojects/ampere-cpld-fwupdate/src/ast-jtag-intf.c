@@ -4,59 +4,59 @@
 
 extern struct jtag_ops jtag0_ops;
 
-static struct jtag_ops *jtag_ops = &jtag0_ops;
-
-__attribute__((constructor)) void __attribute__((constructor))
-ast_jtag_init(void)
+static const struct jtag_ops *jtag_ops(struct ast_jtag *jtag)
 {
-	if ((access(JTAG_DEVICE0, F_OK) == 0) ||
-	    (access(JTAG_DEVICE1, F_OK) == 0)) {
-		jtag_ops = &jtag0_ops;
-	}
+	if (jtag->ops == NULL)
+		jtag->ops = &jtag0_ops;
+
+	return jtag->ops;
 }
 
-void ast_jtag_set_mode(unsigned int mode)
+void ast_jtag_set_mode(struct ast_jtag *jtag, unsigned int mode)
 {
-	jtag_ops->set_mode(mode);
+	jtag_ops(jtag)->set_mode(jtag, mode);
 }
 
-int ast_jtag_open(int jtag_device)
+int ast_jtag_open(struct ast_jtag *jtag, int jtag_device)
 {
-	return jtag_ops->open(jtag_device);
+	return jtag_ops(jtag)->open(jtag, jtag_device);
 }
 
-void ast_jtag_close(void)
+void ast_jtag_close(struct ast_jtag *jtag)
 {
-	jtag_ops->close();
+	jtag_ops(jtag)->close(jtag);
 }
 
-unsigned int ast_get_jtag_freq(void)
+unsigned int ast_get_jtag_freq(struct ast_jtag *jtag)
 {
-	return jtag_ops->get_freq();
+	return jtag_ops(jtag)->get_freq(jtag);
 }
 
-int ast_set_jtag_freq(unsigned int freq)
+int ast_set_jtag_freq(struct ast_jtag *jtag, unsigned int freq)
 {
-	return jtag_ops->set_freq(freq);
+	return jtag_ops(jtag)->set_freq(jtag, freq);
 }
 
-int ast_jtag_run_test_idle(unsigned char reset, unsigned char end,
-			   unsigned char tck)
+int ast_jtag_run_test_idle(struct ast_jtag *jtag, unsigned char reset,
+			   unsigned char end, unsigned char tck)
 {
-	return jtag_ops->run_test_idle(reset, end, tck);
+	return jtag_ops(jtag)->run_test_idle(jtag, reset, end, tck);
 }
 
-int ast_jtag_sir_xfer(unsigned char endir, unsigned int len, unsigned int tdi)
+int ast_jtag_sir_xfer(struct ast_jtag *jtag, unsigned char endir,
+		      unsigned int len, unsigned int tdi)
 {
-	return jtag_ops->sir_xfer(endir, len, tdi);
+	return jtag_ops(jtag)->sir_xfer(jtag, endir, len, tdi);
 }
 
-int ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio)
+int ast_jtag_tdi_xfer(struct ast_jtag *jtag, unsigned char enddr,
+		      unsigned int len, unsigned int *tdio)
 {
-	return jtag_ops->tdi_xfer(enddr, len, tdio);
+	return jtag_ops(jtag)->tdi_xfer(jtag, enddr, len, tdio);
 }
 
-int ast_jtag_tdo_xfer(unsigned char enddr, unsigned int len, unsigned int *tdio)
+int ast_jtag_tdo_xfer(struct ast_jtag *jtag, unsigned char enddr,
+		      unsigned int len, unsigned int *tdio)
 {
-	return jtag_ops->tdo_xfer(enddr, len, tdio);
+	return jtag_ops(jtag)->tdo_xfer(jtag, enddr, len, tdio);
 }
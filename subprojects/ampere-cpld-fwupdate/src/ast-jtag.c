@@ -13,36 +13,33 @@
 #include "ast-jtag-intf.h"
 #include "ast-jtag.h"
 
-static unsigned int g_mode = 0;
-static int jtag_fd = -1;
-
-static void _ast_jtag_set_mode(unsigned int mode)
+static void _ast_jtag_set_mode(struct ast_jtag *jtag, unsigned int mode)
 {
-	g_mode = mode;
+	jtag->mode = mode;
 }
 
-static int _ast_jtag_open(int jtag_device)
+static int _ast_jtag_open(struct ast_jtag *jtag, int jtag_device)
 {
 	struct jtag_mode m;
 
 	if (jtag_device == 0) {
-		jtag_fd = open(JTAG_DEVICE0, O_RDWR);
+		jtag->fd = open(JTAG_DEVICE0, O_RDWR);
 	} else if (jtag_device == 1) {
-		jtag_fd = open(JTAG_DEVICE1, O_RDWR);
+		jtag->fd = open(JTAG_DEVICE1, O_RDWR);
 	} else {
 		perror("Can't open jtag driver, please install driver!! \n");
 		return -1;
 	}
-	if (jtag_fd == -1) {
+	if (jtag->fd == -1) {
 		perror("Can't open jtag driver, please install driver!! \n");
 		return -1;
 	}
 
-	if (g_mode != 0) {
+	if (jtag->mode != 0) {
 		m.feature = JTAG_XFER_MODE;
-		m.mode = g_mode;
+		m.mode = jtag->mode;
 		// Set to desired mode
-		if (ioctl(jtag_fd, JTAG_SIOCMODE, &m) < 0) {
+		if (ioctl(jtag->fd, JTAG_SIOCMODE, &m) < 0) {
 			perror("Failed to set JTAG mode!\n");
 			return -1;
 		}
@@ -51,20 +48,21 @@ static int _ast_jtag_open(int jtag_device)
 	return 0;
 }
 
-static void _ast_jtag_close(void)
+static void _ast_jtag_close(struct ast_jtag *jtag)
 {
-	close(jtag_fd);
+	close(jtag->fd);
+	jtag->fd = -1;
 }
 
-static unsigned int _ast_get_jtag_freq(void)
+static unsigned int _ast_get_jtag_freq(struct ast_jtag *jtag)
 {
 	int retval;
 	unsigned int freq = 0;
 
-	if (jtag_fd == -1)
+	if (jtag->fd == -1)
 		return 0;
 
-	retval = ioctl(jtag_fd, JTAG_GIOCFREQ, &freq);
+	retval = ioctl(jtag->fd, JTAG_GIOCFREQ, &freq);
 	if (retval == -1) {
 		perror("ioctl JTAG get freq fail!\n");
 		return 0;
@@ -73,14 +71,14 @@ static unsigned int _ast_get_jtag_freq(void)
 	return freq;
 }
 
-static int _ast_set_jtag_freq(unsigned int freq)
+static int _ast_set_jtag_freq(struct ast_jtag *jtag, unsigned int freq)
 {
 	int retval = 0;
 
-	if (jtag_fd == -1)
+	if (jtag->fd == -1)
 		return -1;
 
-	retval = ioctl(jtag_fd, JTAG_SIOCFREQ, &freq);
+	retval = ioctl(jtag->fd, JTAG_SIOCFREQ, &freq);
 	if (retval == -1) {
 		perror("ioctl JTAG set freq fail!\n");
 	}
@@ -95,20 +93,20 @@ static int _ast_set_jtag_freq(unsigned int freq)
  * @end: end state
  * @tck: tck cycles
  */
-static int _ast_jtag_run_test_idle(unsigned char reset, unsigned char end,
-				   unsigned char tck)
+static int _ast_jtag_run_test_idle(struct ast_jtag *jtag, unsigned char reset,
+				   unsigned char end, unsigned char tck)
 {
 	int retval = 0;
 	struct jtag_end_tap_state run_idle;
 
-	if (jtag_fd == -1)
+	if (jtag->fd == -1)
 		return -1;
 
 	run_idle.reset = reset;
 	run_idle.endstate = end;
 	run_idle.tck = tck;
 
-	retval = ioctl(jtag_fd, JTAG_SIOCSTATE, &run_idle);
+	retval = ioctl(jtag->fd, JTAG_SIOCSTATE, &run_idle);
 	if (retval == -1) {
 		perror("ioctl JTAG run reset fail!\n");
 	}
@@ -124,14 +122,14 @@ static int _ast_jtag_run_test_idle(unsigned char reset, unsigned char end,
  * @len: data length in bit
  * @tdi: instruction data
  */
-static int _ast_jtag_sir_xfer(unsigned char endir, unsigned int len,
-			      unsigned int tdi)
+static int _ast_jtag_sir_xfer(struct ast_jtag *jtag, unsigned char endir,
+			      unsigned int len, unsigned int tdi)
 {
 	int retval = 0;
 	struct jtag_xfer xfer;
 	unsigned long int addr = (unsigned long int)&tdi;
 
-	if (len > 32 || jtag_fd == -1) {
+	if (len > 32 || jtag->fd == -1) {
 		return -1;
 	}
 
@@ -141,7 +139,7 @@ static int _ast_jtag_sir_xfer(unsigned char endir, unsigned int len,
 	xfer.length = len;
 	xfer.tdio = addr;
 
-	retval = ioctl(jtag_fd, JTAG_IOCXFER, &xfer);
+	retval = ioctl(jtag->fd, JTAG_IOCXFER, &xfer);
 	if (retval == -1) {
 		perror("ioctl JTAG sir fail!\n");
 	}
@@ -157,15 +155,15 @@ static int _ast_jtag_sir_xfer(unsigned char endir, unsigned int len,
  * @len: data length in bit
  * @tdio: data array
  */
-static int _ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len,
-			      unsigned int *tdio)
+static int _ast_jtag_tdi_xfer(struct ast_jtag *jtag, unsigned char enddr,
+			      unsigned int len, unsigned int *tdio)
 {
 	/* write */
 	int retval = 0;
 	struct jtag_xfer xfer;
 	unsigned long int addr = (unsigned long int)tdio;
 
-	if (tdio == NULL || jtag_fd == -1) {
+	if (tdio == NULL || jtag->fd == -1) {
 		return -1;
 	}
 
@@ -175,7 +173,7 @@ static int _ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len,
 	xfer.length = len;
 	xfer.tdio = addr;
 
-	retval = ioctl(jtag_fd, JTAG_IOCXFER, &xfer);
+	retval = ioctl(jtag->fd, JTAG_IOCXFER, &xfer);
 	if (retval == -1) {
 		perror("ioctl JTAG data xfer fail!\n");
 	}
@@ -191,15 +189,15 @@ static int _ast_jtag_tdi_xfer(unsigned char enddr, unsigned int len,
  * @len: data length in bit
  * @tdio: data array
  */
-static int _ast_jtag_tdo_xfer(unsigned char enddr, unsigned int len,
-			      unsigned int *tdio)
+static int _ast_jtag_tdo_xfer(struct ast_jtag *jtag, unsigned char enddr,
+			      unsigned int len, unsigned int *tdio)
 {
 	/* read */
 	int retval = 0;
 	struct jtag_xfer xfer;
 	unsigned long int addr = (unsigned long int)tdio;
 
-	if (tdio == NULL || jtag_fd == -1) {
+	if (tdio == NULL || jtag->fd == -1) {
 		return -1;
 	}
 
@@ -209,7 +207,7 @@ static int _ast_jtag_tdo_xfer(unsigned char enddr, unsigned int len,
 	xfer.length = len;
 	xfer.tdio = addr;
 
-	retval = ioctl(jtag_fd, JTAG_IOCXFER, &xfer);
+	retval = ioctl(jtag->fd, JTAG_IOCXFER, &xfer);
 	if (retval == -1) {
 		perror("ioctl JTAG data xfer fail!\n");
 	}
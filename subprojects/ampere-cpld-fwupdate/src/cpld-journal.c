@@ -0,0 +1,144 @@
+/*
+ * CPLD update journal: resume an interrupted update
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cpld-journal.h"
+#include "cpld-readback.h"
+
+//#define DEBUG
+#ifdef DEBUG
+#define CPLD_DEBUG(...) printf(__VA_ARGS__);
+#else
+#define CPLD_DEBUG(...)
+#endif
+
+static uint32_t journal_crc(const struct cpld_journal_rec *rec)
+{
+	return cpld_crc32(0, rec, offsetof(struct cpld_journal_rec, crc));
+}
+
+static int journal_write(struct cpld_journal *j)
+{
+	j->rec.crc = journal_crc(&j->rec);
+
+	if (pwrite(j->fd, &j->rec, sizeof(j->rec), 0) != sizeof(j->rec) ||
+	    fdatasync(j->fd) < 0) {
+		printf("[%s] Cannot write %s: %s\n", __func__, j->path,
+		       strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Open the journal of the target called name. A record left behind by an
+ * interrupted update of the same image is kept, anything else is reset.
+ * Without a usable journal directory the update simply runs unjournaled.
+ */
+int cpld_journal_open(struct cpld_journal *j, const char *name,
+		      const void *image, size_t size)
+{
+	struct cpld_journal_rec rec;
+	uint32_t image_crc;
+
+	memset(j, 0, sizeof(*j));
+	j->fd = -1;
+
+	if (mkdir(CPLD_JOURNAL_DIR, 0755) < 0 && errno != EEXIST) {
+		printf("[%s] No update journal: %s\n", __func__,
+		       strerror(errno));
+		return -1;
+	}
+
+	snprintf(j->path, sizeof(j->path), "%s/%s", CPLD_JOURNAL_DIR, name);
+	j->fd = open(j->path, O_RDWR | O_CREAT, 0644);
+	if (j->fd < 0) {
+		printf("[%s] No update journal %s: %s\n", __func__, j->path,
+		       strerror(errno));
+		return -1;
+	}
+
+	image_crc = cpld_crc32(0, image, size);
+
+	if (pread(j->fd, &rec, sizeof(rec), 0) == sizeof(rec) &&
+	    rec.magic == CPLD_JOURNAL_MAGIC &&
+	    rec.version == CPLD_JOURNAL_VERSION &&
+	    rec.crc == journal_crc(&rec) && rec.image_size == size &&
+	    rec.image_crc == image_crc) {
+		j->rec = rec;
+		CPLD_DEBUG("[%s] %s: state %u, %u rows\n", __func__, j->path,
+			   rec.state, rec.rows);
+		return 0;
+	}
+
+	j->rec.magic = CPLD_JOURNAL_MAGIC;
+	j->rec.version = CPLD_JOURNAL_VERSION;
+	j->rec.image_size = size;
+	j->rec.image_crc = image_crc;
+	j->rec.state = CPLD_JOURNAL_NONE;
+
+	return journal_write(j);
+}
+
+int cpld_journal_resume(const struct cpld_journal *j)
+{
+	if (j->fd < 0 || j->rec.state != CPLD_JOURNAL_ERASED)
+		return -1;
+
+	return j->rec.rows;
+}
+
+int cpld_journal_set(struct cpld_journal *j, enum cpld_journal_state state,
+		     unsigned int rows)
+{
+	if (j->fd < 0)
+		return 0;
+
+	j->rec.state = state;
+	j->rec.rows = rows;
+
+	return journal_write(j);
+}
+
+void cpld_journal_row(struct cpld_journal *j, unsigned int rows)
+{
+	if (j->fd < 0 || rows % CPLD_JOURNAL_INTERVAL)
+		return;
+
+	cpld_journal_set(j, CPLD_JOURNAL_ERASED, rows);
+}
+
+void cpld_journal_done(struct cpld_journal *j)
+{
+	if (j->fd < 0)
+		return;
+
+	unlink(j->path);
+	cpld_journal_close(j);
+}
+
+void cpld_journal_discard(struct cpld_journal *j)
+{
+	if (j->fd < 0)
+		return;
+
+	printf("[%s] Update failed, the next update erases the flash again\n",
+	       __func__);
+	cpld_journal_done(j);
+}
+
+void cpld_journal_close(struct cpld_journal *j)
+{
+	if (j->fd < 0)
+		return;
+
+	close(j->fd);
+	j->fd = -1;
+}
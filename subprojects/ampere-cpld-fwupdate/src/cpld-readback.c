@@ -0,0 +1,118 @@
+/*
+ * CPLD readback: streaming compare, byte sum and CRC32
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "cpld-readback.h"
+
+#define CRC32_POLY 0xEDB88320 /* reflected 0x04C11DB7 */
+
+/* slicing-by-8 tables, crc32_table[0] is the classic byte table */
+static uint32_t crc32_table[8][256];
+
+static void __attribute__((constructor)) crc32_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (CRC32_POLY & -(crc & 1));
+		crc32_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc32_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = (crc >> 8) ^ crc32_table[0][crc & 0xff];
+			crc32_table[j][i] = crc;
+		}
+	}
+}
+
+uint32_t cpld_crc32(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	crc = ~crc;
+
+	/* 8 bytes per step, read byte by byte so the result is endian free */
+	while (len >= 8) {
+		crc ^= p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+		       (uint32_t)p[3] << 24;
+		crc = crc32_table[7][crc & 0xff] ^
+		      crc32_table[6][(crc >> 8) & 0xff] ^
+		      crc32_table[5][(crc >> 16) & 0xff] ^
+		      crc32_table[4][crc >> 24] ^ crc32_table[3][p[4]] ^
+		      crc32_table[2][p[5]] ^ crc32_table[1][p[6]] ^
+		      crc32_table[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+
+	return ~crc;
+}
+
+unsigned int cpld_byte_sum(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	unsigned int sum = 0;
+	uint64_t acc, v;
+	size_t n;
+
+	/*
+	 * Add the even and odd bytes of each 64-bit word into four 16-bit
+	 * lanes. A lane grows by at most 510 per word, fold it back every
+	 * 128 words before it can overflow.
+	 */
+	while (len >= 8) {
+		acc = 0;
+		for (n = 0; n < 128 && len >= 8; n++) {
+			memcpy(&v, p, sizeof(v));
+			acc += (v & 0x00ff00ff00ff00ffULL) +
+			       ((v >> 8) & 0x00ff00ff00ff00ffULL);
+			p += 8;
+			len -= 8;
+		}
+		sum += (acc & 0xffff) + ((acc >> 16) & 0xffff) +
+		       ((acc >> 32) & 0xffff) + (acc >> 48);
+	}
+
+	while (len--)
+		sum += *p++;
+
+	return sum;
+}
+
+void cpld_readback_init(struct cpld_readback *rb)
+{
+	memset(rb, 0, sizeof(*rb));
+}
+
+int cpld_readback_row(struct cpld_readback *rb, const void *data,
+		      const void *expect, size_t len)
+{
+	rb->sum += cpld_byte_sum(data, len);
+	rb->crc = cpld_crc32(rb->crc, data, len);
+	rb->rows++;
+
+	if (expect != NULL && memcmp(data, expect, len))
+		return -1;
+
+	return 0;
+}
+
+unsigned int cpld_readback_sum(const struct cpld_readback *rb)
+{
+	return rb->sum & 0xffff;
+}
+
+uint32_t cpld_readback_crc32(const struct cpld_readback *rb)
+{
+	return rb->crc;
+}
@@ -0,0 +1,1033 @@
+/*
+ * Simulated CPLDs: jtag_ops backend and i2c-lib replacement
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "ast-jtag-intf.h"
+#include "cpld.h"
+#include "cpld-sim.h"
+#include "jed-image.h"
+#include "i2c-lib.h"
+#include "lattice.h"
+#include "anlogic.h"
+
+//#define DEBUG
+#ifdef DEBUG
+#define CPLD_DEBUG(...) printf(__VA_ARGS__);
+#else
+#define CPLD_DEBUG(...)
+#endif
+
+#define ERR_PRINT(...) fprintf(stderr, __VA_ARGS__);
+
+#define UNUSED(x) (void)(x)
+
+#define SIM_MAX_DEVICES 16
+#define SIM_ROW_WORDS	4
+#define SIM_ROW_BYTES	(SIM_ROW_WORDS * 4)
+#define SIM_PAGE_MASK	0x3fff /* LSC_WRITE_ADDRESS page number */
+#define SIM_TCK_DEFAULT 12000000 /* driver default TCK (Hz) */
+
+/* LSC_READ_STATUS bits */
+#define SIM_STATUS_BUSY (1 << 12)
+#define SIM_STATUS_FAIL (1 << 13)
+
+/* ISC_ERASE operand bits */
+#define SIM_ERASE_CF  0x04
+#define SIM_ERASE_UFM 0x08
+
+#define SIM_SPI_WEL 0x02
+
+/* ANLOGIC bridge buffer: opcode, 24-bit address and one page */
+#define SIM_BRIDGE_SIZE (4 + PAGE_SIZE)
+#define SIM_BRIDGE_US	200 /* SPI transfer behind one bridge write */
+
+const struct cpld_sim_model cpld_sim_models[CPLD_SIM_FAMILY_MAX] = {
+	[CPLD_SIM_XO3LF_9400] = {
+		.name = "LCMXO3LF-9400",
+		.idcode = 0x612BE043,
+		.jtag = 1,
+		.cf_rows = 9212,
+		.ufm_rows = 2048,
+		.erase_us = 2000000,
+		.program_us = 200,
+		.done_us = 200,
+	},
+	[CPLD_SIM_XO3LF_4300] = {
+		.name = "LCMXO3LF-4300",
+		.idcode = 0x612BC043,
+		.jtag = 1,
+		.cf_rows = 5758,
+		.ufm_rows = 768,
+		.erase_us = 1000000,
+		.program_us = 200,
+		.done_us = 200,
+	},
+	[CPLD_SIM_XO3D_9400] = {
+		.name = "LCMXO3D-9400",
+		.idcode = 0x212E3043,
+		.jtag = 1,
+		.cf_rows = 9212,
+		.ufm_rows = 2048,
+		.erase_us = 2000000,
+		.program_us = 200,
+		.done_us = 200,
+	},
+	[CPLD_SIM_YZBB] = {
+		.name = "YZBB-Family",
+		.idcode = 0,
+		.cf_rows = 5758,
+		.ufm_rows = 768,
+		.erase_us = 1000000,
+		.program_us = 200,
+		.done_us = 200,
+	},
+	[CPLD_SIM_ANLOGIC] = {
+		.name = "ANLOGIC-Family",
+		.idcode = 0,
+		.spi = 1,
+		.cf_rows = 256 * 1024,
+		.erase_us = 45000,
+		.program_us = 400,
+	},
+};
+
+/* bytes 1..12 of the UFM ID page, matched against the dev_id fields */
+static const uint32_t yzbb_ufm_id[3] = { 0x42425A59, 0x35383230, 0x32303136 };
+static const uint32_t anlogic_ufm_id[3] = { 0xFFFFFFFF, 0xFFFFFFFF, 0 };
+
+struct cpld_sim {
+	enum cpld_sim_family family;
+	const struct cpld_sim_model *model;
+	int jtag;
+	int bus;
+	int slave;
+	int fd; /* open handle, -1 when closed */
+
+	/* flash */
+	unsigned int *cf;
+	unsigned int *ufm;
+	uint8_t *spi;
+	uint32_t usercode;
+
+	/* MachXO2/XO3 configuration logic */
+	uint8_t ir;
+	int enabled;
+	int ufm_sel;
+	unsigned int addr;
+	uint32_t dr; /* last 32-bit DR shifted in, USERCODE operand */
+	int fail;
+
+	/* SPI bridge */
+	uint8_t bridge[SIM_BRIDGE_SIZE]; /* MISO bytes of the last command */
+	uint16_t bridge_len;
+	uint64_t bridge_ready;
+	int wel;
+
+	/* JTAG clock */
+	unsigned int tck;
+	unsigned int glitch;
+
+	uint64_t busy_until;
+	struct cpld_sim_stats stats;
+};
+
+static struct cpld_sim *sims[SIM_MAX_DEVICES];
+static unsigned int busy_scale = 100;
+static unsigned int tck_limit;
+
+/******************************************************************************/
+/***************************      Device Model      ***************************/
+/******************************************************************************/
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sim_set_busy(struct cpld_sim *sim, uint32_t us)
+{
+	sim->busy_until = now_us() + (uint64_t)us * busy_scale / 100;
+}
+
+static int sim_busy(struct cpld_sim *sim)
+{
+	if (now_us() < sim->busy_until) {
+		sim->stats.busy_polls++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* xorshift32, the initial flash only has to differ from any test image */
+static uint32_t sim_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static unsigned int *sim_rows(struct cpld_sim *sim, unsigned int *rows)
+{
+	if (sim->ufm_sel) {
+		*rows = sim->model->ufm_rows;
+		return sim->ufm;
+	}
+
+	*rows = sim->model->cf_rows;
+	return sim->cf;
+}
+
+static void lattice_erase(struct cpld_sim *sim, unsigned int len,
+			  uint32_t operand)
+{
+	const struct cpld_sim_model *m = sim->model;
+
+	if (!sim->enabled || sim_busy(sim)) {
+		sim->stats.errors++;
+		sim->fail = 1;
+		return;
+	}
+
+	/* the MachXO3D operand selects the flash sectors, erase them all */
+	if (len == LCMXO3D_ERASE_BITS_LEN || (operand & SIM_ERASE_CF)) {
+		memset(sim->cf, 0, (size_t)m->cf_rows * SIM_ROW_BYTES);
+	}
+	if (len == LCMXO3D_ERASE_BITS_LEN || (operand & SIM_ERASE_UFM)) {
+		memset(sim->ufm, 0, (size_t)m->ufm_rows * SIM_ROW_BYTES);
+	}
+
+	sim->fail = 0;
+	sim->stats.erases++;
+	sim_set_busy(sim, m->erase_us);
+	CPLD_DEBUG("[%s] %s: erase %x\n", __func__, m->name, operand);
+}
+
+/* programming only sets fuses, a row has to be erased before */
+static void lattice_program(struct cpld_sim *sim, const unsigned int *data)
+{
+	unsigned int *row;
+	unsigned int rows;
+	int i;
+
+	row = sim_rows(sim, &rows);
+	if (!sim->enabled || sim_busy(sim) || sim->addr >= rows) {
+		sim->stats.errors++;
+		sim->fail = 1;
+		return;
+	}
+
+	row += (size_t)sim->addr * SIM_ROW_WORDS;
+	for (i = 0; i < SIM_ROW_WORDS; i++) {
+		if (row[i]) {
+			sim->stats.errors++;
+			sim->fail = 1;
+		}
+		row[i] |= data[i];
+	}
+
+	sim->addr++;
+	sim->stats.programs++;
+	sim_set_busy(sim, sim->model->program_us);
+}
+
+static void lattice_read(struct cpld_sim *sim, unsigned int *data)
+{
+	unsigned int *row;
+	unsigned int rows;
+
+	row = sim_rows(sim, &rows);
+	if (sim->addr >= rows) {
+		memset(data, 0, SIM_ROW_BYTES);
+		sim->stats.errors++;
+		return;
+	}
+
+	memcpy(data, &row[(size_t)sim->addr * SIM_ROW_WORDS], SIM_ROW_BYTES);
+	sim->addr++;
+	sim->stats.reads++;
+}
+
+static void lattice_write_address(struct cpld_sim *sim, uint32_t address)
+{
+	sim->ufm_sel = (address & LCMXO2_ADDR_UFM) ? 1 : 0;
+	sim->addr = address & SIM_PAGE_MASK;
+}
+
+static uint32_t lattice_status(struct cpld_sim *sim)
+{
+	uint32_t status = 0;
+
+	if (sim_busy(sim)) {
+		status |= SIM_STATUS_BUSY;
+	}
+	if (sim->fail) {
+		status |= SIM_STATUS_FAIL;
+	}
+
+	return status;
+}
+
+/* instructions which act as soon as they are shifted in */
+static void lattice_instruction(struct cpld_sim *sim, uint8_t ins)
+{
+	sim->ir = ins;
+
+	switch (ins) {
+	case LCMXO2_ISC_ENABLE_X:
+		sim->enabled = 1;
+		break;
+	case LCMXO2_LSC_INIT_ADDRESS:
+		sim->ufm_sel = 0;
+		sim->addr = 0;
+		break;
+	case LCMXO2_LSC_INIT_ADDR_UFM:
+		sim->ufm_sel = 1;
+		sim->addr = 0;
+		break;
+	case LCMXO2_ISC_PROGRAM_USERCOD:
+		if (!sim->enabled || sim_busy(sim)) {
+			sim->stats.errors++;
+			sim->fail = 1;
+			break;
+		}
+		sim->usercode = sim->dr;
+		sim_set_busy(sim, sim->model->done_us);
+		break;
+	case LCMXO2_ISC_PROGRAM_DONE:
+		sim_set_busy(sim, sim->model->done_us);
+		break;
+	case LCMXO2_ISC_DISABLE:
+		sim->enabled = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+static void lattice_dr_in(struct cpld_sim *sim, unsigned int len,
+			  const unsigned int *tdi)
+{
+	switch (sim->ir) {
+	case LCMXO2_ISC_ERASE:
+		lattice_erase(sim, len, tdi[0]);
+		break;
+	case LCMXO2_LSC_WRITE_ADDRESS:
+		lattice_write_address(sim, tdi[0]);
+		break;
+	case LCMXO2_LSC_PROG_INCR_NV:
+		if (len == JED_ROW_BITS) {
+			lattice_program(sim, tdi);
+			break;
+		}
+		/* fall through */
+	default:
+		//USERCODE is shifted in before ISC_PROGRAM_USERCODE
+		if (len == 32) {
+			sim->dr = tdi[0];
+		}
+		break;
+	}
+}
+
+static void lattice_dr_out(struct cpld_sim *sim, unsigned int len,
+			   unsigned int *tdo)
+{
+	switch (sim->ir) {
+	case LCMXO2_IDCODE_PUB:
+		tdo[0] = sim->model->idcode;
+		break;
+	case LCMXO2_USERCODE:
+		tdo[0] = sim->usercode;
+		break;
+	case LCMXO2_LSC_CHECK_BUSY:
+		tdo[0] = sim_busy(sim) ? 0x80 : 0;
+		break;
+	case LCMXO2_LSC_READ_STATUS:
+		tdo[0] = lattice_status(sim);
+		break;
+	case LCMXO2_LSC_READ_INCR_NV:
+		if (len == JED_ROW_BITS) {
+			lattice_read(sim, tdo);
+			break;
+		}
+		/* fall through */
+	default:
+		memset(tdo, 0, (len + 31) / 32 * sizeof(*tdo));
+		break;
+	}
+}
+
+/******************************************************************************/
+/***************************      Registry      *******************************/
+/******************************************************************************/
+
+void cpld_sim_set_busy_scale(unsigned int percent)
+{
+	busy_scale = percent;
+}
+
+void cpld_sim_set_tck_limit(unsigned int hz)
+{
+	tck_limit = hz;
+}
+
+struct cpld_sim *cpld_sim_add(enum cpld_sim_family family, int jtag, int bus,
+			      int slave, unsigned int seed)
+{
+	const struct cpld_sim_model *m;
+	struct cpld_sim *sim;
+	uint32_t state = seed ? seed : 1;
+	size_t i;
+	int slot;
+
+	if (family >= CPLD_SIM_FAMILY_MAX) {
+		return NULL;
+	}
+	m = &cpld_sim_models[family];
+
+	if (jtag && !m->jtag) {
+		printf("[%s] %s has no JTAG model\n", __func__, m->name);
+		return NULL;
+	}
+
+	for (slot = 0; slot < SIM_MAX_DEVICES && sims[slot]; slot++)
+		;
+	if (slot == SIM_MAX_DEVICES) {
+		printf("[%s] Too many devices, max %d\n", __func__,
+		       SIM_MAX_DEVICES);
+		return NULL;
+	}
+
+	sim = calloc(1, sizeof(*sim));
+	if (sim == NULL) {
+		printf("[%s] Unable to allocate memory\n", __func__);
+		return NULL;
+	}
+
+	sim->family = family;
+	sim->model = m;
+	sim->jtag = jtag;
+	sim->bus = bus;
+	sim->slave = slave;
+	sim->fd = -1;
+	sim->tck = SIM_TCK_DEFAULT;
+
+	//the device holds some older firmware
+	if (m->spi) {
+		sim->spi = malloc(m->cf_rows);
+		if (sim->spi == NULL) {
+			goto error_exit;
+		}
+		for (i = 0; i < m->cf_rows; i++) {
+			sim->spi[i] = sim_rand(&state);
+		}
+		sim->usercode = 0x01;
+	} else {
+		sim->cf = malloc((size_t)m->cf_rows * SIM_ROW_BYTES);
+		sim->ufm = malloc((size_t)m->ufm_rows * SIM_ROW_BYTES);
+		if (sim->cf == NULL || sim->ufm == NULL) {
+			goto error_exit;
+		}
+		for (i = 0; i < (size_t)m->cf_rows * SIM_ROW_WORDS; i++) {
+			sim->cf[i] = sim_rand(&state);
+		}
+		for (i = 0; i < (size_t)m->ufm_rows * SIM_ROW_WORDS; i++) {
+			sim->ufm[i] = sim_rand(&state);
+		}
+		sim->usercode = sim_rand(&state);
+	}
+
+	sims[slot] = sim;
+
+	return sim;
+
+error_exit:
+	printf("[%s] Unable to allocate memory\n", __func__);
+	cpld_sim_remove(sim);
+	return NULL;
+}
+
+void cpld_sim_remove(struct cpld_sim *sim)
+{
+	int i;
+
+	if (sim == NULL) {
+		return;
+	}
+
+	for (i = 0; i < SIM_MAX_DEVICES; i++) {
+		if (sims[i] == sim) {
+			sims[i] = NULL;
+		}
+	}
+
+	if (sim->fd >= 0) {
+		close(sim->fd);
+	}
+	free(sim->cf);
+	free(sim->ufm);
+	free(sim->spi);
+	free(sim);
+}
+
+const struct cpld_sim_stats *cpld_sim_stats(const struct cpld_sim *sim)
+{
+	return &sim->stats;
+}
+
+const void *cpld_sim_flash(const struct cpld_sim *sim, int sector)
+{
+	if (sim->model->spi) {
+		return sector ? NULL : sim->spi;
+	}
+
+	return sector ? sim->ufm : sim->cf;
+}
+
+uint32_t cpld_sim_usercode(const struct cpld_sim *sim)
+{
+	return sim->usercode;
+}
+
+static struct cpld_sim *sim_find(int jtag, int bus, int slave)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_DEVICES; i++) {
+		if (sims[i] && sims[i]->jtag == jtag && sims[i]->bus == bus &&
+		    (jtag || sims[i]->slave == slave)) {
+			return sims[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct cpld_sim *sim_from_fd(int fd)
+{
+	int i;
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	for (i = 0; i < SIM_MAX_DEVICES; i++) {
+		if (sims[i] && sims[i]->fd == fd) {
+			return sims[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The handle is a real descriptor so the callers can close() it like the
+ * one of a driver.
+ */
+static int sim_open(struct cpld_sim *sim)
+{
+	if (sim->fd >= 0) {
+		printf("[%s] %s is already open\n", __func__,
+		       sim->model->name);
+		return -1;
+	}
+
+	sim->fd = open("/dev/null", O_RDWR);
+	sim->ir = BYPASS;
+	sim->enabled = 0;
+
+	return sim->fd;
+}
+
+/******************************************************************************/
+/***************************     JTAG       ***********************************/
+/******************************************************************************/
+
+static struct cpld_sim *jtag_sim(struct ast_jtag *jtag, unsigned int bits)
+{
+	struct cpld_sim *sim = sim_from_fd(jtag->fd);
+
+	if (sim != NULL) {
+		sim->stats.ioctls++;
+		sim->stats.bytes += (bits + 7) / 8;
+	}
+
+	return sim;
+}
+
+static int sim_jtag_open(struct ast_jtag *jtag, int jtag_device)
+{
+	struct cpld_sim *sim = sim_find(1, jtag_device, 0);
+
+	if (sim == NULL) {
+		printf("[%s] No simulated device on jtag%d\n", __func__,
+		       jtag_device);
+		return -1;
+	}
+
+	jtag->fd = sim_open(sim);
+	if (jtag->fd < 0) {
+		return -1;
+	}
+
+	//the real driver sets the transfer mode with an ioctl
+	if (jtag->mode != 0) {
+		sim->stats.ioctls++;
+	}
+
+	return 0;
+}
+
+static void sim_jtag_close(struct ast_jtag *jtag)
+{
+	struct cpld_sim *sim = sim_from_fd(jtag->fd);
+
+	if (sim != NULL) {
+		sim->fd = -1;
+	}
+	close(jtag->fd);
+	jtag->fd = -1;
+}
+
+static void sim_jtag_set_mode(struct ast_jtag *jtag, unsigned int mode)
+{
+	jtag->mode = mode;
+}
+
+static unsigned int sim_jtag_get_freq(struct ast_jtag *jtag)
+{
+	struct cpld_sim *sim = jtag_sim(jtag, 0);
+
+	return sim ? sim->tck : 0;
+}
+
+static int sim_jtag_set_freq(struct ast_jtag *jtag, unsigned int freq)
+{
+	struct cpld_sim *sim = jtag_sim(jtag, 0);
+
+	if (sim == NULL) {
+		return -1;
+	}
+
+	sim->tck = freq;
+
+	return 0;
+}
+
+static int sim_jtag_run_test_idle(struct ast_jtag *jtag, unsigned char reset,
+				  unsigned char end, unsigned char tck)
+{
+	struct cpld_sim *sim = jtag_sim(jtag, 0);
+
+	UNUSED(end);
+	UNUSED(tck);
+	if (sim == NULL) {
+		return -1;
+	}
+
+	if (reset) {
+		sim->ir = LCMXO2_IDCODE_PUB;
+	}
+
+	return 0;
+}
+
+static int sim_jtag_sir_xfer(struct ast_jtag *jtag, unsigned char endir,
+			     unsigned int len, unsigned int tdi)
+{
+	struct cpld_sim *sim = jtag_sim(jtag, len);
+
+	UNUSED(endir);
+	if (sim == NULL) {
+		return -1;
+	}
+
+	lattice_instruction(sim, tdi & 0xff);
+
+	return 0;
+}
+
+static int sim_jtag_tdo_xfer(struct ast_jtag *jtag, unsigned char enddr,
+			     unsigned int len, unsigned int *tdio)
+{
+	struct cpld_sim *sim = jtag_sim(jtag, len);
+
+	UNUSED(enddr);
+	if (sim == NULL) {
+		return -1;
+	}
+
+	lattice_dr_out(sim, len, tdio);
+
+	//signal integrity above the board limit
+	if (tck_limit && sim->tck > tck_limit && ++sim->glitch % 3 == 0) {
+		tdio[0] ^= 1;
+	}
+
+	return 0;
+}
+
+static int sim_jtag_tdi_xfer(struct ast_jtag *jtag, unsigned char enddr,
+			     unsigned int len, unsigned int *tdio)
+{
+	struct cpld_sim *sim = jtag_sim(jtag, len);
+
+	UNUSED(enddr);
+	if (sim == NULL) {
+		return -1;
+	}
+
+	lattice_dr_in(sim, len, tdio);
+
+	return 0;
+}
+
+const struct jtag_ops cpld_sim_jtag_ops = {
+	.open = sim_jtag_open,
+	.close = sim_jtag_close,
+	.set_mode = sim_jtag_set_mode,
+	.get_freq = sim_jtag_get_freq,
+	.set_freq = sim_jtag_set_freq,
+	.run_test_idle = sim_jtag_run_test_idle,
+	.sir_xfer = sim_jtag_sir_xfer,
+	.tdo_xfer = sim_jtag_tdo_xfer,
+	.tdi_xfer = sim_jtag_tdi_xfer,
+};
+
+/******************************************************************************/
+/***************************      I2C       ***********************************/
+/******************************************************************************/
+
+static uint32_t be32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+	       ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void put_be32(uint8_t *data, uint32_t val)
+{
+	data[0] = (val >> 24) & 0xff;
+	data[1] = (val >> 16) & 0xff;
+	data[2] = (val >> 8) & 0xff;
+	data[3] = val & 0xff;
+}
+
+/* page data is sent LSB first over I2C */
+static void swap_bits(uint8_t *data, unsigned int len)
+{
+	unsigned int i, j;
+	uint8_t swap_byte;
+
+	for (i = 0; i < len; i++) {
+		swap_byte = 0;
+		for (j = 0; j < 8; j++) {
+			if (data[i] & (1 << j)) {
+				swap_byte |= 1 << (7 - j);
+			}
+		}
+		data[i] = swap_byte;
+	}
+}
+
+static void ufm_id(uint8_t *rbuf, uint16_t rcount, const uint32_t *id)
+{
+	uint8_t page[UFM_DATA_LENGTH] = { 0 };
+
+	memcpy(&page[1], id, DEVICEID_LENGTH);
+	memcpy(rbuf, page, rcount < sizeof(page) ? rcount : sizeof(page));
+}
+
+static void lattice_i2c(struct cpld_sim *sim, const uint8_t *tbuf,
+			uint16_t tcount, uint8_t *rbuf, uint16_t rcount)
+{
+	unsigned int row[SIM_ROW_WORDS];
+	uint32_t operand = tcount >= 8 ? be32(&tbuf[4]) : 0;
+	unsigned int pages, i;
+
+	switch (tbuf[0]) {
+	case LCMXO2_IDCODE_PUB:
+		if (rcount >= 4) {
+			put_be32(rbuf, sim->model->idcode);
+		}
+		return;
+	case LCMXO2_USERCODE:
+		if (rcount >= 4) {
+			put_be32(rbuf, sim->usercode);
+		}
+		return;
+	case LCMXO2_LSC_CHECK_BUSY:
+		if (rcount >= 1) {
+			rbuf[0] = sim_busy(sim) ? 0x80 : 0;
+		}
+		return;
+	case LCMXO2_LSC_READ_STATUS:
+		if (rcount >= 4) {
+			put_be32(rbuf, lattice_status(sim));
+		}
+		return;
+	case LCMXO2_ISC_ERASE:
+		sim->ir = LCMXO2_ISC_ERASE;
+		lattice_erase(sim, LATTICE_INS_LENGTH,
+			      tcount > 1 ? tbuf[1] : 0);
+		return;
+	case LCMXO2_LSC_WRITE_ADDRESS:
+		lattice_write_address(sim, operand);
+		return;
+	case LCMXO2_LSC_PROG_INCR_NV:
+		if (tcount < 4 + SIM_ROW_BYTES) {
+			sim->stats.errors++;
+			return;
+		}
+		memcpy(row, &tbuf[4], SIM_ROW_BYTES);
+		swap_bits((uint8_t *)row, SIM_ROW_BYTES);
+		lattice_program(sim, row);
+		return;
+	case LCMXO2_LSC_READ_INCR_NV:
+		//operand bytes 2 and 3 hold the page count
+		pages = tcount >= 4 ? (tbuf[2] << 8) | tbuf[3] : 1;
+		for (i = 0; i < pages && rcount >= SIM_ROW_BYTES; i++) {
+			lattice_read(sim, row);
+			swap_bits((uint8_t *)row, SIM_ROW_BYTES);
+			memcpy(rbuf, row, SIM_ROW_BYTES);
+			rbuf += SIM_ROW_BYTES;
+			rcount -= SIM_ROW_BYTES;
+		}
+		return;
+	case LCMXO2_ISC_PROGRAM_USERCOD:
+		sim->dr = operand;
+		break;
+	default:
+		break;
+	}
+
+	if (sim->family == CPLD_SIM_YZBB) {
+		if (tbuf[0] == YZBB_READ_UFM) {
+			ufm_id(rbuf, rcount, yzbb_ufm_id);
+			return;
+		}
+		if (tbuf[0] == YZBB_READ_VERSION && rcount >= 2) {
+			rbuf[1] = sim->usercode & 0xff;
+			return;
+		}
+	}
+
+	lattice_instruction(sim, tbuf[0]);
+}
+
+/*
+ * The bridge buffer holds what MISO returned while the last command was
+ * clocked out. It can be read once that SPI transfer is over and only as
+ * far as bytes were clocked, anything else is undefined and reads as 0.
+ */
+static void anlogic_read(struct cpld_sim *sim, uint8_t *rbuf, uint16_t rcount)
+{
+	if (now_us() < sim->bridge_ready || rcount > sim->bridge_len) {
+		sim->stats.errors++;
+		return;
+	}
+
+	memcpy(rbuf, sim->bridge, rcount);
+}
+
+/*
+ * SPI NOR behind the ANLOGIC bridge. A bridge write is 02, the bytes
+ * clocked out on SPI and a 00 terminator which is not clocked. A read
+ * in the same transfer comes before the SPI transfer is over.
+ */
+static void anlogic_i2c(struct cpld_sim *sim, const uint8_t *tbuf,
+			uint16_t tcount, uint8_t *rbuf, uint16_t rcount)
+{
+	const struct cpld_sim_model *m = sim->model;
+	uint16_t clocked;
+	uint32_t addr;
+	uint8_t status;
+	int i;
+
+	if (tcount == 0) {
+		anlogic_read(sim, rbuf, rcount);
+		return;
+	}
+
+	switch (tbuf[0]) {
+	case READ_VERSION:
+		if (rcount >= 2) {
+			rbuf[1] = sim->usercode & 0xff;
+		}
+		return;
+	case READ_UFM_ADDR:
+		ufm_id(rbuf, rcount, anlogic_ufm_id);
+		return;
+	case WRITE_DATA_TO_SPI:
+		break;
+	default:
+		return;
+	}
+
+	if (tcount < 3 || tbuf[tcount - 1] != 0) {
+		sim->stats.errors++;
+		return;
+	}
+
+	clocked = tcount - 2;
+	addr = clocked >= 4 ?
+		       ((uint32_t)tbuf[2] << 16) | (tbuf[3] << 8) | tbuf[4] :
+		       0;
+
+	memset(sim->bridge, 0, sizeof(sim->bridge));
+	sim->bridge_len = clocked < SIM_BRIDGE_SIZE ? clocked : SIM_BRIDGE_SIZE;
+	sim->bridge_ready = now_us() + (uint64_t)SIM_BRIDGE_US * busy_scale / 100;
+
+	switch (tbuf[1]) {
+	case WRITE_ENABLE:
+		//ignored while a program or erase is in progress
+		if (sim_busy(sim)) {
+			sim->stats.errors++;
+			break;
+		}
+		sim->wel = 1;
+		break;
+	case WRITE_DISABLE:
+		sim->wel = 0;
+		break;
+	case SECTOR_ERASE:
+		if (!sim->wel || sim_busy(sim) || clocked < 4 ||
+		    addr + SECTOR_SIZE > m->cf_rows) {
+			sim->stats.errors++;
+			break;
+		}
+		addr &= ~(SECTOR_SIZE - 1);
+		memset(&sim->spi[addr], 0xff, SECTOR_SIZE);
+		sim->wel = 0;
+		sim->stats.erases++;
+		sim_set_busy(sim, m->erase_us);
+		break;
+	case PAGE_PROGRAM:
+		if (!sim->wel || sim_busy(sim) || clocked < 4 + PAGE_SIZE ||
+		    addr + PAGE_SIZE > m->cf_rows) {
+			sim->stats.errors++;
+			break;
+		}
+		//NOR programming only clears bits
+		for (i = 0; i < PAGE_SIZE; i++) {
+			sim->spi[addr + i] &= tbuf[5 + i];
+		}
+		sim->wel = 0;
+		sim->stats.programs++;
+		sim_set_busy(sim, m->program_us);
+		break;
+	case READ_STATUS_REG:
+		//the status is shifted out on every byte after the opcode
+		status = (sim_busy(sim) ? SPI_STATUS_WIP : 0) |
+			 (sim->wel ? SIM_SPI_WEL : 0);
+		for (i = 1; i < sim->bridge_len; i++) {
+			sim->bridge[i] = status;
+		}
+		break;
+	case READ_DATA:
+		if (clocked < 4 || addr + PAGE_SIZE > m->cf_rows) {
+			sim->stats.errors++;
+			break;
+		}
+		memcpy(&sim->bridge[4], &sim->spi[addr], sim->bridge_len - 4);
+		sim->stats.reads++;
+		break;
+	default:
+		break;
+	}
+
+	if (rcount) {
+		anlogic_read(sim, rbuf, rcount);
+	}
+}
+
+int i2c_open(uint8_t bus_num, uint8_t addr)
+{
+	struct cpld_sim *sim = sim_find(0, bus_num, addr);
+
+	if (sim == NULL) {
+		ERR_PRINT("No simulated device on i2c-%d @ 0x%x\n", bus_num,
+			  addr);
+		return -1;
+	}
+
+	//open() and the I2C_SLAVE ioctl
+	sim->stats.ioctls++;
+
+	return sim_open(sim);
+}
+
+static void sim_i2c_xfer(struct cpld_sim *sim, uint8_t *tbuf, uint16_t tcount,
+			 uint8_t *rbuf, uint16_t rcount)
+{
+	sim->stats.bytes += tcount + rcount;
+
+	if (rcount) {
+		memset(rbuf, 0, rcount);
+	}
+
+	if (sim->model->spi) {
+		anlogic_i2c(sim, tbuf, tcount, rbuf, rcount);
+	} else if (tcount) {
+		lattice_i2c(sim, tbuf, tcount, rbuf, rcount);
+	}
+}
+
+int i2c_rdwr_msgs(int file, const struct i2c_xfer_msg *msgs,
+		  unsigned int count)
+{
+	struct cpld_sim *sim = sim_from_fd(file);
+	unsigned int i;
+
+	if (sim == NULL) {
+		return -1;
+	}
+
+	sim->stats.ioctls++;
+
+	//a write and the read right after it form one command
+	for (i = 0; i < count; i++) {
+		if (msgs[i].read) {
+			sim_i2c_xfer(sim, NULL, 0, msgs[i].buf, msgs[i].len);
+		} else if (i + 1 < count && msgs[i + 1].read) {
+			sim_i2c_xfer(sim, msgs[i].buf, msgs[i].len,
+				     msgs[i + 1].buf, msgs[i + 1].len);
+			i++;
+		} else {
+			sim_i2c_xfer(sim, msgs[i].buf, msgs[i].len, NULL, 0);
+		}
+	}
+
+	return 0;
+}
+
+int i2c_rdwr_msg_transfer(int file, uint8_t addr, uint8_t *tbuf,
+			  uint16_t tcount, uint8_t *rbuf, uint16_t rcount)
+{
+	struct cpld_sim *sim = sim_from_fd(file);
+
+	UNUSED(addr);
+	if (sim == NULL) {
+		return -1;
+	}
+
+	sim->stats.ioctls++;
+	sim_i2c_xfer(sim, tbuf, tcount, rbuf, rcount);
+
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * JTAG TCK tuning: run at the fastest clock the board handles reliably
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cpld.h"
+#include "cpld-tck.h"
+#include "cpld-journal.h"
+#include "cpld-readback.h"
+
+//#define DEBUG
+#ifdef DEBUG
+#define CPLD_DEBUG(...) printf(__VA_ARGS__);
+#else
+#define CPLD_DEBUG(...)
+#endif
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+static const unsigned int tck_steps[] = CPLD_TCK_STEPS;
+
+static void tck_cache_path(char *path, size_t len, int jtag_device)
+{
+	snprintf(path, len, CPLD_TCK_CACHE, jtag_device);
+}
+
+static uint32_t tck_rec_crc(const struct cpld_tck_rec *rec)
+{
+	return cpld_crc32(0, rec, offsetof(struct cpld_tck_rec, crc));
+}
+
+/* cached frequency for this master and device, 0 if none */
+static unsigned int tck_cache_read(int jtag_device, uint32_t idcode)
+{
+	struct cpld_tck_rec rec;
+	char path[128];
+	ssize_t len;
+	int fd;
+
+	tck_cache_path(path, sizeof(path), jtag_device);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	len = read(fd, &rec, sizeof(rec));
+	close(fd);
+
+	if (len != sizeof(rec) || rec.magic != CPLD_TCK_MAGIC ||
+	    rec.crc != tck_rec_crc(&rec) || rec.idcode != idcode)
+		return 0;
+
+	return rec.freq;
+}
+
+static void tck_cache_write(int jtag_device, uint32_t idcode,
+			    unsigned int freq)
+{
+	struct cpld_tck_rec rec;
+	char path[128];
+	int fd;
+
+	if (mkdir(CPLD_JOURNAL_DIR, 0755) < 0 && errno != EEXIST)
+		return;
+
+	rec.magic = CPLD_TCK_MAGIC;
+	rec.idcode = idcode;
+	rec.freq = freq;
+	rec.crc = tck_rec_crc(&rec);
+
+	tck_cache_path(path, sizeof(path), jtag_device);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("[%s] Cannot write %s: %s\n", __func__, path,
+		       strerror(errno));
+		return;
+	}
+	if (write(fd, &rec, sizeof(rec)) != sizeof(rec))
+		printf("[%s] Cannot write %s\n", __func__, path);
+	close(fd);
+}
+
+void cpld_tck_forget(int jtag_device)
+{
+	char path[128];
+
+	tck_cache_path(path, sizeof(path), jtag_device);
+	unlink(path);
+}
+
+/* count samples at freq all have to match ref */
+static int tck_check(struct cpld_ctx *ctx, const struct cpld_tck_sample *ref,
+		     unsigned int freq, unsigned int count)
+{
+	struct cpld_tck_sample s;
+	unsigned int i;
+
+	if (ast_set_jtag_freq(&ctx->jtag, freq) < 0)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		if (ctx->dev->cpld_sample(ctx, &s) < 0 ||
+		    memcmp(&s, ref, sizeof(s))) {
+			CPLD_DEBUG("[%s] %u Hz: sample %u mismatch\n",
+				   __func__, freq, i);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int cpld_tck_tune(struct cpld_ctx *ctx)
+{
+	struct cpld_tck_sample ref, s;
+	unsigned int freq, orig;
+	unsigned int i, best;
+
+	//a fixed TCK was asked for
+	if (ctx->info.tck) {
+		return ast_set_jtag_freq(&ctx->jtag, ctx->info.tck);
+	}
+
+	if (ctx->dev == NULL || ctx->dev->cpld_sample == NULL)
+		return 0;
+
+	orig = ast_get_jtag_freq(&ctx->jtag);
+
+	//the reference is taken twice at the slowest step
+	if (ast_set_jtag_freq(&ctx->jtag, tck_steps[0]) < 0 ||
+	    ctx->dev->cpld_sample(ctx, &ref) < 0 ||
+	    ctx->dev->cpld_sample(ctx, &s) < 0 || memcmp(&s, &ref, sizeof(s)) ||
+	    ref.idcode == 0 || ref.idcode == 0xFFFFFFFF) {
+		printf("[%s] No stable device at %u Hz, TCK left at %u Hz\n",
+		       __func__, tck_steps[0], orig);
+		if (orig)
+			ast_set_jtag_freq(&ctx->jtag, orig);
+		return -1;
+	}
+
+	freq = tck_cache_read(ctx->info.jtag_device, ref.idcode);
+	if (freq && tck_check(ctx, &ref, freq, CPLD_TCK_SAMPLES)) {
+		printf("JTAG TCK: %u Hz (cached)\n", freq);
+		return 0;
+	}
+
+	best = 0;
+	for (i = 1; i < ARRAY_SIZE(tck_steps); i++) {
+		if (!tck_check(ctx, &ref, tck_steps[i], CPLD_TCK_SAMPLES))
+			break;
+		best = i;
+	}
+
+	//back off until a longer run is clean as well
+	while (best > 0 &&
+	       !tck_check(ctx, &ref, tck_steps[best], CPLD_TCK_CONFIRM)) {
+		best--;
+	}
+
+	freq = tck_steps[best];
+	if (ast_set_jtag_freq(&ctx->jtag, freq) < 0)
+		return -1;
+
+	tck_cache_write(ctx->info.jtag_device, ref.idcode, freq);
+	printf("JTAG TCK: %u Hz\n", freq);
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * CPLD operation timing: adaptive completion polling and latency records
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpld.h"
+#include "cpld-timing.h"
+
+static const char *const op_names[CPLD_OP_MAX] = {
+	[CPLD_OP_CMD] = "command",   [CPLD_OP_ERASE] = "erase",
+	[CPLD_OP_PROGRAM] = "program", [CPLD_OP_USERCODE] = "usercode",
+	[CPLD_OP_DONE] = "done",     [CPLD_OP_READ] = "read",
+};
+
+/* Used when the detected device has no profile, matches the old delays */
+static const struct cpld_timing default_timing = {
+	.op = {
+		[CPLD_OP_CMD] = { 1000, 4000000 },
+		[CPLD_OP_ERASE] = { 1000, 4000000 },
+		[CPLD_OP_PROGRAM] = { 1000, 4000000 },
+		[CPLD_OP_USERCODE] = { 2000, 4000000 },
+		[CPLD_OP_DONE] = { 1000, 4000000 },
+		[CPLD_OP_READ] = { 1000, 1000 },
+	},
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const struct cpld_op_timing *op_timing(struct cpld_ctx *ctx,
+					      enum cpld_op op)
+{
+	const struct cpld_timing *timing = cpld_get_timing(ctx);
+
+	if (timing == NULL)
+		timing = &default_timing;
+
+	return &timing->op[op];
+}
+
+static void op_record(struct cpld_ctx *ctx, enum cpld_op op, uint64_t elapsed)
+{
+	struct cpld_op_stats *stats = &ctx->stats[op];
+
+	stats->count++;
+	stats->total_us += elapsed;
+	if (elapsed > stats->max_us)
+		stats->max_us = elapsed;
+}
+
+int cpld_poll(struct cpld_ctx *ctx, enum cpld_op op, cpld_poll_fn poll,
+	      void *arg)
+{
+	const struct cpld_op_timing *t = op_timing(ctx, op);
+	uint64_t start = now_us();
+	uint64_t deadline = (uint64_t)t->max_us * CPLD_POLL_MARGIN;
+	uint64_t elapsed;
+	uint32_t delay, cap;
+	int ret;
+
+	/* Start at 1/8 of the typical time, never sleep more than typical */
+	delay = t->typ_us / 8;
+	if (delay < CPLD_POLL_MIN_US)
+		delay = CPLD_POLL_MIN_US;
+	cap = (t->typ_us > delay) ? t->typ_us : delay;
+
+	for (;;) {
+		ret = poll(ctx, arg);
+		elapsed = now_us() - start;
+		if (ret <= 0 || elapsed >= deadline)
+			break;
+
+		usleep(delay);
+		delay = (delay * 2 > cap) ? cap : delay * 2;
+	}
+
+	if (ret == 0)
+		op_record(ctx, op, elapsed);
+
+	return ret;
+}
+
+void cpld_wait(struct cpld_ctx *ctx, enum cpld_op op)
+{
+	/* Nothing to poll, keep the full safe margin */
+	const struct cpld_op_timing *t = op_timing(ctx, op);
+
+	usleep(t->max_us);
+	op_record(ctx, op, t->max_us);
+}
+
+void cpld_timing_report(struct cpld_ctx *ctx)
+{
+	struct cpld_op_stats *op_stats = ctx->stats;
+	int i;
+
+	printf("Operation latency (us):\n");
+	for (i = 0; i < CPLD_OP_MAX; i++) {
+		if (op_stats[i].count == 0)
+			continue;
+
+		printf(" %-9s count %lu avg %llu max %llu (typ %u max %u)\n",
+		       op_names[i], op_stats[i].count,
+		       (unsigned long long)(op_stats[i].total_us /
+					    op_stats[i].count),
+		       (unsigned long long)op_stats[i].max_us,
+		       op_timing(ctx, i)->typ_us, op_timing(ctx, i)->max_us);
+	}
+}
@@ -6,52 +6,85 @@ Please get the JEDEC file format before you read the code
 #include <stdlib.h>
 #include <string.h>
 #include "cpld.h"
+#include "cpld-timing.h"
 #include "lattice.h"
 #include "anlogic.h"
 
-struct cpld_dev_info *cur_dev = NULL;
+void cpld_ctx_init(struct cpld_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->info.fd = -1;
+	ctx->jtag.fd = -1;
+	ctx->journal.fd = -1;
+}
+
+void cpld_progress(struct cpld_ctx *ctx, const char *stage, unsigned int done,
+		   unsigned int total)
+{
+	if (ctx->progress) {
+		ctx->progress(ctx, stage, done, total);
+		return;
+	}
+
+	printf("%s: %d/%d (%.2f%%) \r", stage, done, total,
+	       ((done / (float)total) * 100));
+}
 
-int cpld_probe(cpld_intf_t intf, cpld_intf_info_t *attr)
+int cpld_probe(struct cpld_ctx *ctx, cpld_intf_t intf, cpld_intf_info_t *attr)
 {
+	int ret;
+
 	//.No difference between other CPLDs
 	// JTAG: Set JTAG hardware mode
 	// I2C: Open I2C port
-	cur_dev = &lattice_dev_list[0];
+	ctx->dev = &lattice_dev_list[0];
 
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_open) {
+	if (!ctx->dev->cpld_open) {
 		printf("Open not supported\n");
 		return -1;
 	}
 
-	return cur_dev->cpld_open(intf, attr);
+	ret = ctx->dev->cpld_open(ctx, intf, attr);
+	if (ret != 0)
+		return ret;
+
+	return 0;
 }
 
-static int cpld_remove(cpld_intf_t intf)
+static int cpld_remove(struct cpld_ctx *ctx, cpld_intf_t intf)
 {
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_close) {
+	if (!ctx->dev->cpld_close) {
 		printf("Close not supported\n");
 		return -1;
 	}
 
-	return cur_dev->cpld_close(intf);
+	return ctx->dev->cpld_close(ctx, intf);
+}
+
+const struct cpld_timing *cpld_get_timing(struct cpld_ctx *ctx)
+{
+	if (ctx->dev == NULL)
+		return NULL;
+
+	return ctx->dev->timing;
 }
 
-int cpld_scan(cpld_intf_t intf)
+int cpld_scan(struct cpld_ctx *ctx, cpld_intf_t intf)
 {
 	unsigned int idcode = 0;
 
 	// Check for LATTICE device (Jtag and I2C)
-	cpld_get_device_id(&idcode);
+	cpld_get_device_id(ctx, &idcode);
 	for (int i = 0; i < LATTICE_MAX_DEVICE_SUPPORT; i++) {
 		if (idcode == lattice_dev_list[i].dev_id) {
-			cur_dev = &lattice_dev_list[i];
-			printf("Detected: %s\n", cur_dev->name);
+			ctx->dev = &lattice_dev_list[i];
+			printf("Detected: %s\n", ctx->dev->name);
 			return 0;
 		}
 	}
@@ -65,22 +98,22 @@ int cpld_scan(cpld_intf_t intf)
 	if (intf == INTF_I2C) {
 		uint8_t idcode_i2c[16] = { 0 };
 		// Check for YZBB I2C device
-		cur_dev = &lattice_dev_list[LATTICE_MAX_DEVICE_SUPPORT - 1];
-		cpld_get_device_id((unsigned int *)&idcode_i2c);
+		ctx->dev = &lattice_dev_list[LATTICE_MAX_DEVICE_SUPPORT - 1];
+		cpld_get_device_id(ctx, (unsigned int *)&idcode_i2c);
 		if (!memcmp(&idcode_i2c,
 			    &lattice_dev_list[LATTICE_MAX_DEVICE_SUPPORT - 1]
 				     .dev_id,
 			    YZBB_DEVICEID_LENGTH)) {
-			printf("Detected: %s\n", cur_dev->name);
+			printf("Detected: %s\n", ctx->dev->name);
 			return 0;
 		}
 
 		// Check for ANALOGIC I2C device
-		cur_dev = &anlogic_dev_list[0];
-		cpld_get_device_id((unsigned int *)&idcode_i2c);
+		ctx->dev = &anlogic_dev_list[0];
+		cpld_get_device_id(ctx, (unsigned int *)&idcode_i2c);
 		if (!memcmp(&idcode_i2c, &anlogic_dev_list[0].dev_id,
 			    DEVICEID_LENGTH)) {
-			printf("Detected: %s\n", cur_dev->name);
+			printf("Detected: %s\n", ctx->dev->name);
 			return 0;
 		}
 	}
@@ -89,38 +122,38 @@ int cpld_scan(cpld_intf_t intf)
 	return 1;
 }
 
-int cpld_intf_close(cpld_intf_t intf)
+int cpld_intf_close(struct cpld_ctx *ctx, cpld_intf_t intf)
 {
 	int ret;
 
-	ret = cpld_remove(intf);
-	cur_dev = NULL;
+	ret = cpld_remove(ctx, intf);
+	ctx->dev = NULL;
 
 	return ret;
 }
 
-int cpld_get_ver(uint32_t *ver)
+int cpld_get_ver(struct cpld_ctx *ctx, uint32_t *ver)
 {
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_ver) {
+	if (!ctx->dev->cpld_ver) {
 		printf("Get version not supported\n");
 		return -1;
 	}
 
-	return cur_dev->cpld_ver(ver);
+	return ctx->dev->cpld_ver(ctx, ver);
 }
 
-int cpld_get_checksum(char *file, uint32_t *crc)
+int cpld_get_checksum(struct cpld_ctx *ctx, char *file, uint32_t *crc)
 {
 	int ret;
 	FILE *fp_in = NULL;
 
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_checksum) {
+	if (!ctx->dev->cpld_checksum) {
 		printf("Program CPLD not supported\n");
 		return -1;
 	}
@@ -131,47 +164,47 @@ int cpld_get_checksum(char *file, uint32_t *crc)
 		return -1;
 	}
 
-	ret = cur_dev->cpld_checksum(fp_in, crc);
+	ret = ctx->dev->cpld_checksum(ctx, fp_in, crc);
 	fclose(fp_in);
 
 	return ret;
 }
 
-int cpld_get_device_id(uint32_t *dev_id)
+int cpld_get_device_id(struct cpld_ctx *ctx, uint32_t *dev_id)
 {
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_dev_id) {
+	if (!ctx->dev->cpld_dev_id) {
 		printf("Get device id not supported\n");
 		return -1;
 	}
 
-	return cur_dev->cpld_dev_id(dev_id);
+	return ctx->dev->cpld_dev_id(ctx, dev_id);
 }
 
-int cpld_erase(void)
+int cpld_erase(struct cpld_ctx *ctx)
 {
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_erase) {
+	if (!ctx->dev->cpld_erase) {
 		printf("Erase CPLD not supported\n");
 		return -1;
 	}
 
-	return cur_dev->cpld_erase();
+	return ctx->dev->cpld_erase(ctx);
 }
 
-int cpld_program(char *file, char *key, char is_signed)
+int cpld_program(struct cpld_ctx *ctx, char *file, char *key, char is_signed)
 {
 	int ret;
 	FILE *fp_in = NULL;
 
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_program) {
+	if (!ctx->dev->cpld_program) {
 		printf("Program CPLD not supported\n");
 		return -1;
 	}
@@ -182,21 +215,28 @@ int cpld_program(char *file, char *key, char is_signed)
 		return -1;
 	}
 
-	ret = cur_dev->cpld_program(fp_in, key, is_signed);
+	// JTAG: program at the fastest reliable TCK of the detected device,
+	// the driver default otherwise
+	if (ctx->info.intf == INTF_JTAG)
+		cpld_tck_tune(ctx);
+
+	ret = ctx->dev->cpld_program(ctx, fp_in, key, is_signed);
 	fclose(fp_in);
 
+	cpld_timing_report(ctx);
+
 	return ret;
 }
 
-int cpld_verify(char *file)
+int cpld_verify(struct cpld_ctx *ctx, char *file)
 {
 	int ret;
 	FILE *fp_in = NULL;
 
-	if (cur_dev == NULL)
+	if (ctx->dev == NULL)
 		return -1;
 
-	if (!cur_dev->cpld_verify) {
+	if (!ctx->dev->cpld_verify) {
 		printf("Verify CPLD not supported\n");
 		return -1;
 	}
@@ -207,7 +247,7 @@ int cpld_verify(char *file)
 		return -1;
 	}
 
-	cur_dev->cpld_verify(fp_in);
+	ret = ctx->dev->cpld_verify(ctx, fp_in);
 	fclose(fp_in);
 
 	return ret;
@@ -39,11 +39,14 @@ static void usage(FILE *fp, char **argv)
 		" -v | --get-cpld-version       Get current cpld version\n"
 		" -i | --get-cpld-idcode        Get cpld idcode\n"
 		" -c | --checksum               Calculate CPLD checksum\n"
+		" -f | --fast                   With -p, skip the update when the\n"
+		"                               flash already holds the image and\n"
+		"                               skip blank rows (MachXO2/XO3 only)\n"
 		"",
 		argv[0]);
 }
 
-static const char short_options[] = "hvic:p:b:s:t:";
+static const char short_options[] = "hvifc:p:b:s:t:";
 
 static const struct option long_options[] = {
 	{ "help", no_argument, NULL, 'h' },
@@ -51,6 +54,7 @@ static const struct option long_options[] = {
 	{ "get-cpld-version", no_argument, NULL, 'v' },
 	{ "get-cpld-idcode", no_argument, NULL, 'i' },
 	{ "checksum", required_argument, NULL, 'c' },
+	{ "fast", no_argument, NULL, 'f' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -77,10 +81,12 @@ int main(int argc, char *argv[])
 	cpld_t cpld;
 	int rc = -1;
 	cpld_intf_info_t cpld_info;
+	struct cpld_ctx ctx;
 	uint32_t crc;
 
 	memset(&cpld, 0, sizeof(cpld));
 	memset(&cpld_info, 0, sizeof(cpld_info));
+	cpld_ctx_init(&ctx);
 
 	while ((option = getopt_long(argc, argv, short_options, long_options,
 				     NULL)) != (char)-1) {
@@ -112,6 +118,9 @@ int main(int argc, char *argv[])
 		case 'i':
 			cpld.get_device = 1;
 			break;
+		case 'f':
+			cpld_info.fast_update = 1;
+			break;
 		case 'c':
 			cpld.checksum = 1;
 			strcpy(in_name, optarg);
@@ -135,32 +144,32 @@ int main(int argc, char *argv[])
 
 	/* No different between LCMX02 and LCMX03 now */
 	cpld_info.intf = INTF_I2C;
-	if (cpld_probe(INTF_I2C, &cpld_info)) {
+	if (cpld_probe(&ctx, INTF_I2C, &cpld_info)) {
 		printf("CPLD_INTF probe failed!\n");
 		exit(EXIT_FAILURE);
 	}
 
-	if (cpld_scan(INTF_I2C)) {
+	if (cpld_scan(&ctx, INTF_I2C)) {
 		printf("CPLD_INTF scan failed!\n");
 		exit(EXIT_FAILURE);
 	}
 
 	if (cpld.get_version) {
-		if (cpld_get_ver((unsigned int *)&cpld_var)) {
+		if (cpld_get_ver(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD Version: NA\n");
 		}
 		exit(EXIT_SUCCESS);
 	}
 
 	if (cpld.get_device) {
-		if (cpld_get_device_id((unsigned int *)&cpld_var)) {
+		if (cpld_get_device_id(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD DeviceID: NA\n");
 		}
 		exit(EXIT_SUCCESS);
 	}
 
 	if (cpld.checksum) {
-		if (cpld_get_checksum(in_name, &crc)) {
+		if (cpld_get_checksum(&ctx, in_name, &crc)) {
 			printf("CPLD Checksum: NA\n");
 		} else {
 			printf("CPLD Checksum: %X\n", crc);
@@ -170,14 +179,14 @@ int main(int argc, char *argv[])
 
 	if (cpld.program) {
 		// Print CPLD Version
-		if (cpld_get_ver((unsigned int *)&cpld_var)) {
+		if (cpld_get_ver(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD Version: NA\n");
 		}
 		// Print CPLD Device ID
-		if (cpld_get_device_id((unsigned int *)&cpld_var)) {
+		if (cpld_get_device_id(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD DeviceID: NA\n");
 		}
-		rc = cpld_program(in_name, key, 0);
+		rc = cpld_program(&ctx, in_name, key, 0);
 		if (rc < 0) {
 			printf("Failed to program cpld\n");
 			goto end_of_func;
@@ -185,7 +194,7 @@ int main(int argc, char *argv[])
 	}
 
 end_of_func:
-	cpld_intf_close(INTF_I2C);
+	cpld_intf_close(&ctx, INTF_I2C);
 	if (rc == 0) {
 		printf_pass();
 		return 0;
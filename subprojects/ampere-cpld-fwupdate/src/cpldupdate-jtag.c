@@ -40,11 +40,17 @@ static void usage(FILE *fp, char **argv)
 		" -v | --get-cpld-version       Get current cpld version\n"
 		" -i | --get-cpld-idcode        Get cpld idcode\n"
 		" -c | --checksum               Calculate CPLD checksum\n"
+		" -f | --fast                   With -p, skip the update when the\n"
+		"                               flash already holds the image and\n"
+		"                               skip blank rows (MachXO2/XO3 only)\n"
+		" -k | --tck <hz>               Run JTAG at this TCK instead of the\n"
+		"                               fastest reliable one found by probing\n"
+		" -r | --retune                 Probe TCK again, ignore the cached one\n"
 		"",
 		argv[0]);
 }
 
-static const char short_options[] = "hvip:c:t:d:";
+static const char short_options[] = "hvifrp:c:t:d:k:";
 
 static const struct option long_options[] = {
 	{ "help", no_argument, NULL, 'h' },
@@ -52,6 +58,9 @@ static const struct option long_options[] = {
 	{ "get-cpld-version", no_argument, NULL, 'v' },
 	{ "get-cpld-idcode", no_argument, NULL, 'i' },
 	{ "checksum", required_argument, NULL, 'c' },
+	{ "fast", no_argument, NULL, 'f' },
+	{ "tck", required_argument, NULL, 'k' },
+	{ "retune", no_argument, NULL, 'r' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -79,9 +88,12 @@ int main(int argc, char *argv[])
 	int rc = -1;
 	unsigned int crc = 0;
 	cpld_intf_info_t cpld_info;
+	struct cpld_ctx ctx;
+	int retune = 0;
 
 	memset(&cpld, 0, sizeof(cpld));
 	memset(&cpld_info, 0, sizeof(cpld_info));
+	cpld_ctx_init(&ctx);
 
 	while ((option = getopt_long(argc, argv, short_options, long_options,
 				     NULL)) != (char)-1) {
@@ -116,6 +128,15 @@ int main(int argc, char *argv[])
 		case 'i':
 			cpld.get_device = 1;
 			break;
+		case 'f':
+			cpld_info.fast_update = 1;
+			break;
+		case 'k':
+			cpld_info.tck = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			retune = 1;
+			break;
 		case 'c':
 			cpld.checksum = 1;
 			strcpy(in_name, optarg);
@@ -131,32 +152,36 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (cpld_probe(INTF_JTAG, &cpld_info)) {
+	if (retune) {
+		cpld_tck_forget(cpld_info.jtag_device);
+	}
+
+	if (cpld_probe(&ctx, INTF_JTAG, &cpld_info)) {
 		printf("CPLD_INTF probe failed!\n");
 		exit(EXIT_FAILURE);
 	}
 
-	if (cpld_scan(INTF_JTAG)) {
+	if (cpld_scan(&ctx, INTF_JTAG)) {
 		printf("CPLD_INTF scan failed!\n");
 		exit(EXIT_FAILURE);
 	}
 
 	if (cpld.get_version) {
-		if (cpld_get_ver((unsigned int *)&cpld_var)) {
+		if (cpld_get_ver(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD Version: NA\n");
 		}
 		exit(EXIT_SUCCESS);
 	}
 
 	if (cpld.get_device) {
-		if (cpld_get_device_id((unsigned int *)&cpld_var)) {
+		if (cpld_get_device_id(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD DeviceID: NA\n");
 		}
 		exit(EXIT_SUCCESS);
 	}
 
 	if (cpld.checksum) {
-		if (cpld_get_checksum(in_name, &crc)) {
+		if (cpld_get_checksum(&ctx, in_name, &crc)) {
 			printf("CPLD Checksum: NA\n");
 		} else {
 			printf("CPLD Checksum: %X\n", crc);
@@ -166,14 +191,14 @@ int main(int argc, char *argv[])
 
 	if (cpld.program) {
 		// Print CPLD Version
-		if (cpld_get_ver((unsigned int *)&cpld_var)) {
+		if (cpld_get_ver(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD Version: NA\n");
 		}
 		// Print CPLD Device ID
-		if (cpld_get_device_id((unsigned int *)&cpld_var)) {
+		if (cpld_get_device_id(&ctx, (unsigned int *)&cpld_var)) {
 			printf("CPLD DeviceID: NA\n");
 		}
-		rc = cpld_program(in_name, key, 0);
+		rc = cpld_program(&ctx, in_name, key, 0);
 		if (rc < 0) {
 			printf("Failed to program cpld\n");
 			goto end_of_func;
@@ -181,7 +206,7 @@ int main(int argc, char *argv[])
 	}
 
 end_of_func:
-	cpld_intf_close(INTF_JTAG);
+	cpld_intf_close(&ctx, INTF_JTAG);
 	if (rc == 0) {
 		printf_pass();
 		return 0;
@@ -0,0 +1,385 @@
+/*
+* main - update several CPLDs from a manifest, one thread per bus
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "cpld.h"
+
+#define MAX_TARGETS	32
+#define MAX_PATH_LEN	256
+
+struct target {
+	cpld_intf_t intf;
+	int bus; /* i2c bus or jtag device */
+	int slave; /* i2c slave address */
+	char image[MAX_PATH_LEN];
+	char name[32];
+	int group;
+	int rc;
+	double secs;
+	unsigned int last_pct;
+};
+
+struct bus_group {
+	pthread_t tid;
+	int started;
+	struct target *targets[MAX_TARGETS];
+	int count;
+};
+
+static struct target targets[MAX_TARGETS];
+static int target_count;
+static struct bus_group groups[MAX_TARGETS];
+static int group_count;
+static int fast_update;
+
+static void usage(FILE *fp, char **argv)
+{
+	fprintf(fp,
+		"\nampere_cpldupdate_multi v0.0.1 Copyright 2022.\n\n"
+		"Usage: %s -m <manifest> [options]\n\n"
+		"Options:\n"
+		" -h | --help                   Print this message\n"
+		" -m | --manifest               Targets to program, one per line:\n"
+		"                               <i2c|jtag> <bus|jtag-dev> <addr|-> <image>\n"
+		" -f | --fast                   Skip targets that are already up\n"
+		"                               to date and skip blank rows\n"
+		"\n"
+		"Targets on different buses are programmed in parallel, targets\n"
+		"on the same bus one after the other.\n"
+		"",
+		argv[0]);
+}
+
+static const char short_options[] = "hfm:";
+
+static const struct option long_options[] = {
+	{ "help", no_argument, NULL, 'h' },
+	{ "manifest", required_argument, NULL, 'm' },
+	{ "fast", no_argument, NULL, 'f' },
+	{ 0, 0, 0, 0 }
+};
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/******************************************************************************/
+/***************************      Manifest      *******************************/
+/******************************************************************************/
+
+/* a non negative number, or -1 when it is not set or not a number */
+static int parse_number(const char *str)
+{
+	char *end;
+	long val;
+
+	errno = 0;
+	val = strtol(str, &end, 0);
+	if (errno || end == str || *end != '\0' || val < 0 || val > INT_MAX)
+		return -1;
+
+	return val;
+}
+
+static int parse_target(struct target *t, char *line, int lineno)
+{
+	char intf[8];
+	char bus[32];
+	char addr[32];
+
+	if (sscanf(line, "%7s %31s %31s %255s", intf, bus, addr, t->image) !=
+	    4) {
+		printf("[%s] line %d: expected <intf> <bus> <addr> <image>\n",
+		       __func__, lineno);
+		return -1;
+	}
+
+	if (!strcmp(intf, "i2c")) {
+		t->intf = INTF_I2C;
+		if (!strncmp(bus, "/dev/i2c-", strlen("/dev/i2c-")))
+			t->bus = parse_number(bus + strlen("/dev/i2c-"));
+		else
+			t->bus = parse_number(bus);
+		t->slave = parse_number(addr);
+		/* bus 0 is a valid adapter, slave 0 is the general call */
+		if (t->bus < 0 || t->slave <= 0 || t->slave > 0x7f) {
+			printf("[%s] line %d: need bus and slave\n", __func__,
+			       lineno);
+			return -1;
+		}
+		snprintf(t->name, sizeof(t->name), "i2c-%d@0x%02x", t->bus,
+			 t->slave);
+	} else if (!strcmp(intf, "jtag")) {
+		t->intf = INTF_JTAG;
+		if (!strncmp(bus, "/dev/jtag", strlen("/dev/jtag")))
+			t->bus = parse_number(bus + strlen("/dev/jtag"));
+		else
+			t->bus = parse_number(bus);
+		if (t->bus != 0 && t->bus != 1) {
+			printf("[%s] line %d: wrong jtag device\n", __func__,
+			       lineno);
+			return -1;
+		}
+		snprintf(t->name, sizeof(t->name), "jtag%d", t->bus);
+	} else {
+		printf("[%s] line %d: unknown interface %s\n", __func__, lineno,
+		       intf);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* a bus is one i2c adapter or one jtag master */
+static int assign_group(struct target *t)
+{
+	struct target *first;
+	int i;
+
+	for (i = 0; i < group_count; i++) {
+		first = groups[i].targets[0];
+		if (first->intf == t->intf && first->bus == t->bus)
+			break;
+	}
+
+	if (i == group_count)
+		group_count++;
+
+	t->group = i;
+	groups[i].targets[groups[i].count++] = t;
+
+	return 0;
+}
+
+static int load_manifest(const char *file)
+{
+	char line[512];
+	char *p;
+	int lineno = 0;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		printf("[%s] Cannot Open File %s!\n", __func__, file);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+
+		p = strchr(line, '#');
+		if (p != NULL)
+			*p = '\0';
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if (*p == '\0' || *p == '\n' || *p == '\r')
+			continue;
+
+		if (target_count == MAX_TARGETS) {
+			printf("[%s] Too many targets, max %d\n", __func__,
+			       MAX_TARGETS);
+			ret = -1;
+			break;
+		}
+
+		ret = parse_target(&targets[target_count], p, lineno);
+		if (ret < 0)
+			break;
+
+		assign_group(&targets[target_count]);
+		target_count++;
+	}
+
+	fclose(fp);
+
+	if (ret == 0 && target_count == 0) {
+		printf("[%s] No target in %s\n", __func__, file);
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/******************************************************************************/
+/***************************      Update      *********************************/
+/******************************************************************************/
+
+/* one line per 10% so the output of parallel targets stays readable */
+static void target_progress(struct cpld_ctx *ctx, const char *stage,
+			    unsigned int done, unsigned int total)
+{
+	struct target *t = ctx->priv;
+	unsigned int pct;
+
+	if (total == 0)
+		return;
+
+	pct = done * 100 / total;
+	if (done != 1 && pct / 10 == t->last_pct / 10)
+		return;
+
+	t->last_pct = pct;
+	printf("[%s] %s: %u/%u (%u%%)\n", t->name, stage, done, total, pct);
+}
+
+static int update_target(struct target *t)
+{
+	struct cpld_ctx ctx;
+	cpld_intf_info_t info;
+	uint8_t cpld_var[16] = { 0 };
+	char key[32] = { 0 };
+	int rc;
+
+	cpld_ctx_init(&ctx);
+	ctx.progress = target_progress;
+	ctx.priv = t;
+
+	memset(&info, 0, sizeof(info));
+	info.intf = t->intf;
+	info.fast_update = fast_update;
+	if (t->intf == INTF_I2C) {
+		info.bus = t->bus;
+		info.slave = t->slave;
+	} else {
+		info.jtag_device = t->bus;
+	}
+
+	printf("[%s] Programming %s\n", t->name, t->image);
+
+	if (cpld_probe(&ctx, t->intf, &info)) {
+		printf("[%s] CPLD_INTF probe failed!\n", t->name);
+		return -1;
+	}
+
+	if (cpld_scan(&ctx, t->intf)) {
+		printf("[%s] CPLD_INTF scan failed!\n", t->name);
+		rc = -1;
+		goto end_of_func;
+	}
+
+	if (cpld_get_ver(&ctx, (unsigned int *)&cpld_var))
+		printf("[%s] CPLD Version: NA\n", t->name);
+
+	rc = cpld_program(&ctx, t->image, key, 0);
+	if (rc < 0)
+		printf("[%s] Failed to program cpld\n", t->name);
+
+end_of_func:
+	cpld_intf_close(&ctx, t->intf);
+
+	return rc;
+}
+
+static void *bus_thread(void *arg)
+{
+	struct bus_group *g = arg;
+	struct timespec start;
+	struct target *t;
+	int i;
+
+	for (i = 0; i < g->count; i++) {
+		t = g->targets[i];
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		t->rc = update_target(t);
+		t->secs = elapsed(&start);
+		printf("[%s] %s in %.1fs\n", t->name,
+		       t->rc == 0 ? "Done" : "Failed", t->secs);
+	}
+
+	return NULL;
+}
+
+static int print_results(double total)
+{
+	int failed = 0;
+	int i;
+
+	printf("\n%-16s %-6s %8s  %s\n", "Target", "Result", "Time", "Image");
+	for (i = 0; i < target_count; i++) {
+		printf("%-16s %-6s %7.1fs  %s\n", targets[i].name,
+		       targets[i].rc == 0 ? "PASS" : "FAIL", targets[i].secs,
+		       targets[i].image);
+		if (targets[i].rc != 0)
+			failed++;
+	}
+	printf("%d/%d targets updated in %.1fs\n\n", target_count - failed,
+	       target_count, total);
+
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	char option;
+	char *manifest = NULL;
+	struct timespec start;
+	int i;
+
+	while ((option = getopt_long(argc, argv, short_options, long_options,
+				     NULL)) != (char)-1) {
+		switch (option) {
+		case 'h':
+			usage(stdout, argv);
+			exit(EXIT_SUCCESS);
+			break;
+		case 'm':
+			manifest = optarg;
+			break;
+		case 'f':
+			fast_update = 1;
+			break;
+		default:
+			usage(stdout, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (manifest == NULL) {
+		printf("No manifest!\n");
+		usage(stdout, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	if (load_manifest(manifest) < 0)
+		exit(EXIT_FAILURE);
+
+	printf("%d targets on %d buses\n", target_count, group_count);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < group_count; i++) {
+		if (pthread_create(&groups[i].tid, NULL, bus_thread,
+				   &groups[i])) {
+			printf("Failed to start thread for %s\n",
+			       groups[i].targets[0]->name);
+			/* run it here, the other buses keep going */
+			bus_thread(&groups[i]);
+			continue;
+		}
+		groups[i].started = 1;
+	}
+
+	for (i = 0; i < group_count; i++) {
+		if (groups[i].started)
+			pthread_join(groups[i].tid, NULL);
+	}
+
+	if (print_results(elapsed(&start)))
+		exit(EXIT_FAILURE);
+
+	return 0;
+}
@@ -0,0 +1,630 @@
+/*
+* main - update simulated CPLDs and report time and driver calls
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpld.h"
+#include "cpld-sim.h"
+#include "jed-image.h"
+#include "lattice.h"
+
+#define MAX_CASES	(CPLD_SIM_FAMILY_MAX * 2)
+#define MAX_PATH_LEN	256
+#define SIM_UFM_ROWS	64
+#define SIM_SPI_SIZE	(64 * 1024)
+#define SIM_ROW_BYTES	(JED_ROW_WORDS * 4)
+#define SIM_TIME_SLACK	100000 /* us, below this timing is noise */
+
+/*
+ * Keep clear of the bus numbers of real devices, an update journal of a
+ * real CPLD must not be picked up by a simulated one.
+ */
+#define SIM_JTAG_DEVICE 9
+#define SIM_I2C_BUS	250
+#define SIM_I2C_SLAVE	0x40
+
+struct sim_case {
+	enum cpld_sim_family family;
+	int jtag;
+	unsigned int rows; /* CF rows, or image bytes for SPI */
+	int rc;
+	double secs;
+	struct cpld_sim_stats stats;
+};
+
+/* generated image, rows as the JED parser packs them */
+struct sim_image {
+	char path[MAX_PATH_LEN];
+	unsigned int *cf;
+	unsigned int cf_rows;
+	unsigned int *ufm;
+	unsigned int ufm_rows;
+	uint8_t *spi;
+	size_t spi_size;
+	uint32_t usercode;
+};
+
+static struct sim_case cases[MAX_CASES];
+static int case_count;
+static int fast_update;
+static unsigned int max_rows;
+static unsigned int tolerance = 25;
+
+static void usage(FILE *fp, char **argv)
+{
+	fprintf(fp,
+		"\nampere_cpldupdate_sim v0.0.1 Copyright 2022.\n\n"
+		"Usage: %s [options]\n\n"
+		"Options:\n"
+		" -h | --help                   Print this message\n"
+		" -d | --device                 Only this model (default: all)\n"
+		" -i | --interface              Only jtag or i2c (default: both)\n"
+		" -f | --fast                   Use the fast update mode\n"
+		" -r | --rows                   Image size in CF rows or bytes\n"
+		" -b | --busy                   Busy time scale in %% (default: 100)\n"
+		" -o | --output                 Write the results to a CSV file\n"
+		" -c | --compare                Compare with a CSV baseline, fail\n"
+		"                               on more driver calls or a slower\n"
+		"                               update\n"
+		" -t | --tolerance              Allowed slow down in %% (default: 25)\n"
+		" -k | --tck                    Fastest TCK the board carries in Hz,\n"
+		"                               JTAG reads fail above it (default:\n"
+		"                               no limit)\n"
+		"\n"
+		"Models: LCMXO3LF-9400 LCMXO3LF-4300 LCMXO3D-9400 YZBB-Family\n"
+		"        ANLOGIC-Family\n"
+		"",
+		argv[0]);
+}
+
+static const char short_options[] = "hd:i:fr:b:o:c:t:k:";
+
+static const struct option long_options[] = {
+	{ "help", no_argument, NULL, 'h' },
+	{ "device", required_argument, NULL, 'd' },
+	{ "interface", required_argument, NULL, 'i' },
+	{ "fast", no_argument, NULL, 'f' },
+	{ "rows", required_argument, NULL, 'r' },
+	{ "busy", required_argument, NULL, 'b' },
+	{ "output", required_argument, NULL, 'o' },
+	{ "compare", required_argument, NULL, 'c' },
+	{ "tolerance", required_argument, NULL, 't' },
+	{ "tck", required_argument, NULL, 'k' },
+	{ 0, 0, 0, 0 }
+};
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static uint32_t image_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+/******************************************************************************/
+/***************************      Images      *********************************/
+/******************************************************************************/
+
+/* every 8th row is left blank so the fast mode has rows to skip */
+static int gen_rows(unsigned int **rows, unsigned int count, uint32_t *state)
+{
+	unsigned int i;
+
+	*rows = calloc((size_t)count * JED_ROW_WORDS, sizeof(unsigned int));
+	if (*rows == NULL) {
+		printf("[%s] Unable to allocate memory\n", __func__);
+		return -1;
+	}
+
+	for (i = 0; i < count * JED_ROW_WORDS; i++) {
+		if ((i / JED_ROW_WORDS) % 8 != 7)
+			(*rows)[i] = image_rand(state);
+	}
+
+	return 0;
+}
+
+static unsigned int write_rows(FILE *fp, const unsigned int *rows,
+			       unsigned int count)
+{
+	char line[JED_ROW_BITS + 2];
+	const uint8_t *bytes = (const uint8_t *)rows;
+	unsigned int sum = 0;
+	unsigned int i, j;
+
+	line[JED_ROW_BITS] = '\n';
+	line[JED_ROW_BITS + 1] = '\0';
+	for (i = 0; i < count * JED_ROW_WORDS; i += JED_ROW_WORDS) {
+		for (j = 0; j < JED_ROW_BITS; j++)
+			line[j] = '0' + ((rows[i + j / 32] >> (j % 32)) & 1);
+		fputs(line, fp);
+	}
+
+	//the JED C field is the sum of the packed bytes
+	for (i = 0; i < count * SIM_ROW_BYTES; i++)
+		sum += bytes[i];
+
+	return sum;
+}
+
+static int write_jed(struct sim_image *img, FILE *fp)
+{
+	unsigned int sum;
+
+	fprintf(fp, "NOTE simulated image*\nQF%u*\nL000000\n",
+		(img->cf_rows + img->ufm_rows) * JED_ROW_BITS);
+	sum = write_rows(fp, img->cf, img->cf_rows);
+	fprintf(fp, "*\nNOTE TAG DATA*\n");
+	sum += write_rows(fp, img->ufm, img->ufm_rows);
+	fprintf(fp, "*\nNOTE User Electronic Signature Data*\nUH%08X*\n",
+		img->usercode);
+	fprintf(fp, "C%04X*\n", sum & 0xffff);
+
+	return 0;
+}
+
+static int gen_image(struct sim_image *img, struct sim_case *c)
+{
+	const struct cpld_sim_model *m = &cpld_sim_models[c->family];
+	uint32_t state = 0x5eed0000 | c->family;
+	FILE *fp;
+	size_t i;
+	int fd;
+	int ret = 0;
+
+	memset(img, 0, sizeof(*img));
+	img->usercode = 0x20220000 | c->family;
+
+	if (m->spi) {
+		img->spi_size = c->rows;
+		img->spi = malloc(img->spi_size);
+		if (img->spi == NULL) {
+			printf("[%s] Unable to allocate memory\n", __func__);
+			return -1;
+		}
+		for (i = 0; i < img->spi_size; i++)
+			img->spi[i] = image_rand(&state);
+	} else {
+		img->cf_rows = c->rows;
+		img->ufm_rows = m->ufm_rows < SIM_UFM_ROWS ? m->ufm_rows :
+							     SIM_UFM_ROWS;
+		if (gen_rows(&img->cf, img->cf_rows, &state) < 0 ||
+		    gen_rows(&img->ufm, img->ufm_rows, &state) < 0)
+			return -1;
+	}
+
+	snprintf(img->path, sizeof(img->path), "/tmp/cpld-sim-XXXXXX");
+	fd = mkstemp(img->path);
+	if (fd < 0) {
+		printf("[%s] Cannot create %s\n", __func__, img->path);
+		img->path[0] = '\0';
+		return -1;
+	}
+
+	fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	if (m->spi) {
+		if (fwrite(img->spi, 1, img->spi_size, fp) != img->spi_size)
+			ret = -1;
+	} else {
+		ret = write_jed(img, fp);
+	}
+
+	if (fclose(fp) != 0)
+		ret = -1;
+
+	return ret;
+}
+
+static void free_image(struct sim_image *img)
+{
+	if (img->path[0])
+		unlink(img->path);
+	free(img->cf);
+	free(img->ufm);
+	free(img->spi);
+}
+
+/* the device has to hold exactly the image */
+static int check_flash(struct cpld_sim *sim, struct sim_image *img)
+{
+	if (img->spi) {
+		if (memcmp(cpld_sim_flash(sim, 0), img->spi, img->spi_size)) {
+			printf("Flash differs from the image\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (memcmp(cpld_sim_flash(sim, 0), img->cf,
+		   (size_t)img->cf_rows * SIM_ROW_BYTES)) {
+		printf("CF differs from the image\n");
+		return -1;
+	}
+
+	if (memcmp(cpld_sim_flash(sim, 1), img->ufm,
+		   (size_t)img->ufm_rows * SIM_ROW_BYTES)) {
+		printf("UFM differs from the image\n");
+		return -1;
+	}
+
+	if (cpld_sim_usercode(sim) != img->usercode) {
+		printf("USERCODE %X differs from the image %X\n",
+		       cpld_sim_usercode(sim), img->usercode);
+		return -1;
+	}
+
+	return 0;
+}
+
+/******************************************************************************/
+/***************************      Update      *********************************/
+/******************************************************************************/
+
+/* the per row progress output would dominate the measurement */
+static void quiet_progress(struct cpld_ctx *ctx, const char *stage,
+			   unsigned int done, unsigned int total)
+{
+	(void)ctx;
+	(void)stage;
+	(void)done;
+	(void)total;
+}
+
+static int update_sim(struct sim_case *c, struct cpld_sim *sim,
+		      struct sim_image *img)
+{
+	const struct cpld_sim_model *m = &cpld_sim_models[c->family];
+	struct cpld_ctx ctx;
+	cpld_intf_info_t info;
+	unsigned int ver = 0;
+	char key[32] = { 0 };
+	cpld_intf_t intf = c->jtag ? INTF_JTAG : INTF_I2C;
+	int rc;
+
+	cpld_ctx_init(&ctx);
+	ctx.jtag.ops = &cpld_sim_jtag_ops;
+	ctx.progress = quiet_progress;
+
+	memset(&info, 0, sizeof(info));
+	info.intf = intf;
+	info.fast_update = fast_update;
+	info.jtag_device = SIM_JTAG_DEVICE;
+	info.bus = SIM_I2C_BUS;
+	info.slave = (m->spi || c->family == CPLD_SIM_YZBB) ?
+			     YZBB_CPLD_SLAVE :
+			     SIM_I2C_SLAVE;
+
+	//every run tunes TCK from scratch
+	cpld_tck_forget(SIM_JTAG_DEVICE);
+
+	if (cpld_probe(&ctx, intf, &info)) {
+		printf("CPLD_INTF probe failed!\n");
+		return -1;
+	}
+
+	if (cpld_scan(&ctx, intf)) {
+		printf("CPLD_INTF scan failed!\n");
+		rc = -1;
+		goto end_of_func;
+	}
+
+	if (strcmp(ctx.dev->name, m->name)) {
+		printf("Detected %s instead of %s\n", ctx.dev->name, m->name);
+		rc = -1;
+		goto end_of_func;
+	}
+
+	if (cpld_get_ver(&ctx, &ver))
+		printf("CPLD Version: NA\n");
+
+	rc = cpld_program(&ctx, img->path, key, 0);
+	if (rc < 0)
+		printf("Failed to program cpld\n");
+
+end_of_func:
+	cpld_intf_close(&ctx, intf);
+	cpld_tck_forget(SIM_JTAG_DEVICE);
+
+	if (rc == 0)
+		rc = check_flash(sim, img);
+
+	//a misframed or mistimed command is a bug even if the flash is right
+	if (rc == 0 && cpld_sim_stats(sim)->errors) {
+		printf("%lu commands rejected by the device\n",
+		       cpld_sim_stats(sim)->errors);
+		rc = -1;
+	}
+
+	return rc;
+}
+
+static int run_case(struct sim_case *c)
+{
+	struct sim_image img;
+	struct cpld_sim *sim;
+	struct timespec start;
+	const struct cpld_sim_model *m = &cpld_sim_models[c->family];
+
+	printf("\n==== %s over %s ====\n", m->name, c->jtag ? "JTAG" : "I2C");
+	c->rc = -1;
+
+	if (gen_image(&img, c) < 0) {
+		free_image(&img);
+		return -1;
+	}
+
+	sim = cpld_sim_add(c->family, c->jtag,
+			   c->jtag ? SIM_JTAG_DEVICE : SIM_I2C_BUS,
+			   (m->spi || c->family == CPLD_SIM_YZBB) ?
+				   YZBB_CPLD_SLAVE :
+				   SIM_I2C_SLAVE,
+			   c->family + 1);
+	if (sim == NULL) {
+		free_image(&img);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	c->rc = update_sim(c, sim, &img);
+	c->secs = elapsed(&start);
+	c->stats = *cpld_sim_stats(sim);
+
+	cpld_sim_remove(sim);
+	free_image(&img);
+
+	return c->rc;
+}
+
+static void add_cases(int family, const char *intf)
+{
+	const struct cpld_sim_model *m;
+	int i, jtag;
+
+	for (i = 0; i < CPLD_SIM_FAMILY_MAX; i++) {
+		if (family >= 0 && i != family)
+			continue;
+
+		m = &cpld_sim_models[i];
+		for (jtag = 1; jtag >= 0; jtag--) {
+			if (jtag && !m->jtag)
+				continue;
+			if (intf && strcmp(intf, jtag ? "jtag" : "i2c"))
+				continue;
+
+			cases[case_count].family = i;
+			cases[case_count].jtag = jtag;
+			if (m->spi)
+				cases[case_count].rows = SIM_SPI_SIZE;
+			else
+				cases[case_count].rows = m->cf_rows;
+			if (max_rows && max_rows < cases[case_count].rows)
+				cases[case_count].rows = max_rows;
+			case_count++;
+		}
+	}
+}
+
+/******************************************************************************/
+/***************************      Results      ********************************/
+/******************************************************************************/
+
+#define CSV_HEADER                                                     \
+	"model,intf,rows,result,usec,ioctls,bytes,busy_polls,erases,programs," \
+	"reads\n"
+
+static int write_csv(const char *file)
+{
+	struct sim_case *c;
+	FILE *fp;
+	int i;
+
+	fp = fopen(file, "w");
+	if (fp == NULL) {
+		printf("[%s] Cannot Open File %s!\n", __func__, file);
+		return -1;
+	}
+
+	fputs(CSV_HEADER, fp);
+	for (i = 0; i < case_count; i++) {
+		c = &cases[i];
+		fprintf(fp, "%s,%s,%u,%s,%.0f,%lu,%lu,%lu,%lu,%lu,%lu\n",
+			cpld_sim_models[c->family].name,
+			c->jtag ? "jtag" : "i2c", c->rows,
+			c->rc == 0 ? "PASS" : "FAIL", c->secs * 1e6,
+			c->stats.ioctls, c->stats.bytes, c->stats.busy_polls,
+			c->stats.erases, c->stats.programs, c->stats.reads);
+	}
+
+	return fclose(fp);
+}
+
+/*
+ * Driver calls and bytes are exact for a given image, any increase is a
+ * regression. Time only counts beyond the tolerance and SIM_TIME_SLACK.
+ */
+static int compare_csv(const char *file)
+{
+	char line[256];
+	char model[32], intf[8], result[8];
+	unsigned long ioctls, bytes;
+	unsigned int rows;
+	double usec;
+	struct sim_case *c;
+	int regressions = 0;
+	FILE *fp;
+	int i;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		printf("[%s] Cannot Open File %s!\n", __func__, file);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%31[^,],%7[^,],%u,%7[^,],%lf,%lu,%lu", model,
+			   intf, &rows, result, &usec, &ioctls, &bytes) != 7)
+			continue;
+
+		for (i = 0; i < case_count; i++) {
+			c = &cases[i];
+			if (strcmp(model, cpld_sim_models[c->family].name) ||
+			    strcmp(intf, c->jtag ? "jtag" : "i2c") ||
+			    rows != c->rows || c->rc != 0)
+				continue;
+
+			if (c->stats.ioctls > ioctls ||
+			    c->stats.bytes > bytes) {
+				printf("REGRESSION %s %s: %lu ioctls %lu bytes, baseline %lu ioctls %lu bytes\n",
+				       model, intf, c->stats.ioctls,
+				       c->stats.bytes, ioctls, bytes);
+				regressions++;
+			}
+			if (c->secs * 1e6 > usec * (100 + tolerance) / 100 &&
+			    c->secs * 1e6 > usec + SIM_TIME_SLACK) {
+				printf("REGRESSION %s %s: %.2fs, baseline %.2fs\n",
+				       model, intf, c->secs, usec / 1e6);
+				regressions++;
+			}
+		}
+	}
+
+	fclose(fp);
+
+	return regressions;
+}
+
+static int print_results(void)
+{
+	struct sim_case *c;
+	int failed = 0;
+	int i;
+
+	printf("\n%-16s %-5s %7s %-6s %8s %9s %10s %7s %6s\n", "Model", "Intf",
+	       "Rows", "Result", "Time", "ioctls", "bytes", "busy", "/row");
+	for (i = 0; i < case_count; i++) {
+		c = &cases[i];
+		printf("%-16s %-5s %7u %-6s %7.2fs %9lu %10lu %7lu %6.1f\n",
+		       cpld_sim_models[c->family].name,
+		       c->jtag ? "jtag" : "i2c", c->rows,
+		       c->rc == 0 ? "PASS" : "FAIL", c->secs, c->stats.ioctls,
+		       c->stats.bytes, c->stats.busy_polls,
+		       c->stats.programs ? (double)c->stats.ioctls /
+						   c->stats.programs :
+					   0.0);
+		if (c->rc != 0)
+			failed++;
+	}
+	printf("%d/%d updates passed\n\n", case_count - failed, case_count);
+
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	char option;
+	char *output = NULL;
+	char *baseline = NULL;
+	char *intf = NULL;
+	int family = -1;
+	int failed;
+	int i;
+
+	while ((option = getopt_long(argc, argv, short_options, long_options,
+				     NULL)) != (char)-1) {
+		switch (option) {
+		case 'h':
+			usage(stdout, argv);
+			exit(EXIT_SUCCESS);
+			break;
+		case 'd':
+			for (family = 0; family < CPLD_SIM_FAMILY_MAX;
+			     family++) {
+				if (!strcmp(optarg,
+					    cpld_sim_models[family].name))
+					break;
+			}
+			if (family == CPLD_SIM_FAMILY_MAX) {
+				printf("Unknown model %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'i':
+			if (strcmp(optarg, "jtag") && strcmp(optarg, "i2c")) {
+				printf("Unknown interface %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			intf = optarg;
+			break;
+		case 'f':
+			fast_update = 1;
+			break;
+		case 'r':
+			max_rows = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			cpld_sim_set_busy_scale(strtoul(optarg, NULL, 0));
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'c':
+			baseline = optarg;
+			break;
+		case 't':
+			tolerance = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			cpld_sim_set_tck_limit(strtoul(optarg, NULL, 0));
+			break;
+		default:
+			usage(stdout, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	add_cases(family, intf);
+	if (case_count == 0) {
+		printf("Nothing to run\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < case_count; i++)
+		run_case(&cases[i]);
+
+	failed = print_results();
+
+	if (output && write_csv(output) < 0)
+		failed++;
+
+	if (baseline)
+		failed += compare_csv(baseline) != 0;
+
+	if (failed)
+		exit(EXIT_FAILURE);
+
+	return 0;
+}
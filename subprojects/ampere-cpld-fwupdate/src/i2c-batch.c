@@ -0,0 +1,59 @@
+/*
+ * I2C transfer batch on top of i2c-lib
+ */
+
+#include <string.h>
+#include "i2c-batch.h"
+
+void i2c_batch_init(struct i2c_batch *b, int file)
+{
+	memset(b, 0, sizeof(*b));
+	b->file = file;
+}
+
+int i2c_batch_add(struct i2c_batch *b, uint8_t addr, uint8_t *tbuf,
+		  uint16_t tcount, uint8_t *rbuf, uint16_t rcount)
+{
+	unsigned int need = (tcount ? 1 : 0) + (rcount ? 1 : 0);
+	struct i2c_xfer_msg *msg;
+
+	/* Flush on overflow so a write and its read stay in one transfer */
+	if (b->count + need > I2C_XFER_MAX_MSGS) {
+		if (i2c_batch_flush(b) < 0)
+			return -1;
+	}
+
+	if (tcount) {
+		msg = &b->msgs[b->count++];
+		msg->addr = addr;
+		msg->read = 0;
+		msg->len = tcount;
+		msg->buf = tbuf;
+	}
+
+	if (rcount) {
+		msg = &b->msgs[b->count++];
+		msg->addr = addr;
+		msg->read = 1;
+		msg->len = rcount;
+		msg->buf = rbuf;
+	}
+
+	return 0;
+}
+
+int i2c_batch_flush(struct i2c_batch *b)
+{
+	int ret;
+
+	if (b->count == 0)
+		return 0;
+
+	ret = i2c_rdwr_msgs(b->file, b->msgs, b->count);
+
+	b->flushes++;
+	b->sent += b->count;
+	b->count = 0;
+
+	return ret < 0 ? -1 : 0;
+}
@@ -79,3 +79,34 @@ int i2c_rdwr_msg_transfer(int file, uint8_t addr, uint8_t *tbuf,
 	}
 	return 0;
 }
+
+int i2c_rdwr_msgs(int file, const struct i2c_xfer_msg *msgs,
+		  unsigned int count)
+{
+	struct i2c_rdwr_ioctl_data data;
+	struct i2c_msg msg[I2C_XFER_MAX_MSGS];
+	unsigned int i;
+	int rc;
+
+	if (count > I2C_XFER_MAX_MSGS)
+		return -1;
+
+	memset(&msg, 0, sizeof(msg));
+
+	for (i = 0; i < count; i++) {
+		msg[i].addr = msgs[i].addr >> 1;
+		msg[i].flags = msgs[i].read ? I2C_M_RD : 0;
+		msg[i].len = msgs[i].len;
+		msg[i].buf = msgs[i].buf;
+	}
+
+	data.msgs = msg;
+	data.nmsgs = count;
+
+	rc = ioctl(file, I2C_RDWR, &data);
+	if (rc < 0) {
+		// syslog(LOG_ERR, "Failed to do raw io");
+		return -1;
+	}
+	return 0;
+}
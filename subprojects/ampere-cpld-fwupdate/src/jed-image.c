@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jed-image.h"
+
+//#define DEBUG
+#ifdef DEBUG
+#define CPLD_DEBUG(...) printf(__VA_ARGS__);
+#else
+#define CPLD_DEBUG(...)
+#endif
+
+#define ARRAY_SIZE(x)	(sizeof(x) / sizeof((x)[0]))
+#define JED_ROWS_INIT	256
+
+enum jed_state {
+	JED_IDLE = 0,
+	JED_CF = 1,
+	JED_UFM = 2,
+	JED_ENDCF = 3,
+	JED_FEATURE = 4,
+	JED_USERCODE = 5,
+};
+
+struct jed_parser {
+	struct jed_image *img;
+	enum jed_state state;
+	unsigned int sum;
+	int has_checksum;
+};
+
+typedef void (*jed_tag_fn)(struct jed_parser *p, const char *line,
+			   size_t len);
+
+struct jed_tag {
+	const char *name;
+	size_t len;
+	jed_tag_fn fn;
+};
+
+/******************************************************************************/
+/***************************      Field Decoding      *************************/
+/******************************************************************************/
+
+/* decimal digits up to the first non-digit */
+static unsigned long jed_dec(const char *s, size_t len)
+{
+	unsigned long val = 0;
+	size_t i;
+
+	for (i = 0; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+		val = val * 10 + (s[i] - '0');
+	}
+
+	return val;
+}
+
+/* hex digits up to the first non-hex character */
+static unsigned int jed_hex(const char *s, size_t len)
+{
+	unsigned int val = 0;
+	size_t i;
+	int d;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] >= '0' && s[i] <= '9') {
+			d = s[i] - '0';
+		} else if (s[i] >= 'a' && s[i] <= 'f') {
+			d = s[i] - 'a' + 10;
+		} else if (s[i] >= 'A' && s[i] <= 'F') {
+			d = s[i] - 'A' + 10;
+		} else {
+			break;
+		}
+		val = (val << 4) | d;
+	}
+
+	return val;
+}
+
+/* binary digits up to the first non-fuse character, low 32 bits kept */
+static unsigned int jed_bits(const char *s, size_t len)
+{
+	unsigned int val = 0;
+	size_t i;
+
+	for (i = 0; i < len && (s[i] == '0' || s[i] == '1'); i++) {
+		val = (val << 1) | (s[i] - '0');
+	}
+
+	return val;
+}
+
+/******************************************************************************/
+/***************************      Fuse Rows      ******************************/
+/******************************************************************************/
+
+static int jed_add_row(struct jed_parser *p, unsigned int **rows,
+		       unsigned int *count, unsigned int *cap,
+		       const char *line, size_t len)
+{
+	unsigned int *row;
+	unsigned int *tmp;
+	unsigned int new_cap;
+	unsigned int i;
+
+	if (len < JED_ROW_BITS) {
+		printf("[%s] Row %u is %zu fuses long, expected %d\n", __func__,
+		       *count, len, JED_ROW_BITS);
+		return -1;
+	}
+
+	if (*count == *cap) {
+		new_cap = *cap ? *cap * 2 : JED_ROWS_INIT;
+		tmp = realloc(*rows, (size_t)new_cap * JED_ROW_WORDS *
+					     sizeof(unsigned int));
+		if (tmp == NULL) {
+			printf("[%s] Unable to allocate memory\n", __func__);
+			return -1;
+		}
+		*rows = tmp;
+		*cap = new_cap;
+	}
+
+	row = *rows + (size_t)*count * JED_ROW_WORDS;
+	memset(row, 0, JED_ROW_WORDS * sizeof(unsigned int));
+
+	for (i = 0; i < JED_ROW_BITS; i++) {
+		if (line[i] != '0' && line[i] != '1') {
+			printf("[%s] Invalid fuse '%c' in row %u\n", __func__,
+			       line[i], *count);
+			return -1;
+		}
+		row[i / 32] |= (unsigned int)(line[i] - '0') << (i % 32);
+	}
+
+	for (i = 0; i < JED_ROW_WORDS; i++) {
+		p->sum += (row[i] >> 24) & 0xff;
+		p->sum += (row[i] >> 16) & 0xff;
+		p->sum += (row[i] >> 8) & 0xff;
+		p->sum += row[i] & 0xff;
+	}
+
+	(*count)++;
+
+	return 0;
+}
+
+/******************************************************************************/
+/***************************      Tag Handlers      ***************************/
+/******************************************************************************/
+
+static void jed_tag_qf(struct jed_parser *p, const char *line, size_t len)
+{
+	p->img->QF = jed_dec(line + 2, len - 2);
+	p->state = JED_IDLE;
+	CPLD_DEBUG("[QF]%ld\n", p->img->QF);
+}
+
+static void jed_tag_cf(struct jed_parser *p, const char *line, size_t len)
+{
+	(void)line;
+	(void)len;
+	p->state = JED_CF;
+	CPLD_DEBUG("[CFStart]\n");
+}
+
+static void jed_tag_ufm(struct jed_parser *p, const char *line, size_t len)
+{
+	(void)line;
+	(void)len;
+	p->state = JED_UFM;
+	CPLD_DEBUG("[UFMStart]\n");
+}
+
+static void jed_tag_endcf(struct jed_parser *p, const char *line, size_t len)
+{
+	(void)line;
+	(void)len;
+	p->state = JED_ENDCF;
+	CPLD_DEBUG("[CFEnd]\n");
+}
+
+static void jed_tag_feature(struct jed_parser *p, const char *line,
+			    size_t len)
+{
+	(void)line;
+	(void)len;
+	p->state = JED_FEATURE;
+	CPLD_DEBUG("[ROWStart]\n");
+}
+
+static void jed_tag_usercode(struct jed_parser *p, const char *line,
+			     size_t len)
+{
+	(void)line;
+	(void)len;
+	p->state = JED_USERCODE;
+	CPLD_DEBUG("[VersionStart]\n");
+}
+
+static void jed_tag_checksum(struct jed_parser *p, const char *line,
+			     size_t len)
+{
+	p->img->CheckSum = jed_hex(line + 1, len - 1);
+	p->has_checksum = 1;
+	p->state = JED_IDLE;
+	printf("JED Checksum from file: %X\n", p->img->CheckSum);
+}
+
+#define JED_TAG(name, fn) { name, sizeof(name) - 1, fn }
+
+/* checked in order, the first match wins */
+static const struct jed_tag jed_tags[] = {
+	JED_TAG("QF", jed_tag_qf),
+	JED_TAG("L000", jed_tag_cf),
+	JED_TAG("NOTE TAG DATA", jed_tag_ufm),
+	JED_TAG("NOTE FEATURE", jed_tag_feature),
+	JED_TAG("NOTE User Electronic", jed_tag_usercode),
+	JED_TAG("C", jed_tag_checksum),
+	JED_TAG("NOTE END CONFIG DATA", jed_tag_endcf),
+};
+
+static int jed_dispatch_tag(struct jed_parser *p, const char *line,
+			    size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(jed_tags); i++) {
+		if (len >= jed_tags[i].len &&
+		    !memcmp(line, jed_tags[i].name, jed_tags[i].len)) {
+			jed_tags[i].fn(p, line, len);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int jed_parse_line(struct jed_parser *p, const char *line, size_t len)
+{
+	struct jed_image *img = p->img;
+
+	/* fuse rows are by far the most common lines, check them first */
+	if (line[0] == '0' || line[0] == '1') {
+		switch (p->state) {
+		case JED_CF:
+			return jed_add_row(p, &img->CF, &img->CF_Line,
+					   &img->CF_Cap, line, len);
+		case JED_UFM:
+			return jed_add_row(p, &img->UFM, &img->UFM_Line,
+					   &img->UFM_Cap, line, len);
+		case JED_ENDCF:
+			return jed_add_row(p, &img->EndCF, &img->EndCF_Line,
+					   &img->EndCF_Cap, line, len);
+		default:
+			break;
+		}
+	}
+
+	if (jed_dispatch_tag(p, line, len)) {
+		return 0;
+	}
+
+	switch (p->state) {
+	case JED_FEATURE:
+		if (line[0] == 'E') {
+			img->FeatureRow = jed_bits(line + 1, len - 1);
+			CPLD_DEBUG("[FeatureROW]%x\n", img->FeatureRow);
+		} else {
+			img->FEARBits = jed_bits(line, len);
+			CPLD_DEBUG("[FEARBits]%x\n", img->FEARBits);
+			p->state = JED_IDLE;
+		}
+		break;
+	case JED_USERCODE:
+		if (len > 2 && line[0] == 'U' && line[1] == 'H') {
+			img->Version = jed_hex(line + 2, len - 2);
+			CPLD_DEBUG("[UserCode]%x\n", img->Version);
+		}
+		p->state = JED_IDLE;
+		break;
+	case JED_UFM:
+	case JED_ENDCF:
+		/* address line of the section */
+		if (line[0] != 'L') {
+			p->state = JED_IDLE;
+		}
+		break;
+	default:
+		p->state = JED_IDLE;
+		break;
+	}
+
+	return 0;
+}
+
+/******************************************************************************/
+/***************************      Image API      ******************************/
+/******************************************************************************/
+
+/* map the whole image file read-only */
+int jed_image_map(struct jed_image *img, FILE *fp)
+{
+	struct stat st;
+	void *map;
+
+	memset(img, 0, sizeof(*img));
+
+	if (fstat(fileno(fp), &st) < 0) {
+		perror("fstat");
+		return -1;
+	}
+
+	if (st.st_size <= 0) {
+		printf("[%s] Empty image file\n", __func__);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	img->data = map;
+	img->size = st.st_size;
+	CPLD_DEBUG("[%s] Image size %zu\n", __func__, img->size);
+
+	return 0;
+}
+
+/* tokenise the mapped JED file in one pass and validate its checksum */
+int jed_image_parse(struct jed_image *img)
+{
+	struct jed_parser p = { .img = img, .state = JED_IDLE };
+	const char *pos = (const char *)img->data;
+	const char *end = pos + img->size;
+	const char *line;
+	const char *nl;
+	size_t len;
+
+	while (pos < end) {
+		line = pos;
+		nl = memchr(pos, '\n', end - pos);
+		len = (nl ? nl : end) - line;
+		pos = nl ? nl + 1 : end;
+
+		if (len && line[len - 1] == '\r') {
+			len--;
+		}
+		if (!len) {
+			continue;
+		}
+
+		if (jed_parse_line(&p, line, len) < 0) {
+			return -1;
+		}
+	}
+
+	//cf must greater than 0
+	if (!img->CF_Line) {
+		printf("[%s] No CF data in JED file\n", __func__);
+		return -1;
+	}
+
+	p.sum &= 0xffff;
+	if (!p.has_checksum || img->CheckSum != p.sum || img->CheckSum == 0) {
+		printf("[%s] JED File CheckSum Error\n", __func__);
+		return -1;
+	}
+	CPLD_DEBUG("[%s] JED File CheckSum OKay\n", __func__);
+	CPLD_DEBUG("[%s] CF %u UFM %u EndCF %u rows\n", __func__, img->CF_Line,
+		   img->UFM_Line, img->EndCF_Line);
+
+	return 0;
+}
+
+int jed_image_load(struct jed_image *img, FILE *fp)
+{
+	int ret;
+
+	ret = jed_image_map(img, fp);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = jed_image_parse(img);
+	if (ret < 0) {
+		jed_image_free(img);
+	}
+
+	return ret;
+}
+
+void jed_image_free(struct jed_image *img)
+{
+	if (img->data) {
+		munmap((void *)img->data, img->size);
+	}
+
+	free(img->CF);
+	free(img->UFM);
+	free(img->EndCF);
+	memset(img, 0, sizeof(*img));
+}
@@ -4,8 +4,12 @@
 #include <string.h>
 #include "ast-jtag.h"
 #include "cpld.h"
+#include "cpld-timing.h"
 #include "lattice.h"
+#include "jed-image.h"
+#include "cpld-readback.h"
 #include "i2c-lib.h"
+#include "i2c-batch.h"
 
 //#define DEBUG
 //#define VERBOSE_DEBUG
@@ -17,26 +21,10 @@
 
 #define ERR_PRINT(...) fprintf(stderr, __VA_ARGS__);
 
-#define MAX_RETRY	 4000
 #define LATTICE_COL_SIZE 128
 #define ARRAY_SIZE(x)	 (sizeof(x) / sizeof((x)[0]))
 #define UNUSED(x)	 (void)(x)
 
-typedef struct {
-	unsigned long int QF;
-	unsigned int *CF;
-	unsigned int CF_Line;
-	unsigned int *UFM;
-	unsigned int UFM_Line;
-	unsigned int *EndCF;
-	unsigned int EndCF_Line;
-	unsigned int Version;
-	unsigned int CheckSum;
-	unsigned int FEARBits;
-	unsigned int FeatureRow;
-
-} CPLDInfo;
-
 //#define CPLD_DEBUG //enable debug message
 //#define VERBOSE_DEBUG //enable detail debug message
 
@@ -50,93 +38,10 @@ enum {
 	Both_CF_UFM = 1,
 };
 
-static cpld_intf_info_t cpld;
-
 /******************************************************************************/
 /***************************      Common Functions      ***********************/
 /******************************************************************************/
 
-/*search the index of char in string*/
-static int indexof(const char *str, const char *c)
-{
-	char *ptr = strstr(str, c);
-	int index = 0;
-
-	if (ptr) {
-		index = ptr - str;
-	} else {
-		index = -1;
-	}
-
-	return index;
-}
-
-/*identify the str start with a specific str or not*/
-static int startWith(const char *str, const char *c)
-{
-	int len = strlen(c);
-	int i;
-
-	for (i = 0; i < len; i++) {
-		if (str[i] != c[i]) {
-			return 0;
-		}
-	}
-	return 1;
-}
-
-/*convert bit data to byte data*/
-static unsigned int ShiftData(char *data, unsigned int *result, int len)
-{
-	int i;
-	int ret = 0;
-	int result_index = 0, data_index = 0;
-	int bit_count = 0;
-
-#ifdef VERBOSE_DEBUG
-	printf("[%s][%s]\n", __func__, data);
-
-	for (i = 0; i < len; i++) {
-		printf("%c", data[i]);
-
-		if (0 == ((i + 1) % 8)) {
-			printf("\n");
-		}
-	}
-#endif
-
-	for (i = 0; i < len; i++) {
-		data[i] = data[i] - 0x30;
-
-		result[result_index] |= ((unsigned char)data[i] << data_index);
-
-#ifdef VERBOSE_DEBUG
-		printf("[%s]%x %d %x\n", __func__, data[i], data_index,
-		       result[result_index]);
-#endif
-		data_index++;
-
-		bit_count++;
-
-		if (0 == ((i + 1) % 32)) {
-			data_index = 0;
-#ifdef VERBOSE_DEBUG
-			printf("[%s]%x\n", __func__, result[result_index]);
-#endif
-			result_index++;
-		}
-	}
-
-	if (bit_count != len) {
-		printf("[%s] Expected Data Length is [%d] but not [%d] ",
-		       __func__, bit_count, len);
-
-		ret = -1;
-	}
-
-	return ret;
-}
-
 static unsigned int byte_to_int(uint8_t *data)
 {
 	return (((data[0] & 0xFF) << 24) | ((data[1] & 0xFF) << 16) |
@@ -166,471 +71,46 @@ static void swap_bit_byte(uint8_t *data, unsigned int len)
 	}
 }
 
-/*check the size of cf and ufm*/
-static int jed_update_data_size(FILE *jed_fd, int *cf_size, int *ufm_size,
-				int *endcfg_size)
+/*
+ * Open the update journal of this target. Returns the CF row an interrupted
+ * update of the same image got to, or -1 when the flash has to be erased.
+ */
+static int journal_open(struct cpld_ctx *ctx, struct jed_image *dev_info)
 {
-	const char TAG_CF_START[] = "L000";
-	int ReadLineSize = LATTICE_COL_SIZE + 2;
-	char tmp_buf[ReadLineSize];
-	unsigned int CFStart = 0;
-	unsigned int UFMStart = 0;
-	unsigned int CFEnd = 0;
-	const char TAG_UFM[] = "NOTE TAG DATA";
-	const char TAG_CF_END[] = "NOTE END CONFIG DATA";
-	int ret = 0;
-
-	while (NULL != fgets(tmp_buf, ReadLineSize, jed_fd)) {
-		if (startWith(tmp_buf, TAG_CF_START /*"L000"*/)) {
-			CFStart = 1;
-		} else if (startWith(tmp_buf, TAG_UFM /*"NOTE TAG DATA"*/)) {
-			UFMStart = 1;
-		} else if (startWith(tmp_buf,
-				     TAG_CF_END /*"NOTE END CONFIG DATA"*/)) {
-			CFEnd = 1;
-		}
-
-		if (CFStart) {
-			if (!startWith(tmp_buf, TAG_CF_START /*"L000"*/) &&
-			    strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "0") ||
-				    startWith(tmp_buf, "1")) {
-					(*cf_size)++;
-				} else {
-					CFStart = 0;
-				}
-			}
-		} else if (UFMStart) {
-			if (!startWith(tmp_buf, TAG_UFM /*"NOTE TAG DATA"*/) &&
-			    !startWith(tmp_buf, "L") && strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "0") ||
-				    startWith(tmp_buf, "1")) {
-					(*ufm_size)++;
-				} else {
-					UFMStart = 0;
-				}
-			}
-		} else if (CFEnd) {
-			if (!startWith(tmp_buf,
-				       TAG_CF_END /*"NOTE END CONFIG DATA"*/) &&
-			    !startWith(tmp_buf, "L") && strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "0") ||
-				    startWith(tmp_buf, "1")) {
-					(*endcfg_size)++;
-				} else {
-					CFEnd = 0;
-				}
-			}
-		}
-	}
-
-	//cf must greater than 0
-	if (!(*cf_size)) {
-		ret = -1;
-	}
-
-	return ret;
-}
-
-static int jed_file_parser(FILE *jed_fd, CPLDInfo *dev_info, int cf_size,
-			   int ufm_size, int endcfg_size)
-{
-	/**TAG Information**/
-	const char TAG_QF[] = "QF";
-	const char TAG_CF_START[] = "L000";
-	const char TAG_UFM[] = "NOTE TAG DATA";
-	const char TAG_CF_END[] = "NOTE END CONFIG DATA";
-	const char TAG_ROW[] = "NOTE FEATURE";
-	const char TAG_CHECKSUM[] = "C";
-	const char TAG_USERCODE[] = "NOTE User Electronic";
-	/**TAG Information**/
-
-	int ReadLineSize =
-		LATTICE_COL_SIZE +
-		2; //the len of 128 only contain data size, '\n' need to be considered, too.
-	char tmp_buf[ReadLineSize];
-	char data_buf[LATTICE_COL_SIZE];
-	unsigned int CFStart = 0;
-	unsigned int UFMStart = 0;
-	unsigned int CFEnd = 0;
-	unsigned int ROWStart = 0;
-	unsigned int VersionStart = 0;
-	unsigned int ChkSUMStart = 0;
-	unsigned int JED_CheckSum = 0;
-	int copy_size;
-	int current_addr = 0;
-	unsigned int i;
-	int ret = 0;
-	int cf_size_used = (cf_size * LATTICE_COL_SIZE) / 8; // unit: bytes
-	int ufm_size_used = (ufm_size * LATTICE_COL_SIZE) / 8; // unit: bytes
-	int endcfg_size_used =
-		(endcfg_size * LATTICE_COL_SIZE) / 8; // unit: bytes
-
-	dev_info->CF = (unsigned int *)malloc(cf_size_used);
-	memset(dev_info->CF, 0, cf_size_used);
-
-	if (ufm_size_used) {
-		dev_info->UFM = (unsigned int *)malloc(ufm_size_used);
-		memset(dev_info->UFM, 0, ufm_size_used);
-	}
-
-	if (endcfg_size_used) {
-		dev_info->EndCF = (unsigned int *)malloc(endcfg_size_used);
-		memset(dev_info->EndCF, 0, endcfg_size_used);
-	}
-
-	dev_info->CF_Line = 0;
-	dev_info->UFM_Line = 0;
-	dev_info->EndCF_Line = 0;
-
-	while (NULL != fgets(tmp_buf, ReadLineSize, jed_fd)) {
-		if (startWith(tmp_buf, TAG_QF /*"QF"*/)) {
-			copy_size = indexof(tmp_buf, "*") -
-				    indexof(tmp_buf, "F") - 1;
-
-			memset(data_buf, 0, sizeof(data_buf));
-
-			memcpy(data_buf, &tmp_buf[2], copy_size);
-
-			dev_info->QF = atol(data_buf);
-
-			CPLD_DEBUG("[QF]%ld\n", dev_info->QF);
-		} else if (startWith(tmp_buf, TAG_CF_START /*"L000"*/)) {
-			CPLD_DEBUG("[CFStart]\n");
-			CFStart = 1;
-		} else if (startWith(tmp_buf, TAG_UFM /*"NOTE TAG DATA"*/)) {
-			CPLD_DEBUG("[UFMStart]\n");
-			UFMStart = 1;
-		} else if (startWith(tmp_buf, TAG_ROW /*"NOTE FEATURE"*/)) {
-			CPLD_DEBUG("[ROWStart]\n");
-			ROWStart = 1;
-		} else if (startWith(tmp_buf,
-				     TAG_USERCODE /*"NOTE User Electronic"*/)) {
-			CPLD_DEBUG("[VersionStart]\n");
-			VersionStart = 1;
-		} else if (startWith(tmp_buf, TAG_CHECKSUM /*"C"*/)) {
-			CPLD_DEBUG("[ChkSUMStart]\n");
-			ChkSUMStart = 1;
-		} else if (startWith(tmp_buf,
-				     TAG_CF_END /*"NOTE END CONFIG DATA"*/)) {
-			CPLD_DEBUG("[CFEnd]\n");
-			CFEnd = 1;
-		}
-
-		if (CFStart) {
-#ifdef VERBOSE_DEBUG
-			printf("[%s][%d][%c]", __func__, strlen(tmp_buf),
-			       tmp_buf[0]);
-#endif
-			if (!startWith(tmp_buf, TAG_CF_START /*"L000"*/) &&
-			    strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "0") ||
-				    startWith(tmp_buf, "1")) {
-					current_addr = (dev_info->CF_Line *
-							LATTICE_COL_SIZE) /
-						       32;
-
-					memset(data_buf, 0, sizeof(data_buf));
-
-					memcpy(data_buf, tmp_buf,
-					       LATTICE_COL_SIZE);
-
-					/*convert string to byte data*/
-					ShiftData(data_buf,
-						  &dev_info->CF[current_addr],
-						  LATTICE_COL_SIZE);
-
-#ifdef VERBOSE_DEBUG
-					//          printf("[%d]%x %x %x %x\n",dev_info->CF_Line, dev_info->CF[current_addr],dev_info->CF[current_addr+1],dev_info->CF[current_addr+2],dev_info->CF[current_addr+3]);
-					printf("[%d] ", dev_info->CF_Line);
-					for (i = 0; i < sizeof(unsigned int);
-					     i++) {
-						printf("%x ",
-						       (dev_info->CF[current_addr +
-								     i]) &
-							       0xff);
-						printf("%x ",
-						       (dev_info->CF[current_addr +
-								     i] >>
-							8) & 0xff);
-						printf("%x ",
-						       (dev_info->CF[current_addr +
-								     i] >>
-							16) & 0xff);
-						printf("%x ",
-						       (dev_info->CF[current_addr +
-								     i] >>
-							24) & 0xff);
-					}
-					printf("\n");
-#endif
-					//each data has 128bits(4*unsigned int), so the for-loop need to be run 4 times
-
-					for (i = 0; i < sizeof(unsigned int);
-					     i++) {
-						JED_CheckSum +=
-							(dev_info->CF
-								 [current_addr +
-								  i] >>
-							 24) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->CF
-								 [current_addr +
-								  i] >>
-							 16) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->CF
-								 [current_addr +
-								  i] >>
-							 8) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->CF
-								 [current_addr +
-								  i]) &
-							0xff;
-					}
-
-					dev_info->CF_Line++;
-				} else {
-					CPLD_DEBUG("[%s]CF Line: %d\n",
-						   __func__, dev_info->CF_Line);
-					CFStart = 0;
-				}
-			}
-		} else if (ChkSUMStart && strlen(tmp_buf) != 1) {
-			ChkSUMStart = 0;
-
-			copy_size = indexof(tmp_buf, "*") -
-				    indexof(tmp_buf, "C") - 1;
-
-			memset(data_buf, 0, sizeof(data_buf));
-
-			memcpy(data_buf, &tmp_buf[1], copy_size);
-
-			dev_info->CheckSum = strtoul(data_buf, NULL, 16);
-			printf("JED Checksum from file: %X\n",
-			       dev_info->CheckSum);
-		} else if (ROWStart) {
-			if (!startWith(tmp_buf, TAG_ROW /*"NOTE FEATURE"*/) &&
-			    strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "E")) {
-					copy_size = strlen(tmp_buf) -
-						    indexof(tmp_buf, "E") - 2;
-
-					memset(data_buf, 0, sizeof(data_buf));
-
-					memcpy(data_buf, &tmp_buf[1],
-					       copy_size);
-
-					dev_info->FeatureRow =
-						strtoul(data_buf, NULL, 2);
-				} else {
-					copy_size = indexof(tmp_buf, "*") - 1;
-
-					memset(data_buf, 0, sizeof(data_buf));
+	char name[32];
 
-					memcpy(data_buf, &tmp_buf[2],
-					       copy_size);
-
-					dev_info->FEARBits =
-						strtoul(data_buf, NULL, 2);
-					CPLD_DEBUG("[FeatureROW]%x\n",
-						   dev_info->FeatureRow);
-					CPLD_DEBUG("[FEARBits]%x\n",
-						   dev_info->FEARBits);
-					ROWStart = 0;
-				}
-			}
-		} else if (VersionStart) {
-			if (!startWith(
-				    tmp_buf,
-				    TAG_USERCODE /*"NOTE User Electronic"*/) &&
-			    strlen(tmp_buf) != 1) {
-				VersionStart = 0;
-
-				if (startWith(tmp_buf, "UH")) {
-					copy_size = indexof(tmp_buf, "*") -
-						    indexof(tmp_buf, "H") - 1;
-
-					memset(data_buf, 0, sizeof(data_buf));
-
-					memcpy(data_buf, &tmp_buf[2],
-					       copy_size);
-
-					dev_info->Version =
-						strtoul(data_buf, NULL, 16);
-					CPLD_DEBUG("[UserCode]%x\n",
-						   dev_info->Version);
-				}
-			}
-		} else if (UFMStart) {
-			if (!startWith(tmp_buf, TAG_UFM /*"NOTE TAG DATA"*/) &&
-			    !startWith(tmp_buf, "L") && strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "0") ||
-				    startWith(tmp_buf, "1")) {
-					current_addr = (dev_info->UFM_Line *
-							LATTICE_COL_SIZE) /
-						       32;
-
-					memset(data_buf, 0, sizeof(data_buf));
-
-					memcpy(data_buf, tmp_buf,
-					       LATTICE_COL_SIZE);
-
-					ShiftData(data_buf,
-						  &dev_info->UFM[current_addr],
-						  LATTICE_COL_SIZE);
-#ifdef VERBOSE_DEBUG
-					printf("%x %x %x %x\n",
-					       dev_info->UFM[current_addr],
-					       dev_info->UFM[current_addr + 1],
-					       dev_info->UFM[current_addr + 2],
-					       dev_info->UFM[current_addr + 3]);
-#endif
-					//each data has 128bits(4*unsigned int), so the for-loop need to be run 4 times
-
-					for (i = 0; i < sizeof(unsigned int);
-					     i++) {
-						JED_CheckSum +=
-							(dev_info->UFM
-								 [current_addr +
-								  i] >>
-							 24) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->UFM
-								 [current_addr +
-								  i] >>
-							 16) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->UFM
-								 [current_addr +
-								  i] >>
-							 8) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->UFM
-								 [current_addr +
-								  i]) &
-							0xff;
-					}
-
-					dev_info->UFM_Line++;
-				} else {
-					CPLD_DEBUG("[%s]UFM Line: %d\n",
-						   __func__,
-						   dev_info->UFM_Line);
-					UFMStart = 0;
-				}
-			}
-		} else if (CFEnd) {
-			if (!startWith(tmp_buf,
-				       TAG_CF_END /*"NOTE END CONFIG DATA"*/) &&
-			    !startWith(tmp_buf, "L") && strlen(tmp_buf) != 1) {
-				if (startWith(tmp_buf, "0") ||
-				    startWith(tmp_buf, "1")) {
-					current_addr = (dev_info->EndCF_Line *
-							LATTICE_COL_SIZE) /
-						       32;
-					memset(data_buf, 0, sizeof(data_buf));
-					memcpy(data_buf, tmp_buf,
-					       LATTICE_COL_SIZE);
-					ShiftData(
-						data_buf,
-						&dev_info->EndCF[current_addr],
-						LATTICE_COL_SIZE);
-#ifdef VERBOSE_DEBUG
-					printf("dev_info->EndCF_Line : %d | %x %x %x %x\n",
-					       dev_info->EndCF_Line,
-					       dev_info->EndCF[current_addr],
-					       dev_info->EndCF[current_addr + 1],
-					       dev_info->EndCF[current_addr + 2],
-					       dev_info->EndCF[current_addr +
-							       3]);
-#endif
-					//each data has 128bits(4*unsigned int), so the for-loop need to be run 4 times
-					for (i = 0; i < sizeof(unsigned int);
-					     i++) {
-						JED_CheckSum +=
-							(dev_info->EndCF
-								 [current_addr +
-								  i] >>
-							 24) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->EndCF
-								 [current_addr +
-								  i] >>
-							 16) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->EndCF
-								 [current_addr +
-								  i] >>
-							 8) &
-							0xff;
-						JED_CheckSum +=
-							(dev_info->EndCF
-								 [current_addr +
-								  i]) &
-							0xff;
-					}
-
-					dev_info->EndCF_Line++;
-				} else {
-					CPLD_DEBUG("[%s]EndCF Line: %d\n",
-						   __func__,
-						   dev_info->EndCF_Line);
-					CFEnd = 0;
-				}
-			}
-		}
+	if (!ctx->dev || !ctx->dev->resumable) {
+		return -1;
 	}
 
-	JED_CheckSum = JED_CheckSum & 0xffff;
-
-	if (dev_info->CheckSum != JED_CheckSum || dev_info->CheckSum == 0) {
-		printf("[%s] JED File CheckSum Error\n", __func__);
-		ret = -1;
+	if (ctx->info.intf == INTF_JTAG) {
+		snprintf(name, sizeof(name), "jtag%d", ctx->info.jtag_device);
 	} else {
-		CPLD_DEBUG("[%s] JED File CheckSum OKay\n", __func__);
+		snprintf(name, sizeof(name), "i2c-%d-%02x", ctx->info.bus,
+			 ctx->info.slave);
 	}
-	return ret;
-}
-
-void jed_file_parse_header(FILE *jed_fd)
-{
-	//File
-	char tmp_buf[160];
 
-	//Header paser
-	while (fgets(tmp_buf, 120, jed_fd) != NULL) {
-#ifdef VERBOSE_DEBUG
-		printf("%s \n", tmp_buf);
-#endif
-		if (tmp_buf[0] == 0x4C) { // "L"
-			break;
-		}
+	if (cpld_journal_open(&ctx->journal, name, dev_info->data,
+			      dev_info->size) < 0) {
+		return -1;
 	}
+
+	return cpld_journal_resume(&ctx->journal);
 }
 
 /******************************************************************************/
 /***************************     JTAG       ***********************************/
 /******************************************************************************/
-static int jtag_cpld_get_id(unsigned int *dev_id)
+static int jtag_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
 	unsigned int dr_data[4] = { 0 };
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 	//Check the IDCODE_PUB
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_IDCODE_PUB);
 	dr_data[0] = 0x0;
-	ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 32, dr_data);
+	ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
 
 	*dev_id = dr_data[0];
 	printf("CPLD DeviceID: %X\n", *dev_id);
@@ -638,54 +118,62 @@ static int jtag_cpld_get_id(unsigned int *dev_id)
 	return 0;
 }
 
-static unsigned int jtag_check_device_status(int mode)
+static int jtag_poll_busy(struct cpld_ctx *ctx, void *arg)
 {
-	int RETRY = MAX_RETRY;
-	unsigned int buf[4] = { 0 };
+	unsigned int *status = arg;
+	unsigned int buf = 0;
+
+	//LSC_CHECK_BUSY(0xF0): bit 7 is the busy flag
+	if (ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+			      LATTICE_INS_LENGTH, LCMXO2_LSC_CHECK_BUSY) < 0 ||
+	    ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 8, &buf) < 0) {
+		*status = 1;
+		return -1;
+	}
+	*status = (buf >> 7) & 0x1;
+
+	return *status;
+}
+
+static int jtag_poll_status(struct cpld_ctx *ctx, void *arg)
+{
+	unsigned int *status = arg;
+	unsigned int buf = 0;
+
+	//LSC_READ_STATUS(0x3C): bits 12-13 are busy and fail
+	if (ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+			      LATTICE_INS_LENGTH, LCMXO2_LSC_READ_STATUS) < 0 ||
+	    ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, &buf) < 0) {
+		*status = 1;
+		return -1;
+	}
+	*status = (buf >> 12) & 0x3;
+
+	return *status;
+}
+
+static unsigned int jtag_check_device_status(struct cpld_ctx *ctx, int mode,
+					     enum cpld_op op)
+{
+	unsigned int status = 0;
 
 	switch (mode) {
 	case CHECK_BUSY:
-		//      ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-		do {
-			ast_jtag_sir_xfer(JTAG_STATE_TLRESET,
-					  LATTICE_INS_LENGTH,
-					  LCMXO2_LSC_CHECK_BUSY);
-			usleep(1000);
-			buf[0] = 0x0;
-			ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 8, &buf[0]);
-			buf[0] = (buf[0] >> 7) & 0x1;
-			if (buf[0] == 0x0) {
-				break;
-			}
-			RETRY--;
-		} while (RETRY);
+		cpld_poll(ctx, op, jtag_poll_busy, &status);
 		break;
 
 	case CHECK_STATUS:
-		//      ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-		do {
-			ast_jtag_sir_xfer(JTAG_STATE_TLRESET,
-					  LATTICE_INS_LENGTH,
-					  LCMXO2_LSC_READ_STATUS);
-			usleep(1000);
-			buf[0] = 0x0;
-			ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 32, &buf[0]);
-			buf[0] = (buf[0] >> 12) & 0x3;
-			if (buf[0] == 0x0) {
-				break;
-			}
-			RETRY--;
-		} while (RETRY);
+		cpld_poll(ctx, op, jtag_poll_status, &status);
 		break;
 
 	default:
 		break;
 	}
 
-	return buf[0];
+	return status;
 }
 
-static int jtag_cpld_start()
+static int jtag_cpld_start(struct cpld_ctx *ctx)
 {
 	unsigned int dr_data[4] = { 0 };
 	int ret = 0;
@@ -693,14 +181,15 @@ static int jtag_cpld_start()
 	//Enable the Flash (Transparent Mode)
 	CPLD_DEBUG("[%s] Enter transparent mode!\n", __func__);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_ENABLE_X);
 	dr_data[0] = 0x08;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, dr_data);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  dr_data);
 
 	//LSC_CHECK_BUSY(0xF0) instruction
-	dr_data[0] = jtag_check_device_status(CHECK_BUSY);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_BUSY, CPLD_OP_CMD);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -711,7 +200,7 @@ static int jtag_cpld_start()
 
 	CPLD_DEBUG("[%s] READ_STATUS(0x3C)!\n", __func__);
 	//READ_STATUS(0x3C) instruction
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS, CPLD_OP_CMD);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -723,20 +212,20 @@ static int jtag_cpld_start()
 	return ret;
 }
 
-static int jtag_cpld_end()
+static int jtag_cpld_end(struct cpld_ctx *ctx)
 {
 	int ret = 0;
 	unsigned int status;
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_PROGRAM_DONE);
 
 	CPLD_DEBUG("[%s] Program DONE bit\n", __func__);
 
 	//Read CHECK_BUSY
 
-	status = jtag_check_device_status(CHECK_BUSY);
+	status = jtag_check_device_status(ctx, CHECK_BUSY, CPLD_OP_DONE);
 	if (status != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, status);
 		ret = -1;
@@ -744,7 +233,7 @@ static int jtag_cpld_end()
 
 	CPLD_DEBUG("[%s] READ_STATUS: %x\n", __func__, ret);
 
-	status = jtag_check_device_status(CHECK_STATUS);
+	status = jtag_check_device_status(ctx, CHECK_STATUS, CPLD_OP_DONE);
 	if (status != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, status);
 		ret = -1;
@@ -754,28 +243,29 @@ static int jtag_cpld_end()
 
 	//Exit the programming mode
 	//Shift in ISC DISABLE(0x26) instruction
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_DISABLE);
 
 	return ret;
 }
 
-static int jtag_cpld_check_id()
+static int jtag_cpld_check_id(struct cpld_ctx *ctx)
 {
+	UNUSED(ctx);
 #if 0
   unsigned int dr_data[4] = {0};
   int ret = -1;
   unsigned int i;
 
   //RUNTEST IDLE
-  ast_jtag_run_test_idle(1, JTAG_STATE_TLRESET, 3);
+  ast_jtag_run_test_idle(&ctx->jtag, 1, JTAG_STATE_TLRESET, 3);
 
   CPLD_DEBUG("[%s] RUNTEST IDLE\n", __func__);
 
   //Check the IDCODE_PUB
-  ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_IDCODE_PUB);
+  ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, LCMXO2_IDCODE_PUB);
   dr_data[0] = 0x0;
-  ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 32, dr_data);
+  ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
 
   CPLD_DEBUG("[%s] ID Code: %x\n", __func__, dr_data[0]);
 
@@ -794,115 +284,335 @@ static int jtag_cpld_check_id()
 #endif
 }
 
-/*write cf data*/
-static int jtag_sendCFdata(CPLDInfo *dev_info)
+/*
+ * Fast update mode
+ *
+ * CF and UFM can only be erased as whole sectors, so rows can not be
+ * rewritten in place. Instead the flash is read back before the erase and a
+ * device which already holds the image is left untouched. Otherwise the
+ * sectors are erased as usual, rows which stay in the erased state (all
+ * fuses 0) are skipped by moving the page address with LSC_WRITE_ADDRESS,
+ * and only the written rows are verified.
+ */
+static int row_is_blank(const unsigned int *row)
+{
+	return !(row[0] | row[1] | row[2] | row[3]);
+}
+
+/*
+ * Program rows. The busy flag of each row is read back right after the row,
+ * without the sleep of the polling loop, which is only entered when the
+ * device is still busy.
+ */
+static int jtag_send_rows(struct cpld_ctx *ctx, unsigned int *data,
+			  unsigned int lines, unsigned int first,
+			  unsigned int sector, int show_progress)
 {
 	int ret = 0;
 	int CurrentAddr = 0;
 	unsigned int i;
-	unsigned status;
+	unsigned int busy;
+	unsigned int status;
+	unsigned int address;
+	unsigned int skipped = 0;
+	int jump = 0;
 
-	for (i = 0; i < dev_info->CF_Line; i++) {
-		printf("Writing Data: %d/%d (%.2f%%) \r", (i + 1),
-		       dev_info->CF_Line,
-		       (((i + 1) / (float)dev_info->CF_Line) * 100));
+	for (i = 0; i < lines; i++) {
+		if (show_progress) {
+			cpld_progress(ctx, "Writing Data", i + 1, lines);
+		}
 
 		CurrentAddr = (i * LATTICE_COL_SIZE) / 32;
 
-		//RUNTEST    IDLE    15 TCK    1.00E-003 SEC;
-		//    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-
-		//set page to program page
-		ast_jtag_sir_xfer(JTAG_STATE_PAUSEIR, LATTICE_INS_LENGTH,
-				  LCMXO2_LSC_PROG_INCR_NV);
+		//rows before first are already programmed
+		if (i < first) {
+			jump = 1;
+			continue;
+		}
 
-		//send data
-		ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE,
-				  &dev_info->CF[CurrentAddr]);
+		if (ctx->info.fast_update && row_is_blank(&data[CurrentAddr])) {
+			skipped++;
+			jump = 1;
+			//an erased row is as good as a programmed one
+			if (sector == LCMXO2_ADDR_CF) {
+				cpld_journal_row(&ctx->journal, i + 1);
+			}
+			continue;
+		}
 
-		//usleep(1000);
+		//move the page address over the skipped rows
+		if (jump) {
+			address = sector | i;
+			if (ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+					      LATTICE_INS_LENGTH,
+					      LCMXO2_LSC_WRITE_ADDRESS) < 0 ||
+			    ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+					      32, &address) < 0) {
+				printf("[%s]JTAG transfer Error\n", __func__);
+				ret = -1;
+				break;
+			}
+			jump = 0;
+		}
 
-		status = jtag_check_device_status(CHECK_BUSY);
-		if (status != 0) {
-			printf("[%s]Write CF Error, status = %x\n", __func__,
-			       status);
+		//set page to program page, send data, LSC_CHECK_BUSY(0xF0)
+		busy = 0;
+		if (ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_PAUSEIR,
+				      LATTICE_INS_LENGTH,
+				      LCMXO2_LSC_PROG_INCR_NV) < 0 ||
+		    ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				      LATTICE_COL_SIZE, &data[CurrentAddr]) < 0 ||
+		    ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				      LATTICE_INS_LENGTH,
+				      LCMXO2_LSC_CHECK_BUSY) < 0 ||
+		    ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 8,
+				      &busy) < 0) {
+			printf("[%s]JTAG transfer Error\n", __func__);
 			ret = -1;
 			break;
 		}
+
+		if ((busy >> 7) & 0x1) {
+			status = jtag_check_device_status(ctx, CHECK_BUSY,
+							  CPLD_OP_PROGRAM);
+			if (status != 0) {
+				printf("[%s]Write Error, status = %x\n",
+				       __func__, status);
+				ret = -1;
+				break;
+			}
+		}
+
+		if (sector == LCMXO2_ADDR_CF) {
+			cpld_journal_row(&ctx->journal, i + 1);
+		}
+	}
+
+	if (skipped) {
+		printf("\nSkipped %u of %u blank rows\n", skipped, lines);
 	}
 
+	return ret;
+}
+
+/*write cf data*/
+static int jtag_sendCFdata(struct cpld_ctx *ctx, struct jed_image *dev_info,
+			   unsigned int first)
+{
+	int ret;
+
+	ret = jtag_send_rows(ctx, dev_info->CF, dev_info->CF_Line, first,
+			     LCMXO2_ADDR_CF, 1);
+
 	printf("\n");
 
 	return ret;
 }
 
 /*write ufm data if need*/
-static int jtag_sendUFMdata(CPLDInfo *dev_info)
+static int jtag_sendUFMdata(struct cpld_ctx *ctx, struct jed_image *dev_info)
 {
-	int ret = 0;
-	int CurrentAddr = 0;
+	return jtag_send_rows(ctx, dev_info->UFM, dev_info->UFM_Line, 0,
+			      LCMXO2_ADDR_UFM, 0);
+}
+
+/*
+ * Read back the sector selected by init_cmd and compare it with the image.
+ * Returns the first differing row, or lines when all rows match.
+ */
+static unsigned int jtag_diff_rows(struct cpld_ctx *ctx, unsigned char init_cmd,
+				   const unsigned int *data,
+				   unsigned int lines)
+{
+	unsigned int buff[4] = { 0 };
 	unsigned int i;
-	unsigned int status;
 
-	for (i = 0; i < dev_info->UFM_Line; i++) {
-		CurrentAddr = (i * LATTICE_COL_SIZE) / 32;
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  init_cmd);
+	buff[0] = 0x04;
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  &buff[0]);
+	cpld_wait(ctx, CPLD_OP_READ);
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_LSC_READ_INCR_NV);
+	cpld_wait(ctx, CPLD_OP_READ);
+
+	for (i = 0; i < lines; i++) {
+		memset(buff, 0, sizeof(buff));
+		ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_COL_SIZE, buff);
+		if (memcmp(buff, &data[(i * LATTICE_COL_SIZE) / 32],
+			   sizeof(buff))) {
+			break;
+		}
+	}
 
-		//RUNTEST    IDLE    15 TCK    1.00E-003 SEC;
-		//    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+	return i;
+}
 
-		//set page to program page
-		ast_jtag_sir_xfer(JTAG_STATE_PAUSEIR, LATTICE_INS_LENGTH,
-				  LCMXO2_LSC_PROG_INCR_NV);
+/* move the read address, the read instruction is shifted in again */
+static void jtag_read_seek(struct cpld_ctx *ctx, unsigned int address)
+{
+	unsigned int dr_data[4] = { 0 };
 
-		//send data
-		ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE,
-				  &dev_info->UFM[CurrentAddr]);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_LSC_WRITE_ADDRESS);
+	dr_data[0] = address;
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
 
-		//usleep(1000);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_LSC_READ_INCR_NV);
+	cpld_wait(ctx, CPLD_OP_READ);
+}
 
-		status = jtag_check_device_status(CHECK_BUSY);
-		if (status != 0) {
-			printf("[%s]Write UFM Error, status = %x\n", __func__,
-			       status);
-			ret = -1;
+/*
+ * Read back CF, UFM and USERCODE. Returns 0 when the flash already holds the
+ * image, 1 otherwise.
+ */
+static int jtag_cpld_diff(struct cpld_ctx *ctx, struct jed_image *dev_info)
+{
+	unsigned int dr_data[4] = { 0 };
+	unsigned int row;
+
+	row = jtag_diff_rows(ctx, LCMXO2_LSC_INIT_ADDRESS, dev_info->CF,
+			     dev_info->CF_Line);
+	if (row < dev_info->CF_Line) {
+		printf("CF row %u differs from the image\n", row);
+		return 1;
+	}
+
+	if (dev_info->UFM_Line) {
+		row = jtag_diff_rows(ctx, LCMXO2_LSC_INIT_ADDR_UFM,
+				     dev_info->UFM, dev_info->UFM_Line);
+		if (row < dev_info->UFM_Line) {
+			printf("UFM row %u differs from the image\n", row);
+			return 1;
+		}
+	}
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_USERCODE);
+	ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
+	if (dr_data[0] != dev_info->Version) {
+		printf("USERCODE %X differs from the image %X\n", dr_data[0],
+		       dev_info->Version);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Find where an interrupted update stopped. Rows from the last journaled
+ * row on must either match the image or still be blank, the first blank
+ * one is where programming continues. Returns -1 when the flash holds
+ * anything else.
+ */
+static int jtag_resume_row(struct cpld_ctx *ctx, struct jed_image *dev_info,
+			   unsigned int from)
+{
+	unsigned int buff[4] = { 0 };
+	unsigned int i;
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_LSC_INIT_ADDRESS);
+	buff[0] = 0x04;
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  &buff[0]);
+	cpld_wait(ctx, CPLD_OP_READ);
+
+	jtag_read_seek(ctx, LCMXO2_ADDR_CF | from);
+
+	for (i = from; i < dev_info->CF_Line; i++) {
+		memset(buff, 0, sizeof(buff));
+		ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_COL_SIZE, buff);
+		if (!memcmp(buff, &dev_info->CF[i * JED_ROW_WORDS],
+			    sizeof(buff))) {
+			continue;
+		}
+		if (row_is_blank(buff)) {
 			break;
 		}
+		printf("CF row %u is neither blank nor the image\n", i);
+		return -1;
 	}
 
-	return ret;
+	return i;
+}
+
+/*
+ * IDCODE, USERCODE and CF row 0 for the TCK tuning. The row is read in
+ * transparent mode, the DONE bit is left alone.
+ */
+static int jtag_cpld_sample(struct cpld_ctx *ctx, struct cpld_tck_sample *s)
+{
+	unsigned int dr_data[4] = { 0 };
+
+	memset(s, 0, sizeof(*s));
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_IDCODE_PUB);
+	ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
+	s->idcode = dr_data[0];
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_USERCODE);
+	dr_data[0] = 0;
+	ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
+	s->usercode = dr_data[0];
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_ISC_ENABLE_X);
+	dr_data[0] = 0x08;
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  dr_data);
+	if (jtag_check_device_status(ctx, CHECK_BUSY, CPLD_OP_CMD) != 0) {
+		return -1;
+	}
+
+	jtag_read_seek(ctx, LCMXO2_ADDR_CF);
+	ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_COL_SIZE,
+			  s->row);
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  LCMXO2_ISC_DISABLE);
+
+	return 0;
 }
 
-static int jtag_cpld_get_ver(unsigned int *ver)
+static int jtag_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
 	int ret;
 	unsigned int dr_data[4] = { 0 };
 
-	ret = jtag_cpld_check_id();
+	ret = jtag_cpld_check_id(ctx);
 
 	if (ret < 0) {
 		printf("[%s] Unknown Device ID!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_start();
+	ret = jtag_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
 	//Shift in READ USERCODE(0xC0) instruction;
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_USERCODE);
 
 	CPLD_DEBUG("[%s] READ USERCODE(0xC0)\n", __func__);
 
 	//Read UserCode
 	dr_data[0] = 0;
-	ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, 32, dr_data);
+	ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
 	*ver = dr_data[0];
 
 	printf("CPLD Version: %X\n", *ver);
-	ret = jtag_cpld_end();
+	ret = jtag_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 	}
@@ -911,71 +621,62 @@ error_exit:
 	return ret;
 }
 
-static int jtag_cpld_checksum(FILE *jed_fd, unsigned int *crc)
+static int jtag_cpld_checksum(struct cpld_ctx *ctx, FILE *jed_fd,
+			      unsigned int *crc)
 {
-	CPLDInfo dev_info = { 0 };
-	int cf_size = 0;
-	int endcfg_size = 0;
-	int ufm_size = 0;
+	struct jed_image dev_info = { 0 };
+	struct cpld_readback rb;
 	int ret;
-	unsigned int i, j;
+	unsigned int i;
+#ifdef VERBOSE_DEBUG
+	unsigned int j;
+#endif
 	unsigned int buff[4] = { 0 };
 
 	CPLD_DEBUG("[%s]\n", __func__);
 
 	*crc = 0;
+	cpld_readback_init(&rb);
 
-	ret = jtag_cpld_check_id();
+	ret = jtag_cpld_check_id(ctx);
 	if (ret < 0) {
 		printf("[%s] Unknown Device ID!\n", __func__);
 		goto error_exit;
 	}
 
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//get update data size
-	ret = jed_update_data_size(jed_fd, &cf_size, &ufm_size, &endcfg_size);
-	if (ret < 0) {
-		printf("[%s] Update Data Size Error!\n", __func__);
-		goto error_exit;
-	}
-
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//parse info from JED file and calculate checksum
-	ret = jed_file_parser(jed_fd, &dev_info, cf_size, ufm_size,
-			      endcfg_size);
+	//map and parse the JED file, the checksum is validated on the way
+	ret = jed_image_load(&dev_info, jed_fd);
 	if (ret < 0) {
 		printf("[%s] JED file CheckSum Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_start();
+	ret = jtag_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_INIT_ADDRESS);
 
 	buff[0] = 0x04;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, &buff[0]);
-	usleep(1000);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  &buff[0]);
+	cpld_wait(ctx, CPLD_OP_READ);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_READ_INCR_NV);
-	usleep(1000);
+	cpld_wait(ctx, CPLD_OP_READ);
 
 	//  CPLD_DEBUG("[%s] dev_info->CF_Line: %d\n", __func__, dev_info->CF_Line);
 
 	for (i = 0; i < dev_info.CF_Line; i++) {
 		memset(buff, 0, sizeof(buff));
-		ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, buff);
+		ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_COL_SIZE, buff);
 #ifdef VERBOSE_DEBUG
 		printf("[%d] ", i);
 		for (j = 0; j < 4; j++) {
@@ -983,46 +684,33 @@ static int jtag_cpld_checksum(FILE *jed_fd, unsigned int *crc)
 		}
 		printf("\n");
 #endif
-		for (j = 0; j < sizeof(unsigned int); j++) {
-			*crc += (buff[j] >> 24) & 0xff;
-			*crc += (buff[j] >> 16) & 0xff;
-			*crc += (buff[j] >> 8) & 0xff;
-			*crc += (buff[j]) & 0xff;
-		}
+		cpld_readback_row(&rb, buff, NULL, sizeof(buff));
 	}
 
+	//EndCF rows are not read back, they count as in the JED file
 	for (i = 0; i < dev_info.EndCF_Line; i++) {
-#ifdef VERBOSE_DEBUG
-		printf("[%d] ", i);
-		for (j = 0; j < 4; j++) {
-			printf("%x ", dev_info.EndCF[j]);
-		}
-		printf("\n");
-#endif
-		for (j = 0; j < sizeof(unsigned int); j++) {
-			*crc += (dev_info.EndCF[i + j] >> 24) & 0xff;
-			*crc += (dev_info.EndCF[i + j] >> 16) & 0xff;
-			*crc += (dev_info.EndCF[i + j] >> 8) & 0xff;
-			*crc += (dev_info.EndCF[i + j]) & 0xff;
-		}
+		cpld_readback_row(&rb, &dev_info.EndCF[i * JED_ROW_WORDS],
+				  NULL, JED_ROW_WORDS * sizeof(unsigned int));
 	}
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_INIT_ADDR_UFM);
 
 	buff[0] = 0x04;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, &buff[0]);
-	usleep(1000);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  &buff[0]);
+	cpld_wait(ctx, CPLD_OP_READ);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_READ_INCR_NV);
-	usleep(1000);
+	cpld_wait(ctx, CPLD_OP_READ);
 
 	for (i = 0; i < dev_info.UFM_Line; i++) {
 		memset(buff, 0, sizeof(buff));
-		ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, buff);
+		ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_COL_SIZE, buff);
 #ifdef VERBOSE_DEBUG
 		printf("[%d] ", i);
 		for (j = 0; j < 4; j++) {
@@ -1030,74 +718,77 @@ static int jtag_cpld_checksum(FILE *jed_fd, unsigned int *crc)
 		}
 		printf("\n");
 #endif
-		for (j = 0; j < sizeof(unsigned int); j++) {
-			*crc += (buff[j] >> 24) & 0xff;
-			*crc += (buff[j] >> 16) & 0xff;
-			*crc += (buff[j] >> 8) & 0xff;
-			*crc += (buff[j]) & 0xff;
-		}
+		cpld_readback_row(&rb, buff, NULL, sizeof(buff));
 	}
 
-	*crc &= 0xFFFF;
+	*crc = cpld_readback_sum(&rb);
+	printf("CPLD CRC32: %08X\n", cpld_readback_crc32(&rb));
 
-	ret = jtag_cpld_end();
+	ret = jtag_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 		goto error_exit;
 	}
 
 error_exit:
-	if (NULL != dev_info.CF) {
-		free(dev_info.CF);
-	}
-
-	if (NULL != dev_info.EndCF) {
-		free(dev_info.EndCF);
-	}
-
-	if (NULL != dev_info.UFM) {
-		free(dev_info.UFM);
-	}
+	jed_image_free(&dev_info);
 
 	return ret;
 }
 
-static int jtag_cpld_verify(CPLDInfo *dev_info)
+static int jtag_cpld_verify(struct cpld_ctx *ctx, struct jed_image *dev_info)
 {
 	unsigned int i;
 	int result;
 	int current_addr = 0;
 	unsigned int buff[4] = { 0 };
 	int ret = 0;
+	struct cpld_readback rb;
+	int jump = 0;
+
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	cpld_readback_init(&rb);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_INIT_ADDRESS);
 
 	buff[0] = 0x04;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, &buff[0]);
-	usleep(1000);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  &buff[0]);
+	cpld_wait(ctx, CPLD_OP_READ);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_READ_INCR_NV);
-	usleep(1000);
+	cpld_wait(ctx, CPLD_OP_READ);
 
 	CPLD_DEBUG("[%s] dev_info->CF_Line: %d\n", __func__, dev_info->CF_Line);
 
 	for (i = 0; i < dev_info->CF_Line; i++) {
-		printf("Verify Data: %d/%d (%.2f%%) \r", (i + 1),
-		       dev_info->CF_Line,
-		       (((i + 1) / (float)dev_info->CF_Line) * 100));
+		cpld_progress(ctx, "Verify Data", i + 1, dev_info->CF_Line);
 
 		current_addr = (i * LATTICE_COL_SIZE) / 32;
 
+		//only the written rows are verified in fast mode
+		if (ctx->info.fast_update &&
+		    row_is_blank(&dev_info->CF[current_addr])) {
+			jump = 1;
+			continue;
+		}
+
+		if (jump) {
+			jtag_read_seek(ctx, LCMXO2_ADDR_CF | i);
+			jump = 0;
+		}
+
 		memset(buff, 0, sizeof(buff));
 
-		ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, buff);
+		ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_COL_SIZE, buff);
 
-		result = memcmp(buff, &dev_info->CF[current_addr],
-				sizeof(unsigned int));
+		result = cpld_readback_row(&rb, buff,
+					   &dev_info->CF[current_addr],
+					   sizeof(buff));
 
 		if (result) {
 			CPLD_DEBUG(
@@ -1117,50 +808,55 @@ static int jtag_cpld_verify(CPLDInfo *dev_info)
 	if (-1 == ret) {
 		printf("\n[%s] Verify CPLD FW Error\n", __func__);
 	} else {
-		CPLD_DEBUG("\n[%s] Verify CPLD FW Pass\n", __func__);
+		CPLD_DEBUG("\n[%s] Verify CPLD FW Pass, CRC32 %08X\n",
+			   __func__, cpld_readback_crc32(&rb));
 	}
 
 	return ret;
 }
 
-static int jtag_cpld_lcm3d_verify(CPLDInfo *dev_info)
+static int jtag_cpld_lcm3d_verify(struct cpld_ctx *ctx,
+				  struct jed_image *dev_info)
 {
 	unsigned int i;
 	int result;
 	int current_addr = 0;
 	unsigned int buff[4] = { 0 };
 	int ret = 0;
+	struct cpld_readback rb;
 	unsigned int operand;
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	cpld_readback_init(&rb);
+
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_INIT_ADDRESS);
 
 	operand = 0x000100;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LCMXO3D_INIT_ADD_BITS_LEN,
-			  &operand);
-	usleep(1000);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+			  LCMXO3D_INIT_ADD_BITS_LEN, &operand);
+	cpld_wait(ctx, CPLD_OP_READ);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_READ_INCR_NV);
-	usleep(1000);
+	cpld_wait(ctx, CPLD_OP_READ);
 
 	CPLD_DEBUG("[%s] dev_info->CF_Line: %d\n", __func__, dev_info->CF_Line);
 
 	for (i = 0; i < dev_info->CF_Line; i++) {
-		printf("Verify Data: %d/%d (%.2f%%) \r", (i + 1),
-		       dev_info->CF_Line,
-		       (((i + 1) / (float)dev_info->CF_Line) * 100));
+		cpld_progress(ctx, "Verify Data", i + 1, dev_info->CF_Line);
 
 		current_addr = (i * LATTICE_COL_SIZE) / 32;
 
 		memset(buff, 0, sizeof(buff));
 
-		ast_jtag_tdo_xfer(JTAG_STATE_TLRESET, LATTICE_COL_SIZE, buff);
+		ast_jtag_tdo_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_COL_SIZE, buff);
 
-		result = memcmp(buff, &dev_info->CF[current_addr],
-				sizeof(unsigned int));
+		result = cpld_readback_row(&rb, buff,
+					   &dev_info->CF[current_addr],
+					   sizeof(buff));
 
 		if (result) {
 			CPLD_DEBUG(
@@ -1180,20 +876,21 @@ static int jtag_cpld_lcm3d_verify(CPLDInfo *dev_info)
 	if (-1 == ret) {
 		printf("\n[%s] Verify CPLD FW Error\n", __func__);
 	} else {
-		CPLD_DEBUG("\n[%s] Verify CPLD FW Pass\n", __func__);
+		CPLD_DEBUG("\n[%s] Verify CPLD FW Pass, CRC32 %08X\n",
+			   __func__, cpld_readback_crc32(&rb));
 	}
 
 	return ret;
 }
 
-static int jtag_cpld_erase(int erase_type)
+static int jtag_cpld_erase(struct cpld_ctx *ctx, int erase_type)
 {
 	unsigned int dr_data[4] = { 0 };
 	int ret = 0;
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 	//Erase the Flash
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_ERASE);
 
 	CPLD_DEBUG("[%s] ERASE(0x0E)!\n", __func__);
@@ -1208,9 +905,10 @@ static int jtag_cpld_erase(int erase_type)
 		break;
 	}
 
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH, dr_data);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+			  dr_data);
 
-	dr_data[0] = jtag_check_device_status(CHECK_BUSY);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_BUSY, CPLD_OP_ERASE);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1222,7 +920,7 @@ static int jtag_cpld_erase(int erase_type)
 	//Shift in LSC_READ_STATUS(0x3C) instruction
 	CPLD_DEBUG("[%s] READ_STATUS!\n", __func__);
 
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS, CPLD_OP_ERASE);
 
 	if (dr_data[0] != 0) {
 		printf("Erase Failed, status = %x\n", dr_data[0]);
@@ -1236,23 +934,24 @@ static int jtag_cpld_erase(int erase_type)
 	return ret;
 }
 
-static int jtag_cpld_lcm3d_erase()
+static int jtag_cpld_lcm3d_erase(struct cpld_ctx *ctx)
 {
 	unsigned int dr_data[4] = { 0 };
 	unsigned int operand;
 	int ret = 0;
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 	//Erase the Flash
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_ERASE);
 
 	CPLD_DEBUG("[%s] ERASE(0x0E)!\n", __func__);
 
 	operand = 0x000100;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LCMXO3D_ERASE_BITS_LEN, &operand);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+			  LCMXO3D_ERASE_BITS_LEN, &operand);
 
-	dr_data[0] = jtag_check_device_status(CHECK_BUSY);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_BUSY, CPLD_OP_ERASE);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1264,7 +963,7 @@ static int jtag_cpld_lcm3d_erase()
 	//Shift in LSC_READ_STATUS(0x3C) instruction
 	CPLD_DEBUG("[%s] READ_STATUS!\n", __func__);
 
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS, CPLD_OP_ERASE);
 
 	if (dr_data[0] != 0) {
 		printf("Erase Failed, status = %x\n", dr_data[0]);
@@ -1278,32 +977,37 @@ static int jtag_cpld_lcm3d_erase()
 	return ret;
 }
 
-static int jtag_cpld_program(CPLDInfo *dev_info)
+static int jtag_cpld_program(struct cpld_ctx *ctx, struct jed_image *dev_info,
+			     unsigned int first)
 {
 	int ret = 0;
 	unsigned int dr_data[4] = { 0 };
 
 	//Program CFG
 	CPLD_DEBUG("[%s] Program CFG \n", __func__);
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 	//Shift in LSC_INIT_ADDRESS(0x46) instruction
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_INIT_ADDRESS);
 
 	CPLD_DEBUG("[%s] INIT_ADDRESS(0x46) \n", __func__);
 
-	ret = jtag_sendCFdata(dev_info);
+	ret = jtag_sendCFdata(ctx, dev_info, first);
 	if (ret < 0) {
 		goto error_exit;
 	}
 
 	if (dev_info->UFM_Line) {
-		//    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+		//a partly programmed UFM can only be redone after an erase
+		cpld_journal_set(&ctx->journal, CPLD_JOURNAL_UFM,
+				 dev_info->CF_Line);
+
+		//    ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 		//program UFM
-		ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
-				  LCMXO2_LSC_INIT_ADDR_UFM);
+		ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_INS_LENGTH, LCMXO2_LSC_INIT_ADDR_UFM);
 
-		ret = jtag_sendUFMdata(dev_info);
+		ret = jtag_sendUFMdata(ctx, dev_info);
 		if (ret < 0) {
 			goto error_exit;
 		}
@@ -1312,7 +1016,8 @@ static int jtag_cpld_program(CPLDInfo *dev_info)
 	CPLD_DEBUG("[%s] Update CPLD done \n", __func__);
 
 	//Read the status bit
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS,
+					      CPLD_OP_PROGRAM);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1325,19 +1030,28 @@ static int jtag_cpld_program(CPLDInfo *dev_info)
 
 	//Write UserCode
 	dr_data[0] = dev_info->Version;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, 32, dr_data);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
 
 	CPLD_DEBUG("[%s] Write USERCODE: %x\n", __func__, dr_data[0]);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_PROGRAM_USERCOD);
-	usleep(2000);
+
+	//Wait for the USERCODE program to complete
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_BUSY,
+					      CPLD_OP_USERCODE);
+	if (dr_data[0] != 0) {
+		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
+		ret = -1;
+		goto error_exit;
+	}
 
 	CPLD_DEBUG("[%s] PROGRAM USERCODE(0xC2)\n", __func__);
 
 	//Read the status bit
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS,
+					      CPLD_OP_USERCODE);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1351,7 +1065,8 @@ error_exit:
 	return ret;
 }
 
-static int jtag_cpld_lcm3d_program(CPLDInfo *dev_info)
+static int jtag_cpld_lcm3d_program(struct cpld_ctx *ctx,
+				   struct jed_image *dev_info)
 {
 	int ret = 0;
 	unsigned int dr_data[4] = { 0 };
@@ -1359,28 +1074,28 @@ static int jtag_cpld_lcm3d_program(CPLDInfo *dev_info)
 
 	//Program CFG
 	CPLD_DEBUG("[%s] Program CFG \n", __func__);
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 	//Shift in LSC_INIT_ADDRESS(0x46) instruction
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_LSC_INIT_ADDRESS);
 	operand = 0x000100;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, LCMXO3D_INIT_ADD_BITS_LEN,
-			  &operand);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+			  LCMXO3D_INIT_ADD_BITS_LEN, &operand);
 
 	CPLD_DEBUG("[%s] INIT_ADDRESS(0x46) \n", __func__);
 
-	ret = jtag_sendCFdata(dev_info);
+	ret = jtag_sendCFdata(ctx, dev_info, 0);
 	if (ret < 0) {
 		goto error_exit;
 	}
 
 	if (dev_info->UFM_Line) {
-		//    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+		//    ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 		//program UFM
-		ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
-				  LCMXO2_LSC_INIT_ADDR_UFM);
+		ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET,
+				  LATTICE_INS_LENGTH, LCMXO2_LSC_INIT_ADDR_UFM);
 
-		ret = jtag_sendUFMdata(dev_info);
+		ret = jtag_sendUFMdata(ctx, dev_info);
 		if (ret < 0) {
 			goto error_exit;
 		}
@@ -1389,7 +1104,8 @@ static int jtag_cpld_lcm3d_program(CPLDInfo *dev_info)
 	CPLD_DEBUG("[%s] Update CPLD done \n", __func__);
 
 	//Read the status bit
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS,
+					      CPLD_OP_PROGRAM);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1402,19 +1118,28 @@ static int jtag_cpld_lcm3d_program(CPLDInfo *dev_info)
 
 	//Write UserCode
 	dr_data[0] = dev_info->Version;
-	ast_jtag_tdi_xfer(JTAG_STATE_TLRESET, 32, dr_data);
+	ast_jtag_tdi_xfer(&ctx->jtag, JTAG_STATE_TLRESET, 32, dr_data);
 
 	CPLD_DEBUG("[%s] Write USERCODE: %x\n", __func__, dr_data[0]);
 
-	//  ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
-	ast_jtag_sir_xfer(JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
+	//  ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
+	ast_jtag_sir_xfer(&ctx->jtag, JTAG_STATE_TLRESET, LATTICE_INS_LENGTH,
 			  LCMXO2_ISC_PROGRAM_USERCOD);
-	usleep(2000);
+
+	//Wait for the USERCODE program to complete
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_BUSY,
+					      CPLD_OP_USERCODE);
+	if (dr_data[0] != 0) {
+		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
+		ret = -1;
+		goto error_exit;
+	}
 
 	CPLD_DEBUG("[%s] PROGRAM USERCODE(0xC2)\n", __func__);
 
 	//Read the status bit
-	dr_data[0] = jtag_check_device_status(CHECK_STATUS);
+	dr_data[0] = jtag_check_device_status(ctx, CHECK_STATUS,
+					      CPLD_OP_USERCODE);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1428,189 +1153,166 @@ error_exit:
 	return ret;
 }
 
-static int jtag_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int jtag_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd, char *key,
+			    char is_signed)
 {
-	CPLDInfo dev_info = { 0 };
-	int cf_size = 0;
-	int endcfg_size = 0;
-	int ufm_size = 0;
+	struct jed_image dev_info = { 0 };
 	int erase_type = 0;
+	int resume;
 	int ret;
 
 	CPLD_DEBUG("[%s]\n", __func__);
 	UNUSED(key);
 	UNUSED(is_signed);
-	ret = jtag_cpld_check_id();
+	ret = jtag_cpld_check_id(ctx);
 	if (ret < 0) {
 		printf("[%s] Unknown Device ID!\n", __func__);
 		goto error_exit;
 	}
 
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//get update data size
-	ret = jed_update_data_size(jed_fd, &cf_size, &ufm_size, &endcfg_size);
-	if (ret < 0) {
-		printf("[%s] Update Data Size Error!\n", __func__);
-		goto error_exit;
-	}
-
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//parse info from JED file and calculate checksum
-	ret = jed_file_parser(jed_fd, &dev_info, cf_size, ufm_size,
-			      endcfg_size);
+	//map and parse the JED file, the checksum is validated on the way
+	ret = jed_image_load(&dev_info, jed_fd);
 	if (ret < 0) {
 		printf("[%s] JED file CheckSum Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_start();
+	ret = jtag_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
-	if (dev_info.UFM_Line) {
-		erase_type = Both_CF_UFM;
-	} else {
-		erase_type = Only_CF;
+	if (ctx->info.fast_update && !jtag_cpld_diff(ctx, &dev_info)) {
+		printf("CPLD already up to date, skip programming\n");
+		goto end_program;
 	}
 
-	ret = jtag_cpld_erase(erase_type);
-	if (ret < 0) {
-		printf("[%s] Erase failed!\n", __func__);
-		goto error_exit;
+	resume = journal_open(ctx, &dev_info);
+	if (resume >= 0) {
+		resume = jtag_resume_row(ctx, &dev_info, resume);
+	}
+
+	if (resume >= 0) {
+		printf("Resuming interrupted update at CF row %d of %u\n",
+		       resume, dev_info.CF_Line);
+	} else {
+		if (dev_info.UFM_Line) {
+			erase_type = Both_CF_UFM;
+		} else {
+			erase_type = Only_CF;
+		}
+
+		ret = jtag_cpld_erase(ctx, erase_type);
+		if (ret < 0) {
+			printf("[%s] Erase failed!\n", __func__);
+			goto error_exit;
+		}
+		cpld_journal_set(&ctx->journal, CPLD_JOURNAL_ERASED, 0);
+		resume = 0;
 	}
 
-	ret = jtag_cpld_program(&dev_info);
+	ret = jtag_cpld_program(ctx, &dev_info, resume);
 	if (ret < 0) {
 		printf("[%s] Program failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_verify(&dev_info);
+	ret = jtag_cpld_verify(ctx, &dev_info);
 	if (ret < 0) {
 		printf("[%s] Verify Failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_end();
+end_program:
+	ret = jtag_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 		goto error_exit;
 	}
 
-error_exit:
-	if (NULL != dev_info.CF) {
-		free(dev_info.CF);
-	}
-
-	if (NULL != dev_info.EndCF) {
-		free(dev_info.EndCF);
-	}
+	//verified, nothing left to resume
+	cpld_journal_done(&ctx->journal);
 
-	if (NULL != dev_info.UFM) {
-		free(dev_info.UFM);
+error_exit:
+	//a failed update leaves no trusted rows behind
+	if (ret < 0) {
+		cpld_journal_discard(&ctx->journal);
 	}
+	cpld_journal_close(&ctx->journal);
+	jed_image_free(&dev_info);
 
 	return ret;
 }
 
-static int jtag_cpld_lcm3d_update(FILE *jed_fd, char *key, char is_signed)
+static int jtag_cpld_lcm3d_update(struct cpld_ctx *ctx, FILE *jed_fd, char *key,
+				  char is_signed)
 {
-	CPLDInfo dev_info = { 0 };
-	int cf_size = 0;
-	int ufm_size = 0;
-	int endcfg_size = 0;
+	struct jed_image dev_info = { 0 };
 	int ret;
 
 	CPLD_DEBUG("[%s]\n", __func__);
 	UNUSED(key);
 	UNUSED(is_signed);
-	ret = jtag_cpld_check_id();
+	ret = jtag_cpld_check_id(ctx);
 	if (ret < 0) {
 		printf("[%s] Unknown Device ID!\n", __func__);
 		goto error_exit;
 	}
 
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//get update data size
-	ret = jed_update_data_size(jed_fd, &cf_size, &ufm_size, &endcfg_size);
-	if (ret < 0) {
-		printf("[%s] Update Data Size Error!\n", __func__);
-		goto error_exit;
-	}
-
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//parse info from JED file and calculate checksum
-	ret = jed_file_parser(jed_fd, &dev_info, cf_size, ufm_size,
-			      endcfg_size);
+	//map and parse the JED file, the checksum is validated on the way
+	ret = jed_image_load(&dev_info, jed_fd);
 	if (ret < 0) {
 		printf("[%s] JED file CheckSum Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_start();
+	ret = jtag_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_lcm3d_erase();
+	ret = jtag_cpld_lcm3d_erase(ctx);
 	if (ret < 0) {
 		printf("[%s] Erase failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_lcm3d_program(&dev_info);
+	ret = jtag_cpld_lcm3d_program(ctx, &dev_info);
 	if (ret < 0) {
 		printf("[%s] Program failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_lcm3d_verify(&dev_info);
+	ret = jtag_cpld_lcm3d_verify(ctx, &dev_info);
 	if (ret < 0) {
 		printf("[%s] Verify Failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = jtag_cpld_end();
+	ret = jtag_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 		goto error_exit;
 	}
 
 error_exit:
-	if (NULL != dev_info.CF) {
-		free(dev_info.CF);
-	}
-
-	if (NULL != dev_info.EndCF) {
-		free(dev_info.EndCF);
-	}
-
-	if (NULL != dev_info.UFM) {
-		free(dev_info.UFM);
-	}
+	jed_image_free(&dev_info);
 
 	return ret;
 }
 
-static int yzbb_jtag_cpld_get_ver(unsigned int *ver)
+static int yzbb_jtag_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
+	UNUSED(ctx);
 	UNUSED(ver);
 	return 0;
 }
 
-static int yzbb_jtag_cpld_get_id(unsigned int *dev_id)
+static int yzbb_jtag_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
+	UNUSED(ctx);
 	UNUSED(dev_id);
 	return 0;
 }
@@ -1618,86 +1320,84 @@ static int yzbb_jtag_cpld_get_id(unsigned int *dev_id)
 /******************************************************************************/
 /***************************      I2C       ***********************************/
 /******************************************************************************/
-static int i2c_cpld_get_id(unsigned int *dev_id)
+static int i2c_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
 	uint8_t cmd[4] = { 0xE0, 0x00, 0x00, 0x00 };
 	uint8_t dr_data[4];
 	int ret = -1;
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, cmd, sizeof(cmd),
-				    dr_data, sizeof(dr_data));
-	if (ret != 0) {
-		printf("read_device_id() failed\n");
-		return ret;
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, cmd,
+				    sizeof(cmd), dr_data, sizeof(dr_data));
+	if (ret != 0) {
+		printf("read_device_id() failed\n");
+		return ret;
+	}
+	CPLD_DEBUG("Read Device ID = 0x%X 0x%X 0x%X 0x%X -\n", dr_data[0],
+		   dr_data[1], dr_data[2], dr_data[3]);
+	*dev_id = byte_to_int(dr_data);
+	printf("CPLD DeviceID: %X\n", *dev_id);
+
+	return 0;
+}
+
+static int i2c_poll_busy(struct cpld_ctx *ctx, void *arg)
+{
+	unsigned int *status = arg;
+	uint8_t flag[1];
+	uint8_t busy_flag_cmd[4] = { 0xF0, 0x00, 0x00, 0x00 };
+
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				  busy_flag_cmd, sizeof(busy_flag_cmd), flag,
+				  sizeof(flag)) != 0) {
+		ERR_PRINT("read_busy_flag()");
+		*status = 1;
+		return -1;
+	}
+	*status = (flag[0] & 0x80) ? 1 : 0;
+
+	return *status;
+}
+
+static int i2c_poll_status(struct cpld_ctx *ctx, void *arg)
+{
+	unsigned int *status = arg;
+	uint8_t buf[4];
+	uint8_t status_cmd[4] = { 0x3C, 0x00, 0x00, 0x00 };
+
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				  status_cmd,
+				  sizeof(status_cmd), buf, sizeof(buf)) != 0) {
+		ERR_PRINT("read_status_flag()");
+		*status = 1;
+		return -1;
 	}
-	CPLD_DEBUG("Read Device ID = 0x%X 0x%X 0x%X 0x%X -\n", dr_data[0],
-		   dr_data[1], dr_data[2], dr_data[3]);
-	*dev_id = byte_to_int(dr_data);
-	printf("CPLD DeviceID: %X\n", *dev_id);
+	*status = (byte_to_int(buf) >> 12) & 0x3;
 
-	return 0;
+	return *status;
 }
 
-static unsigned int i2c_check_device_status(int mode)
+static unsigned int i2c_check_device_status(struct cpld_ctx *ctx, int mode,
+					    enum cpld_op op)
 {
-	int RETRY = MAX_RETRY;
-	uint8_t flag[1];
-	uint8_t status[4];
-	uint8_t busy_flag_cmd[4] = { 0xF0, 0x00, 0x00, 0x00 };
-	uint8_t status_cmd[4] = { 0x3C, 0x00, 0x00, 0x00 };
-	int ret = -1;
-	unsigned int rc = 1;
-	unsigned int tmp;
+	unsigned int status = 1;
 
 	switch (mode) {
 	case CHECK_BUSY:
-		do {
-			ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-						    busy_flag_cmd,
-						    sizeof(busy_flag_cmd), flag,
-						    sizeof(flag));
-			if (ret != 0) {
-				ERR_PRINT("read_busy_flag()");
-				break;
-			}
-			if (!(flag[0] & 0x80)) {
-				rc = 0;
-				break;
-			}
-			usleep(1000);
-			RETRY--;
-		} while (RETRY);
+		cpld_poll(ctx, op, i2c_poll_busy, &status);
 		break;
 
 	case CHECK_STATUS:
-		do {
-			ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-						    status_cmd,
-						    sizeof(status_cmd), status,
-						    sizeof(status));
-			if (ret != 0) {
-				ERR_PRINT("read_status_flag()");
-				break;
-			}
-			tmp = byte_to_int(status);
-			tmp = (tmp >> 12) & 0x3;
-			if (!tmp) {
-				rc = 0;
-				break;
-			}
-			usleep(1000);
-			RETRY--;
-		} while (RETRY);
+		cpld_poll(ctx, op, i2c_poll_status, &status);
 		break;
 
 	default:
 		break;
 	}
 
-	return rc;
+	return status;
 }
 
-static int i2c_cpld_start()
+static int i2c_cpld_start(struct cpld_ctx *ctx)
 {
 	uint8_t enable_program_cmd[3] = { 0x74, 0x08, 0x00 };
 	unsigned int dr_data[4] = { 0 };
@@ -1706,7 +1406,7 @@ static int i2c_cpld_start()
 	//Enable the Flash (Transparent Mode)
 	CPLD_DEBUG("[%s] Enter transparent mode!\n", __func__);
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
 				    enable_program_cmd,
 				    sizeof(enable_program_cmd), NULL, 0);
 	if (ret != 0) {
@@ -1715,7 +1415,7 @@ static int i2c_cpld_start()
 	}
 
 	//LSC_CHECK_BUSY(0xF0) instruction
-	dr_data[0] = i2c_check_device_status(CHECK_BUSY);
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_BUSY, CPLD_OP_CMD);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1726,7 +1426,7 @@ static int i2c_cpld_start()
 
 	CPLD_DEBUG("[%s] READ_STATUS(0x3C)!\n", __func__);
 	//READ_STATUS(0x3C) instruction
-	dr_data[0] = i2c_check_device_status(CHECK_STATUS);
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_STATUS, CPLD_OP_CMD);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -1738,7 +1438,7 @@ static int i2c_cpld_start()
 	return ret;
 }
 
-static int i2c_cpld_end()
+static int i2c_cpld_end(struct cpld_ctx *ctx)
 {
 	int ret = 0;
 	unsigned int status;
@@ -1746,7 +1446,8 @@ static int i2c_cpld_end()
 	uint8_t refresh_cmd[3] = { 0x79, 0x00, 0x00 };
 	uint8_t disable_cmd[4] = { 0x26, 0x00, 0x00, 0x00 };
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, program_done_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    program_done_cmd,
 				    sizeof(program_done_cmd), NULL, 0);
 	if (ret != 0) {
 		printf("i2c_cpld_end() program done failed\n");
@@ -1757,7 +1458,7 @@ static int i2c_cpld_end()
 
 	//Read CHECK_BUSY
 
-	status = i2c_check_device_status(CHECK_BUSY);
+	status = i2c_check_device_status(ctx, CHECK_BUSY, CPLD_OP_DONE);
 	if (status != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, status);
 		ret = -1;
@@ -1765,7 +1466,7 @@ static int i2c_cpld_end()
 
 	CPLD_DEBUG("[%s] READ_STATUS: %x\n", __func__, ret);
 
-	status = i2c_check_device_status(CHECK_STATUS);
+	status = i2c_check_device_status(ctx, CHECK_STATUS, CPLD_OP_DONE);
 	if (status != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, status);
 		ret = -1;
@@ -1774,8 +1475,8 @@ static int i2c_cpld_end()
 	CPLD_DEBUG("[%s] READ_STATUS: %x\n", __func__, ret);
 
 	// Refresh CPLD
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, refresh_cmd,
-				    sizeof(refresh_cmd), NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    refresh_cmd, sizeof(refresh_cmd), NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_refresh(): Refresh CPLD failed");
 		return ret;
@@ -1784,8 +1485,8 @@ static int i2c_cpld_end()
 
 	//Exit the programming mode
 	//Shift in ISC DISABLE(0x26) instruction
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, disable_cmd,
-				    sizeof(disable_cmd), NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    disable_cmd, sizeof(disable_cmd), NULL, 0);
 	if (ret != 0) {
 		printf("i2c_cpld_end() disable failed\n");
 		return ret;
@@ -1794,14 +1495,15 @@ static int i2c_cpld_end()
 	return ret;
 }
 
-static int i2c_cpld_check_id()
+static int i2c_cpld_check_id(struct cpld_ctx *ctx)
 {
+	UNUSED(ctx);
 #if 0
   unsigned int dr_data[4] = {0};
   int ret = -1;
   unsigned int i;
 
-  i2c_cpld_get_id(dr_data);
+  i2c_cpld_get_id(ctx, dr_data);
 
   CPLD_DEBUG("[%s] ID Code: %x\n", __func__, dr_data[0]);
 
@@ -1820,111 +1522,330 @@ static int i2c_cpld_check_id()
 #endif
 }
 
-/*write cf data*/
-static int i2c_sendCFdata(CPLDInfo *dev_info)
+static void i2c_address_cmd(uint8_t *cmd, unsigned int address)
+{
+	cmd[0] = LCMXO2_LSC_WRITE_ADDRESS;
+	cmd[1] = 0x00;
+	cmd[2] = 0x00;
+	cmd[3] = 0x00;
+	cmd[4] = (address >> 24) & 0xff;
+	cmd[5] = (address >> 16) & 0xff;
+	cmd[6] = (address >> 8) & 0xff;
+	cmd[7] = address & 0xff;
+}
+
+/* move the page address, used to skip rows and to read back sparse rows */
+static int i2c_write_address(struct cpld_ctx *ctx, unsigned int address)
+{
+	uint8_t write_addr_cmd[1 + 3 + 4];
+	int ret;
+
+	i2c_address_cmd(write_addr_cmd, address);
+
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    write_addr_cmd,
+				    sizeof(write_addr_cmd), NULL, 0);
+	if (ret != 0) {
+		ERR_PRINT("i2c_write_address(): Write Page Address");
+	}
+
+	return ret;
+}
+
+/*
+ * Read pages consecutive rows from the current page address with a single
+ * LSC_READ_INCR_NV, at most LCMXO2_I2C_READ_PAGES, and fix their bit order.
+ */
+static int i2c_read_pages(struct cpld_ctx *ctx, void *buf, unsigned int pages)
+{
+	/* 0x73 0x00: i2c, 0x73 0x10: JTAG/SSPI */
+	uint8_t read_page_cmd[4] = { LCMXO2_LSC_READ_INCR_NV, 0x00, 0x00,
+				     0x00 };
+
+	read_page_cmd[2] = (pages >> 8) & 0xff;
+	read_page_cmd[3] = pages & 0xff;
+
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				  read_page_cmd, sizeof(read_page_cmd), buf,
+				  pages * JED_ROW_WORDS * 4) != 0) {
+		return -1;
+	}
+	swap_bit_byte(buf, pages * JED_ROW_WORDS * 4);
+
+	return 0;
+}
+
+/*
+ * The address move of a skipped run, the page program and the first busy
+ * check of each row go out as one I2C_RDWR transfer. Pages are programmed
+ * one at a time (LSC_PROG_INCR_NV takes a single page over I2C), the busy
+ * flag is only polled further while the page is still being written.
+ */
+static int i2c_send_rows(struct cpld_ctx *ctx, unsigned int *data,
+			 unsigned int lines, unsigned int first,
+			 unsigned int sector, int show_progress)
 {
 	uint8_t write_page_cmd[4] = { 0x70, 0x00, 0x00, 0x01 };
 	uint8_t program_page_cmd[1 + 3 + 16] = {
 		0
 	}; /* 1B Command + 3B Operands + 16B Write Data */
+	uint8_t write_addr_cmd[1 + 3 + 4];
+	uint8_t busy_flag_cmd[4] = { LCMXO2_LSC_CHECK_BUSY, 0x00, 0x00, 0x00 };
+	uint8_t flag[1];
+	struct i2c_batch batch;
+	uint8_t addr = ctx->info.slave << 1;
 	int ret = 0;
 	int CurrentAddr = 0;
 	unsigned int i;
-	unsigned status;
+	unsigned int status;
+	unsigned int skipped = 0;
+	int jump = 0;
 
+	i2c_batch_init(&batch, ctx->info.fd);
 	memcpy(&program_page_cmd[0], write_page_cmd, 4);
-	for (i = 0; i < dev_info->CF_Line; i++) {
-		printf("Writing Data: %d/%d (%.2f%%) \r", (i + 1),
-		       dev_info->CF_Line,
-		       (((i + 1) / (float)dev_info->CF_Line) * 100));
+	for (i = 0; i < lines; i++) {
+		if (show_progress) {
+			cpld_progress(ctx, "Writing Data", i + 1, lines);
+		}
 
 		CurrentAddr = (i * LATTICE_COL_SIZE) / 32;
 
-		memcpy(&program_page_cmd[4], &dev_info->CF[CurrentAddr], 16);
+		//rows before first are already programmed
+		if (i < first) {
+			jump = 1;
+			continue;
+		}
+
+		if (ctx->info.fast_update && row_is_blank(&data[CurrentAddr])) {
+			skipped++;
+			jump = 1;
+			//an erased row is as good as a programmed one
+			if (sector == LCMXO2_ADDR_CF) {
+				cpld_journal_row(&ctx->journal, i + 1);
+			}
+			continue;
+		}
+
+		if (jump) {
+			i2c_address_cmd(write_addr_cmd, sector | i);
+			i2c_batch_add(&batch, addr, write_addr_cmd,
+				      sizeof(write_addr_cmd), NULL, 0);
+			jump = 0;
+		}
+
+		memcpy(&program_page_cmd[4], &data[CurrentAddr], 16);
 		swap_bit_byte(&program_page_cmd[4], 16);
-		ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-					    program_page_cmd, 1 + 3 + 16, NULL,
-					    0);
+		i2c_batch_add(&batch, addr, program_page_cmd,
+			      sizeof(program_page_cmd), NULL, 0);
+		i2c_batch_add(&batch, addr, busy_flag_cmd,
+			      sizeof(busy_flag_cmd), flag, sizeof(flag));
+		ret = i2c_batch_flush(&batch);
 		if (ret != 0) {
 			ERR_PRINT("program_flash(): Program Page Data");
 			return ret;
 		}
-		//usleep(1000);
 
-		status = i2c_check_device_status(CHECK_BUSY);
+		status = 0;
+		if (flag[0] & 0x80) {
+			status = i2c_check_device_status(ctx, CHECK_BUSY,
+							 CPLD_OP_PROGRAM);
+		}
 		if (status != 0) {
-			printf("[%s]Write CF Error, status = %x\n", __func__,
+			printf("[%s]Write Error, status = %x\n", __func__,
 			       status);
 			ret = -1;
 			break;
 		}
+
+		if (sector == LCMXO2_ADDR_CF) {
+			cpld_journal_row(&ctx->journal, i + 1);
+		}
+	}
+
+	if (skipped) {
+		printf("\nSkipped %u of %u blank rows\n", skipped, lines);
 	}
 
+	return ret;
+}
+
+/*write cf data*/
+static int i2c_sendCFdata(struct cpld_ctx *ctx, struct jed_image *dev_info,
+			   unsigned int first)
+{
+	int ret;
+
+	ret = i2c_send_rows(ctx, dev_info->CF, dev_info->CF_Line, first,
+			    LCMXO2_ADDR_CF, 1);
+
 	printf("\n");
 
 	return ret;
 }
 
 /*write ufm data if need*/
-static int i2c_sendUFMdata(CPLDInfo *dev_info)
+static int i2c_sendUFMdata(struct cpld_ctx *ctx, struct jed_image *dev_info)
 {
-	uint8_t write_page_cmd[4] = { 0x70, 0x00, 0x00, 0x01 };
-	uint8_t program_page_cmd[1 + 3 + 16] = {
-		0
-	}; /* 1B Command + 3B Operands + 16B Write Data */
-	int ret = 0;
-	int CurrentAddr = 0;
-	unsigned int i;
-	unsigned int status;
+	return i2c_send_rows(ctx, dev_info->UFM, dev_info->UFM_Line, 0,
+			     LCMXO2_ADDR_UFM, 0);
+}
 
-	memcpy(&program_page_cmd[0], write_page_cmd, 4);
-	for (i = 0; i < dev_info->UFM_Line; i++) {
-		CurrentAddr = (i * LATTICE_COL_SIZE) / 32;
+/*
+ * Read back the sector selected by init_cmd and compare it with the image.
+ * Returns the first differing row, lines when all rows match, or -1 on a
+ * transfer error.
+ */
+static int i2c_diff_rows(struct cpld_ctx *ctx, uint8_t init_cmd,
+			 const unsigned int *data, unsigned int lines)
+{
+	uint8_t reset_addr_cmd[4] = { init_cmd, 0x00, 0x00, 0x00 };
+	unsigned int buff[LCMXO2_I2C_READ_PAGES * JED_ROW_WORDS];
+	unsigned int i, j, n;
+
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				  reset_addr_cmd,
+				  sizeof(reset_addr_cmd), NULL, 0) != 0) {
+		ERR_PRINT("i2c_diff_rows(): Reset Page Address");
+		return -1;
+	}
 
-		memcpy(&program_page_cmd[4], &dev_info->UFM[CurrentAddr], 16);
-		swap_bit_byte(&program_page_cmd[4], 16);
-		ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-					    program_page_cmd,
-					    sizeof(program_page_cmd), NULL, 0);
-		if (ret != 0) {
-			ERR_PRINT("program_flash(): Program Page Data");
-			return ret;
+	for (i = 0; i < lines; i += n) {
+		n = lines - i;
+		if (n > LCMXO2_I2C_READ_PAGES)
+			n = LCMXO2_I2C_READ_PAGES;
+
+		if (i2c_read_pages(ctx, buff, n) != 0) {
+			ERR_PRINT("i2c_diff_rows(): Read Data fail");
+			return -1;
+		}
+		for (j = 0; j < n; j++) {
+			if (memcmp(&buff[j * JED_ROW_WORDS],
+				   &data[(i + j) * JED_ROW_WORDS],
+				   JED_ROW_WORDS * 4)) {
+				return i + j;
+			}
 		}
-		//usleep(1000);
+	}
 
-		status = i2c_check_device_status(CHECK_BUSY);
-		if (status != 0) {
-			printf("[%s]Write UFM Error, status = %x\n", __func__,
-			       status);
-			ret = -1;
-			break;
+	return lines;
+}
+
+/*
+ * Read back CF, UFM and USERCODE. Returns 0 when the flash already holds the
+ * image, 1 otherwise and -1 on a transfer error.
+ */
+static int i2c_cpld_diff(struct cpld_ctx *ctx, struct jed_image *dev_info)
+{
+	uint8_t user_code_cmd[4] = { 0xC0, 0x00, 0x00, 0x00 };
+	uint8_t dr_data[4];
+	unsigned int usercode;
+	int row;
+
+	row = i2c_diff_rows(ctx, LCMXO2_LSC_INIT_ADDRESS, dev_info->CF,
+			    dev_info->CF_Line);
+	if (row < 0) {
+		return -1;
+	}
+	if ((unsigned int)row < dev_info->CF_Line) {
+		printf("CF row %d differs from the image\n", row);
+		return 1;
+	}
+
+	if (dev_info->UFM_Line) {
+		row = i2c_diff_rows(ctx, LCMXO2_LSC_INIT_ADDR_UFM,
+				    dev_info->UFM, dev_info->UFM_Line);
+		if (row < 0) {
+			return -1;
+		}
+		if ((unsigned int)row < dev_info->UFM_Line) {
+			printf("UFM row %d differs from the image\n", row);
+			return 1;
 		}
 	}
 
-	return ret;
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				  user_code_cmd, sizeof(user_code_cmd), dr_data,
+				  sizeof(dr_data)) != 0) {
+		ERR_PRINT("i2c_cpld_diff(): read usercode failed");
+		return -1;
+	}
+	usercode = byte_to_int(dr_data);
+	if (usercode != dev_info->Version) {
+		printf("USERCODE %X differs from the image %X\n", usercode,
+		       dev_info->Version);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* see jtag_resume_row() */
+static int i2c_resume_row(struct cpld_ctx *ctx, struct jed_image *dev_info,
+			  unsigned int from)
+{
+	uint8_t reset_addr_cmd[4] = { LCMXO2_LSC_INIT_ADDRESS, 0x00, 0x00,
+				      0x00 };
+	unsigned int buff[LCMXO2_I2C_READ_PAGES * JED_ROW_WORDS];
+	unsigned int *row;
+	unsigned int i, j, n;
+
+	if (i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				  reset_addr_cmd, sizeof(reset_addr_cmd), NULL,
+				  0) != 0 ||
+	    i2c_write_address(ctx, LCMXO2_ADDR_CF | from) != 0) {
+		ERR_PRINT("i2c_resume_row(): Reset Page Address");
+		return -1;
+	}
+
+	for (i = from; i < dev_info->CF_Line; i += n) {
+		n = dev_info->CF_Line - i;
+		if (n > LCMXO2_I2C_READ_PAGES)
+			n = LCMXO2_I2C_READ_PAGES;
+
+		if (i2c_read_pages(ctx, buff, n) != 0) {
+			ERR_PRINT("i2c_resume_row(): Read Data fail");
+			return -1;
+		}
+		for (j = 0; j < n; j++) {
+			row = &buff[j * JED_ROW_WORDS];
+			if (!memcmp(row, &dev_info->CF[(i + j) * JED_ROW_WORDS],
+				    JED_ROW_WORDS * 4)) {
+				continue;
+			}
+			if (row_is_blank(row)) {
+				return i + j;
+			}
+			printf("CF row %u is neither blank nor the image\n",
+			       i + j);
+			return -1;
+		}
+	}
+
+	return i;
 }
 
-static int i2c_cpld_get_ver(unsigned int *ver)
+static int i2c_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
 	int ret;
 	uint8_t user_code_cmd[4] = { 0xC0, 0x00, 0x00, 0x00 };
 	uint8_t dr_data[4];
 
-	ret = i2c_cpld_check_id();
+	ret = i2c_cpld_check_id(ctx);
 
 	if (ret < 0) {
 		printf("[%s] Unknown Device ID!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_start();
+	ret = i2c_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
 	//Shift in READ USERCODE(0xC0) instruction;
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, user_code_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    user_code_cmd,
 				    sizeof(user_code_cmd), dr_data,
 				    sizeof(dr_data));
 	if (ret != 0) {
@@ -1938,7 +1859,7 @@ static int i2c_cpld_get_ver(unsigned int *ver)
 	CPLD_DEBUG("USERCODE= 0x%X\n", *ver);
 	printf("CPLD Version: %X\n", *ver);
 
-	ret = i2c_cpld_end();
+	ret = i2c_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 	}
@@ -1947,145 +1868,125 @@ error_exit:
 	return ret;
 }
 
-static int i2c_cpld_checksum(FILE *jed_fd, unsigned int *crc)
+/* fold lines rows from the current page address into rb */
+static int i2c_readback_rows(struct cpld_ctx *ctx, struct cpld_readback *rb,
+			     unsigned int lines)
+{
+	unsigned int buff[LCMXO2_I2C_READ_PAGES * JED_ROW_WORDS];
+	unsigned int i, j, n;
+
+	for (i = 0; i < lines; i += n) {
+		n = lines - i;
+		if (n > LCMXO2_I2C_READ_PAGES)
+			n = LCMXO2_I2C_READ_PAGES;
+
+		if (i2c_read_pages(ctx, buff, n) != 0) {
+			return -1;
+		}
+		for (j = 0; j < n; j++) {
+#ifdef VERBOSE_DEBUG
+			printf("[%d] %08x %08x %08x %08x\n", i + j,
+			       buff[j * JED_ROW_WORDS],
+			       buff[j * JED_ROW_WORDS + 1],
+			       buff[j * JED_ROW_WORDS + 2],
+			       buff[j * JED_ROW_WORDS + 3]);
+#endif
+			cpld_readback_row(rb, &buff[j * JED_ROW_WORDS], NULL,
+					  JED_ROW_WORDS * 4);
+		}
+	}
+
+	return 0;
+}
+
+static int i2c_cpld_checksum(struct cpld_ctx *ctx, FILE *jed_fd,
+			     unsigned int *crc)
 {
-	unsigned int i, j;
-	uint8_t buff[16] = { 0 };
 	int ret = 0;
 	uint8_t reset_addr_cmd[4] = { 0x46, 0x00, 0x00, 0x00 };
-	/* 0x73 0x00: i2c, 0x73 0x10: JTAG/SSPI */
-	uint8_t read_page_cmd[4] = { 0x73, 0x00, 0x00, 0x01 };
 
-	CPLDInfo dev_info = { 0 };
-	int cf_size = 0;
-	int endcfg_size = 0;
-	int ufm_size = 0;
+	struct jed_image dev_info = { 0 };
+	struct cpld_readback rb;
 
 	CPLD_DEBUG("[%s]\n", __func__);
 
 	*crc = 0;
+	cpld_readback_init(&rb);
 
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//get update data size
-	ret = jed_update_data_size(jed_fd, &cf_size, &ufm_size, &endcfg_size);
-	if (ret < 0) {
-		printf("[%s] Update Data Size Error!\n", __func__);
-		goto error_exit;
-	}
-
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//parse info from JED file and calculate checksum
-	ret = jed_file_parser(jed_fd, &dev_info, cf_size, ufm_size,
-			      endcfg_size);
+	//map and parse the JED file, the checksum is validated on the way
+	ret = jed_image_load(&dev_info, jed_fd);
 	if (ret < 0) {
 		printf("[%s] JED file CheckSum Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_start();
+	ret = i2c_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, reset_addr_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    reset_addr_cmd,
 				    sizeof(reset_addr_cmd), NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_cpld_checksum(): Reset Page Address");
-		return ret;
+		goto error_exit;
 	}
 
-	for (i = 0; i < dev_info.CF_Line; i++) {
-		memset(buff, 0, sizeof(buff));
-		ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-					    read_page_cmd,
-					    sizeof(read_page_cmd), buff,
-					    sizeof(buff));
-		if (ret != 0) {
-			ERR_PRINT("i2c_cpld_checksum(): Read Data fail");
-			return ret;
-		}
-#ifdef VERBOSE_DEBUG
-		printf("[%d] ", i);
-		for (j = 0; j < 16; j++) {
-			printf("%x ", buff[j]);
-		}
-		printf("\n");
-#endif
-		swap_bit_byte(buff, 16);
-		for (j = 0; j < 16; j++) {
-			*crc += buff[j] & 0xff;
-		}
+	ret = i2c_readback_rows(ctx, &rb, dev_info.CF_Line);
+	if (ret != 0) {
+		ERR_PRINT("i2c_cpld_checksum(): Read Data fail");
+		goto error_exit;
 	}
 
 	reset_addr_cmd[0] = 0x47;
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, reset_addr_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    reset_addr_cmd,
 				    sizeof(reset_addr_cmd), NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_cpld_checksum(): Reset Page Address");
-		return ret;
+		goto error_exit;
 	}
 
-	for (i = 0; i < dev_info.UFM_Line; i++) {
-		memset(buff, 0, sizeof(buff));
-		ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-					    read_page_cmd,
-					    sizeof(read_page_cmd), buff,
-					    sizeof(buff));
-		if (ret != 0) {
-			ERR_PRINT("i2c_cpld_checksum(): Read Data fail");
-			return ret;
-		}
-#ifdef VERBOSE_DEBUG
-		printf("[%d] ", i);
-		for (j = 0; j < 16; j++) {
-			printf("%x ", buff[j]);
-		}
-		printf("\n");
-#endif
-		swap_bit_byte(buff, 16);
-		for (j = 0; j < 16; j++) {
-			*crc += buff[j] & 0xff;
-		}
+	ret = i2c_readback_rows(ctx, &rb, dev_info.UFM_Line);
+	if (ret != 0) {
+		ERR_PRINT("i2c_cpld_checksum(): Read Data fail");
+		goto error_exit;
 	}
-	*crc &= 0xFFFF;
+	*crc = cpld_readback_sum(&rb);
+	printf("CPLD CRC32: %08X\n", cpld_readback_crc32(&rb));
 
-	ret = i2c_cpld_end();
+	ret = i2c_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 		goto error_exit;
 	}
 error_exit:
-	if (NULL != dev_info.CF) {
-		free(dev_info.CF);
-	}
-
-	if (NULL != dev_info.EndCF) {
-		free(dev_info.EndCF);
-	}
-
-	if (NULL != dev_info.UFM) {
-		free(dev_info.UFM);
-	}
+	jed_image_free(&dev_info);
 	return ret;
 }
 
-static int i2c_cpld_verify(CPLDInfo *dev_info)
+/*
+ * Rows are read back in runs of up to LCMXO2_I2C_READ_PAGES, a run ends
+ * early at a row that fast mode did not write.
+ */
+static int i2c_cpld_verify(struct cpld_ctx *ctx, struct jed_image *dev_info)
 {
-	unsigned int i;
+	unsigned int i, j, n;
 	int result;
 	int current_addr = 0;
-	uint8_t buff[16] = { 0 };
+	unsigned int buff[LCMXO2_I2C_READ_PAGES * JED_ROW_WORDS];
+	unsigned int *row;
 	int ret = 0;
+	struct cpld_readback rb;
+	int jump = 0;
 	uint8_t reset_addr_cmd[4] = { 0x46, 0x00, 0x00, 0x00 };
-	/* 0x73 0x00: i2c, 0x73 0x10: JTAG/SSPI */
-	uint8_t read_page_cmd[4] = { 0x73, 0x00, 0x00, 0x01 };
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, reset_addr_cmd,
+	cpld_readback_init(&rb);
+
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    reset_addr_cmd,
 				    sizeof(reset_addr_cmd), NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_cpld_verify(): Reset Page Address");
@@ -2094,34 +1995,65 @@ static int i2c_cpld_verify(CPLDInfo *dev_info)
 
 	CPLD_DEBUG("[%s] dev_info->CF_Line: %d\n", __func__, dev_info->CF_Line);
 
-	for (i = 0; i < dev_info->CF_Line; i++) {
-		printf("Verify Data: %d/%d (%.2f%%) \r", (i + 1),
-		       dev_info->CF_Line,
-		       (((i + 1) / (float)dev_info->CF_Line) * 100));
+	for (i = 0; i < dev_info->CF_Line; i += n) {
 		current_addr = (i * LATTICE_COL_SIZE) / 32;
-		memset(buff, 0, sizeof(buff));
-		ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
-					    read_page_cmd,
-					    sizeof(read_page_cmd), buff,
-					    sizeof(buff));
+		n = 1;
+
+		//only the written rows are verified in fast mode
+		if (ctx->info.fast_update &&
+		    row_is_blank(&dev_info->CF[current_addr])) {
+			cpld_progress(ctx, "Verify Data", i + 1,
+				      dev_info->CF_Line);
+			jump = 1;
+			continue;
+		}
+
+		if (jump) {
+			ret = i2c_write_address(ctx, LCMXO2_ADDR_CF | i);
+			if (ret != 0) {
+				return ret;
+			}
+			jump = 0;
+		}
+
+		//extend the run up to the next row fast mode skipped
+		while (n < LCMXO2_I2C_READ_PAGES && i + n < dev_info->CF_Line) {
+			current_addr = (i + n) * JED_ROW_WORDS;
+			if (ctx->info.fast_update &&
+			    row_is_blank(&dev_info->CF[current_addr])) {
+				break;
+			}
+			n++;
+		}
+
+		ret = i2c_read_pages(ctx, buff, n);
 		if (ret != 0) {
 			ERR_PRINT("i2c_cpld_verify(): Read Data fail");
 			return ret;
 		}
-		swap_bit_byte(buff, 16);
-		result = memcmp(buff, &dev_info->CF[current_addr],
-				sizeof(unsigned int));
-		if (result) {
-			CPLD_DEBUG(
-				"\nPage#%d (%x %x %x %x) did not match with CF (%x %x %x %x)\n",
-				i, buff[0], buff[1], buff[2], buff[3],
-				dev_info->CF[current_addr],
-				dev_info->CF[current_addr + 1],
-				dev_info->CF[current_addr + 2],
-				dev_info->CF[current_addr + 3]);
-			ret = -1;
-			break;
+
+		for (j = 0; j < n; j++) {
+			cpld_progress(ctx, "Verify Data", i + j + 1,
+				      dev_info->CF_Line);
+			row = &buff[j * JED_ROW_WORDS];
+			current_addr = (i + j) * JED_ROW_WORDS;
+			result = cpld_readback_row(&rb, row,
+						   &dev_info->CF[current_addr],
+						   JED_ROW_WORDS * 4);
+			if (result) {
+				CPLD_DEBUG(
+					"\nPage#%d (%x %x %x %x) did not match with CF (%x %x %x %x)\n",
+					i + j, row[0], row[1], row[2], row[3],
+					dev_info->CF[current_addr],
+					dev_info->CF[current_addr + 1],
+					dev_info->CF[current_addr + 2],
+					dev_info->CF[current_addr + 3]);
+				ret = -1;
+				break;
+			}
 		}
+		if (ret == -1)
+			break;
 	}
 
 	printf("\n");
@@ -2129,13 +2061,14 @@ static int i2c_cpld_verify(CPLDInfo *dev_info)
 	if (-1 == ret) {
 		printf("\n[%s] Verify CPLD FW Error\n", __func__);
 	} else {
-		CPLD_DEBUG("\n[%s] Verify CPLD FW Pass\n", __func__);
+		CPLD_DEBUG("\n[%s] Verify CPLD FW Pass, CRC32 %08X\n",
+			   __func__, cpld_readback_crc32(&rb));
 	}
 
 	return ret;
 }
 
-static int i2c_cpld_erase(int erase_type)
+static int i2c_cpld_erase(struct cpld_ctx *ctx, int erase_type)
 {
 	unsigned int dr_data[4] = { 0 };
 	uint8_t erase_flash_cmd[4] = { 0x0E, 0x0, 0x00, 0x00 };
@@ -2153,14 +2086,15 @@ static int i2c_cpld_erase(int erase_type)
 		break;
 	}
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, erase_flash_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    erase_flash_cmd,
 				    sizeof(erase_flash_cmd), NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_cpld_erase()");
 		return ret;
 	}
 
-	dr_data[0] = i2c_check_device_status(CHECK_BUSY);
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_BUSY, CPLD_OP_ERASE);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -2172,7 +2106,7 @@ static int i2c_cpld_erase(int erase_type)
 	//Shift in LSC_READ_STATUS(0x3C) instruction
 	CPLD_DEBUG("[%s] READ_STATUS!\n", __func__);
 
-	dr_data[0] = i2c_check_device_status(CHECK_STATUS);
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_STATUS, CPLD_OP_ERASE);
 
 	if (dr_data[0] != 0) {
 		printf("Erase Failed, status = %x\n", dr_data[0]);
@@ -2186,7 +2120,8 @@ static int i2c_cpld_erase(int erase_type)
 	return ret;
 }
 
-static int i2c_cpld_program(CPLDInfo *dev_info)
+static int i2c_cpld_program(struct cpld_ctx *ctx, struct jed_image *dev_info,
+			    unsigned int first)
 {
 	int ret = 0;
 	unsigned int dr_data[4] = { 0 };
@@ -2197,7 +2132,8 @@ static int i2c_cpld_program(CPLDInfo *dev_info)
 	//Program CFG
 	CPLD_DEBUG("[%s] Program CFG \n", __func__);
 	//Shift in LSC_INIT_ADDRESS(0x46) instruction
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, reset_addr_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    reset_addr_cmd,
 				    sizeof(reset_addr_cmd), NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_cpld_program(): Reset CFG Page Address");
@@ -2205,16 +2141,20 @@ static int i2c_cpld_program(CPLDInfo *dev_info)
 	}
 	CPLD_DEBUG("[%s] INIT_ADDRESS(0x46) \n", __func__);
 
-	ret = i2c_sendCFdata(dev_info);
+	ret = i2c_sendCFdata(ctx, dev_info, first);
 	if (ret < 0) {
 		goto error_exit;
 	}
 
 	if (dev_info->UFM_Line) {
-		//    ast_jtag_run_test_idle(0, JTAG_STATE_TLRESET, 3);
+		//a partly programmed UFM can only be redone after an erase
+		cpld_journal_set(&ctx->journal, CPLD_JOURNAL_UFM,
+				 dev_info->CF_Line);
+
+		//    ast_jtag_run_test_idle(&ctx->jtag, 0, JTAG_STATE_TLRESET, 3);
 		reset_addr_cmd[0] = 0x47;
 		//program UFM
-		ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1,
+		ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
 					    reset_addr_cmd,
 					    sizeof(reset_addr_cmd), NULL, 0);
 		if (ret != 0) {
@@ -2222,7 +2162,7 @@ static int i2c_cpld_program(CPLDInfo *dev_info)
 			return ret;
 		}
 
-		ret = i2c_sendUFMdata(dev_info);
+		ret = i2c_sendUFMdata(ctx, dev_info);
 		if (ret < 0) {
 			goto error_exit;
 		}
@@ -2231,7 +2171,8 @@ static int i2c_cpld_program(CPLDInfo *dev_info)
 	CPLD_DEBUG("[%s] Update CPLD done \n", __func__);
 
 	//Read the status bit
-	dr_data[0] = i2c_check_device_status(CHECK_STATUS);
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_STATUS,
+					     CPLD_OP_PROGRAM);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -2251,17 +2192,25 @@ static int i2c_cpld_program(CPLDInfo *dev_info)
 	memcpy(&prog_buf[0], prog_user_code_cmd, 4);
 	memcpy(&prog_buf[4], &dr_data[0], 4);
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, prog_buf,
-				    1 + 3 + 4, NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    prog_buf, 1 + 3 + 4, NULL, 0);
 	if (ret != 0) {
 		ERR_PRINT("i2c_cpld_program(): Reset CFG Page Address");
 		return ret;
 	}
-	usleep(2000);
+
+	//Wait for the USERCODE program to complete
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_BUSY, CPLD_OP_USERCODE);
+	if (dr_data[0] != 0) {
+		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
+		ret = -1;
+		goto error_exit;
+	}
 	CPLD_DEBUG("[%s] PROGRAM USERCODE(0xC2)\n", __func__);
 
 	//Read the status bit
-	dr_data[0] = i2c_check_device_status(CHECK_STATUS);
+	dr_data[0] = i2c_check_device_status(ctx, CHECK_STATUS,
+					     CPLD_OP_USERCODE);
 
 	if (dr_data[0] != 0) {
 		printf("[%s] Device Busy, status = %x\n", __func__, dr_data[0]);
@@ -2275,104 +2224,112 @@ error_exit:
 	return ret;
 }
 
-static int i2c_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int i2c_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd, char *key,
+			   char is_signed)
 {
-	CPLDInfo dev_info = { 0 };
-	int cf_size = 0;
-	int endcfg_size = 0;
-	int ufm_size = 0;
+	struct jed_image dev_info = { 0 };
 	int erase_type = 0;
+	int resume;
 	int ret;
 
 	CPLD_DEBUG("[%s]\n", __func__);
 	UNUSED(key);
 	UNUSED(is_signed);
-	ret = i2c_cpld_check_id();
+	ret = i2c_cpld_check_id(ctx);
 	if (ret < 0) {
 		printf("[%s] Unknown Device ID!\n", __func__);
 		goto error_exit;
 	}
 
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//get update data size
-	ret = jed_update_data_size(jed_fd, &cf_size, &ufm_size, &endcfg_size);
-	if (ret < 0) {
-		printf("[%s] Update Data Size Error!\n", __func__);
-		goto error_exit;
-	}
-
-	//set file pointer to the beginning
-	fseek(jed_fd, 0, SEEK_SET);
-
-	//parse info from JED file and calculate checksum
-	ret = jed_file_parser(jed_fd, &dev_info, cf_size, ufm_size,
-			      endcfg_size);
+	//map and parse the JED file, the checksum is validated on the way
+	ret = jed_image_load(&dev_info, jed_fd);
 	if (ret < 0) {
 		printf("[%s] JED file CheckSum Error!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_start();
+	ret = i2c_cpld_start(ctx);
 	if (ret < 0) {
 		printf("[%s] Enter Transparent mode Error!\n", __func__);
 		goto error_exit;
 	}
 
-	if (dev_info.UFM_Line) {
-		erase_type = Both_CF_UFM;
-	} else {
-		erase_type = Only_CF;
+	if (ctx->info.fast_update) {
+		ret = i2c_cpld_diff(ctx, &dev_info);
+		if (ret < 0) {
+			printf("[%s] Read back failed!\n", __func__);
+			goto error_exit;
+		}
+		if (ret == 0) {
+			printf("CPLD already up to date, skip programming\n");
+			goto end_program;
+		}
 	}
 
-	ret = i2c_cpld_erase(erase_type);
-	if (ret < 0) {
-		printf("[%s] Erase failed!\n", __func__);
-		goto error_exit;
+	resume = journal_open(ctx, &dev_info);
+	if (resume >= 0) {
+		resume = i2c_resume_row(ctx, &dev_info, resume);
+	}
+
+	if (resume >= 0) {
+		printf("Resuming interrupted update at CF row %d of %u\n",
+		       resume, dev_info.CF_Line);
+	} else {
+		if (dev_info.UFM_Line) {
+			erase_type = Both_CF_UFM;
+		} else {
+			erase_type = Only_CF;
+		}
+
+		ret = i2c_cpld_erase(ctx, erase_type);
+		if (ret < 0) {
+			printf("[%s] Erase failed!\n", __func__);
+			goto error_exit;
+		}
+		cpld_journal_set(&ctx->journal, CPLD_JOURNAL_ERASED, 0);
+		resume = 0;
 	}
 
-	ret = i2c_cpld_program(&dev_info);
+	ret = i2c_cpld_program(ctx, &dev_info, resume);
 	if (ret < 0) {
 		printf("[%s] Program failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_verify(&dev_info);
+	ret = i2c_cpld_verify(ctx, &dev_info);
 	if (ret < 0) {
 		printf("[%s] Verify Failed!\n", __func__);
 		goto error_exit;
 	}
 
-	ret = i2c_cpld_end();
+end_program:
+	ret = i2c_cpld_end(ctx);
 	if (ret < 0) {
 		printf("[%s] Exit Transparent Mode Failed!\n", __func__);
 		goto error_exit;
 	}
 
-error_exit:
-	if (NULL != dev_info.CF) {
-		free(dev_info.CF);
-	}
-
-	if (NULL != dev_info.EndCF) {
-		free(dev_info.EndCF);
-	}
+	//verified, nothing left to resume
+	cpld_journal_done(&ctx->journal);
 
-	if (NULL != dev_info.UFM) {
-		free(dev_info.UFM);
+error_exit:
+	//a failed update leaves no trusted rows behind
+	if (ret < 0) {
+		cpld_journal_discard(&ctx->journal);
 	}
+	cpld_journal_close(&ctx->journal);
+	jed_image_free(&dev_info);
 
 	return ret;
 }
 
-static int yzbb_i2c_cpld_get_ver(unsigned int *ver)
+static int yzbb_i2c_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
 	uint8_t cmd[YZBB_READ_VER_INS_LENGTH] = { YZBB_READ_VERSION };
 	uint8_t dr_data[YZBB_VERSION_DATA_LENGTH];
 	int ret = -1;
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, YZBB_CPLD_SLAVE << 1,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, YZBB_CPLD_SLAVE << 1,
 				    (uint8_t *)&cmd, YZBB_READ_VER_INS_LENGTH,
 				    (uint8_t *)&dr_data,
 				    YZBB_VERSION_DATA_LENGTH);
@@ -2394,7 +2351,7 @@ static int yzbb_i2c_cpld_get_ver(unsigned int *ver)
 	return 0;
 }
 
-static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
+static int yzbb_i2c_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
 	/* Get the ID in the UFM sector (address 0xCA).
      * All YZBB CPLDs need to support this field. */
@@ -2414,8 +2371,8 @@ static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
 
 	int ret = -1;
 
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, en_cfg_cmd,
-				    sizeof(en_cfg_cmd), NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    en_cfg_cmd, sizeof(en_cfg_cmd), NULL, 0);
 	if (ret != 0) {
 		printf("read_device_id() Enable Configuration Interface failed\n");
 		return ret;
@@ -2423,8 +2380,8 @@ static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
 	// Delay 10ms
 	usleep(10000);
 	// Check the configuration status
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, status_cmd,
-				    sizeof(status_cmd), st_data,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    status_cmd, sizeof(status_cmd), st_data,
 				    sizeof(st_data));
 	if (ret != 0) {
 		printf("read_device_id() configuration status failed\n");
@@ -2436,7 +2393,8 @@ static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
 		return -1;
 	}
 	// Init UFM address
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, init_ufm_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    init_ufm_cmd,
 				    sizeof(init_ufm_cmd), NULL, 0);
 	if (ret != 0) {
 		printf("read_device_id() Init UFM address failed\n");
@@ -2444,7 +2402,7 @@ static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
 	}
 	usleep(1000);
 	// Get ID in the UFM sector
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, ufm_cmd,
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1, ufm_cmd,
 				    sizeof(ufm_cmd), ufm_data,
 				    sizeof(ufm_data));
 	if (ret != 0) {
@@ -2468,15 +2426,15 @@ static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
 	printf("\n");
 
 	// Disable Configuration Interface
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, dis_cfg_cmd,
-				    sizeof(dis_cfg_cmd), NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    dis_cfg_cmd, sizeof(dis_cfg_cmd), NULL, 0);
 	if (ret != 0) {
 		printf("read_device_id() Disable Configuration Interface failed\n");
 		return ret;
 	}
 	// Send Bypass
-	ret = i2c_rdwr_msg_transfer(cpld.fd, cpld.slave << 1, bypass_cmd,
-				    sizeof(bypass_cmd), NULL, 0);
+	ret = i2c_rdwr_msg_transfer(ctx->info.fd, ctx->info.slave << 1,
+				    bypass_cmd, sizeof(bypass_cmd), NULL, 0);
 	if (ret != 0) {
 		printf("read_device_id() Send Bypass failed\n");
 		return ret;
@@ -2489,56 +2447,69 @@ static int yzbb_i2c_cpld_get_id(unsigned int *dev_id)
 /***************************      Common       ********************************/
 /******************************************************************************/
 
-static int LCMXO2Family_cpld_get_ver(unsigned int *ver)
+static int LCMXO2Family_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
-	return (cpld.intf == INTF_JTAG) ? jtag_cpld_get_ver(ver) :
-					  i2c_cpld_get_ver(ver);
+	return (ctx->info.intf == INTF_JTAG) ? jtag_cpld_get_ver(ctx, ver) :
+					  i2c_cpld_get_ver(ctx, ver);
 }
 
-static int LCMXO2Family_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int LCMXO2Family_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd,
+				    char *key, char is_signed)
 {
-	return (cpld.intf == INTF_JTAG) ?
-		       jtag_cpld_update(jed_fd, key, is_signed) :
-		       i2c_cpld_update(jed_fd, key, is_signed);
+	return (ctx->info.intf == INTF_JTAG) ?
+		       jtag_cpld_update(ctx, jed_fd, key, is_signed) :
+		       i2c_cpld_update(ctx, jed_fd, key, is_signed);
 }
 
-static int LCMXO3D_cpld_update(FILE *jed_fd, char *key, char is_signed)
+static int LCMXO3D_cpld_update(struct cpld_ctx *ctx, FILE *jed_fd, char *key,
+			       char is_signed)
 {
-	return (cpld.intf == INTF_JTAG) ?
-		       jtag_cpld_lcm3d_update(jed_fd, key, is_signed) :
-		       i2c_cpld_update(jed_fd, key, is_signed);
+	/* MachXO3D page addressing differs, always do a full update */
+	if (ctx->info.fast_update) {
+		printf("Fast update is not supported on MachXO3D\n");
+		ctx->info.fast_update = 0;
+	}
+
+	return (ctx->info.intf == INTF_JTAG) ?
+		       jtag_cpld_lcm3d_update(ctx, jed_fd, key, is_signed) :
+		       i2c_cpld_update(ctx, jed_fd, key, is_signed);
 }
 
-static int LCMXO2Family_cpld_get_id(unsigned int *dev_id)
+static int LCMXO2Family_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
-	return (cpld.intf == INTF_JTAG) ? jtag_cpld_get_id(dev_id) :
-					  i2c_cpld_get_id(dev_id);
+	return (ctx->info.intf == INTF_JTAG) ? jtag_cpld_get_id(ctx, dev_id) :
+					  i2c_cpld_get_id(ctx, dev_id);
 }
 
-static int LCMXO2Family_cpld_checksum(FILE *jed_fd, uint32_t *crc)
+static int LCMXO2Family_cpld_checksum(struct cpld_ctx *ctx, FILE *jed_fd,
+				      uint32_t *crc)
 {
-	return (cpld.intf == INTF_JTAG) ? jtag_cpld_checksum(jed_fd, crc) :
-					  i2c_cpld_checksum(jed_fd, crc);
+	return (ctx->info.intf == INTF_JTAG) ? jtag_cpld_checksum(ctx, jed_fd,
+								  crc) :
+					  i2c_cpld_checksum(ctx, jed_fd, crc);
 }
 
-static int LCMXO2Family_cpld_dev_open(cpld_intf_t intf, cpld_intf_info_t *attr)
+static int LCMXO2Family_cpld_dev_open(struct cpld_ctx *ctx, cpld_intf_t intf,
+				      cpld_intf_info_t *attr)
 {
 	int rc = 0;
 
-	cpld.intf = intf;
+	ctx->info.intf = intf;
 	if (attr != NULL) {
-		cpld.bus = attr->bus;
-		cpld.slave = attr->slave;
-		cpld.mode = attr->mode;
-		cpld.jtag_device = attr->jtag_device;
+		ctx->info.bus = attr->bus;
+		ctx->info.slave = attr->slave;
+		ctx->info.mode = attr->mode;
+		ctx->info.jtag_device = attr->jtag_device;
+		ctx->info.fast_update = attr->fast_update;
+		ctx->info.tck = attr->tck;
 	}
 
 	if (intf == INTF_JTAG) {
-		ast_jtag_set_mode(JTAG_XFER_HW_MODE);
-		rc = ast_jtag_open(cpld.jtag_device);
+		ast_jtag_set_mode(&ctx->jtag, JTAG_XFER_HW_MODE);
+		rc = ast_jtag_open(&ctx->jtag, ctx->info.jtag_device);
 	} else if (intf == INTF_I2C) {
-		cpld.fd = i2c_open(cpld.bus, cpld.slave);
-		if (cpld.fd < 0)
+		ctx->info.fd = i2c_open(ctx->info.bus, ctx->info.slave);
+		if (ctx->info.fd < 0)
 			rc = -1;
 	} else {
 		printf("[%s] Interface type %d is not supported\n", __func__,
@@ -2549,12 +2520,12 @@ static int LCMXO2Family_cpld_dev_open(cpld_intf_t intf, cpld_intf_info_t *attr)
 	return rc;
 }
 
-static int LCMXO2Family_cpld_dev_close(cpld_intf_t intf)
+static int LCMXO2Family_cpld_dev_close(struct cpld_ctx *ctx, cpld_intf_t intf)
 {
 	if (intf == INTF_JTAG) {
-		ast_jtag_close();
+		ast_jtag_close(&ctx->jtag);
 	} else if (intf == INTF_I2C) {
-		close(cpld.fd);
+		close(ctx->info.fd);
 	} else {
 		printf("[%s] Interface type %d is not supported\n", __func__,
 		       intf);
@@ -2563,19 +2534,48 @@ static int LCMXO2Family_cpld_dev_close(cpld_intf_t intf)
 	return 0;
 }
 
-static int YZBBFamily_cpld_get_ver(unsigned int *ver)
+static int YZBBFamily_cpld_get_ver(struct cpld_ctx *ctx, unsigned int *ver)
 {
-	return (cpld.intf == INTF_JTAG) ? yzbb_jtag_cpld_get_ver(ver) :
-					  yzbb_i2c_cpld_get_ver(ver);
+	return (ctx->info.intf == INTF_JTAG) ?
+		       yzbb_jtag_cpld_get_ver(ctx, ver) :
+		       yzbb_i2c_cpld_get_ver(ctx, ver);
 }
 
-static int YZBBFamily_cpld_get_id(unsigned int *dev_id)
+static int YZBBFamily_cpld_get_id(struct cpld_ctx *ctx, unsigned int *dev_id)
 {
-	return (cpld.intf == INTF_JTAG) ? yzbb_jtag_cpld_get_id(dev_id) :
-					  yzbb_i2c_cpld_get_id(dev_id);
+	return (ctx->info.intf == INTF_JTAG) ?
+		       yzbb_jtag_cpld_get_id(ctx, dev_id) :
+		       yzbb_i2c_cpld_get_id(ctx, dev_id);
 }
 
 /******************************************************************************/
+/*
+ * MachXO2/XO3 flash timing (us). Typical values follow the family datasheets,
+ * maximum values are kept generous as polling returns as soon as the device
+ * is ready. The CF erase time grows with the density.
+ */
+static const struct cpld_timing lcmxo3_4300_timing = {
+	.op = {
+		[CPLD_OP_CMD] = { 10, 1000000 },
+		[CPLD_OP_ERASE] = { 1000000, 4000000 },
+		[CPLD_OP_PROGRAM] = { 200, 10000 },
+		[CPLD_OP_USERCODE] = { 200, 10000 },
+		[CPLD_OP_DONE] = { 200, 10000 },
+		[CPLD_OP_READ] = { 0, 0 },
+	},
+};
+
+static const struct cpld_timing lcmxo3_9400_timing = {
+	.op = {
+		[CPLD_OP_CMD] = { 10, 1000000 },
+		[CPLD_OP_ERASE] = { 2000000, 8000000 },
+		[CPLD_OP_PROGRAM] = { 200, 10000 },
+		[CPLD_OP_USERCODE] = { 200, 10000 },
+		[CPLD_OP_DONE] = { 200, 10000 },
+		[CPLD_OP_READ] = { 0, 0 },
+	},
+};
+
 struct cpld_dev_info lattice_dev_list[] = {
   [0] = {
     .name = "LCMXO3LF-9400",
@@ -2586,6 +2586,9 @@ struct cpld_dev_info lattice_dev_list[] = {
     .cpld_program = LCMXO2Family_cpld_update,
     .cpld_dev_id = LCMXO2Family_cpld_get_id,
     .cpld_checksum = LCMXO2Family_cpld_checksum,
+    .cpld_sample = jtag_cpld_sample,
+    .timing = &lcmxo3_9400_timing,
+    .resumable = 1,
   },
   [1] = {
     .name = "LCMXO3LF-4300",
@@ -2596,6 +2599,9 @@ struct cpld_dev_info lattice_dev_list[] = {
     .cpld_program = LCMXO2Family_cpld_update,
     .cpld_dev_id = LCMXO2Family_cpld_get_id,
     .cpld_checksum = LCMXO2Family_cpld_checksum,
+    .cpld_sample = jtag_cpld_sample,
+    .timing = &lcmxo3_4300_timing,
+    .resumable = 1,
   },
   [2] = {
     .name = "LCMXO3D-9400",
@@ -2606,6 +2612,8 @@ struct cpld_dev_info lattice_dev_list[] = {
     .cpld_program = LCMXO3D_cpld_update,
     .cpld_dev_id = LCMXO2Family_cpld_get_id,
     .cpld_checksum = LCMXO2Family_cpld_checksum,
+    .cpld_sample = jtag_cpld_sample,
+    .timing = &lcmxo3_9400_timing,
   },
   [3] = {
     .name = "YZBB-Family",
@@ -2618,5 +2626,6 @@ struct cpld_dev_info lattice_dev_list[] = {
     .cpld_program = LCMXO2Family_cpld_update,
     .cpld_dev_id = YZBBFamily_cpld_get_id,
     .cpld_checksum = LCMXO2Family_cpld_checksum,
+    .timing = &lcmxo3_9400_timing,
   },
 };
@@ -17,6 +17,7 @@
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/container/flat_map.hpp>
 
 #include <sdbusplus/asio/connection.hpp>
@@ -25,9 +26,13 @@
 #include <sdbusplus/message.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 
+#include <gpiod.hpp>
+#include <nlohmann/json.hpp>
+
 #include <array>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -40,15 +45,61 @@ bool addSoCInterfaces = false;
 boost::asio::io_service io;
 auto conn = std::make_shared<sdbusplus::asio::connection>(io);
 auto objectServer = sdbusplus::asio::object_server(conn);
-bool s0_present = false;
-bool s1_present = false;
 
-std::shared_ptr<sdbusplus::asio::dbus_interface> hostPresenceS0 = nullptr;
-std::shared_ptr<sdbusplus::asio::dbus_interface> hostPresenceS1 = nullptr;
 const char *script_s0_present = "/usr/sbin/ampere_utils host present s0";
 const char *script_s1_present = "/usr/sbin/ampere_utils host present s1";
 constexpr const char *cpuInventoryPath =
 	"/xyz/openbmc_project/inventory/system/chassis/motherboard";
+constexpr const char *cpuPresentCfgFile =
+	"/usr/share/ampere-cpu-present/ampere-cpu-present-cfg.json";
+/*
+ * PowerGood (bool) and State ("Absent", "Off" or "On") of a CPU, next to
+ * its Inventory.Item
+ */
+constexpr const char *cpuStateInterface =
+	"xyz.openbmc_project.Ampere.Cpu.State";
+
+/* GPIO line, looked up by name */
+struct GpioCfg {
+	std::string name;
+	bool activeLow;
+};
+
+/*
+ * GPIOs of each socket. The line names and polarity can be changed in
+ * cpuPresentCfgFile. Lines that can be requested for edge events are
+ * monitored and the D-Bus properties follow them. When the presence line
+ * can not be read at all, the presence comes from the ampere_utils script
+ * once at startup.
+ *
+ * This service owns the lines while it runs, other users such as
+ * ampere-trst-wa read Present and PowerGood from D-Bus instead.
+ */
+struct CpuSocket {
+	std::string name;
+	GpioCfg presence;
+	GpioCfg pwrgd;
+	const char *script;
+	bool present = false;
+	bool powerGood = false;
+	gpiod::line presenceLine{};
+	gpiod::line pwrgdLine{};
+	boost::asio::posix::stream_descriptor presenceEvent{ io };
+	boost::asio::posix::stream_descriptor pwrgdEvent{ io };
+	std::shared_ptr<sdbusplus::asio::dbus_interface> item{};
+	std::shared_ptr<sdbusplus::asio::dbus_interface> state{};
+};
+
+std::array<CpuSocket, 2> cpuSockets = { {
+	{ "CPU_1",
+	  { "S0_PRESENCE", true },
+	  { "S0_PCP_PWRGD", false },
+	  script_s0_present },
+	{ "CPU_2",
+	  { "S1_PRESENCE", true },
+	  { "S1_PCP_PWRGD", false },
+	  script_s1_present },
+} };
 
 std::string exec(const char *cmd)
 {
@@ -65,57 +116,230 @@ std::string exec(const char *cmd)
 	return result;
 }
 
-void checkCpuPresent()
+void parseGpioCfg(const nlohmann::json &data, const char *key,
+		  GpioCfg CpuSocket::*gpio)
+{
+	/* "<key>": [ { "gpio": "S0_PRESENCE", "active_low": true }, ... ] */
+	if (!data.contains(key) || !data[key].is_array()) {
+		return;
+	}
+	const auto &list = data[key];
+	for (std::size_t i = 0; i < list.size() && i < cpuSockets.size();
+	     i++) {
+		GpioCfg &cfg = cpuSockets[i].*gpio;
+
+		cfg.name = list[i].value("gpio", cfg.name);
+		cfg.activeLow = list[i].value("active_low", cfg.activeLow);
+	}
+}
+
+void parseCpuPresentCfg()
+{
+	std::ifstream cfgFile(cpuPresentCfgFile);
+
+	if (!cfgFile.is_open()) {
+		return;
+	}
+
+	auto data = nlohmann::json::parse(cfgFile, nullptr, false);
+	if (data.is_discarded()) {
+		std::cerr << "Can not parse " << cpuPresentCfgFile << std::endl;
+		return;
+	}
+
+	parseGpioCfg(data, "presence", &CpuSocket::presence);
+	parseGpioCfg(data, "pwrgd", &CpuSocket::pwrgd);
+}
+
+/* 1 when asserted, 0 when not, -1 when the line can not be read */
+int readGpio(const GpioCfg &gpio)
 {
+	if (gpio.name.empty()) {
+		return -1;
+	}
+
 	try {
-		/* script_s0_present exit with 0 when S1 present */
-		std::size_t found = exec(script_s0_present).find("0");
-		if (found != std::string::npos) {
-			s0_present = true;
+		gpiod::line line = gpiod::find_line(gpio.name);
+		if (!line) {
+			std::cerr << "Can not find the " << gpio.name << " line"
+				  << std::endl;
+			return -1;
 		}
 
-		found = exec(script_s1_present).find("0");
-		if (found != std::string::npos) {
-			s1_present = true;
+		line.request({ "ampere-cpu-present",
+			       gpiod::line_request::DIRECTION_INPUT,
+			       gpio.activeLow ?
+				       gpiod::line_request::FLAG_ACTIVE_LOW :
+				       0 });
+		int value = line.get_value();
+		line.release();
+
+		return value;
+	} catch (const std::exception &e) {
+		std::cerr << gpio.name << ": " << e.what() << std::endl;
+	}
+
+	return -1;
+}
+
+/*
+ * Request a line for edge events on both edges. Its value can still be read
+ * with get_value(), the events are waited for on the event descriptor.
+ * Returns an empty line when the line can not be requested that way.
+ */
+gpiod::line requestGpioEvents(const GpioCfg &gpio,
+			      boost::asio::posix::stream_descriptor &event)
+{
+	gpiod::line line;
+
+	if (gpio.name.empty()) {
+		return line;
+	}
+
+	try {
+		line = gpiod::find_line(gpio.name);
+		if (!line) {
+			return line;
 		}
+
+		line.request({ "ampere-cpu-present",
+			       gpiod::line_request::EVENT_BOTH_EDGES,
+			       gpio.activeLow ?
+				       gpiod::line_request::FLAG_ACTIVE_LOW :
+				       0 });
+		event.assign(line.event_get_fd());
 	} catch (const std::exception &e) {
-		std::cerr << e.what() << std::endl;
+		std::cerr << gpio.name << " events: " << e.what() << std::endl;
+		return gpiod::line();
+	}
+
+	return line;
+}
+
+/*
+ * Call handler with the value of the line after each edge. Edges closer
+ * together than the wakeup only give one call with the final value.
+ */
+void waitGpioEvent(gpiod::line &line,
+		   boost::asio::posix::stream_descriptor &event,
+		   const std::function<void(bool)> &handler)
+{
+	event.async_wait(
+		boost::asio::posix::stream_descriptor::wait_read,
+		[&line, &event, handler](const boost::system::error_code ec) {
+			if (ec) {
+				std::cerr << line.name()
+					  << " wait error: " << ec.message()
+					  << std::endl;
+				return;
+			}
+
+			try {
+				line.event_read();
+				handler(line.get_value());
+			} catch (const std::exception &e) {
+				std::cerr << line.name() << ": " << e.what()
+					  << std::endl;
+			}
+			waitGpioEvent(line, event, handler);
+		});
+}
+
+const char *cpuState(const CpuSocket &socket)
+{
+	if (!socket.present) {
+		return "Absent";
+	}
+
+	return socket.powerGood ? "On" : "Off";
+}
+
+void updateCpuInterfaces(CpuSocket &socket)
+{
+	if (socket.item) {
+		socket.item->set_property("Present", socket.present);
+	}
+	if (socket.state) {
+		socket.state->set_property("PowerGood", socket.powerGood);
+		socket.state->set_property("State",
+					   std::string(cpuState(socket)));
+	}
+}
+
+void checkSocketPresent(CpuSocket &socket)
+{
+	socket.presenceLine =
+		requestGpioEvents(socket.presence, socket.presenceEvent);
+	if (socket.presenceLine) {
+		socket.present = socket.presenceLine.get_value();
+		return;
+	}
+
+	int value = readGpio(socket.presence);
+	if (value >= 0) {
+		socket.present = value;
+		return;
+	}
+
+	/* the script exit with 0 when the socket is present */
+	socket.present = exec(socket.script).find("0") != std::string::npos;
+}
+
+void checkSocketPowerGood(CpuSocket &socket)
+{
+	socket.pwrgdLine = requestGpioEvents(socket.pwrgd, socket.pwrgdEvent);
+	if (socket.pwrgdLine) {
+		socket.powerGood = socket.pwrgdLine.get_value();
+		return;
+	}
+
+	socket.powerGood = readGpio(socket.pwrgd) > 0;
+}
+
+void checkCpuPresent()
+{
+	for (auto &socket : cpuSockets) {
+		try {
+			checkSocketPresent(socket);
+			checkSocketPowerGood(socket);
+		} catch (const std::exception &e) {
+			std::cerr << e.what() << std::endl;
+		}
 	}
 }
 
 void addCpuPresentInterfaces()
 {
 	/* Update CPU present status before add Present D-Bus interfaces*/
-	s0_present = false;
-	s1_present = false;
 	checkCpuPresent();
 
 	try {
 		if (!addSoCInterfaces) {
-			if (s0_present) {
-				std::string socName = "CPU_1";
-				hostPresenceS0 = objectServer.add_interface(
-					cpuInventoryPath + std::string("/") +
-						socName,
-					"xyz.openbmc_project.Inventory.Item");
-				hostPresenceS0->register_property("PrettyName",
-								  socName);
-				hostPresenceS0->register_property("Present",
-								  true);
-				hostPresenceS0->initialize();
-			}
+			for (auto &socket : cpuSockets) {
+				/* an absent CPU is listed if it can show up */
+				if (!socket.present && !socket.presenceLine) {
+					continue;
+				}
 
-			if (s1_present) {
-				std::string socName = "CPU_2";
-				hostPresenceS1 = objectServer.add_interface(
-					cpuInventoryPath + std::string("/") +
-						socName,
+				std::string path = cpuInventoryPath +
+						   std::string("/") +
+						   socket.name;
+				socket.item = objectServer.add_interface(
+					path,
 					"xyz.openbmc_project.Inventory.Item");
-				hostPresenceS1->register_property("PrettyName",
-								  socName);
-				hostPresenceS1->register_property("Present",
-								  true);
-				hostPresenceS1->initialize();
+				socket.item->register_property("PrettyName",
+							       socket.name);
+				socket.item->register_property("Present",
+							       socket.present);
+				socket.item->initialize();
+
+				socket.state = objectServer.add_interface(
+					path, cpuStateInterface);
+				socket.state->register_property(
+					"PowerGood", socket.powerGood);
+				socket.state->register_property(
+					"State", std::string(cpuState(socket)));
+				socket.state->initialize();
 			}
 			addSoCInterfaces = true;
 		}
@@ -124,11 +348,54 @@ void addCpuPresentInterfaces()
 	}
 }
 
+void presenceChanged(CpuSocket &socket, bool present)
+{
+	if (present == socket.present) {
+		return;
+	}
+
+	std::cout << socket.name << (present ? " inserted" : " removed")
+		  << std::endl;
+	socket.present = present;
+	updateCpuInterfaces(socket);
+}
+
+void powerGoodChanged(CpuSocket &socket, bool powerGood)
+{
+	if (powerGood == socket.powerGood) {
+		return;
+	}
+
+	socket.powerGood = powerGood;
+	updateCpuInterfaces(socket);
+}
+
+void monitorCpuGpios()
+{
+	for (auto &socket : cpuSockets) {
+		if (socket.presenceLine) {
+			waitGpioEvent(socket.presenceLine, socket.presenceEvent,
+				      [&socket](bool value) {
+					      presenceChanged(socket, value);
+				      });
+		}
+		if (socket.pwrgdLine) {
+			waitGpioEvent(socket.pwrgdLine, socket.pwrgdEvent,
+				      [&socket](bool value) {
+					      powerGoodChanged(socket, value);
+				      });
+		}
+	}
+}
+
 int main(int argc, char **argv)
 {
-	conn->request_name("xyz.openbmc_project.Ampere.Cpu");
 	objectServer.add_manager("/xyz/openbmc_project/inventory");
+	parseCpuPresentCfg();
 	addCpuPresentInterfaces();
+	monitorCpuGpios();
+	/* units ordered after this one find the CPU objects in place */
+	conn->request_name("xyz.openbmc_project.Ampere.Cpu");
 	io.run();
 
 	return 0;
@@ -1,14 +1,16 @@
-#include <gpiod.h>
+#include <systemd/sd-bus.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 
@@ -18,56 +20,130 @@
 #define JTAG_SIOCMODE	   _IOW(__JTAG_IOCTL_MAGIC, 5, unsigned int)
 #define JTAG_SIOCTRST	   _IOW(__JTAG_IOCTL_MAGIC, 7, unsigned int)
 
-#define S1_PRESENCE  151
-#define S0_PCP_PWRGD 150
-#define S1_PCP_PWRGD 179
+/*
+ * The socket presence and PCP_PWRGD lines are owned by ampere-cpu-present,
+ * which publishes them as Present and PowerGood. Waiting for PowerGood to
+ * be set stands in for the rising edge of the line.
+ */
+#define CPU_SERVICE	"xyz.openbmc_project.Ampere.Cpu"
+#define CPU_INVENTORY	"/xyz/openbmc_project/inventory/system/chassis/motherboard"
+#define CPU_S0_PATH	CPU_INVENTORY "/CPU_1"
+#define CPU_S1_PATH	CPU_INVENTORY "/CPU_2"
+#define CPU_ITEM_IFACE	"xyz.openbmc_project.Inventory.Item"
+#define CPU_STATE_IFACE "xyz.openbmc_project.Ampere.Cpu.State"
 
 #define UNUSED(x) (void)(x)
 
-static int event_callback(int event_type, unsigned int line_offset,
-			  const struct timespec *timestamp, void *data)
+static uint64_t now_usec(void)
 {
-	UNUSED(data);
-	UNUSED(line_offset);
-	UNUSED(timestamp);
-	UNUSED(event_type);
+	struct timespec ts;
 
-	/* exit at first rising edge */
-	return GPIOD_CTXLESS_EVENT_CB_RET_STOP;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
-int startMonitorGpio(const char *device, unsigned int gpio_number,
-		     int event_type, int mon_time)
+static int power_good_callback(sd_bus_message *m, void *data,
+			       sd_bus_error *ret_error)
 {
-	bool active_low = false;
+	bool *power_good = data;
+	const char *iface;
+	const char *name;
+	int value;
 	int rv;
-	struct timespec timeout = { (time_t)mon_time, 0 };
 
-	rv = gpiod_ctxless_event_monitor(device, event_type, gpio_number,
-					 active_low, "jtag-trst-wa", &timeout,
-					 NULL, event_callback, NULL);
+	UNUSED(ret_error);
+
+	rv = sd_bus_message_read(m, "s", &iface);
+	if (rv < 0)
+		return rv;
+
+	rv = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}");
+	if (rv < 0)
+		return rv;
+
+	while ((rv = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY,
+						    "sv")) > 0) {
+		rv = sd_bus_message_read(m, "s", &name);
+		if (rv < 0)
+			return rv;
+
+		if (!strcmp(name, "PowerGood")) {
+			rv = sd_bus_message_read(m, "v", "b", &value);
+			/* exit at first rising edge */
+			if (rv >= 0 && value)
+				*power_good = true;
+		} else {
+			rv = sd_bus_message_skip(m, "v");
+		}
+		if (rv < 0)
+			return rv;
+
+		rv = sd_bus_message_exit_container(m);
+		if (rv < 0)
+			return rv;
+	}
 
-	if (rv) {
-		perror("error waiting for events");
+	return rv;
+}
+
+int startMonitorPowerGood(sd_bus *bus, const char *path, int mon_time)
+{
+	sd_bus_slot *slot = NULL;
+	bool power_good = false;
+	uint64_t deadline = now_usec() + (uint64_t)mon_time * 1000000;
+	uint64_t now;
+	char match[256];
+	int rv;
+
+	snprintf(match, sizeof(match),
+		 "type='signal',sender='%s',path='%s',"
+		 "interface='org.freedesktop.DBus.Properties',"
+		 "member='PropertiesChanged',arg0='%s'",
+		 CPU_SERVICE, path, CPU_STATE_IFACE);
+
+	rv = sd_bus_add_match(bus, &slot, match, power_good_callback,
+			      &power_good);
+
+	while (rv >= 0 && !power_good) {
+		rv = sd_bus_process(bus, NULL);
+		if (rv != 0)
+			continue;
+
+		now = now_usec();
+		if (now >= deadline) {
+			rv = -ETIMEDOUT;
+			break;
+		}
+		rv = sd_bus_wait(bus, deadline - now);
+	}
+
+	sd_bus_slot_unref(slot);
+
+	if (!power_good) {
+		fprintf(stderr, "error waiting for %s PowerGood: %s\n", path,
+			strerror(-rv));
 		return EXIT_FAILURE;
 	}
 
 	return EXIT_SUCCESS;
 }
 
-bool isSlavePresent(const char *device, unsigned int gpio_number)
+bool isSlavePresent(sd_bus *bus, const char *path)
 {
-	bool active_low = false;
-	int value;
+	sd_bus_error error = SD_BUS_ERROR_NULL;
+	int present = 0;
+	int rv;
 
-	value = gpiod_ctxless_get_value(device, gpio_number, active_low,
-					"jtag-trst-wa");
-	/* slave_presence active low */
-	if (value == 0) {
-		return true;
+	/* a socket that can not show up is not listed */
+	rv = sd_bus_get_property_trivial(bus, CPU_SERVICE, path,
+					 CPU_ITEM_IFACE, "Present", &error,
+					 'b', &present);
+	sd_bus_error_free(&error);
+	if (rv < 0) {
+		return false;
 	}
 
-	return false;
+	return present;
 }
 
 /**
@@ -92,19 +168,28 @@ static void jtag_set_trst(int fd, unsigned int lvl)
 int main()
 {
 	int delayTime = 1;
+	sd_bus *bus = NULL;
+	bool slave_present;
 	int jtag_fd;
 	int ret;
-	bool slave_present = isSlavePresent("gpiochip0", S1_PRESENCE);
+
+	ret = sd_bus_open_system(&bus);
+	if (ret < 0) {
+		fprintf(stderr, "Can't connect to system bus: %s\n",
+			strerror(-ret));
+		return -1;
+	}
+	slave_present = isSlavePresent(bus, CPU_S1_PATH);
 
 	jtag_fd = open(JTAG_DEVICE0, O_RDWR);
 	if (jtag_fd == -1) {
 		perror("Can't open jtag driver, please install driver!! \n");
+		sd_bus_unref(bus);
 		return -1;
 	}
 
 	/* wait for S0_PCP_PWRGD */
-	ret = startMonitorGpio("gpiochip0", S0_PCP_PWRGD,
-			       GPIOD_CTXLESS_EVENT_RISING_EDGE, 60);
+	ret = startMonitorPowerGood(bus, CPU_S0_PATH, 60);
 	/* toggle S0_JTAG_TRST */
 	if (ret == EXIT_SUCCESS) {
 		jtag_set_trst(jtag_fd, 0);
@@ -115,13 +200,13 @@ int main()
 	} else {
 		perror("jtag-trst time out\n");
 		close(jtag_fd);
+		sd_bus_unref(bus);
 		return ret;
 	}
 
 	if (slave_present) {
 		/* wait for S1_PCP_PWRGD */
-		ret = startMonitorGpio("gpiochip0", S1_PCP_PWRGD,
-				       GPIOD_CTXLESS_EVENT_RISING_EDGE, 60);
+		ret = startMonitorPowerGood(bus, CPU_S1_PATH, 60);
 		/* toggle S1_JTAG_TRST */
 		if (ret == EXIT_SUCCESS) {
 			jtag_set_trst(jtag_fd, 0);
@@ -132,11 +217,13 @@ int main()
 		} else {
 			perror("jtag-trst time out\n");
 			close(jtag_fd);
+			sd_bus_unref(bus);
 			return ret;
 		}
 	}
 
 	close(jtag_fd);
+	sd_bus_unref(bus);
 
 	return ret;
 }
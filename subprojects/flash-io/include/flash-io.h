@@ -0,0 +1,102 @@
+#ifndef _FLASH_IO_H_
+#define _FLASH_IO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Flash I/O shared by nvparm, ampere_eeprom_prog and ampere_fru_upgrade
+ *
+ * A flash_dev is opened on one of the backends below and then accessed
+ * through flash_dev_read/write/erase, which split a request into the
+ * transfers the device takes (read_max, aligned write_max pages) and time
+ * each of them. Progress lines, CRCs and the timing summary are the same
+ * for every tool.
+ */
+enum flash_op {
+	FLASH_OP_READ = 0,
+	FLASH_OP_WRITE = 1,
+	FLASH_OP_ERASE = 2,
+	FLASH_OP_MAX
+};
+
+struct flash_op_stats {
+	unsigned long count; /* backend calls */
+	uint64_t bytes;
+	uint64_t total_us;
+	uint64_t max_us;
+};
+
+/* bits of flash_dev.flags */
+#define FLASH_DEV_BIT_PROGRAM 0x1 /* bits can be cleared without an erase */
+#define FLASH_DEV_FRESH_READ  0x2 /* reads reopen the device (sysfs) */
+
+struct flash_dev;
+
+struct flash_dev_ops {
+	/* one transfer, within read_max and one write_max page */
+	int (*read)(struct flash_dev *dev, uint32_t off, void *buf,
+		    size_t len);
+	int (*write)(struct flash_dev *dev, uint32_t off, const void *buf,
+		     size_t len);
+	/* whole erase blocks, NULL when the device needs no erase */
+	int (*erase)(struct flash_dev *dev, uint32_t off, size_t len);
+	/* check the device answers, NULL when opening is enough */
+	int (*probe)(struct flash_dev *dev);
+};
+
+struct flash_dev {
+	const struct flash_dev_ops *ops;
+	char path[128];
+	int fd;
+	uint32_t flags;
+	uint32_t size; /* 0 when unknown */
+	uint32_t write_size; /* write alignment */
+	uint32_t write_max; /* writes do not cross a page of this size, or 0 */
+	uint32_t read_max; /* longest read transfer, or 0 */
+	uint32_t erase_size; /* 0 when there is no erase */
+	struct flash_op_stats stats[FLASH_OP_MAX];
+	/* I2C EEPROM */
+	uint8_t slave;
+	uint8_t addr_len;
+	unsigned int twr_max_ms;
+};
+
+/* MTD character device, geometry from MEMGETINFO */
+int flash_dev_open_mtd(struct flash_dev *dev, const char *path);
+/*
+ * sysfs eeprom file of the at24 driver. Writes are split at page_size,
+ * with FLASH_DEV_FRESH_READ each read goes through a new descriptor,
+ * opened with O_DIRECT where the file allows it.
+ */
+int flash_dev_open_sysfs(struct flash_dev *dev, const char *path,
+			 uint32_t page_size, uint32_t flags);
+/*
+ * AT24 EEPROM on an I2C bus, 64KB per slave address from slave on. Write
+ * cycles are ACK polled for up to twr_max_ms.
+ */
+int flash_dev_open_i2c_eeprom(struct flash_dev *dev, int bus, uint8_t slave,
+			      uint32_t page_size, unsigned int twr_max_ms);
+void flash_dev_close(struct flash_dev *dev);
+
+int flash_dev_probe(struct flash_dev *dev);
+int flash_dev_read(struct flash_dev *dev, uint32_t off, void *buf,
+		   size_t len);
+int flash_dev_write(struct flash_dev *dev, uint32_t off, const void *buf,
+		    size_t len);
+int flash_dev_erase(struct flash_dev *dev, uint32_t off, size_t len);
+int flash_dev_sync(struct flash_dev *dev);
+/* buffer aligned for the device, free() it */
+void *flash_dev_alloc(const struct flash_dev *dev, size_t size);
+void flash_dev_print_stats(const struct flash_dev *dev);
+
+/* zlib compatible CRC32, start with crc 0 */
+uint32_t flash_crc32(uint32_t crc, const void *buf, size_t len);
+/* CRC16-CCITT (polynomial 0x1021), start with crc 0 */
+uint16_t flash_crc16(uint16_t crc, const void *buf, size_t len);
+
+uint64_t flash_now_us(void);
+/* "what: done/total (n%)" line, redrawn at most every 500 ms */
+void flash_progress(const char *what, size_t done, size_t total);
+
+#endif /* _FLASH_IO_H_ */
@@ -0,0 +1,186 @@
+/*
+ * Flash I/O backend: AT24 EEPROM on an I2C bus
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include "flash-io.h"
+
+/*
+ * The slave I2C EEPROM bus addresses start from the given slave, each of
+ * them addresses a range of 64KB. Reads run sequentially up to the end of
+ * that bank, split at the I2C_RDWR message limit of the kernel.
+ */
+#define EEPROM_BANK_SIZE     0x10000
+#define EEPROM_MAX_READ_LEN  8192
+#define EEPROM_MAX_PAGE_SIZE 0x100
+#define EEPROM_ACK_POLL_US   100
+
+static uint8_t eeprom_slave(struct flash_dev *dev, uint32_t off)
+{
+	return dev->slave + off / EEPROM_BANK_SIZE;
+}
+
+/* the offset bytes sent ahead of a read or write */
+static int eeprom_addr(struct flash_dev *dev, uint32_t off, uint8_t *buf)
+{
+	uint16_t off_tmp = off % EEPROM_BANK_SIZE;
+
+	if (dev->addr_len == 2) {
+		buf[0] = (off_tmp & 0xFF00) >> 8;
+		buf[1] = off_tmp & 0x00FF;
+	} else {
+		buf[0] = off_tmp & 0x00FF;
+	}
+
+	return dev->addr_len;
+}
+
+/*
+ * Wait for the write cycle to finish by ACK polling: a one byte read at
+ * the current address is NACKed until the EEPROM is ready again.
+ */
+static int eeprom_wait_write(struct flash_dev *dev, uint8_t slave)
+{
+	struct i2c_rdwr_ioctl_data ioctl_data;
+	struct i2c_msg i2c_msg;
+	uint8_t data;
+	uint64_t start;
+
+	i2c_msg.addr = slave;
+	i2c_msg.flags = I2C_M_RD;
+	i2c_msg.len = 1;
+	i2c_msg.buf = &data;
+	ioctl_data.msgs = &i2c_msg;
+	ioctl_data.nmsgs = 1;
+
+	start = flash_now_us();
+	while (ioctl(dev->fd, I2C_RDWR, &ioctl_data) < 0) {
+		if (flash_now_us() - start > (uint64_t)dev->twr_max_ms * 1000) {
+			printf("EEPROM @0x%x still busy after %d ms\n", slave,
+			       dev->twr_max_ms);
+			return -ETIMEDOUT;
+		}
+		usleep(EEPROM_ACK_POLL_US);
+	}
+
+	return 0;
+}
+
+static int eeprom_read(struct flash_dev *dev, uint32_t off, void *buf,
+		       size_t len)
+{
+	struct i2c_rdwr_ioctl_data ioctl_data;
+	struct i2c_msg i2c_msgs[2];
+	uint8_t addr[2], *p = buf;
+	uint32_t boundary;
+	size_t bytes;
+
+	/* one byte offset parts are 256 bytes devices */
+	boundary = dev->addr_len == 2 ? EEPROM_BANK_SIZE : 0x100;
+
+	while (len) {
+		bytes = boundary - off % boundary;
+		if (bytes > len)
+			bytes = len;
+
+		/* A dummy write operation should be done according to the I2C protocol */
+		i2c_msgs[0].addr = eeprom_slave(dev, off);
+		i2c_msgs[0].flags = 0;
+		i2c_msgs[0].len = eeprom_addr(dev, off, addr);
+		i2c_msgs[0].buf = addr;
+
+		/* Read operation */
+		i2c_msgs[1].addr = i2c_msgs[0].addr;
+		i2c_msgs[1].flags = I2C_M_RD;
+		i2c_msgs[1].len = bytes;
+		i2c_msgs[1].buf = p;
+
+		ioctl_data.msgs = i2c_msgs;
+		ioctl_data.nmsgs = 2;
+		if (ioctl(dev->fd, I2C_RDWR, &ioctl_data) < 0) {
+			printf("Failed to read data from EEPROM @0x%x via i2c!\n",
+			       i2c_msgs[0].addr);
+			return -EIO;
+		}
+
+		off += bytes;
+		p += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+static int eeprom_write(struct flash_dev *dev, uint32_t off, const void *buf,
+			size_t len)
+{
+	uint8_t wr_buf[EEPROM_MAX_PAGE_SIZE + 2];
+	uint8_t slave = eeprom_slave(dev, off);
+	int addr_len;
+
+	if (ioctl(dev->fd, I2C_SLAVE, slave) < 0)
+		return -ENODEV;
+
+	addr_len = eeprom_addr(dev, off, wr_buf);
+	memcpy(&wr_buf[addr_len], buf, len);
+	if (write(dev->fd, wr_buf, addr_len + len) != (ssize_t)(addr_len + len)) {
+		printf("Failed to write data to I2C bus\n");
+		return -EIO;
+	}
+
+	/* wait for the I2C write to be done */
+	return eeprom_wait_write(dev, slave);
+}
+
+static int eeprom_probe(struct flash_dev *dev)
+{
+	uint8_t buf[1];
+
+	if (ioctl(dev->fd, I2C_SLAVE, dev->slave) < 0 ||
+	    write(dev->fd, buf, 0) < 0)
+		return -EACCES;
+
+	return 0;
+}
+
+static const struct flash_dev_ops eeprom_ops = {
+	.read = eeprom_read,
+	.write = eeprom_write,
+	.probe = eeprom_probe,
+};
+
+int flash_dev_open_i2c_eeprom(struct flash_dev *dev, int bus, uint8_t slave,
+			      uint32_t page_size, unsigned int twr_max_ms)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->ops = &eeprom_ops;
+	snprintf(dev->path, sizeof(dev->path), "/dev/i2c-%d", bus);
+
+	if (page_size > EEPROM_MAX_PAGE_SIZE) {
+		printf("EEPROM page size %d is not supported\n", page_size);
+		return -EINVAL;
+	}
+
+	dev->fd = open(dev->path, O_RDWR);
+	if (dev->fd < 0) {
+		perror("Failed to open I2C device!");
+		return -ENODEV;
+	}
+
+	dev->slave = slave;
+	/* parts with pages of 32 bytes and more take a two bytes offset */
+	dev->addr_len = page_size >= 0x20 ? 2 : 1;
+	dev->write_size = 1;
+	dev->write_max = page_size;
+	dev->read_max = EEPROM_MAX_READ_LEN;
+	dev->twr_max_ms = twr_max_ms;
+
+	return 0;
+}
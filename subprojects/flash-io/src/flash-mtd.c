@@ -0,0 +1,86 @@
+/*
+ * Flash I/O backend: MTD character device
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <mtd/mtd-user.h>
+#include <sys/ioctl.h>
+#include "flash-io.h"
+
+static int mtd_read(struct flash_dev *dev, uint32_t off, void *buf,
+		    size_t len)
+{
+	if (pread(dev->fd, buf, len, off) != (ssize_t)len) {
+		printf("%s: read 0x%x+0x%x failed: %s\n", dev->path, off,
+		       (unsigned int)len, strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int mtd_write(struct flash_dev *dev, uint32_t off, const void *buf,
+		     size_t len)
+{
+	if (pwrite(dev->fd, buf, len, off) != (ssize_t)len) {
+		printf("%s: write 0x%x+0x%x failed: %s\n", dev->path, off,
+		       (unsigned int)len, strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int mtd_erase(struct flash_dev *dev, uint32_t off, size_t len)
+{
+	struct erase_info_user erase;
+
+	erase.start = off;
+	erase.length = len;
+	if (ioctl(dev->fd, MEMERASE, &erase) < 0) {
+		printf("%s: erase 0x%.8x-0x%.8x failed: %s\n", dev->path, off,
+		       (unsigned int)(off + len), strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static const struct flash_dev_ops mtd_ops = {
+	.read = mtd_read,
+	.write = mtd_write,
+	.erase = mtd_erase,
+};
+
+int flash_dev_open_mtd(struct flash_dev *dev, const char *path)
+{
+	struct mtd_info_user mtd;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->ops = &mtd_ops;
+	snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+	dev->fd = open(path, O_SYNC | O_RDWR);
+	if (dev->fd < 0) {
+		printf("Failed to open the file: %s\n", path);
+		return -ENODEV;
+	}
+
+	if (ioctl(dev->fd, MEMGETINFO, &mtd) < 0) {
+		printf("%s: MEMGETINFO failed: %s\n", path, strerror(errno));
+		flash_dev_close(dev);
+		return -ENODEV;
+	}
+
+	dev->size = mtd.size;
+	dev->erase_size = mtd.erasesize;
+	dev->write_size = mtd.writesize ? mtd.writesize : 1;
+	if (mtd.type == MTD_NORFLASH && dev->write_size == 1)
+		dev->flags |= FLASH_DEV_BIT_PROGRAM;
+
+	return 0;
+}
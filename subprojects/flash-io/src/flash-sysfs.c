@@ -0,0 +1,106 @@
+/*
+ * Flash I/O backend: sysfs eeprom file of the at24 driver
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "flash-io.h"
+
+/* reads go through this buffer, a whole O_DIRECT block */
+#define SYSFS_READ_MAX 4096
+
+static unsigned char read_buf[SYSFS_READ_MAX]
+	__attribute__((aligned(SYSFS_READ_MAX)));
+
+static int sysfs_read(struct flash_dev *dev, uint32_t off, void *buf,
+		      size_t len)
+{
+	ssize_t ret;
+	int fd = dev->fd;
+
+	/*
+	 * A descriptor of its own per read, so that the data cannot be
+	 * served from anything left over from the write
+	 */
+	if (dev->flags & FLASH_DEV_FRESH_READ) {
+		fd = open(dev->path, O_RDONLY | O_DIRECT);
+		if (fd >= 0) {
+			/* O_DIRECT wants whole blocks */
+			ret = pread(fd, read_buf, SYSFS_READ_MAX,
+				    off & ~(SYSFS_READ_MAX - 1));
+			if (ret >= 0)
+				ret -= off & (SYSFS_READ_MAX - 1);
+			if (ret >= (ssize_t)len) {
+				memcpy(buf,
+				       &read_buf[off & (SYSFS_READ_MAX - 1)],
+				       len);
+				close(fd);
+				return 0;
+			}
+			close(fd);
+		}
+		fd = open(dev->path, O_RDONLY);
+		if (fd < 0) {
+			printf("Can't open %s for reading\n", dev->path);
+			return -ENODEV;
+		}
+	}
+
+	ret = pread(fd, buf, len, off);
+	if (fd != dev->fd)
+		close(fd);
+	if (ret != (ssize_t)len) {
+		printf("%s: read 0x%x+0x%x failed\n", dev->path, off,
+		       (unsigned int)len);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int sysfs_write(struct flash_dev *dev, uint32_t off, const void *buf,
+		       size_t len)
+{
+	if (pwrite(dev->fd, buf, len, off) != (ssize_t)len) {
+		printf("%s: write 0x%x+0x%x failed\n", dev->path, off,
+		       (unsigned int)len);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static const struct flash_dev_ops sysfs_ops = {
+	.read = sysfs_read,
+	.write = sysfs_write,
+};
+
+int flash_dev_open_sysfs(struct flash_dev *dev, const char *path,
+			 uint32_t page_size, uint32_t flags)
+{
+	struct stat st;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->ops = &sysfs_ops;
+	dev->flags = flags;
+	snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+	dev->fd = open(path, O_RDWR);
+	if (dev->fd < 0) {
+		printf("Can't open device %s\n", path);
+		return -ENODEV;
+	}
+	if (fstat(dev->fd, &st) == 0)
+		dev->size = st.st_size;
+
+	dev->write_size = 1;
+	dev->write_max = page_size;
+	dev->read_max = SYSFS_READ_MAX;
+
+	return 0;
+}
@@ -18,21 +18,16 @@
 
 #include <fcntl.h>
 #include <linux/errno.h>
-#include <linux/i2c.h>
-#include <linux/i2c-dev.h>
-#include <netinet/in.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
-#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
-#include <zlib.h>
+#include "flash-io.h"
 
 #pragma pack(1)
 
-#define PERCENTAGE(x, total) (((x) * 100) / (total))
-
 enum eeprom_type {
 	EEPROM_24C02 = 1,
 	EEPROM_24C64 = 2,
@@ -43,17 +38,24 @@ enum eeprom_type {
 #define DEFAULT_I2C_BUS		     1
 #define DEFAULT_I2C_EEPROM_ADDR	     0x50
 #define DEFAULT_I2C_EEPROM_TYPE	     EEPROM_24C1024
-#define EEPROM_RD_FLG		     0
-#define EEPROM_WR_FLG		     1
 #define EEPROM_24C1024_PAGE_SIZE     0x100
 #define EEPROM_24C512_PAGE_SIZE	     0x80
 #define EEPROM_24C64_PAGE_SIZE	     0x20
 #define EEPROM_24C02_PAGE_SIZE	     0x8
-#define EEPROM_MAX_PAGE_SIZE_SUPPORT EEPROM_24C1024_PAGE_SIZE
-#define MAX_EEPROM_ADDR_LEN	     2
+/*
+ * The EEPROM does not acknowledge its address while a write cycle is in
+ * progress. Completion is polled for, up to the tWR of the part.
+ */
+#define EEPROM_TWR_MAX_MS	     10
+/*
+ * Programming, readback, verify and compare work through one buffer of
+ * the size of the longest I2C read, whatever the size of the image.
+ */
+#define EEPROM_CHUNK_SIZE	     8192
 
 struct smpmpro_ctl {
 	uint8_t prog_mode;
+	uint8_t diff_mode;
 	uint8_t detect_mode;
 	uint8_t read_mode;
 	uint8_t i2c_bus;
@@ -61,9 +63,11 @@ struct smpmpro_ctl {
 	uint8_t eeprom_type;
 	char filename[128];
 	uint32_t rc;
+	uint32_t twr_max_ms;
 };
 
 static struct smpmpro_ctl ctl;
+static struct flash_dev eeprom;
 
 static void display_usage(void)
 {
@@ -76,23 +80,11 @@ static void display_usage(void)
 	printf("\t\t\t 1:24c04 2:24c64 3:24c1024\n");
 	printf("\t-r <count>\t: read <count> bytes from EEPROM offset 0\n");
 	printf("\t-p\t\t: program the file\n");
+	printf("\t-u\t\t: with -p, only write the pages that differ\n");
 	printf("\t-d\t\t: detect the EEPROM\n");
 	printf("\t-f <file>\t: The firmware file\n");
-}
-
-/*
- * Open the i2c bus device
- */
-static int open_i2c_dev(char *i2c_device)
-{
-	int fd = open(i2c_device, O_RDWR);
-
-	if (fd < 0) {
-		perror("Failed to open I2C device!");
-		return -1;
-	}
-
-	return fd;
+	printf("\t-w <ms>\t\t: max write cycle time (default %d ms)\n",
+	       EEPROM_TWR_MAX_MS);
 }
 
 static int bus_arg_handler(int argc, char **argv, int index)
@@ -147,24 +139,41 @@ static int detect_arg_handler(int argc, char **argv, int index)
 	return 0;
 }
 
-static char *arglist[] = { "-b", "-s", "-t", "-r", "-p", "-d", "-f", NULL };
+static int diff_arg_handler(int argc, char **argv, int index)
+{
+	ctl.diff_mode = 1;
+	return 0;
+}
+
+static int twr_arg_handler(int argc, char **argv, int index)
+{
+	ctl.twr_max_ms = (uint32_t)strtol(argv[index + 1], NULL, 10);
+	if (ctl.twr_max_ms == 0) {
+		printf("Invalid write cycle time %d\n", ctl.twr_max_ms);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static char *arglist[] = { "-b", "-s", "-t", "-r", "-p",
+			   "-d", "-f", "-w", "-u", NULL };
 
 static int (*handlerlist[])(int, char **,
 			    int) = { bus_arg_handler,	   slave_arg_handler,
 				     dev_type_arg_handler, read_arg_handler,
 				     prog_arg_handler,	   detect_arg_handler,
-				     file_arg_handler,	   NULL };
+				     file_arg_handler,	   twr_arg_handler,
+				     diff_arg_handler,	   NULL };
 
-static void hexdump(char *buf, ssize_t len)
+static void hexdump(uint32_t base, char *buf, ssize_t len)
 {
 	ssize_t i;
 
 	for (i = 0; i < len; i++) {
 		if ((i % 16) == 0)
-			printf("\n%04lx: ", (unsigned long)i);
+			printf("\n%04lx: ", (unsigned long)(base + i));
 		printf("%02x ", buf[i]);
 	}
-	printf("\n");
 }
 
 static int parse_arguments(int argc, char **argv)
@@ -217,208 +226,171 @@ static int eeprom_get_pagesize(uint8_t type)
 	return pagesize;
 }
 
-static int i2c_master_write(int fd, uint8_t slave, uint8_t *data, size_t count)
+/*
+ * Read the EEPROM a chunk at a time, then write and read back only the runs
+ * of pages that differ from the image. The whole EEPROM is read again at
+ * the end and its CRC32 compared with the image.
+ */
+static int program_fw_diff(struct flash_dev *dev, const uint8_t *img,
+			   ssize_t sz)
 {
-	int ret = 0;
+	uint8_t cur[EEPROM_CHUNK_SIZE];
+	ssize_t pagesize, chunk, off, pos, end, len;
+	unsigned int pages = 0, changed = 0;
+	uint32_t crc_img = 0, crc_rd = 0;
+
+	pagesize = dev->write_max;
+
+	for (off = 0; off < sz; off += chunk) {
+		chunk = (sz - off < EEPROM_CHUNK_SIZE) ? sz - off :
+							  EEPROM_CHUNK_SIZE;
+		flash_progress("Programing changed pages", off, sz);
+		if (flash_dev_read(dev, off, cur, chunk) < 0) {
+			printf("\nRead FAILED at offset 0x%x\n", (int)off);
+			return -EIO;
+		}
 
-	if (ioctl(fd, I2C_SLAVE, slave) < 0) {
-		ret = -ENODEV;
-		return ret;
-	}
+		for (pos = 0; pos < chunk; pos = end) {
+			len = (chunk - pos < pagesize) ? chunk - pos : pagesize;
+			end = pos + len;
+			pages++;
+			if (!memcmp(&cur[pos], &img[off + pos], len))
+				continue;
+
+			/* extend to the whole run of differing pages */
+			changed++;
+			while (end < chunk) {
+				len = (chunk - end < pagesize) ? chunk - end :
+								 pagesize;
+				if (!memcmp(&cur[end], &img[off + end], len))
+					break;
+				end += len;
+				pages++;
+				changed++;
+			}
 
-	/* Write the specified data onto the I2C bus */
-	ret = write(fd, data, count);
-	if (ret != count) {
-		printf("Failed to write data to I2C bus\n");
-		ret = -ENODEV;
-		return ret;
+			if (flash_dev_write(dev, off + pos, &img[off + pos],
+					    end - pos) < 0 ||
+			    flash_dev_read(dev, off + pos, &cur[pos],
+					   end - pos) < 0) {
+				printf("\nFAILED at offset 0x%x\n",
+				       (int)(off + pos));
+				return -EIO;
+			}
+			if (memcmp(&cur[pos], &img[off + pos], end - pos)) {
+				printf("\nVerify FAILED at offset 0x%x\n",
+				       (int)(off + pos));
+				return -EAGAIN;
+			}
+		}
 	}
-
-	return ret;
-}
-
-static int i2c_master_read(int fd, uint8_t slave, uint8_t *wr_data,
-			   uint8_t *data, uint16_t offset, size_t data_len)
-{
-	struct i2c_rdwr_ioctl_data ioctl_data;
-	struct i2c_msg i2c_msgs[2];
-
-	if (data_len > EEPROM_MAX_PAGE_SIZE_SUPPORT) {
-		printf("*** Warning: Sequential read should not exceed %d bytes, \
-                        otherwise the read data will be rolled over!\n",
-		       EEPROM_MAX_PAGE_SIZE_SUPPORT);
+	flash_progress("Programing changed pages", sz, sz);
+	printf("\n");
+	printf("%u of %u pages differed\n", changed, pages);
+
+	for (off = 0; off < sz; off += chunk) {
+		chunk = (sz - off < EEPROM_CHUNK_SIZE) ? sz - off :
+							  EEPROM_CHUNK_SIZE;
+		flash_progress("Reading from EEPROM", off, sz);
+		if (flash_dev_read(dev, off, cur, chunk) < 0) {
+			printf("\nRead FAILED at offset 0x%x\n", (int)off);
+			return -EIO;
+		}
+		crc_img = flash_crc32(crc_img, &img[off], chunk);
+		crc_rd = flash_crc32(crc_rd, cur, chunk);
 	}
+	flash_progress("Reading from EEPROM", sz, sz);
+	printf("\n");
 
-	/* A dummy write operation should be done according to the I2C protocol */
-	ioctl_data.nmsgs = 2;
-	ioctl_data.msgs = i2c_msgs;
-	ioctl_data.msgs[0].len = MAX_EEPROM_ADDR_LEN;
-	ioctl_data.msgs[0].addr = slave;
-	ioctl_data.msgs[0].flags = 0;
-	ioctl_data.msgs[0].buf = wr_data;
-
-	/* Read operation */
-	ioctl_data.msgs[1].len = data_len;
-	ioctl_data.msgs[1].addr = slave;
-	ioctl_data.msgs[1].flags = 1;
-	ioctl_data.msgs[1].buf = data;
-
-	if (ioctl(fd, I2C_RDWR, &ioctl_data) < 0) {
-		printf("Failed to read data from EEPROM @0x%x via i2c!\n",
-		       slave);
-		return -1;
+	printf("CRC32 checksum calculation ... ");
+	if (crc_img != crc_rd) {
+		printf("FAILED. Try to program again!\n");
+		return -EAGAIN;
 	}
+	printf("PASSED\n");
 
 	return 0;
 }
 
-static int detect_eeprom(int fd, struct smpmpro_ctl *ctl)
-{
-	uint8_t buff[1];
-	int ret;
-
-	ret = i2c_master_write(fd, ctl->eeprom_addr, buff, 0);
-	if (ret < 0)
-		return -EACCES;
-	return 0;
-}
-
-static ssize_t eeprom_rd_wr(int fd, struct smpmpro_ctl *ctl, uint32_t offset,
-			    uint8_t *buf, ssize_t size, uint8_t rw_flag)
+static int program_fw(struct flash_dev *dev, const uint8_t *img, ssize_t sz)
 {
-	ssize_t ret, bytes, len;
-	int pagesize;
-	uint8_t wr_buf[EEPROM_MAX_PAGE_SIZE_SUPPORT + MAX_EEPROM_ADDR_LEN];
-	uint8_t rd_buf[EEPROM_MAX_PAGE_SIZE_SUPPORT];
-	uint8_t *p = buf;
-	uint16_t buf_off, off_tmp;
-	uint32_t off;
-	uint8_t eeprom_addr;
-
-	len = size;
-	pagesize = eeprom_get_pagesize(ctl->eeprom_type);
-	off = offset;
-loop:
-	if (rw_flag == EEPROM_WR_FLG)
-		printf("\rPrograming FW file: %d/%d (%d%%)", (int)(size - len),
-		       (int)size, (int)PERCENTAGE(size - len, size));
-	else
-		printf("\rReading from EEPROM: %d/%d (%d%%)", (int)(size - len),
-		       (int)size, (int)PERCENTAGE(size - len, size));
-	buf_off = 0;
-
-	/*
-	 * The slave I2C EEPROM bus addresses start from 0x50 upto 0x53.
-	 * Each I2C slave can address a range of 64KB.
-	 * Readjust the offset to address a total of 256KB eeprom memory.
-	 */
-
-	if (off >= 0x30000) {
-		off_tmp = (uint16_t)(off - 0x30000);
-	} else if (off >= 0x20000) {
-		off_tmp = (uint16_t)(off - 0x20000);
-	} else if (off >= 0x10000) {
-		off_tmp = (uint16_t)(off - 0x10000);
-	} else
-		off_tmp = (uint16_t)off;
-
-	eeprom_addr = ctl->eeprom_addr + off / 0x10000;
-
-	/* EEPROM offset address */
-	if (pagesize == EEPROM_24C64_PAGE_SIZE ||
-	    pagesize == EEPROM_24C512_PAGE_SIZE ||
-	    pagesize == EEPROM_24C1024_PAGE_SIZE) {
-		wr_buf[buf_off++] = (off_tmp & 0xFF00) >> 8;
-		wr_buf[buf_off++] = (off_tmp & 0x00FF);
-	} else {
-		wr_buf[buf_off++] = off_tmp & 0x00FF;
-	}
-	if (len >= pagesize)
-		bytes = pagesize;
-	else
-		bytes = len;
-	if (rw_flag == EEPROM_WR_FLG) {
-		memcpy(&wr_buf[buf_off], p, bytes);
-		ret = i2c_master_write(fd, eeprom_addr, wr_buf,
-				       bytes + buf_off);
-		if (ret == -1) {
-			printf("%s: fail to send wr data\n", __func__);
-			return -EIO;
-		}
-		/* delay 10ms for the I2C write is done */
-		usleep(10 * 1000);
-	} else {
-		ret = i2c_master_read(fd, eeprom_addr, wr_buf, rd_buf, buf_off,
-				      bytes);
-		if (ret == -1) {
-			printf("%s: fail to read data\n", __func__);
+	uint8_t buf_tmp[EEPROM_CHUNK_SIZE];
+	ssize_t off, chunk;
+	uint32_t crc_img = 0, crc_rd = 0;
+
+	for (off = 0; off < sz; off += chunk) {
+		chunk = (sz - off < EEPROM_CHUNK_SIZE) ? sz - off :
+							  EEPROM_CHUNK_SIZE;
+		flash_progress("Programing FW file", off, sz);
+		if (flash_dev_write(dev, off, &img[off], chunk) < 0) {
+			printf("FAILED\n");
 			return -EIO;
 		}
-		memcpy(p, rd_buf, bytes);
 	}
-	off += bytes;
-	p += bytes;
-	len -= bytes;
-	if (len > 0)
-		goto loop;
-
-	return (int)(size - len);
-}
-
-static int program_fw(int fd, struct smpmpro_ctl *ctl, void *buff, ssize_t sz)
-{
-	char *buf_tmp;
-	ssize_t bytes_wr, bytes_rd;
-	int ret = 0;
-	uint32_t crc32_checksum;
-
-	printf("Programing FW file: 0/%d (0%%)", (int)sz);
-	crc32_checksum = crc32(0, (unsigned char *)buff, sz);
-	bytes_wr = eeprom_rd_wr(fd, ctl, 0, (uint8_t *)buff, sz, EEPROM_WR_FLG);
-	if (bytes_wr == -1) {
-		printf("FAILED\n");
-		return -EIO;
-	}
-	printf("\rPrograming FW file: %d/%d (100%%)\n", (int)sz, (int)sz);
+	flash_progress("Programing FW file", sz, sz);
+	printf("\n");
 	printf("===== Pgming FW file completed =====\n");
 
-	buf_tmp = malloc(sz);
-	if (!buf_tmp) {
-		printf("Not enough memory\n");
-		return -ENOMEM;
-	}
-	printf("Reading from EEPROM: 0/%d (0%%)", (int)sz);
-	bytes_rd =
-		eeprom_rd_wr(fd, ctl, 0, (uint8_t *)buf_tmp, sz, EEPROM_RD_FLG);
-	if (bytes_rd == -1) {
-		printf("FAILED\n");
-		ret = -EIO;
-		goto err;
+	/* read back a chunk at a time, stop at the first mismatch */
+	for (off = 0; off < sz; off += chunk) {
+		chunk = (sz - off < EEPROM_CHUNK_SIZE) ? sz - off :
+							  EEPROM_CHUNK_SIZE;
+		flash_progress("Reading from EEPROM", off, sz);
+		if (flash_dev_read(dev, off, buf_tmp, chunk) < 0) {
+			printf("FAILED\n");
+			return -EIO;
+		}
+		if (memcmp(buf_tmp, &img[off], chunk)) {
+			printf("\nMismatch in 0x%x..0x%x. Try to program again!\n",
+			       (int)off, (int)(off + chunk - 1));
+			return -EAGAIN;
+		}
+		crc_img = flash_crc32(crc_img, &img[off], chunk);
+		crc_rd = flash_crc32(crc_rd, buf_tmp, chunk);
 	}
-	printf("\rReading from EEPROM: %d/%d (100%%)\n", (int)sz, (int)sz);
+	flash_progress("Reading from EEPROM", sz, sz);
+	printf("\n");
 	printf("===== Reading from EEPROM completed =====\n");
 
 	printf("CRC32 checksum calculation ... ");
-	if (crc32_checksum != crc32(0, (unsigned char *)buf_tmp, sz)) {
+	if (crc_img != crc_rd) {
 		printf("FAILED. Try to program again!\n");
-		ret = -EAGAIN;
-		goto err;
+		return -EAGAIN;
 	}
 	printf("PASSED\n");
 
-err:
-	free(buf_tmp);
-	return ret;
+	return 0;
+}
+
+static int read_eeprom(struct flash_dev *dev, uint32_t count)
+{
+	char buf[EEPROM_CHUNK_SIZE];
+	ssize_t off, chunk;
+
+	printf("Reading %d bytes from EEPROM: ... ", count);
+	for (off = 0; off < count; off += chunk) {
+		chunk = (count - off < EEPROM_CHUNK_SIZE) ? count - off :
+							     EEPROM_CHUNK_SIZE;
+		if (flash_dev_read(dev, off, buf, chunk) < 0) {
+			printf("FAILED\n");
+			return -EIO;
+		}
+		if (off == 0)
+			printf("\n");
+		hexdump(off, buf, chunk);
+	}
+	printf("\n");
+
+	return 0;
 }
 
 int main(int argc, char **argv)
 {
-	FILE *fp;
-	int fd;
-	char i2cdev[16];
+	struct stat st;
+	int ffd;
 	int ret;
 	ssize_t sz;
-	char *buf;
+	uint8_t *img;
 
 	memset(&ctl, 0, sizeof(struct smpmpro_ctl));
 	/* Parsing the arguments */
@@ -434,76 +406,76 @@ int main(int argc, char **argv)
 		ctl.eeprom_addr = DEFAULT_I2C_EEPROM_ADDR;
 	if (!ctl.eeprom_type)
 		ctl.eeprom_type = DEFAULT_I2C_EEPROM_TYPE;
-
-	/* Create the device file string */
-	ret = snprintf(i2cdev, sizeof(i2cdev), "/dev/i2c-%d", ctl.i2c_bus);
-	if (ret >= (signed int)sizeof(i2cdev))
-		return -EINVAL;
+	if (!ctl.twr_max_ms)
+		ctl.twr_max_ms = EEPROM_TWR_MAX_MS;
 
 	/* Open I2C bus device */
-	fd = open_i2c_dev(i2cdev);
-	if (fd < 0) {
-		printf("Can not open I2C Device %s\n", i2cdev);
+	ret = flash_dev_open_i2c_eeprom(&eeprom, ctl.i2c_bus, ctl.eeprom_addr,
+					eeprom_get_pagesize(ctl.eeprom_type),
+					ctl.twr_max_ms);
+	if (ret < 0) {
+		printf("Can not open I2C Device %s\n", eeprom.path);
 		return -ENODEV;
 	}
 
 	/* Try to probe the EEPROM */
-	printf("Probing %s for the EEPROM 0x%x ... ", i2cdev, ctl.eeprom_addr);
-	if (detect_eeprom(fd, &ctl)) {
+	printf("Probing %s for the EEPROM 0x%x ... ", eeprom.path,
+	       ctl.eeprom_addr);
+	if (flash_dev_probe(&eeprom)) {
 		printf("NOT FOUND!\n");
+		flash_dev_close(&eeprom);
 		return -ENODEV;
 	}
 	printf("FOUND\n");
-	if (ctl.detect_mode)
+	if (ctl.detect_mode) {
+		flash_dev_close(&eeprom);
 		return 0;
+	}
 
 	/* Attemp to read from EEPROM */
 	if (ctl.read_mode) {
-		printf("Reading %d bytes from EEPROM: ... ", ctl.rc);
-		sz = 0;
-		buf = malloc(ctl.rc);
-		if (!buf) {
-			printf("Not enough memory\n");
-			return -ENOMEM;
-		}
-		sz = eeprom_rd_wr(fd, &ctl, 0, (uint8_t *)buf, ctl.rc,
-				  EEPROM_RD_FLG);
-		if (sz == -1) {
-			printf("FAILED\n");
-			ret = -EIO;
-		}
-		ret = 0;
-		hexdump((void *)buf, ctl.rc);
-		free(buf);
+		ret = read_eeprom(&eeprom, ctl.rc);
+		flash_dev_close(&eeprom);
 		return ret;
 	}
 
-	/* Read FW file to buffer */
-	fp = fopen(ctl.filename, "rb");
-	if (!fp) {
+	/* Map the FW file, it is read straight from the page cache */
+	ffd = open(ctl.filename, O_RDONLY);
+	if (ffd < 0) {
 		printf("Can't open file for reading\n");
+		flash_dev_close(&eeprom);
+		return -EINVAL;
+	}
+	if (fstat(ffd, &st) < 0 || st.st_size == 0) {
+		printf("Can't read the file size\n");
+		close(ffd);
+		flash_dev_close(&eeprom);
 		return -EINVAL;
 	}
-	fseek(fp, 0, SEEK_END);
-	sz = ftell(fp);
-	buf = malloc(sz);
-	if (!buf) {
-		printf("Not enough memory\n");
+	sz = st.st_size;
+	img = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, ffd, 0);
+	if (img == MAP_FAILED) {
+		printf("Can't map the file\n");
+		close(ffd);
+		flash_dev_close(&eeprom);
 		return -ENOMEM;
 	}
-	fseek(fp, 0, SEEK_SET);
-	fread(buf, sz, 1, fp);
+	madvise(img, sz, MADV_SEQUENTIAL);
+	ret = 0;
 
 	if (ctl.prog_mode) {
-		ret = program_fw(fd, &ctl, buf, sz);
-		if (ret) {
-			free(buf);
-			return -EIO;
-		}
+		if (ctl.diff_mode)
+			ret = program_fw_diff(&eeprom, img, sz);
+		else
+			ret = program_fw(&eeprom, img, sz);
+		flash_dev_print_stats(&eeprom);
+		if (ret)
+			ret = -EIO;
 	}
 
-	free(buf);
-	fclose(fp);
+	munmap(img, sz);
+	close(ffd);
+	flash_dev_close(&eeprom);
 
-	return 0;
+	return ret;
 }
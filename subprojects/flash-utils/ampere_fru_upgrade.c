@@ -18,21 +18,30 @@
 
 #include <fcntl.h>
 #include <linux/errno.h>
-#include <linux/i2c-dev.h>
-#include <linux/i2c.h>
-#include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
-#include <zlib.h>
+#include "flash-io.h"
 
 #pragma pack(1)
 
+/*
+ * The image is written one EEPROM page per write() at page aligned offsets,
+ * so the at24 driver never has to split a write. Verify reads the device
+ * back a chunk at a time through a fresh descriptor (FLASH_DEV_FRESH_READ)
+ * and stops at the first mismatch.
+ */
+#define FRU_PAGE_SIZE	  32
+#define FRU_MAX_PAGE_SIZE 4096
+#define FRU_CHUNK_SIZE	  4096
+
 static char fru_device[128] = "";
 static char fru_image[128] = "";
+static unsigned int fru_page_size = FRU_PAGE_SIZE;
+static struct flash_dev fru;
 
 static void display_usage(void)
 {
@@ -40,6 +49,24 @@ static void display_usage(void)
 	printf("Arguments:\n");
 	printf("\t-d <dev> \t: FRU sysfs device\n");
 	printf("\t-f <file>\t: The FRU file\n");
+	printf("\t-s <size>\t: EEPROM page size (default %d)\n",
+	       FRU_PAGE_SIZE);
+}
+
+static int page_arg_handler(int argc, char **argv, int index)
+{
+	unsigned long size;
+
+	if (index + 1 >= argc)
+		return -EINVAL;
+	size = strtoul(argv[index + 1], NULL, 0);
+	/* a power of two, up to FRU_MAX_PAGE_SIZE */
+	if (size == 0 || size > FRU_MAX_PAGE_SIZE || (size & (size - 1))) {
+		printf("Invalid page size %s\n", argv[index + 1]);
+		return -EINVAL;
+	}
+	fru_page_size = size;
+	return 1;
 }
 
 static int image_arg_handler(int argc, char **argv, int index)
@@ -56,10 +83,11 @@ static int device_arg_handler(int argc, char **argv, int index)
 	return 0;
 }
 
-static char *arglist[] = { "-d", "-f", NULL };
+static char *arglist[] = { "-d", "-f", "-s", NULL };
 
 static int (*handlerlist[])(int, char **, int) = { device_arg_handler,
-						   image_arg_handler, NULL };
+						   image_arg_handler,
+						   page_arg_handler, NULL };
 
 static int parse_arguments(int argc, char **argv)
 {
@@ -88,49 +116,83 @@ static int parse_arguments(int argc, char **argv)
 	return 0;
 }
 
-static int verify_valid_image(uint32_t crc32_checksum, ssize_t sz)
+static void show_throughput(const char *what, ssize_t sz, uint64_t us)
 {
-	FILE *fru_device_file;
-	char *buf;
-	uint32_t checksum;
-	int ret = 0;
-
-	/* Read FW file to buffer */
-	fru_device_file = fopen(fru_device, "rb");
-	if (!fru_device_file) {
-		printf("Can't open file for reading\n");
-		return -EINVAL;
+	if (!us)
+		us = 1;
+	printf("%s: %d bytes in %llu ms (%llu bytes/s)\n", what, (int)sz,
+	       (unsigned long long)(us / 1000),
+	       (unsigned long long)sz * 1000000 / us);
+}
+
+static int write_image(const unsigned char *buf, ssize_t sz)
+{
+	ssize_t off, chunk;
+	uint64_t start;
+
+	start = flash_now_us();
+	for (off = 0; off < sz; off += chunk) {
+		flash_progress("Writing FRU", off, sz);
+		chunk = (sz - off < FRU_CHUNK_SIZE) ? sz - off : FRU_CHUNK_SIZE;
+		if (flash_dev_write(&fru, off, &buf[off], chunk) < 0) {
+			printf("\nWrite FAILED at 0x%lx\n", (unsigned long)off);
+			return -EIO;
+		}
 	}
-	fseek(fru_device_file, 0, SEEK_END);
-	buf = malloc(sz);
-	if (!buf) {
-		printf("Not enough memory\n");
-		fclose(fru_device_file);
-		return -ENOMEM;
+	if (flash_dev_sync(&fru) < 0) {
+		printf("\nFlush FAILED\n");
+		return -EIO;
 	}
-	fseek(fru_device_file, 0, SEEK_SET);
-	fread(buf, sz, 1, fru_device_file);
+	flash_progress("Writing FRU", sz, sz);
+	printf("\n");
+	show_throughput("Write", sz, flash_now_us() - start);
 
-	/* Get checksum of input data */
-	checksum = crc32(0, (unsigned char *)buf, sz);
+	return 0;
+}
+
+static int verify_valid_image(const unsigned char *img,
+			      uint32_t crc32_checksum, ssize_t sz)
+{
+	unsigned char verify_buf[FRU_CHUNK_SIZE];
+	uint32_t checksum = 0;
+	ssize_t off, chunk;
+	uint64_t start;
+
+	start = flash_now_us();
+	for (off = 0; off < sz; off += chunk) {
+		flash_progress("Verifying FRU", off, sz);
+		chunk = (sz - off < FRU_CHUNK_SIZE) ? sz - off : FRU_CHUNK_SIZE;
+		if (flash_dev_read(&fru, off, verify_buf, chunk) < 0) {
+			printf("\nCan't read back the device at 0x%lx\n",
+			       (unsigned long)off);
+			return -EIO;
+		}
+		if (memcmp(verify_buf, &img[off], chunk)) {
+			printf("\nMismatch data in 0x%lx..0x%lx!\n",
+			       (unsigned long)off,
+			       (unsigned long)(off + chunk - 1));
+			return -EIO;
+		}
+		checksum = flash_crc32(checksum, verify_buf, chunk);
+	}
+	flash_progress("Verifying FRU", sz, sz);
+	printf("\n");
 
 	if (checksum != crc32_checksum) {
 		printf("Mismatch data!");
-		ret = -EIO;
+		return -EIO;
 	}
+	show_throughput("Verify", sz, flash_now_us() - start);
 
-	fclose(fru_device_file);
-
-	return ret;
+	return 0;
 }
 
 int main(int argc, char **argv)
 {
-	FILE *fru_image_file;
-	FILE *fru_device_file;
-	int ret;
+	struct stat st;
+	int fd, ret;
 	ssize_t sz;
-	char *buf;
+	unsigned char *buf;
 	uint32_t crc32_checksum;
 
 	/* Parsing the arguments */
@@ -141,61 +203,43 @@ int main(int argc, char **argv)
 		return -EOPNOTSUPP;
 	}
 
-	/* Read FW file to buffer */
-	fru_image_file = fopen(fru_image, "rb");
-	if (!fru_image_file) {
+	/* Map the FRU file, it is read straight from the page cache */
+	fd = open(fru_image, O_RDONLY);
+	if (fd < 0) {
 		printf("Can't open file for reading\n");
 		return -EINVAL;
 	}
-	fseek(fru_image_file, 0, SEEK_END);
-	sz = ftell(fru_image_file);
-	buf = malloc(sz);
-	if (!buf) {
-		printf("Not enough memory\n");
-		fclose(fru_image_file);
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		printf("Can't read the file size\n");
+		close(fd);
+		return -EINVAL;
+	}
+	sz = st.st_size;
+	buf = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		printf("Can't map the file\n");
+		close(fd);
 		return -ENOMEM;
 	}
-	fseek(fru_image_file, 0, SEEK_SET);
-	fread(buf, sz, 1, fru_image_file);
 
 	/* Get checksum of input data */
-	crc32_checksum = crc32(0, (unsigned char *)buf, sz);
+	crc32_checksum = flash_crc32(0, buf, sz);
 
-	/* Write into FRU device */
-	fru_device_file = fopen(fru_device, "rb+");
-	if (!fru_device_file) {
-		printf("Can't open device for upgrading\n");
-		fclose(fru_image_file);
+	if (flash_dev_open_sysfs(&fru, fru_device, fru_page_size,
+				 FLASH_DEV_FRESH_READ) < 0) {
+		munmap(buf, sz);
+		close(fd);
 		return -EINVAL;
 	}
-	if (fseek(fru_device_file, 0, SEEK_END)) {
-		/* Error when accessing file */
-		/* Close files and skip checksum */
-		crc32_checksum = 0;
-		ret = -EIO;
-		goto closefiles;
-	}
-	rewind(fru_device_file);
-	if (fwrite(buf, sz, 1, fru_device_file) != 1) {
-		/* Error when accessing file */
-		/* Close files and skip checksum */
-		crc32_checksum = 0;
-		ret = -EIO;
-		goto closefiles;
-	}
 
-	fflush(fru_device_file);
-	fsync(fileno(fru_device_file));
+	/* Write into FRU device, then verify it against the image */
+	ret = write_image(buf, sz);
+	if (!ret)
+		ret = verify_valid_image(buf, crc32_checksum, sz);
 
-closefiles:
-	free(buf);
-	fclose(fru_image_file);
-	fclose(fru_device_file);
-
-	/* Verify the image by checking the checksum */
-	if (crc32_checksum != 0) {
-		ret = verify_valid_image(crc32_checksum, sz);
-	}
+	flash_dev_close(&fru);
+	munmap(buf, sz);
+	close(fd);
 
 	return ret;
 }
@@ -3,14 +3,20 @@
 #include <phosphor-logging/elog-errors.hpp>
 #include <phosphor-logging/elog.hpp>
 #include <sdbusplus/bus.hpp>
+#include <sdbusplus/server/interface.hpp>
 #include <sdbusplus/server/object.hpp>
+#include <sdbusplus/vtable.hpp>
 #include <sdeventplus/clock.hpp>
 #include <sdeventplus/event.hpp>
 #include <sdeventplus/utility/timer.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 #include <xyz/openbmc_project/Control/Power/Cap/server.hpp>
 
+#include <bit>
 #include <chrono>
+#include <deque>
+#include <optional>
+#include <string>
 
 using CapClass = sdbusplus::xyz::openbmc_project::Control::Power::server::Cap;
 using CapItf = sdbusplus::server::object_t<CapClass>;
@@ -23,6 +29,37 @@ namespace Control
 	{
 		namespace Cap
 		{
+			/** @brief Filtering applied to the total power readings before
+			 *         the exceed/drop-below transitions are taken.
+			 *         The defaults keep the raw ">= powerCap" behaviour.
+			 */
+			struct HysteresisCfg {
+				/** @brief watts above the cap to count as exceeded */
+				uint32_t exceedBand = 0;
+				/** @brief watts below the cap to count as dropped */
+				uint32_t dropBand = 0;
+				/** @brief minimum time spent in a state before leaving it */
+				std::chrono::milliseconds minDwell{ 0 };
+				/** @brief N of the last M samples must agree (M <= 32) */
+				uint8_t filterN = 1;
+				uint8_t filterM = 1;
+				/** @brief window used to compute the transition rate */
+				std::chrono::seconds rateWindow{ 60 };
+				/** @brief transitions per window reported as flapping,
+				 *         0 disables the warning */
+				uint32_t flapThreshold = 0;
+			};
+
+			/** @brief Read-only transition counters, published next to the
+			 *         Cap interface on the same path:
+			 *         ExceedTransitions, DropTransitions and
+			 *         SuppressedTransitions (t) count since startup,
+			 *         RecentTransitions (t) is the number of transitions
+			 *         inside the last rate window.
+			 */
+			constexpr auto transitionsInterface =
+				"com.ampere.PowerCap.Transitions";
+
 			class PowerCap : public CapItf {
 			    public:
 				PowerCap() = delete;
@@ -30,18 +67,22 @@ namespace Control
 				PowerCap &operator=(const PowerCap &) = delete;
 				PowerCap(PowerCap &&) = delete;
 				PowerCap &operator=(PowerCap &&) = delete;
-				virtual ~PowerCap() = default;
+				virtual ~PowerCap();
 
 				/*  @brief Constructor to put object onto bus at a dbus path.
      *  @param[in] bus - sdbusplus D-Bus to attach to.
      *  @param[in] path - Path to attach to.
+     *  @param[in] cfgFile - File storing the power cap configuration.
      */
 				PowerCap(sdbusplus::bus_t &bus,
 					 const char *path,
 					 const sdeventplus::Event &event,
 					 std::string totalPwrSrv,
 					 std::string totalPwrObjectPath,
-					 std::string totalPwrItf);
+					 std::string totalPwrItf,
+					 const HysteresisCfg &hystCfg = {},
+					 std::string cfgFile =
+						 "/usr/share/power-manager/powerCap.cfg");
 
 				/*  @brief Request to set the Enable property of the interface.
      *  @param[in] value - the value of Enable property.
@@ -89,6 +130,40 @@ namespace Control
 				std::string totalPwrObjectPath;
 				std::string totalPwrItf;
 
+				/** @brief hysteresis and sample filter settings */
+				HysteresisCfg hystCfg;
+
+				/** @brief filtered state, true while the limit is exceeded */
+				bool overLimit = false;
+
+				/** @brief history of the last M samples, bit 0 is newest */
+				uint32_t aboveHistory = 0;
+				uint32_t belowHistory = 0;
+
+				/** @brief first reading at or above the cap of the current
+     *         exceed episode, used to report enforcement latency */
+				std::optional<std::chrono::steady_clock::time_point>
+					capCrossedAt;
+
+				/** @brief time of the last filtered transition */
+				std::chrono::steady_clock::time_point lastTransition{};
+
+				/** @brief transition counters, published on
+				 *         transitionsInterface and logged with every
+				 *         transition */
+				uint64_t exceedTransitions = 0;
+				uint64_t dropTransitions = 0;
+				uint64_t suppressedTransitions = 0;
+
+				/** @brief true once the pending edge was counted as
+				 *         suppressed, so an edge held back by the dwell
+				 *         is counted once and not once per sample */
+				bool edgeSuppressed = false;
+
+				/** @brief transitions inside the current rate window */
+				std::deque<std::chrono::steady_clock::time_point>
+					recentTransitions;
+
 				/** @brief minimun sampling periodic in microseconds */
 				const uint64_t minSamplPeriod = 1000000;
 
@@ -111,9 +186,34 @@ namespace Control
 				/** @brief the current configuration */
 				paramsCfg currentCfg;
 
+				/** @brief on-disk configuration record, fixed width fields
+     *         so the layout does not depend on the compiler
+     */
+				static constexpr uint32_t cfgRecordMagic =
+					0x50434647; // "PCFG"
+				static constexpr uint16_t cfgRecordVersion = 1;
+
+				struct __attribute__((packed)) cfgRecord {
+					uint32_t magic;
+					uint16_t version;
+					uint16_t length;
+					uint32_t crc;
+					uint8_t enableFlag;
+					uint8_t exceptAct;
+					uint16_t reserved;
+					uint32_t powerCap;
+					uint64_t correctTime;
+					uint64_t samplePeriod;
+				};
+
 				/** @brief the file to store old configuration */
-				std::string oldParametersCfgFile =
-					"/usr/share/power-manager/powerCap.cfg";
+				std::string oldParametersCfgFile;
+
+				/** @brief delay used to coalesce configuration writes */
+				const std::chrono::milliseconds cfgFlushDelay{ 500 };
+
+				/** @brief true while the stored configuration is applied */
+				bool restoringCfg = false;
 
 				/** @brief the correction timer */
 				sdeventplus::utility::Timer<
@@ -123,6 +223,34 @@ namespace Control
 				sdeventplus::utility::Timer<
 					sdeventplus::ClockId::Monotonic>
 					samplingTimer;
+				/** @brief the configuration flush timer */
+				sdeventplus::utility::Timer<
+					sdeventplus::ClockId::Monotonic>
+					flushTimer;
+
+				/** @brief transitionsInterface on objectPath */
+				sdbusplus::server::interface_t transitionsItf;
+
+				/** @brief the vtable of transitionsInterface */
+				static const sdbusplus::vtable_t transitionsVtable[];
+
+				/** @brief the D-Bus getter of the transition counters */
+				static int getTransitionCounter(
+					sd_bus *bus, const char *path,
+					const char *interface,
+					const char *property,
+					sd_bus_message *reply, void *userdata,
+					sd_bus_error *error);
+
+				/** @brief the function to count an edge held back by the
+     *         minimum dwell, once per edge
+     */
+				void suppressTransition();
+
+				/** @brief the function to drop the transitions older
+     *         than the rate window
+     */
+				void pruneRecentTransitions();
 
 				/** @brief the call-back function when correction timer is expried */
 				void callBackCorrectTimer();
@@ -130,9 +258,38 @@ namespace Control
 				/** @brief the call-back function when sampling timer is expried */
 				void callBackSamplingTimer();
 
-				/** @brief the function to store current configuration */
+				/** @brief the call-back function when flush timer is expried */
+				void callBackFlushTimer();
+
+				/** @brief the function to run one power sample through the
+     *         hysteresis band and N-of-M filter
+     *  @param[in] power - the total power consumption in watts
+     *  @param[in] cap - the power cap in watts
+     */
+				void filterPowerSample(uint32_t power, uint32_t cap);
+
+				/** @brief the function to account a filtered transition and
+     *         warn when the transition rate looks like flapping
+     *  @param[in] exceed - true for exceed, false for drop below
+     */
+				void recordTransition(bool exceed);
+
+				/** @brief the function to schedule storing the current
+     *         configuration, setters arriving within cfgFlushDelay
+     *         are coalesced into one write */
 				void writeCurrentCfg();
 
+				/** @brief the function to store current configuration through
+     *         a temporary file and rename
+     *  @return - true on success
+     */
+				bool flushCurrentCfg();
+
+				/** @brief the function to load the stored configuration
+     *  @return - true if a valid configuration was loaded
+     */
+				bool readCurrentCfg();
+
 				/** @brief the function to log power limit event
      *  @param[in] assertFlg - Direction of event
      *                         true: Total power exceed the limit
@@ -37,7 +37,7 @@ namespace Control
 								.c_str(),
 							event, totalPwrSrv,
 							totalPwrObjectPath,
-							totalPwrItf);
+							totalPwrItf, hystCfg);
 				}
 
 			    private:
@@ -60,6 +60,9 @@ namespace Control
 				std::string totalPwrItf =
 					"xyz.openbmc_project.Sensor.Value";
 
+				phosphor::Control::Power::Cap::HysteresisCfg
+					hystCfg;
+
 				void parsePowerManagerCfg();
 			};
 		} // namespace Manager
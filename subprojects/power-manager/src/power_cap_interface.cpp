@@ -22,9 +22,18 @@
 #include <sdbusplus/server.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
+#include <fcntl.h>
+#include <systemd/sd-bus.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
+#include <vector>
 
 namespace phosphor
 {
@@ -47,16 +56,43 @@ namespace Control
 			constexpr auto SYSTEMD_INTERFACE =
 				"org.freedesktop.systemd1.Manager";
 
+			const sdbusplus::vtable_t PowerCap::transitionsVtable[] = {
+				sdbusplus::vtable::start(),
+				sdbusplus::vtable::property(
+					"ExceedTransitions", "t",
+					getTransitionCounter,
+					sdbusplus::vtable::property_::emits_change),
+				sdbusplus::vtable::property(
+					"DropTransitions", "t",
+					getTransitionCounter,
+					sdbusplus::vtable::property_::emits_change),
+				sdbusplus::vtable::property(
+					"SuppressedTransitions", "t",
+					getTransitionCounter,
+					sdbusplus::vtable::property_::emits_change),
+				/*
+     * Ages out without a signal, computed on every read
+     */
+				sdbusplus::vtable::property(
+					"RecentTransitions", "t",
+					getTransitionCounter,
+					sdbusplus::vtable::property_::none),
+				sdbusplus::vtable::end()
+			};
+
 			PowerCap::PowerCap(sdbusplus::bus_t &bus,
 					   const char *path,
 					   const sdeventplus::Event &event,
 					   std::string totalPwrSrv,
 					   std::string totalPwrObjectPath,
-					   std::string totalPwrItf)
+					   std::string totalPwrItf,
+					   const HysteresisCfg &hystCfg,
+					   std::string cfgFile)
 				: CapItf(bus, path), bus(bus), objectPath(path),
 				  event(event), totalPwrSrv(totalPwrSrv),
 				  totalPwrObjectPath(totalPwrObjectPath),
-				  totalPwrItf(totalPwrItf),
+				  totalPwrItf(totalPwrItf), hystCfg(hystCfg),
+				  oldParametersCfgFile(cfgFile),
 				  correctTimer(
 					  event,
 					  std::bind(
@@ -66,23 +102,34 @@ namespace Control
 					  event,
 					  std::bind(
 						  &PowerCap::callBackSamplingTimer,
-						  this))
+						  this)),
+				  flushTimer(event,
+					     std::bind(
+						     &PowerCap::callBackFlushTimer,
+						     this)),
+				  transitionsItf(bus, path, transitionsInterface,
+						 transitionsVtable, this)
 			{
-				std::ifstream oldCfgFile(
-					oldParametersCfgFile.c_str(),
-					std::ios::in | std::ios::binary);
+				/*
+     * The sample history is a 32 bits shift register, N must fit in M
+     */
+				this->hystCfg.filterM = std::clamp<uint8_t>(
+					this->hystCfg.filterM, 1, 32);
+				this->hystCfg.filterN = std::clamp<uint8_t>(
+					this->hystCfg.filterN, 1,
+					this->hystCfg.filterM);
 
 				/*
      * Read the old configuration
      */
-				if (oldCfgFile.is_open()) {
-					oldCfgFile.read((char *)(&currentCfg),
-							sizeof(paramsCfg));
+				if (readCurrentCfg()) {
+					restoringCfg = true;
 					powerCapEnable(currentCfg.enableFlag);
 					exceptionAction(currentCfg.exceptAct);
 					powerCap(currentCfg.powerCap);
 					correctionTime(currentCfg.correctTime);
 					samplingPeriod(currentCfg.samplePeriod);
+					restoringCfg = false;
 				} else {
 					currentCfg.enableFlag =
 						CapItf::powerCapEnable();
@@ -95,7 +142,16 @@ namespace Control
 					currentCfg.samplePeriod =
 						CapItf::samplingPeriod();
 				}
-				oldCfgFile.close();
+			}
+
+			PowerCap::~PowerCap()
+			{
+				/*
+     * Do not lose a configuration change which is still coalescing
+     */
+				if (flushTimer.isEnabled()) {
+					flushCurrentCfg();
+				}
 			}
 
 			bool PowerCap::powerCapEnable(bool value)
@@ -127,6 +183,10 @@ namespace Control
          */
 					samplingTimer.restart(std::nullopt);
 					correctTimer.restart(std::nullopt);
+					overLimit = false;
+					aboveHistory = 0;
+					belowHistory = 0;
+					capCrossedAt.reset();
 				}
 
 				currentCfg.enableFlag = value;
@@ -200,6 +260,19 @@ namespace Control
 				}
 				}
 
+				/*
+     * Report how long it took from the first reading at or above the cap
+     * until the exception action was issued
+     */
+				if (capCrossedAt) {
+					auto latency = std::chrono::duration_cast<
+						std::chrono::milliseconds>(
+						std::chrono::steady_clock::now() -
+						*capCrossedAt);
+					info("Power cap enforced {LATENCY_MS} ms after the cap was crossed",
+					     "LATENCY_MS", latency.count());
+				}
+
 				notifyTotalPowerExceedPowerCap();
 			}
 
@@ -238,69 +311,345 @@ namespace Control
 								   double>(
 								totalPowerVal));
 
+						filterPowerSample(currentPower,
+								  powerCap);
+					} catch (const sdbusplus::exception_t
+							 &e) {
+						error("Error when tries to get the total power");
+					}
+				}
+			}
+
+			void PowerCap::filterPowerSample(uint32_t power,
+							 uint32_t cap)
+			{
+				uint32_t mask = (hystCfg.filterM >= 32) ?
+							0xffffffff :
+							((1u << hystCfg.filterM) - 1);
+				bool above = (uint64_t)power >=
+					     (uint64_t)cap + hystCfg.exceedBand;
+				bool below = (uint64_t)power +
+						     hystCfg.dropBand <
+					     (uint64_t)cap;
+				auto now = std::chrono::steady_clock::now();
+				bool dwellDone = (now - lastTransition) >=
+						 hystCfg.minDwell;
+
+				if (power >= cap && !capCrossedAt) {
+					capCrossedAt = now;
+				}
+
+				aboveHistory =
+					((aboveHistory << 1) | above) & mask;
+				belowHistory =
+					((belowHistory << 1) | below) & mask;
+
+				if (std::popcount(aboveHistory) >=
+				    hystCfg.filterN) {
+					if (!overLimit) {
+						if (!dwellDone) {
+							suppressTransition();
+							return;
+						}
+						overLimit = true;
+						lastTransition = now;
+						recordTransition(true);
+					}
+					edgeSuppressed = false;
+
+					/*
+         * If the total power consumption is greater than power cap then
+         * trigger one shot correction timer.
+         */
+					if (!correctTimer.isEnabled() &&
+					    !correctTimer.hasExpired()) {
 						/*
-             * If the total power consumption is greater than power cap then
-             * trigger one shot correction timer.
+             * Enable correction timer
              */
-						if (((uint32_t)(std::get<double>(
-							    totalPowerVal))) >=
-						    powerCap) {
-							if (!correctTimer
-								     .isEnabled() &&
-							    !correctTimer
-								     .hasExpired()) {
-								/*
-                     * Enable correction timer
-                     */
-								uint64_t correctTime =
-									CapItf::correctionTime();
-								correctTimer.restartOnce(
-									std::chrono::microseconds(
-										correctTime));
-							}
-						} else {
-							if (correctTimer
-								    .hasExpired()) {
-								auto currentExcepAct =
-									CapItf::exceptionAction();
-
-								if ((currentExcepAct ==
-								     CapClass::ExceptionActions::
-									     HardPowerOff) ||
-								    (currentExcepAct ==
-								     CapClass::ExceptionActions::
-									     LogEventOnly)) {
-									logPowerLimitEvent(
-										false);
-								}
-
-								notifyTotalPowerDropBelowPowerCap();
-							}
-
+						uint64_t correctTime =
+							CapItf::correctionTime();
+						correctTimer.restartOnce(
+							std::chrono::microseconds(
+								correctTime));
+					}
+				} else if (std::popcount(belowHistory) >=
+					   hystCfg.filterN) {
+					if (overLimit) {
+						if (!dwellDone) {
+							suppressTransition();
 							/*
-                 * Disable correction timer when total power is lower than power
-                 * cap
-                 */
-							correctTimer.restart(
-								std::nullopt);
+             * The state is held by the dwell, but the power is
+             * below the cap: the exception action must not fire.
+             * An expired timer is kept for the drop below
+             * notification once the dwell is over.
+             */
+							if (correctTimer.isEnabled()) {
+								correctTimer.restart(
+									std::nullopt);
+							}
+							return;
 						}
-					} catch (const sdbusplus::exception_t
-							 &e) {
-						error("Error when tries to get the total power");
+						overLimit = false;
+						lastTransition = now;
+						recordTransition(false);
+					}
+					edgeSuppressed = false;
+
+					if (correctTimer.hasExpired()) {
+						auto currentExcepAct =
+							CapItf::exceptionAction();
+
+						if ((currentExcepAct ==
+						     CapClass::ExceptionActions::
+							     HardPowerOff) ||
+						    (currentExcepAct ==
+						     CapClass::ExceptionActions::
+							     LogEventOnly)) {
+							logPowerLimitEvent(false);
+						}
+
+						notifyTotalPowerDropBelowPowerCap();
 					}
+
+					/*
+         * Disable correction timer when total power is lower than power
+         * cap
+         */
+					correctTimer.restart(std::nullopt);
+					capCrossedAt.reset();
+				} else {
+					/*
+         * Readings inside the hysteresis band keep the current state
+         */
+					edgeSuppressed = false;
 				}
 			}
 
-			void PowerCap::writeCurrentCfg()
+			void PowerCap::suppressTransition()
+			{
+				if (edgeSuppressed) {
+					return;
+				}
+
+				edgeSuppressed = true;
+				suppressedTransitions++;
+				transitionsItf.property_changed(
+					"SuppressedTransitions");
+			}
+
+			void PowerCap::pruneRecentTransitions()
 			{
-				std::ofstream oldCfgFile(
+				auto now = std::chrono::steady_clock::now();
+
+				while (!recentTransitions.empty() &&
+				       (now - recentTransitions.front()) >
+					       hystCfg.rateWindow) {
+					recentTransitions.pop_front();
+				}
+			}
+
+			int PowerCap::getTransitionCounter(
+				sd_bus *, const char *, const char *,
+				const char *property, sd_bus_message *reply,
+				void *userdata, sd_bus_error *)
+			{
+				auto cap = static_cast<PowerCap *>(userdata);
+				uint64_t value = 0;
+
+				if (!strcmp(property, "ExceedTransitions")) {
+					value = cap->exceedTransitions;
+				} else if (!strcmp(property, "DropTransitions")) {
+					value = cap->dropTransitions;
+				} else if (!strcmp(property,
+						   "SuppressedTransitions")) {
+					value = cap->suppressedTransitions;
+				} else {
+					cap->pruneRecentTransitions();
+					value = cap->recentTransitions.size();
+				}
+
+				return sd_bus_message_append(reply, "t", value);
+			}
+
+			void PowerCap::recordTransition(bool exceed)
+			{
+				auto now = std::chrono::steady_clock::now();
+
+				if (exceed) {
+					exceedTransitions++;
+					transitionsItf.property_changed(
+						"ExceedTransitions");
+				} else {
+					dropTransitions++;
+					transitionsItf.property_changed(
+						"DropTransitions");
+				}
+
+				recentTransitions.push_back(now);
+				pruneRecentTransitions();
+
+				info("Power cap transition: {DIRECTION}, exceeds {EXCEEDS}, drops {DROPS}, suppressed {SUPPRESSED}, recent {RECENT}",
+				     "DIRECTION", exceed ? "exceed" : "drop below",
+				     "EXCEEDS", exceedTransitions, "DROPS",
+				     dropTransitions, "SUPPRESSED",
+				     suppressedTransitions, "RECENT",
+				     recentTransitions.size());
+
+				if (hystCfg.flapThreshold != 0 &&
+				    recentTransitions.size() >=
+					    hystCfg.flapThreshold) {
+					warning("Power cap transitions are flapping: {RECENT} in {WINDOW}s, consider widening the hysteresis band",
+						"RECENT",
+						recentTransitions.size(),
+						"WINDOW",
+						hystCfg.rateWindow.count());
+				}
+			}
+
+			bool PowerCap::readCurrentCfg()
+			{
+				std::ifstream oldCfgFile(
 					oldParametersCfgFile.c_str(),
-					std::ios::out | std::ios::binary);
-				if (oldCfgFile.is_open()) {
-					oldCfgFile.write((char *)(&currentCfg),
-							 sizeof(paramsCfg));
+					std::ios::in | std::ios::binary);
+
+				if (!oldCfgFile.is_open()) {
+					return false;
 				}
+
+				std::vector<char> data(
+					(std::istreambuf_iterator<char>(
+						oldCfgFile)),
+					std::istreambuf_iterator<char>());
 				oldCfgFile.close();
+
+				/*
+     * Files written before the record was versioned are the raw paramsCfg
+     * struct. Accept them once and rewrite them in the new format.
+     */
+				if (data.size() == sizeof(paramsCfg)) {
+					std::memcpy(&currentCfg, data.data(),
+						    sizeof(paramsCfg));
+					info("Migrating unversioned power cap configuration");
+					writeCurrentCfg();
+					return true;
+				}
+
+				cfgRecord record;
+				if (data.size() != sizeof(cfgRecord)) {
+					error("Invalid power cap configuration size {SIZE}",
+					      "SIZE", data.size());
+					return false;
+				}
+				std::memcpy(&record, data.data(), sizeof(record));
+
+				uint32_t crc = record.crc;
+				record.crc = 0;
+				if (record.magic != cfgRecordMagic ||
+				    record.version != cfgRecordVersion ||
+				    record.length != sizeof(cfgRecord) ||
+				    crc != crc32(0,
+						 reinterpret_cast<const Bytef *>(
+							 &record),
+						 sizeof(record))) {
+					error("Corrupted power cap configuration, using defaults");
+					return false;
+				}
+
+				currentCfg.enableFlag = record.enableFlag;
+				currentCfg.exceptAct =
+					static_cast<CapClass::ExceptionActions>(
+						record.exceptAct);
+				currentCfg.powerCap = record.powerCap;
+				currentCfg.correctTime = record.correctTime;
+				currentCfg.samplePeriod = record.samplePeriod;
+
+				return true;
+			}
+
+			void PowerCap::writeCurrentCfg()
+			{
+				if (restoringCfg || flushTimer.isEnabled()) {
+					return;
+				}
+
+				flushTimer.restartOnce(cfgFlushDelay);
+			}
+
+			void PowerCap::callBackFlushTimer()
+			{
+				flushCurrentCfg();
+			}
+
+			bool PowerCap::flushCurrentCfg()
+			{
+				cfgRecord record{};
+				std::string tmpFile =
+					oldParametersCfgFile + ".tmp";
+
+				/*
+     * Cancel a pending flush when called outside of the timer
+     */
+				if (flushTimer.isEnabled()) {
+					flushTimer.restart(std::nullopt);
+				}
+
+				record.magic = cfgRecordMagic;
+				record.version = cfgRecordVersion;
+				record.length = sizeof(cfgRecord);
+				record.enableFlag = currentCfg.enableFlag;
+				record.exceptAct =
+					static_cast<uint8_t>(currentCfg.exceptAct);
+				record.powerCap = currentCfg.powerCap;
+				record.correctTime = currentCfg.correctTime;
+				record.samplePeriod = currentCfg.samplePeriod;
+				record.crc = crc32(
+					0, reinterpret_cast<const Bytef *>(&record),
+					sizeof(record));
+
+				int fd = open(tmpFile.c_str(),
+					      O_WRONLY | O_CREAT | O_TRUNC |
+						      O_CLOEXEC,
+					      0644);
+				if (fd < 0) {
+					error("Can not open {FILE} to store power cap configuration",
+					      "FILE", tmpFile);
+					return false;
+				}
+
+				ssize_t ret = write(fd, &record, sizeof(record));
+				if (ret != (ssize_t)sizeof(record) || fsync(fd) != 0) {
+					error("Can not write power cap configuration");
+					close(fd);
+					unlink(tmpFile.c_str());
+					return false;
+				}
+				close(fd);
+
+				if (rename(tmpFile.c_str(),
+					   oldParametersCfgFile.c_str()) != 0) {
+					error("Can not replace power cap configuration");
+					unlink(tmpFile.c_str());
+					return false;
+				}
+
+				/*
+     * The rename is only durable once the directory entry is on flash
+     */
+				std::string cfgDir = oldParametersCfgFile.substr(
+					0, oldParametersCfgFile.rfind('/'));
+				int dirFd = open(cfgDir.c_str(),
+						 O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				if (dirFd < 0 || fsync(dirFd) != 0) {
+					error("Can not sync {DIR} after storing power cap configuration",
+					      "DIR", cfgDir);
+					if (dirFd >= 0) {
+						close(dirFd);
+					}
+					return false;
+				}
+				close(dirFd);
+
+				return true;
 			}
 
 			void PowerCap::logPowerLimitEvent(bool assertFlg)
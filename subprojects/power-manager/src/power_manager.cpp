@@ -67,6 +67,37 @@ namespace Control
 					totalPwrItf = totalPwr.value(
 						"interface", totalPwrItf);
 				}
+
+				/*
+     * Get the hysteresis and sample filter of the limit notifications
+     */
+				if (data.contains("hysteresis")) {
+					const auto &hyst =
+						data.at("hysteresis");
+					hystCfg.exceedBand = hyst.value(
+						"exceed_band_watts",
+						hystCfg.exceedBand);
+					hystCfg.dropBand = hyst.value(
+						"drop_band_watts",
+						hystCfg.dropBand);
+					hystCfg.minDwell =
+						std::chrono::milliseconds(hyst.value(
+							"min_dwell_ms",
+							hystCfg.minDwell
+								.count()));
+					hystCfg.filterN = hyst.value(
+						"filter_n", hystCfg.filterN);
+					hystCfg.filterM = hyst.value(
+						"filter_m", hystCfg.filterM);
+					hystCfg.rateWindow =
+						std::chrono::seconds(hyst.value(
+							"rate_window_s",
+							hystCfg.rateWindow
+								.count()));
+					hystCfg.flapThreshold = hyst.value(
+						"flap_threshold",
+						hystCfg.flapThreshold);
+				}
 			}
 
 		} // namespace Manager
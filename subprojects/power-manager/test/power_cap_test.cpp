@@ -0,0 +1,414 @@
+/**
+ * Copyright (C) 2022 Ampere Computing LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Power cap test, run on a private session bus (dbus-run-session).
+ *
+ * A stub thread owns the total power sensor, systemd and chassis state
+ * services. The sensor replays a power trace, one sample per Get, and
+ * every StartUnit or chassis transition is recorded with its time. Each
+ * scenario runs a PowerCap object on its own event loop, then checks the
+ * exception action, the order of the notifications and the time from the
+ * first sample over the cap to the exception action.
+ */
+
+#include "power_cap_interface.hpp"
+#include "power_trace.hpp"
+
+#include <systemd/sd-bus.h>
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/server/interface.hpp>
+#include <sdbusplus/vtable.hpp>
+#include <sdeventplus/event.hpp>
+#include <sdeventplus/utility/timer.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace phosphor::Control::Power::Cap;
+using Clock = std::chrono::steady_clock;
+
+constexpr auto capPath = "/xyz/openbmc_project/control/host0/power_cap";
+constexpr auto sensorService = "xyz.openbmc_project.VirtualSensor";
+constexpr auto sensorPath = "/xyz/openbmc_project/sensors/power/total_power";
+constexpr auto sensorItf = "xyz.openbmc_project.Sensor.Value";
+constexpr auto systemdService = "org.freedesktop.systemd1";
+constexpr auto systemdPath = "/org/freedesktop/systemd1";
+constexpr auto systemdItf = "org.freedesktop.systemd1.Manager";
+constexpr auto chassisService = "xyz.openbmc_project.State.Chassis";
+constexpr auto chassisPath = "/xyz/openbmc_project/state/chassis0";
+constexpr auto chassisItf = "xyz.openbmc_project.State.Chassis";
+
+constexpr auto exceedUnit = "power-cap-exceeds-limit.service";
+constexpr auto dropUnit = "power-cap-drops-below-limit.service";
+constexpr auto oemUnit = "power-cap-action-oem.service";
+constexpr auto powerOff = "xyz.openbmc_project.State.Chassis.Transition.Off";
+
+constexpr uint32_t testPowerCap = 500;
+constexpr auto testSamplePeriod = std::chrono::seconds(1);
+/*
+ * Slack around the correction time, wide enough for a loaded build host:
+ * the action may come a sample period late, never much early.
+ */
+constexpr auto latencyEarly = std::chrono::milliseconds(100);
+constexpr auto latencyLate = testSamplePeriod + std::chrono::seconds(1);
+
+/** @brief one recorded sensor read or action */
+struct Record {
+	std::string what;
+	uint32_t watts;
+	Clock::time_point at;
+};
+
+/** @brief services the PowerCap object talks to */
+struct Stub {
+	std::mutex lock;
+	std::unique_ptr<PowerTrace> trace;
+	uint32_t lastWatts = 0;
+	std::vector<Record> samples;
+	std::vector<Record> actions;
+	std::string transition =
+		"xyz.openbmc_project.State.Chassis.Transition.On";
+	std::atomic<bool> stop = false;
+
+	void reset(const std::string &traceFile)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		trace = std::make_unique<PowerTrace>(traceFile, false);
+		lastWatts = 0;
+		samples.clear();
+		actions.clear();
+	}
+};
+
+static int getValue(sd_bus *, const char *, const char *, const char *,
+		    sd_bus_message *reply, void *userdata, sd_bus_error *)
+{
+	auto stub = static_cast<Stub *>(userdata);
+	std::lock_guard<std::mutex> guard(stub->lock);
+
+	/*
+     * Hold the last sample once the trace is finished
+     */
+	if (stub->trace) {
+		stub->trace->next(stub->lastWatts);
+	}
+	stub->samples.push_back({ "sample", stub->lastWatts, Clock::now() });
+
+	return sd_bus_message_append(reply, "d", (double)stub->lastWatts);
+}
+
+static int startUnit(sd_bus_message *msg, void *userdata, sd_bus_error *)
+{
+	auto stub = static_cast<Stub *>(userdata);
+	const char *unit;
+	const char *mode;
+	int ret;
+
+	ret = sd_bus_message_read(msg, "ss", &unit, &mode);
+	if (ret < 0) {
+		return ret;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(stub->lock);
+		stub->actions.push_back({ unit, 0, Clock::now() });
+	}
+
+	return sd_bus_reply_method_return(msg, "o",
+					  "/org/freedesktop/systemd1/job/1");
+}
+
+static int getTransition(sd_bus *, const char *, const char *, const char *,
+			 sd_bus_message *reply, void *userdata, sd_bus_error *)
+{
+	auto stub = static_cast<Stub *>(userdata);
+	std::lock_guard<std::mutex> guard(stub->lock);
+
+	return sd_bus_message_append(reply, "s", stub->transition.c_str());
+}
+
+static int setTransition(sd_bus *, const char *, const char *, const char *,
+			 sd_bus_message *value, void *userdata, sd_bus_error *)
+{
+	auto stub = static_cast<Stub *>(userdata);
+	const char *transition;
+	int ret;
+
+	ret = sd_bus_message_read(value, "s", &transition);
+	if (ret < 0) {
+		return ret;
+	}
+
+	std::lock_guard<std::mutex> guard(stub->lock);
+	stub->transition = transition;
+	stub->actions.push_back({ transition, 0, Clock::now() });
+
+	return 0;
+}
+
+static const sdbusplus::vtable_t sensorVtable[] = {
+	sdbusplus::vtable::start(),
+	sdbusplus::vtable::property("Value", "d", getValue),
+	sdbusplus::vtable::end()
+};
+
+static const sdbusplus::vtable_t systemdVtable[] = {
+	sdbusplus::vtable::start(),
+	sdbusplus::vtable::method("StartUnit", "ss", "o", startUnit),
+	sdbusplus::vtable::end()
+};
+
+static const sdbusplus::vtable_t chassisVtable[] = {
+	sdbusplus::vtable::start(),
+	sdbusplus::vtable::property("RequestedPowerTransition", "s",
+				    getTransition, setTransition),
+	sdbusplus::vtable::end()
+};
+
+/** @brief Serve the stub services on a connection of their own until
+ *         the test is finished.
+ */
+static void runStub(Stub *stub, std::promise<bool> ready)
+{
+	bool served = false;
+
+	try {
+		auto bus = sdbusplus::bus::new_user();
+		sdbusplus::server::interface_t sensor(bus, sensorPath, sensorItf,
+						      sensorVtable, stub);
+		sdbusplus::server::interface_t systemd(
+			bus, systemdPath, systemdItf, systemdVtable, stub);
+		sdbusplus::server::interface_t chassis(
+			bus, chassisPath, chassisItf, chassisVtable, stub);
+
+		bus.request_name(sensorService);
+		bus.request_name(systemdService);
+		bus.request_name(chassisService);
+		ready.set_value(true);
+		served = true;
+
+		while (!stub->stop) {
+			while (bus.process_discard()) {
+			}
+			bus.wait(std::chrono::milliseconds(100));
+		}
+	} catch (const std::exception &e) {
+		fprintf(stderr, "Stub services failed: %s\n", e.what());
+		if (!served) {
+			ready.set_value(false);
+		}
+	}
+}
+
+/** @brief one power cap scenario */
+struct Scenario {
+	const char *name;
+	const char *trace;
+	CapClass::ExceptionActions action;
+	std::chrono::milliseconds correctionTime;
+	HysteresisCfg hystCfg;
+	/** @brief actions expected in order */
+	std::vector<std::string> expected;
+};
+
+static bool runScenario(Stub &stub, const std::string &traceDir,
+			const std::filesystem::path &cfgFile,
+			const Scenario &scenario)
+{
+	std::string traceFile = traceDir + "/" + scenario.trace;
+	bool pass = true;
+
+	stub.reset(traceFile);
+	std::filesystem::remove(cfgFile);
+
+	{
+		auto bus = sdbusplus::bus::new_user();
+		auto event = sdeventplus::Event::get_new();
+		bus.attach_event(event.get(), SD_EVENT_PRIORITY_NORMAL);
+
+		PowerCap cap(bus, capPath, event, sensorService, sensorPath,
+			     sensorItf, scenario.hystCfg, cfgFile.string());
+		cap.exceptionAction(scenario.action);
+		cap.powerCap(testPowerCap);
+		cap.correctionTime(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+				scenario.correctionTime)
+				.count());
+		cap.samplingPeriod(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+				testSamplePeriod)
+				.count());
+		cap.powerCapEnable(true);
+
+		/*
+         * Run until the whole trace was sampled, plus the drop below
+         */
+		size_t samples = PowerTrace(traceFile, false).size();
+		sdeventplus::utility::Timer<sdeventplus::ClockId::Monotonic>
+			stopTimer(event,
+				  [&event](auto &) { event.exit(0); });
+		stopTimer.restartOnce(testSamplePeriod * (samples + 1) +
+				      latencyLate);
+		event.loop();
+	}
+
+	std::lock_guard<std::mutex> guard(stub.lock);
+
+	std::vector<std::string> actual;
+	for (const auto &action : stub.actions) {
+		actual.push_back(action.what);
+	}
+	if (actual != scenario.expected) {
+		fprintf(stderr, "%s: unexpected actions:", scenario.name);
+		for (const auto &what : actual) {
+			fprintf(stderr, " %s", what.c_str());
+		}
+		fprintf(stderr, "\n");
+		pass = false;
+	}
+
+	/*
+     * The exception action is taken the correction time after the first
+     * sample over the cap and its hysteresis band
+     */
+	if (pass && !scenario.expected.empty()) {
+		auto crossed = std::find_if(
+			stub.samples.begin(), stub.samples.end(),
+			[&](const Record &sample) {
+				return sample.watts >=
+				       testPowerCap + scenario.hystCfg.exceedBand;
+			});
+		if (crossed == stub.samples.end()) {
+			fprintf(stderr, "%s: the trace never crossed the cap\n",
+				scenario.name);
+			return false;
+		}
+
+		auto latency =
+			std::chrono::duration_cast<std::chrono::milliseconds>(
+				stub.actions.front().at - crossed->at);
+		printf("%s: enforcement latency %lld ms, correction time %lld ms\n",
+		       scenario.name, (long long)latency.count(),
+		       (long long)scenario.correctionTime.count());
+		if (latency < scenario.correctionTime - latencyEarly ||
+		    latency > scenario.correctionTime + latencyLate) {
+			fprintf(stderr, "%s: enforcement latency out of range\n",
+				scenario.name);
+			pass = false;
+		}
+	}
+
+	printf("%s: %s\n", scenario.name, pass ? "PASS" : "FAIL");
+	return pass;
+}
+
+int main(int argc, char **argv)
+{
+	using namespace std::chrono_literals;
+	using Action = CapClass::ExceptionActions;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <trace directory>\n", argv[0]);
+		return 1;
+	}
+
+	HysteresisCfg band;
+	band.exceedBand = 20;
+	band.dropBand = 20;
+
+	HysteresisCfg dwell;
+	dwell.minDwell = 5000ms;
+
+	const std::vector<Scenario> scenarios = {
+		{ "log-event-only",
+		  "step.trace",
+		  Action::LogEventOnly,
+		  2000ms,
+		  {},
+		  { exceedUnit, dropUnit } },
+		{ "hard-power-off",
+		  "step.trace",
+		  Action::HardPowerOff,
+		  1500ms,
+		  {},
+		  { powerOff, exceedUnit, dropUnit } },
+		{ "oem",
+		  "step.trace",
+		  Action::Oem,
+		  1500ms,
+		  {},
+		  { oemUnit, exceedUnit, dropUnit } },
+		{ "spike-shorter-than-correction",
+		  "spike.trace",
+		  Action::LogEventOnly,
+		  2000ms,
+		  {},
+		  {} },
+		/*
+         * The drop below is held back by the dwell, the correction
+         * timer must still be cancelled
+         */
+		{ "drop-during-dwell",
+		  "spike.trace",
+		  Action::HardPowerOff,
+		  2000ms,
+		  dwell,
+		  {} },
+		{ "noise-inside-hysteresis",
+		  "noise.trace",
+		  Action::LogEventOnly,
+		  1000ms,
+		  band,
+		  {} },
+	};
+
+	Stub stub;
+	std::promise<bool> ready;
+	auto stubReady = ready.get_future();
+	std::thread stubThread(runStub, &stub, std::move(ready));
+	if (!stubReady.get()) {
+		stubThread.join();
+		return 1;
+	}
+
+	auto cfgFile = std::filesystem::temp_directory_path() /
+		       ("power-cap-test-" + std::to_string(getpid()) + ".cfg");
+	int failed = 0;
+	for (const auto &scenario : scenarios) {
+		if (!runScenario(stub, argv[1], cfgFile, scenario)) {
+			failed++;
+		}
+	}
+	std::filesystem::remove(cfgFile);
+
+	stub.stop = true;
+	stubThread.join();
+
+	return failed ? 1 : 0;
+}
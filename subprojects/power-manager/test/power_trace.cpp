@@ -0,0 +1,182 @@
+/**
+ * Copyright (C) 2022 Ampere Computing LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "power_trace.hpp"
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace phosphor
+{
+namespace Control
+{
+	namespace Power
+	{
+		namespace Cap
+		{
+
+			PHOSPHOR_LOG2_USING;
+
+			/** @brief upper bound of the samples a trace expands to */
+			constexpr long long maxTraceSamples = 100000;
+
+			/** @brief Read a sample count of a directive. The count is
+			 *         parsed signed so "-1" is rejected instead of
+			 *         wrapping to a huge unsigned value.
+			 *  @param[in] iss - the directive arguments.
+			 *  @param[in] total - samples already loaded.
+			 *  @param[out] count - the sample count.
+			 *  @return - false when missing, not positive or too large.
+			 */
+			static bool readCount(std::istringstream &iss,
+					      size_t total, size_t &count)
+			{
+				long long value;
+
+				if (!(iss >> value) || value <= 0 ||
+				    value > maxTraceSamples - (long long)total) {
+					return false;
+				}
+
+				count = (size_t)value;
+				return true;
+			}
+
+			PowerTrace::PowerTrace(const std::string &path, bool loop)
+				: loop(loop)
+			{
+				std::ifstream traceFile(path);
+				std::string line;
+				size_t lineNum = 0;
+				/*
+     * Fixed seed so the same trace always replays the same samples
+     */
+				std::minstd_rand gen(1);
+
+				if (!traceFile.is_open()) {
+					error("Can not open power trace {FILE}",
+					      "FILE", path);
+					return;
+				}
+
+				while (std::getline(traceFile, line)) {
+					lineNum++;
+					line = line.substr(0, line.find('#'));
+
+					std::istringstream iss(line);
+					std::string directive;
+					if (!(iss >> directive)) {
+						continue;
+					}
+
+					if (directive == "ramp") {
+						double from, to;
+						size_t count;
+						if (!(iss >> from >> to) ||
+						    !readCount(iss, samples.size(),
+							       count)) {
+							error("Invalid ramp at {FILE}:{LINE}",
+							      "FILE", path,
+							      "LINE", lineNum);
+							continue;
+						}
+						for (size_t i = 0; i < count; i++) {
+							double step =
+								(count > 1) ?
+									(to - from) *
+										i /
+										(count -
+										 1) :
+									0;
+							samples.push_back(
+								(uint32_t)std::max(
+									0.0,
+									from + step));
+						}
+					} else if (directive == "noise") {
+						double watts, amplitude;
+						size_t count;
+						if (!(iss >> watts >> amplitude) ||
+						    amplitude < 0 ||
+						    !readCount(iss, samples.size(),
+							       count)) {
+							error("Invalid noise at {FILE}:{LINE}",
+							      "FILE", path,
+							      "LINE", lineNum);
+							continue;
+						}
+						std::uniform_real_distribution<double>
+							dist(-amplitude,
+							     amplitude);
+						for (size_t i = 0; i < count; i++) {
+							samples.push_back(
+								(uint32_t)std::max(
+									0.0,
+									watts + dist(gen)));
+						}
+					} else {
+						double watts;
+						size_t count = 1;
+						std::istringstream value(
+							directive);
+						/*
+     * The sample count of a step is optional and defaults to one
+     */
+						iss >> std::ws;
+						if (!(value >> watts) ||
+						    (iss.eof() ?
+							     samples.size() >=
+								     maxTraceSamples :
+							     !readCount(iss,
+									samples.size(),
+									count))) {
+							error("Invalid directive at {FILE}:{LINE}",
+							      "FILE", path,
+							      "LINE", lineNum);
+							continue;
+						}
+						samples.insert(
+							samples.end(), count,
+							(uint32_t)std::max(
+								0.0, watts));
+					}
+				}
+
+				info("Loaded {COUNT} power samples from {FILE}",
+				     "COUNT", samples.size(), "FILE", path);
+			}
+
+			bool PowerTrace::next(uint32_t &watts)
+			{
+				if (pos >= samples.size()) {
+					if (!loop || samples.empty()) {
+						return false;
+					}
+					pos = 0;
+				}
+
+				watts = samples[pos++];
+				return true;
+			}
+
+		} // namespace Cap
+	} // namespace Power
+} // namespace Control
+} // namespace phosphor
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace phosphor
+{
+namespace Control
+{
+	namespace Power
+	{
+		namespace Cap
+		{
+			/** @brief Scripted total power source, served by the stub
+			 *         power sensor of the power cap test.
+			 *
+			 *  One directive per line, '#' starts a comment, sample
+			 *  counts must be positive and a trace expands to at most
+			 *  100000 samples:
+			 *    <watts> [samples]                  - step, hold the value
+			 *    ramp <from> <to> <samples>         - linear ramp
+			 *    noise <watts> <amplitude> <samples> - uniform noise
+			 */
+			class PowerTrace {
+			    public:
+				PowerTrace() = delete;
+				PowerTrace(const PowerTrace &) = delete;
+				PowerTrace &operator=(const PowerTrace &) = delete;
+				PowerTrace(PowerTrace &&) = delete;
+				PowerTrace &operator=(PowerTrace &&) = delete;
+				virtual ~PowerTrace() = default;
+
+				/*  @brief Constructor to load a trace file.
+     *  @param[in] path - Path of the trace file.
+     *  @param[in] loop - Restart from the first sample at the end.
+     */
+				PowerTrace(const std::string &path, bool loop);
+
+				/*  @brief Get the next sample of the trace.
+     *  @param[out] watts - the total power consumption.
+     *  @return - false when the trace is empty or finished.
+     */
+				bool next(uint32_t &watts);
+
+				/*  @brief Get the number of samples of the trace. */
+				size_t size() const
+				{
+					return samples.size();
+				}
+
+			    private:
+				/** @brief expanded samples in watts */
+				std::vector<uint32_t> samples;
+
+				/** @brief index of the next sample */
+				size_t pos = 0;
+
+				/** @brief restart at the end of the trace */
+				bool loop;
+			};
+		} // namespace Cap
+	} // namespace Power
+} // namespace Control
+} // namespace phosphor